@@ -0,0 +1,353 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageAnnotationJournal.h"
+#include "vtkSlicerbreastImageAtomicFile.h"
+#include "vtkSlicerbreastImageBinaryReport.h"
+#include "vtkSlicerbreastImageContentHash.h"
+
+//QT includes
+#include <QByteArray>
+#include <QDir>
+#include <QFileInfo>
+
+// STD includes
+#include <cstddef>
+#include <cstring>
+
+namespace
+{
+const char journalMagic[4] = { 'B', 'I', 'A', 'J' };
+const quint16 journalVersion = 1;
+
+quint32 recordChecksum(const char* record, size_t size)
+{
+	// the checksum field is not part of the checksum
+	return static_cast<quint32>(vtkSlicerbreastImageContentHash::Hash(record + sizeof(quint32), size - sizeof(quint32)));
+}
+
+void appendRecord(QByteArray& records, int operation, int section, const QString& key, const QString& value)
+{
+	QByteArray keyUtf8 = key.toUtf8();
+	QByteArray valueUtf8 = value.toUtf8();
+	vtkSlicerbreastImageAnnotationJournal::Record record;
+	record.Checksum = 0;
+	record.Operation = operation;
+	record.Section = section;
+	record.KeySize = keyUtf8.size();
+	record.ValueSize = valueUtf8.size();
+	int start = records.size();
+	records.append(reinterpret_cast<const char*>(&record), sizeof(record));
+	records.append(keyUtf8);
+	records.append(valueUtf8);
+	quint32 checksum = recordChecksum(records.constData() + start, records.size() - start);
+	std::memcpy(records.data() + start, &checksum, sizeof(checksum));
+}
+
+int appendChanges(QByteArray& records, int section, const QMap<QString, QString>& journaled, const QMap<QString, QString>& current)
+{
+	int count = 0;
+	for (QMap<QString, QString>::const_iterator entry = current.constBegin(); entry != current.constEnd(); ++entry)
+	{
+		QMap<QString, QString>::const_iterator old = journaled.constFind(entry.key());
+		if (old == journaled.constEnd() || old.value() != entry.value())
+		{
+			appendRecord(records, vtkSlicerbreastImageAnnotationJournal::SetOperation, section, entry.key(), entry.value());
+			count++;
+		}
+	}
+	for (QMap<QString, QString>::const_iterator old = journaled.constBegin(); old != journaled.constEnd(); ++old)
+	{
+		if (!current.contains(old.key()))
+		{
+			appendRecord(records, vtkSlicerbreastImageAnnotationJournal::RemoveOperation, section, old.key(), QString());
+			count++;
+		}
+	}
+	return count;
+}
+
+// offset after count records of records, which were checked before
+int skipRecords(const QByteArray& records, int count)
+{
+	int offset = 0;
+	for (int i = 0; i < count && offset + static_cast<int>(sizeof(vtkSlicerbreastImageAnnotationJournal::Record)) <= records.size(); i++)
+	{
+		vtkSlicerbreastImageAnnotationJournal::Record record;
+		std::memcpy(&record, records.constData() + offset, sizeof(record));
+		offset += sizeof(record) + record.KeySize + record.ValueSize;
+	}
+	return offset;
+}
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageAnnotationJournal::vtkSlicerbreastImageAnnotationJournal()
+{
+	this->NumberOfRecords = 0;
+	this->FirstRecord = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageAnnotationJournal::~vtkSlicerbreastImageAnnotationJournal()
+{
+	this->Close();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageAnnotationJournal::Open(const QString& fileName, const QMap<QString, QString>& m_dicomInf,
+	const QMap<QString, QString>& m_pacasInf, const QMap<QString, QString>& m_annotationInf)
+{
+	this->Close();
+	this->Information[0] = m_dicomInf;
+	this->Information[1] = m_pacasInf;
+	this->Information[2] = m_annotationInf;
+	QDir().mkpath(QFileInfo(fileName).absolutePath());
+	this->File.setFileName(fileName);
+	if (!this->File.open(QFile::ReadWrite))
+	{
+		return false;
+	}
+
+	QByteArray content = this->File.readAll();
+	Header header;
+	if (content.size() < static_cast<int>(sizeof(Header)))
+	{
+		// new journal, or one torn before its header was written
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.Magic, journalMagic, sizeof(journalMagic));
+		header.Version = journalVersion;
+		header.HeaderSize = sizeof(Header);
+		this->File.resize(0);
+		this->File.seek(0);
+		if (this->File.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header) || !this->File.flush())
+		{
+			this->Close();
+			return false;
+		}
+		return true;
+	}
+	std::memcpy(&header, content.constData(), sizeof(header));
+	if (std::memcmp(header.Magic, journalMagic, sizeof(journalMagic)) != 0 || header.Version != journalVersion
+		|| header.HeaderSize < sizeof(Header) || header.HeaderSize > content.size())
+	{
+		this->Close();
+		return false;
+	}
+	this->FirstRecord = header.FirstRecord;
+
+	int offset = header.HeaderSize;
+	while (offset + static_cast<int>(sizeof(Record)) <= content.size())
+	{
+		Record record;
+		std::memcpy(&record, content.constData() + offset, sizeof(record));
+		int size = sizeof(Record) + record.KeySize + record.ValueSize;
+		QMap<QString, QString>* section = this->getSection(record.Section);
+		if (offset + size > content.size() || !section
+			|| recordChecksum(content.constData() + offset, size) != record.Checksum)
+		{
+			break;
+		}
+		const char* key = content.constData() + offset + sizeof(Record);
+		QString keyString = QString::fromUtf8(key, record.KeySize);
+		if (record.Operation == SetOperation)
+		{
+			section->insert(keyString, QString::fromUtf8(key + record.KeySize, record.ValueSize));
+		}
+		else if (record.Operation == RemoveOperation)
+		{
+			section->remove(keyString);
+		}
+		else
+		{
+			break;
+		}
+		offset += size;
+		this->NumberOfRecords++;
+	}
+	// cut a record torn by a crash, the next appends follow the valid ones
+	if (offset != content.size())
+	{
+		this->File.resize(offset);
+	}
+	this->File.seek(offset);
+	return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageAnnotationJournal::Close()
+{
+	this->File.close();
+	this->NumberOfRecords = 0;
+	this->FirstRecord = 0;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageAnnotationJournal::IsOpen() const
+{
+	return this->File.isOpen();
+}
+
+//----------------------------------------------------------------------------
+QString vtkSlicerbreastImageAnnotationJournal::GetFileName() const
+{
+	return this->File.fileName();
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerbreastImageAnnotationJournal::Append(const QMap<QString, QString>& m_dicomInf,
+	const QMap<QString, QString>& m_pacasInf, const QMap<QString, QString>& m_annotationInf)
+{
+	if (!this->IsOpen())
+	{
+		return -1;
+	}
+	QByteArray records;
+	int count = 0;
+	const QMap<QString, QString>* current[3] = { &m_dicomInf, &m_pacasInf, &m_annotationInf };
+	for (int i = 0; i < 3; i++)
+	{
+		count += appendChanges(records, vtkSlicerbreastImageBinaryReport::DicomSection + i, this->Information[i], *current[i]);
+	}
+	if (count == 0)
+	{
+		return 0;
+	}
+	// one write, a crash tears at most the last record
+	if (this->File.write(records) != records.size() || !this->File.flush())
+	{
+		return -1;
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		this->Information[i] = *current[i];
+	}
+	this->NumberOfRecords += count;
+	return count;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageAnnotationJournal::Truncate()
+{
+	if (!this->IsOpen())
+	{
+		return false;
+	}
+	// numbered before the records are dropped, a crash between both keeps
+	// the records and numbers them after the ones they follow, so the
+	// positions taken before stay before them
+	quint64 firstRecord = this->FirstRecord + this->NumberOfRecords;
+	if (!this->File.seek(offsetof(Header, FirstRecord))
+		|| this->File.write(reinterpret_cast<const char*>(&firstRecord), sizeof(firstRecord)) != sizeof(firstRecord)
+		|| !this->File.flush() || !this->File.resize(sizeof(Header)) || !this->File.seek(sizeof(Header)))
+	{
+		return false;
+	}
+	this->FirstRecord = firstRecord;
+	this->NumberOfRecords = 0;
+	return true;
+}
+
+//----------------------------------------------------------------------------
+qint64 vtkSlicerbreastImageAnnotationJournal::GetPosition() const
+{
+	return this->FirstRecord + this->NumberOfRecords;
+}
+
+//----------------------------------------------------------------------------
+qint64 vtkSlicerbreastImageAnnotationJournal::GetFirstRecord() const
+{
+	return this->FirstRecord;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageAnnotationJournal::Discard(qint64 position)
+{
+	if (!this->IsOpen())
+	{
+		return false;
+	}
+	qint64 discarded = qMin(position - this->FirstRecord, static_cast<qint64>(this->NumberOfRecords));
+	if (discarded <= 0)
+	{
+		return true;
+	}
+	Header header;
+	if (!this->File.seek(0) || this->File.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header)
+		|| !this->File.seek(header.HeaderSize))
+	{
+		return false;
+	}
+	QByteArray records = this->File.readAll();
+	QByteArray kept = records.mid(skipRecords(records, static_cast<int>(discarded)));
+	header.FirstRecord = this->FirstRecord + discarded;
+	header.HeaderSize = sizeof(Header);
+	QByteArray content(reinterpret_cast<const char*>(&header), sizeof(header));
+	content.append(kept);
+
+	// the file is closed while it is replaced, which Windows requires
+	QString fileName = this->File.fileName();
+	this->File.close();
+	bool replaced = vtkSlicerbreastImageAtomicFile::Write(fileName, content);
+	this->File.setFileName(fileName);
+	if (!this->File.open(QFile::ReadWrite) || !this->File.seek(this->File.size()))
+	{
+		this->Close();
+		return false;
+	}
+	if (replaced)
+	{
+		this->FirstRecord = header.FirstRecord;
+		this->NumberOfRecords -= static_cast<int>(discarded);
+	}
+	return replaced;
+}
+
+//----------------------------------------------------------------------------
+const QMap<QString, QString>& vtkSlicerbreastImageAnnotationJournal::GetDicomInformation() const
+{
+	return this->Information[0];
+}
+
+//----------------------------------------------------------------------------
+const QMap<QString, QString>& vtkSlicerbreastImageAnnotationJournal::GetPacasInformation() const
+{
+	return this->Information[1];
+}
+
+//----------------------------------------------------------------------------
+const QMap<QString, QString>& vtkSlicerbreastImageAnnotationJournal::GetAnnotationInformation() const
+{
+	return this->Information[2];
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerbreastImageAnnotationJournal::GetNumberOfRecords() const
+{
+	return this->NumberOfRecords;
+}
+
+//----------------------------------------------------------------------------
+QMap<QString, QString>* vtkSlicerbreastImageAnnotationJournal::getSection(int section)
+{
+	if (section < vtkSlicerbreastImageBinaryReport::DicomSection || section > vtkSlicerbreastImageBinaryReport::AnnotationSection)
+	{
+		return NULL;
+	}
+	return &this->Information[section - vtkSlicerbreastImageBinaryReport::DicomSection];
+}
@@ -0,0 +1,124 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkSlicerbreastImageAnnotationJournal - append-only log of report edits
+// .SECTION Description
+// Binary journal of the changes made to the information maps of an annotation
+// report (the keys of vtkSlicerbreastImageLogic::writeAnnotationXML). The
+// file is a small header followed by records that set or remove one key of
+// one section. Each record carries a checksum, so a record torn by a crash
+// ends the replay and is cut from the file.
+// Record appends the differences between the given maps and the replayed
+// report, so an autosave writes only what changed. Records are absolute
+// values: replaying them again over a report that already contains them
+// gives the same report, which makes compaction into a snapshot safe at
+// any point (see vtkSlicerbreastImageLogic::CompactAnnotationJournal).
+// Records are numbered from the creation of the journal, so a position
+// taken when a report is exported still names the same records after
+// later appends, truncations or a reopen.
+
+#ifndef __vtkSlicerbreastImageAnnotationJournal_h
+#define __vtkSlicerbreastImageAnnotationJournal_h
+
+// QT includes
+#include <QString>
+#include <QMap>
+#include <QFile>
+
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageAnnotationJournal
+{
+public:
+  enum Operation
+  {
+    SetOperation = 1,
+    RemoveOperation
+  };
+
+#pragma pack(push, 1)
+  struct Header
+  {
+    char Magic[4];
+    quint16 Version;
+    quint16 HeaderSize;
+    /// number of the first record of the file, the records dropped before
+    quint64 FirstRecord;
+  };
+
+  /// Followed by KeySize bytes of UTF-8 key and ValueSize bytes of UTF-8
+  /// value. Checksum is the low half of the XXH64 of the rest of the record.
+  struct Record
+  {
+    quint32 Checksum;
+    quint8 Operation;
+    /// vtkSlicerbreastImageBinaryReport::Section
+    quint8 Section;
+    quint16 KeySize;
+    quint32 ValueSize;
+  };
+#pragma pack(pop)
+
+  vtkSlicerbreastImageAnnotationJournal();
+  ~vtkSlicerbreastImageAnnotationJournal();
+
+  /// Open or create a journal and replay it over the given report. The
+  /// records after the first invalid one are discarded.
+  bool Open(const QString& fileName, const QMap<QString, QString>& m_dicomInf,
+    const QMap<QString, QString>& m_pacasInf, const QMap<QString, QString>& m_annotationInf);
+  void Close();
+  bool IsOpen() const;
+  QString GetFileName() const;
+
+  /// Append the changes from the replayed report to the given maps. Return
+  /// the number of records appended, -1 on error.
+  int Append(const QMap<QString, QString>& m_dicomInf,
+    const QMap<QString, QString>& m_pacasInf, const QMap<QString, QString>& m_annotationInf);
+  /// Drop all the records, once the report was saved elsewhere.
+  bool Truncate();
+  /// Number of the record the next Append writes.
+  qint64 GetPosition() const;
+  /// Drop the records before position, once the report they lead to was
+  /// saved elsewhere, and keep the later ones. The file is replaced
+  /// atomically.
+  bool Discard(qint64 position);
+  /// Number of the first record of the file.
+  qint64 GetFirstRecord() const;
+
+  /// Report replayed from the journal, the maps use the keys of
+  /// vtkSlicerbreastImageLogic::writeAnnotationXML.
+  const QMap<QString, QString>& GetDicomInformation() const;
+  const QMap<QString, QString>& GetPacasInformation() const;
+  const QMap<QString, QString>& GetAnnotationInformation() const;
+  /// Records in the file, the work done since the last truncation.
+  int GetNumberOfRecords() const;
+
+protected:
+  QMap<QString, QString>* getSection(int section);
+
+  QFile File;
+  QMap<QString, QString> Information[3];
+  int NumberOfRecords;
+  qint64 FirstRecord;
+
+private:
+  vtkSlicerbreastImageAnnotationJournal(const vtkSlicerbreastImageAnnotationJournal&); // Not implemented
+  void operator=(const vtkSlicerbreastImageAnnotationJournal&); // Not implemented
+};
+
+#endif
@@ -0,0 +1,89 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageAtomicFile.h"
+
+// QT includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+//----------------------------------------------------------------------------
+QString vtkSlicerbreastImageAtomicFile::TemporaryFileName(const QString& fileName)
+{
+	return fileName + QString(".%1.tmp").arg(QCoreApplication::applicationPid());
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageAtomicFile::Sync(QFile& file)
+{
+	if (!file.flush())
+	{
+		return false;
+	}
+#ifdef _WIN32
+	return _commit(file.handle()) == 0;
+#else
+	return fsync(file.handle()) == 0;
+#endif
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageAtomicFile::Replace(const QString& temporaryName, const QString& fileName)
+{
+#ifdef _WIN32
+	bool renamed = MoveFileExW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(temporaryName).utf16()),
+		reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(fileName).utf16()),
+		MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	bool renamed = ::rename(QFile::encodeName(temporaryName).constData(), QFile::encodeName(fileName).constData()) == 0;
+#endif
+	if (!renamed)
+	{
+		QFile::remove(temporaryName);
+	}
+	return renamed;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageAtomicFile::Write(const QString& fileName, const QByteArray& content)
+{
+	QString temporaryName = TemporaryFileName(fileName);
+	QFile file(temporaryName);
+	if (!file.open(QFile::WriteOnly | QFile::Truncate))
+	{
+		return false;
+	}
+	bool written = file.write(content) == content.size() && Sync(file);
+	file.close();
+	if (!written || file.error() != QFile::NoError)
+	{
+		QFile::remove(temporaryName);
+		return false;
+	}
+	return Replace(temporaryName, fileName);
+}
@@ -0,0 +1,55 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkSlicerbreastImageAtomicFile - crash safe replacement of files
+// .SECTION Description
+// Files of the module are written to a temporary file next to them and
+// renamed over the file. The rename replaces the file in one step (rename
+// on POSIX, MoveFileEx on Windows, where QFile::rename removes the file
+// first), so a crash or a concurrent reader finds either the previous or
+// the new file, and a mapping of the previous file stays valid.
+
+#ifndef __vtkSlicerbreastImageAtomicFile_h
+#define __vtkSlicerbreastImageAtomicFile_h
+
+// QT includes
+#include <QByteArray>
+#include <QString>
+
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+class QFile;
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageAtomicFile
+{
+public:
+  /// Temporary file next to fileName, unique to the process.
+  static QString TemporaryFileName(const QString& fileName);
+
+  /// Flush an open file and sync it to disk.
+  static bool Sync(QFile& file);
+
+  /// Rename temporaryName over fileName. temporaryName is removed when it
+  /// can not replace fileName, which is then left as it was.
+  static bool Replace(const QString& temporaryName, const QString& fileName);
+
+  /// Write content to fileName through a synced temporary file.
+  static bool Write(const QString& fileName, const QByteArray& content);
+};
+
+#endif
@@ -0,0 +1,400 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageBinaryReport.h"
+
+//QT includes
+#include <QByteArray>
+#include <QDebug>
+#include <QHash>
+#include <QRegExp>
+#include <QSysInfo>
+#include <QVector>
+
+// STD includes
+#include <cstring>
+
+namespace
+{
+const char reportMagic[4] = { 'B', 'I', 'A', 'R' };
+const quint16 reportVersion = 1;
+
+const char* clusterFieldNames[vtkSlicerbreastImageBinaryReport::NumberOfClusterFields] = {
+	"number", "size", "shape", "distribution",
+	"xCenterRas", "yCenterRas", "zCenterRas", "xRadiusRas", "yRadiusRas", "zRadiusRas",
+	"xCenterIjk", "yCenterIjk", "zCenterIjk", "xRadiusIjk", "yRadiusIjk", "zRadiusIjk" };
+
+// string table with deduplicated entries: quint32 length, UTF-8 bytes, '\0'
+class StringTable
+{
+public:
+	quint32 add(const QString& string)
+	{
+		QByteArray utf8 = string.toUtf8();
+		QHash<QByteArray, quint32>::const_iterator found = this->References.constFind(utf8);
+		if (found != this->References.constEnd())
+		{
+			return found.value();
+		}
+		quint32 reference = this->Data.size();
+		quint32 length = utf8.size();
+		this->Data.append(reinterpret_cast<const char*>(&length), sizeof(length));
+		this->Data.append(utf8);
+		this->Data.append('\0');
+		// keep the lengths aligned
+		while (this->Data.size() % 4)
+		{
+			this->Data.append('\0');
+		}
+		this->References.insert(utf8, reference);
+		return reference;
+	}
+	QByteArray Data;
+	QHash<QByteArray, quint32> References;
+};
+
+bool isCanonicalDouble(const QString& text, double& value)
+{
+	bool ok = false;
+	value = text.toDouble(&ok);
+	return ok && QString::number(value, 'f', 4) == text;
+}
+
+bool isCanonicalInt(const QString& text, qint32& value)
+{
+	bool ok = false;
+	value = text.toInt(&ok);
+	return ok && QString::number(value) == text;
+}
+}
+
+//----------------------------------------------------------------------------
+const quint32 vtkSlicerbreastImageBinaryReport::NoString;
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageBinaryReport::vtkSlicerbreastImageBinaryReport()
+{
+	this->Data = NULL;
+	this->FileHeader = NULL;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageBinaryReport::~vtkSlicerbreastImageBinaryReport()
+{
+	this->Close();
+}
+
+//----------------------------------------------------------------------------
+const char* vtkSlicerbreastImageBinaryReport::GetClusterFieldName(int field)
+{
+	if (field < 0 || field >= NumberOfClusterFields)
+	{
+		return NULL;
+	}
+	return clusterFieldNames[field];
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageBinaryReport::Write(const QString& fileName, const QMap<QString, QString>& reportAttributes,
+	const QMap<QString, QString>& m_dicomInf, const QMap<QString, QString>& m_pacasInf, const QMap<QString, QString>& m_annotationInf)
+{
+	if (QSysInfo::ByteOrder != QSysInfo::LittleEndian)
+	{
+		qWarning() << "vtkSlicerbreastImageBinaryReport::Write: only little-endian hosts are supported";
+		return false;
+	}
+	StringTable strings;
+	QVector<Entry> entries;
+	const QMap<QString, QString>* sections[] = { &reportAttributes, &m_dicomInf, &m_pacasInf, &m_annotationInf };
+	int number = m_annotationInf.value("clusterNumber").toInt();
+	QRegExp clusterKey("^(\\d+)-[A-Za-z]+$");
+	for (int section = ReportSection; section <= AnnotationSection; section++)
+	{
+		for (QMap<QString, QString>::const_iterator iter = sections[section]->constBegin(); iter != sections[section]->constEnd(); ++iter)
+		{
+			if (section == AnnotationSection && clusterKey.exactMatch(iter.key())
+				&& clusterKey.cap(1).toInt() >= 1 && clusterKey.cap(1).toInt() <= number)
+			{
+				// stored in the cluster records
+				continue;
+			}
+			Entry entry;
+			entry.Section = section;
+			entry.Key = strings.add(iter.key());
+			entry.Value = strings.add(iter.value());
+			entries.append(entry);
+		}
+	}
+
+	QVector<Cluster> clusters(qMax(number, 0));
+	for (int i = 1; i <= number; i++)
+	{
+		Cluster& cluster = clusters[i - 1];
+		std::memset(&cluster, 0, sizeof(cluster));
+		for (int field = 0; field < NumberOfClusterFields; field++)
+		{
+			QString key = QString("%1-%2").arg(i).arg(clusterFieldNames[field]);
+			bool numeric = false;
+			if (m_annotationInf.contains(key))
+			{
+				QString text = m_annotationInf.value(key);
+				if (field == NumberField)
+				{
+					numeric = isCanonicalInt(text, cluster.Number);
+				}
+				else if (field == SizeField)
+				{
+					numeric = isCanonicalDouble(text, cluster.Size);
+				}
+				else if (field >= RasField && field < IjkField)
+				{
+					numeric = isCanonicalDouble(text, cluster.Ras[field - RasField]);
+				}
+				else if (field >= IjkField)
+				{
+					numeric = isCanonicalInt(text, cluster.Ijk[field - IjkField]);
+				}
+				if (!numeric)
+				{
+					quint32 reference = strings.add(text);
+					if (field == NumberField) cluster.Number = reference;
+					else if (field == SizeField) cluster.Size = reference;
+					else if (field == ShapeField) cluster.Shape = reference;
+					else if (field == DistributionField) cluster.Distribution = reference;
+					else if (field < IjkField) cluster.Ras[field - RasField] = reference;
+					else cluster.Ijk[field - IjkField] = reference;
+				}
+			}
+			else
+			{
+				if (field == NumberField) cluster.Number = NoString;
+				else if (field == SizeField) cluster.Size = NoString;
+				else if (field == ShapeField) cluster.Shape = NoString;
+				else if (field == DistributionField) cluster.Distribution = NoString;
+				else if (field < IjkField) cluster.Ras[field - RasField] = NoString;
+				else cluster.Ijk[field - IjkField] = NoString;
+			}
+			if (!numeric)
+			{
+				cluster.TextMask |= (1u << field);
+			}
+		}
+	}
+
+	Header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.Magic, reportMagic, sizeof(reportMagic));
+	header.Version = reportVersion;
+	header.HeaderSize = sizeof(Header);
+	header.EntryTableOffset = sizeof(Header);
+	header.EntryCount = entries.size();
+	// 8 bytes alignment of the doubles of the cluster records
+	header.ClusterTableOffset = (header.EntryTableOffset + entries.size() * sizeof(Entry) + 7) & ~7u;
+	header.ClusterCount = clusters.size();
+	header.StringTableOffset = header.ClusterTableOffset + clusters.size() * sizeof(Cluster);
+	header.StringTableSize = strings.Data.size();
+	header.FileSize = header.StringTableOffset + header.StringTableSize;
+
+	QByteArray content(header.FileSize, '\0');
+	std::memcpy(content.data(), &header, sizeof(header));
+	if (!entries.isEmpty())
+	{
+		std::memcpy(content.data() + header.EntryTableOffset, entries.constData(), entries.size() * sizeof(Entry));
+	}
+	if (!clusters.isEmpty())
+	{
+		std::memcpy(content.data() + header.ClusterTableOffset, clusters.constData(), clusters.size() * sizeof(Cluster));
+	}
+	std::memcpy(content.data() + header.StringTableOffset, strings.Data.constData(), strings.Data.size());
+
+	QFile file(fileName);
+	if (!file.open(QFile::WriteOnly | QFile::Truncate))
+	{
+		return false;
+	}
+	bool written = (file.write(content) == content.size());
+	file.close();
+	return written;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageBinaryReport::Open(const QString& fileName)
+{
+	this->Close();
+	if (QSysInfo::ByteOrder != QSysInfo::LittleEndian)
+	{
+		qWarning() << "vtkSlicerbreastImageBinaryReport::Open: only little-endian hosts are supported";
+		return false;
+	}
+	this->File.setFileName(fileName);
+	if (!this->File.open(QFile::ReadOnly) || this->File.size() < static_cast<qint64>(sizeof(Header)))
+	{
+		this->Close();
+		return false;
+	}
+	this->Data = this->File.map(0, this->File.size());
+	const Header* header = reinterpret_cast<const Header*>(this->Data);
+	if (!this->Data
+		|| std::memcmp(header->Magic, reportMagic, sizeof(reportMagic)) != 0
+		|| header->Version != reportVersion
+		|| header->FileSize != this->File.size()
+		|| header->EntryTableOffset + static_cast<qint64>(header->EntryCount) * sizeof(Entry) > header->FileSize
+		|| header->ClusterTableOffset + static_cast<qint64>(header->ClusterCount) * sizeof(Cluster) > header->FileSize
+		|| header->StringTableOffset + static_cast<qint64>(header->StringTableSize) > header->FileSize)
+	{
+		qWarning() << "vtkSlicerbreastImageBinaryReport::Open: invalid report" << fileName;
+		this->Close();
+		return false;
+	}
+	this->FileHeader = header;
+	return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageBinaryReport::Close()
+{
+	if (this->Data)
+	{
+		this->File.unmap(const_cast<uchar*>(this->Data));
+	}
+	this->File.close();
+	this->Data = NULL;
+	this->FileHeader = NULL;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageBinaryReport::IsOpen() const
+{
+	return this->FileHeader != NULL;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerbreastImageBinaryReport::GetNumberOfEntries() const
+{
+	return this->FileHeader ? this->FileHeader->EntryCount : 0;
+}
+
+//----------------------------------------------------------------------------
+const vtkSlicerbreastImageBinaryReport::Entry* vtkSlicerbreastImageBinaryReport::GetEntry(int i) const
+{
+	return reinterpret_cast<const Entry*>(this->Data + this->FileHeader->EntryTableOffset) + i;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerbreastImageBinaryReport::GetNumberOfClusters() const
+{
+	return this->FileHeader ? this->FileHeader->ClusterCount : 0;
+}
+
+//----------------------------------------------------------------------------
+const vtkSlicerbreastImageBinaryReport::Cluster* vtkSlicerbreastImageBinaryReport::GetCluster(int i) const
+{
+	return reinterpret_cast<const Cluster*>(this->Data + this->FileHeader->ClusterTableOffset) + i;
+}
+
+//----------------------------------------------------------------------------
+const char* vtkSlicerbreastImageBinaryReport::GetString(quint32 reference, quint32* length) const
+{
+	if (!this->FileHeader || reference == NoString
+		|| static_cast<qint64>(reference) + sizeof(quint32) > this->FileHeader->StringTableSize)
+	{
+		return NULL;
+	}
+	const uchar* entry = this->Data + this->FileHeader->StringTableOffset + reference;
+	quint32 stringLength;
+	std::memcpy(&stringLength, entry, sizeof(stringLength));
+	if (static_cast<qint64>(reference) + sizeof(quint32) + stringLength >= this->FileHeader->StringTableSize)
+	{
+		return NULL;
+	}
+	if (length)
+	{
+		*length = stringLength;
+	}
+	return reinterpret_cast<const char*>(entry + sizeof(quint32));
+}
+
+//----------------------------------------------------------------------------
+QString vtkSlicerbreastImageBinaryReport::getQString(quint32 reference) const
+{
+	quint32 length = 0;
+	const char* string = this->GetString(reference, &length);
+	return string ? QString::fromUtf8(string, length) : QString();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageBinaryReport::ReadInformation(QMap<QString, QString>& reportAttributes,
+	QMap<QString, QString>& m_dicomInf, QMap<QString, QString>& m_pacasInf, QMap<QString, QString>& m_annotationInf) const
+{
+	QMap<QString, QString>* sections[] = { &reportAttributes, &m_dicomInf, &m_pacasInf, &m_annotationInf };
+	for (int i = 0; i < this->GetNumberOfEntries(); i++)
+	{
+		const Entry* entry = this->GetEntry(i);
+		if (entry->Section <= AnnotationSection)
+		{
+			sections[entry->Section]->insert(this->getQString(entry->Key), this->getQString(entry->Value));
+		}
+	}
+	for (int i = 0; i < this->GetNumberOfClusters(); i++)
+	{
+		const Cluster* cluster = this->GetCluster(i);
+		for (int field = 0; field < NumberOfClusterFields; field++)
+		{
+			bool text = (cluster->TextMask & (1u << field)) != 0;
+			quint32 reference = NoString;
+			QString value;
+			if (field == NumberField)
+			{
+				reference = cluster->Number;
+				value = QString::number(cluster->Number);
+			}
+			else if (field == SizeField)
+			{
+				reference = static_cast<quint32>(cluster->Size);
+				value = QString::number(cluster->Size, 'f', 4);
+			}
+			else if (field == ShapeField)
+			{
+				reference = cluster->Shape;
+			}
+			else if (field == DistributionField)
+			{
+				reference = cluster->Distribution;
+			}
+			else if (field < IjkField)
+			{
+				reference = static_cast<quint32>(cluster->Ras[field - RasField]);
+				value = QString::number(cluster->Ras[field - RasField], 'f', 4);
+			}
+			else
+			{
+				reference = cluster->Ijk[field - IjkField];
+				value = QString::number(cluster->Ijk[field - IjkField]);
+			}
+			if (text)
+			{
+				if (reference == NoString)
+				{
+					continue;
+				}
+				value = this->getQString(reference);
+			}
+			m_annotationInf.insert(QString("%1-%2").arg(i + 1).arg(clusterFieldNames[field]), value);
+		}
+	}
+}
@@ -0,0 +1,143 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkSlicerbreastImageBinaryReport - compact binary annotation report
+// .SECTION Description
+// Versioned little-endian equivalent of the XML annotation report. The file
+// is a fixed header followed by a table of (section, key, value) string
+// references for the report, DicomInformation and PacasInformation entries,
+// one fixed-width record per cluster (8 byte aligned), and the string table.
+// Numeric cluster fields are stored as numbers when their text is the
+// canonical formatting written by the module (4 decimals for RAS and size,
+// integers otherwise) and as string references otherwise, which keeps the
+// conversion from and to XML lossless.
+// Reading maps the file in memory: the accessors return pointers into the
+// mapping and do not allocate.
+
+#ifndef __vtkSlicerbreastImageBinaryReport_h
+#define __vtkSlicerbreastImageBinaryReport_h
+
+// QT includes
+#include <QString>
+#include <QMap>
+#include <QFile>
+
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageBinaryReport
+{
+public:
+  enum Section
+  {
+    ReportSection = 0,
+    DicomSection,
+    PacasSection,
+    AnnotationSection
+  };
+
+  /// Cluster fields in record order, a set bit of Cluster::TextMask means the
+  /// field is a string table reference.
+  enum ClusterField
+  {
+    NumberField = 0,
+    SizeField,
+    ShapeField,
+    DistributionField,
+    RasField,
+    IjkField = RasField + 6,
+    NumberOfClusterFields = IjkField + 6
+  };
+
+  static const quint32 NoString = 0xffffffff;
+
+#pragma pack(push, 1)
+  struct Header
+  {
+    char Magic[4];
+    quint16 Version;
+    quint16 HeaderSize;
+    quint32 FileSize;
+    quint32 StringTableOffset;
+    quint32 StringTableSize;
+    quint32 EntryTableOffset;
+    quint32 EntryCount;
+    quint32 ClusterTableOffset;
+    quint32 ClusterCount;
+    quint32 Reserved[7];
+  };
+
+  struct Entry
+  {
+    quint32 Section;
+    quint32 Key;
+    quint32 Value;
+  };
+
+  struct Cluster
+  {
+    quint32 TextMask;
+    qint32 Number;
+    quint32 Shape;
+    quint32 Distribution;
+    double Size;
+    /// x, y, z center then x, y, z radius
+    double Ras[6];
+    qint32 Ijk[6];
+  };
+#pragma pack(pop)
+
+  vtkSlicerbreastImageBinaryReport();
+  ~vtkSlicerbreastImageBinaryReport();
+
+  /// Write a report. The information maps use the keys of
+  /// vtkSlicerbreastImageLogic::writeAnnotationXML, reportAttributes holds
+  /// the attributes of the XML root node.
+  static bool Write(const QString& fileName, const QMap<QString, QString>& reportAttributes,
+    const QMap<QString, QString>& m_dicomInf, const QMap<QString, QString>& m_pacasInf, const QMap<QString, QString>& m_annotationInf);
+
+  /// Map a report file in memory and check its header.
+  bool Open(const QString& fileName);
+  void Close();
+  bool IsOpen() const;
+
+  int GetNumberOfEntries() const;
+  const Entry* GetEntry(int i) const;
+  int GetNumberOfClusters() const;
+  const Cluster* GetCluster(int i) const;
+  /// String of the table, NULL for NoString. length is set if not NULL.
+  const char* GetString(quint32 reference, quint32* length = 0) const;
+
+  /// Decode the whole report in the map layout of Write.
+  void ReadInformation(QMap<QString, QString>& reportAttributes,
+    QMap<QString, QString>& m_dicomInf, QMap<QString, QString>& m_pacasInf, QMap<QString, QString>& m_annotationInf) const;
+
+  static const char* GetClusterFieldName(int field);
+
+protected:
+  QString getQString(quint32 reference) const;
+
+  QFile File;
+  const uchar* Data;
+  const Header* FileHeader;
+
+private:
+  vtkSlicerbreastImageBinaryReport(const vtkSlicerbreastImageBinaryReport&); // Not implemented
+  void operator=(const vtkSlicerbreastImageBinaryReport&); // Not implemented
+};
+
+#endif
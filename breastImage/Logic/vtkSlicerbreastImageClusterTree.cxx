@@ -0,0 +1,407 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageClusterTree.h"
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <queue>
+
+namespace
+{
+const char treeMagic[4] = { 'B', 'I', 'C', 'T' };
+const int treeVersion = 1;
+
+// orders item indices by the center of their box along one axis
+struct CenterLess
+{
+	CenterLess(const std::vector<double>& bounds, int axis) : Bounds(bounds), Axis(axis) {}
+	bool operator()(int a, int b) const
+	{
+		return this->Bounds[6 * a + 2 * this->Axis] + this->Bounds[6 * a + 2 * this->Axis + 1]
+			< this->Bounds[6 * b + 2 * this->Axis] + this->Bounds[6 * b + 2 * this->Axis + 1];
+	}
+	const std::vector<double>& Bounds;
+	int Axis;
+};
+
+// Sort-Tile-Recursive order of [first, last): slabs along x, then y, then z
+void strSort(std::vector<int>::iterator first, std::vector<int>::iterator last,
+	const std::vector<double>& bounds, int axis, int capacity)
+{
+	int count = static_cast<int>(last - first);
+	std::sort(first, last, CenterLess(bounds, axis));
+	if (axis == 2 || count <= capacity)
+	{
+		return;
+	}
+	int pages = (count + capacity - 1) / capacity;
+	int slabs = static_cast<int>(std::ceil(std::pow(static_cast<double>(pages), 1. / (3 - axis))));
+	int slabSize = capacity * ((pages + slabs - 1) / slabs);
+	for (int start = 0; start < count; start += slabSize)
+	{
+		strSort(first + start, first + std::min(start + slabSize, count), bounds, axis + 1, capacity);
+	}
+}
+
+void mergeBounds(double bounds[6], const double* other)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		bounds[2 * axis] = std::min(bounds[2 * axis], other[2 * axis]);
+		bounds[2 * axis + 1] = std::max(bounds[2 * axis + 1], other[2 * axis + 1]);
+	}
+}
+
+bool overlaps(const double* a, const double* b)
+{
+	return a[0] <= b[1] && b[0] <= a[1] && a[2] <= b[3] && b[2] <= a[3] && a[4] <= b[5] && b[4] <= a[5];
+}
+
+double squaredDistance(const double* bounds, const double point[3])
+{
+	double distance = 0.;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		double delta = std::max(std::max(bounds[2 * axis] - point[axis], point[axis] - bounds[2 * axis + 1]), 0.);
+		distance += delta * delta;
+	}
+	return distance;
+}
+
+template <class T>
+void writeVector(std::ofstream& out, const std::vector<T>& values)
+{
+	int count = static_cast<int>(values.size());
+	out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+	if (count > 0)
+	{
+		out.write(reinterpret_cast<const char*>(&values[0]), count * sizeof(T));
+	}
+}
+
+template <class T>
+bool readVector(std::ifstream& in, std::vector<T>& values)
+{
+	int count = 0;
+	in.read(reinterpret_cast<char*>(&count), sizeof(count));
+	if (!in || count < 0)
+	{
+		return false;
+	}
+	values.resize(count);
+	if (count > 0)
+	{
+		in.read(reinterpret_cast<char*>(&values[0]), count * sizeof(T));
+	}
+	return !in.fail();
+}
+}
+
+//----------------------------------------------------------------------------
+const int vtkSlicerbreastImageClusterTree::NodeCapacity;
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageClusterTree::vtkSlicerbreastImageClusterTree()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageClusterTree::Clear()
+{
+	this->Bounds.clear();
+	this->ReportIds.clear();
+	this->Clusters.clear();
+	this->ReportFiles.clear();
+	this->Nodes.clear();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageClusterTree::packLevel(std::vector<int>& items, const std::vector<double>& itemBounds,
+	std::vector<Node>& level, bool leaf) const
+{
+	strSort(items.begin(), items.end(), itemBounds, 0, NodeCapacity);
+	int count = static_cast<int>(items.size());
+	for (int first = 0; first < count; first += NodeCapacity)
+	{
+		Node node;
+		node.First = first;
+		node.Count = std::min(NodeCapacity, count - first);
+		node.Leaf = leaf ? 1 : 0;
+		std::memcpy(node.Bounds, &itemBounds[6 * items[first]], sizeof(node.Bounds));
+		for (int i = 1; i < node.Count; i++)
+		{
+			mergeBounds(node.Bounds, &itemBounds[6 * items[first + i]]);
+		}
+		level.push_back(node);
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageClusterTree::Build(const std::vector<double>& bounds, const std::vector<int>& reportIds,
+	const std::vector<int>& clusters, const std::vector<std::string>& reportFiles)
+{
+	this->Clear();
+	this->ReportFiles = reportFiles;
+	int count = static_cast<int>(clusters.size());
+	if (count == 0)
+	{
+		return;
+	}
+
+	// leaves, clusters are stored in leaf order so that a leaf covers a contiguous range
+	std::vector<int> items(count);
+	for (int i = 0; i < count; i++)
+	{
+		items[i] = i;
+	}
+	std::vector<Node> level;
+	this->packLevel(items, bounds, level, true);
+	this->Bounds.resize(6 * count);
+	this->ReportIds.resize(count);
+	this->Clusters.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		std::memcpy(&this->Bounds[6 * i], &bounds[6 * items[i]], 6 * sizeof(double));
+		this->ReportIds[i] = reportIds[items[i]];
+		this->Clusters[i] = clusters[items[i]];
+	}
+
+	// upper levels, each level is appended in packing order so that children are contiguous
+	while (level.size() > 1)
+	{
+		int levelSize = static_cast<int>(level.size());
+		std::vector<double> levelBounds(6 * levelSize);
+		items.resize(levelSize);
+		for (int i = 0; i < levelSize; i++)
+		{
+			std::memcpy(&levelBounds[6 * i], level[i].Bounds, sizeof(level[i].Bounds));
+			items[i] = i;
+		}
+		std::vector<Node> parents;
+		this->packLevel(items, levelBounds, parents, false);
+		int offset = static_cast<int>(this->Nodes.size());
+		for (int i = 0; i < levelSize; i++)
+		{
+			this->Nodes.push_back(level[items[i]]);
+		}
+		for (size_t i = 0; i < parents.size(); i++)
+		{
+			parents[i].First += offset;
+		}
+		level.swap(parents);
+	}
+	this->Nodes.push_back(level[0]);
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerbreastImageClusterTree::GetNumberOfClusters() const
+{
+	return static_cast<int>(this->Clusters.size());
+}
+
+//----------------------------------------------------------------------------
+const std::string& vtkSlicerbreastImageClusterTree::GetReportFile(int id) const
+{
+	return this->ReportFiles[this->ReportIds[id]];
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerbreastImageClusterTree::GetCluster(int id) const
+{
+	return this->Clusters[id];
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageClusterTree::GetBounds(int id, double bounds[6]) const
+{
+	std::memcpy(bounds, &this->Bounds[6 * id], 6 * sizeof(double));
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageClusterTree::FindOverlapping(const double bounds[6], std::vector<int>& ids) const
+{
+	ids.clear();
+	if (this->Nodes.empty())
+	{
+		return;
+	}
+	std::vector<int> stack;
+	stack.push_back(static_cast<int>(this->Nodes.size()) - 1);
+	while (!stack.empty())
+	{
+		const Node& node = this->Nodes[stack.back()];
+		stack.pop_back();
+		if (!overlaps(node.Bounds, bounds))
+		{
+			continue;
+		}
+		for (int i = node.First; i < node.First + node.Count; i++)
+		{
+			if (!node.Leaf)
+			{
+				stack.push_back(i);
+			}
+			else if (overlaps(&this->Bounds[6 * i], bounds))
+			{
+				ids.push_back(i);
+			}
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageClusterTree::FindNearest(const double point[3], int k, std::vector<int>& ids) const
+{
+	ids.clear();
+	if (this->Nodes.empty() || k <= 0)
+	{
+		return;
+	}
+	// best first search, nodes are stored as index >= 0 and clusters as -(id + 1)
+	typedef std::pair<double, int> Candidate;
+	std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate> > queue;
+	int root = static_cast<int>(this->Nodes.size()) - 1;
+	queue.push(Candidate(squaredDistance(this->Nodes[root].Bounds, point), root));
+	while (!queue.empty() && static_cast<int>(ids.size()) < k)
+	{
+		Candidate candidate = queue.top();
+		queue.pop();
+		if (candidate.second < 0)
+		{
+			ids.push_back(-candidate.second - 1);
+			continue;
+		}
+		const Node& node = this->Nodes[candidate.second];
+		for (int i = node.First; i < node.First + node.Count; i++)
+		{
+			if (node.Leaf)
+			{
+				queue.push(Candidate(squaredDistance(&this->Bounds[6 * i], point), -(i + 1)));
+			}
+			else
+			{
+				queue.push(Candidate(squaredDistance(this->Nodes[i].Bounds, point), i));
+			}
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageClusterTree::Save(const char* fileName) const
+{
+	std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		return false;
+	}
+	out.write(treeMagic, sizeof(treeMagic));
+	out.write(reinterpret_cast<const char*>(&treeVersion), sizeof(treeVersion));
+	writeVector(out, this->Nodes);
+	writeVector(out, this->Bounds);
+	writeVector(out, this->ReportIds);
+	writeVector(out, this->Clusters);
+	int files = static_cast<int>(this->ReportFiles.size());
+	out.write(reinterpret_cast<const char*>(&files), sizeof(files));
+	for (int i = 0; i < files; i++)
+	{
+		int length = static_cast<int>(this->ReportFiles[i].size());
+		out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		out.write(this->ReportFiles[i].data(), length);
+	}
+	return !out.fail();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageClusterTree::Load(const char* fileName)
+{
+	this->Clear();
+	std::ifstream in(fileName, std::ios::binary);
+	char magic[4];
+	int version = 0;
+	in.read(magic, sizeof(magic));
+	in.read(reinterpret_cast<char*>(&version), sizeof(version));
+	if (!in || std::memcmp(magic, treeMagic, sizeof(magic)) != 0 || version != treeVersion)
+	{
+		return false;
+	}
+	int files = 0;
+	if (!readVector(in, this->Nodes) || !readVector(in, this->Bounds)
+		|| !readVector(in, this->ReportIds) || !readVector(in, this->Clusters)
+		|| !in.read(reinterpret_cast<char*>(&files), sizeof(files)) || files < 0)
+	{
+		this->Clear();
+		return false;
+	}
+	this->ReportFiles.resize(files);
+	for (int i = 0; i < files; i++)
+	{
+		int length = 0;
+		in.read(reinterpret_cast<char*>(&length), sizeof(length));
+		if (!in || length < 0)
+		{
+			this->Clear();
+			return false;
+		}
+		this->ReportFiles[i].resize(length);
+		if (length > 0)
+		{
+			in.read(&this->ReportFiles[i][0], length);
+		}
+	}
+	if (in.fail() || !this->isConsistent())
+	{
+		this->Clear();
+		return false;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageClusterTree::isConsistent() const
+{
+	size_t count = this->Clusters.size();
+	if (this->Bounds.size() != 6 * count || this->ReportIds.size() != count
+		|| this->Nodes.empty() != (count == 0))
+	{
+		return false;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		if (this->ReportIds[i] < 0 || this->ReportIds[i] >= static_cast<int>(this->ReportFiles.size()))
+		{
+			return false;
+		}
+	}
+	// leaves cover clusters, other nodes cover nodes stored before them,
+	// so queries end and stay in the vectors
+	for (size_t i = 0; i < this->Nodes.size(); i++)
+	{
+		const Node& node = this->Nodes[i];
+		int limit = node.Leaf ? static_cast<int>(count) : static_cast<int>(i);
+		if (node.First < 0 || node.Count < 1 || node.Count > NodeCapacity || node.First > limit - node.Count)
+		{
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,86 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkSlicerbreastImageClusterTree - R-tree over annotated cluster boxes
+// .SECTION Description
+// Static R-tree bulk loaded with Sort-Tile-Recursive packing over the boxes
+// of the annotated clusters of a report corpus, in RAS or IJK coordinates.
+// Answers overlap and k-nearest queries and can be saved to disk so that
+// reloading the corpus does not require parsing the reports again.
+// Boxes use the VTK bounds layout (xmin, xmax, ymin, ymax, zmin, zmax).
+
+#ifndef __vtkSlicerbreastImageClusterTree_h
+#define __vtkSlicerbreastImageClusterTree_h
+
+// STD includes
+#include <string>
+#include <vector>
+
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageClusterTree
+{
+public:
+  vtkSlicerbreastImageClusterTree();
+
+  /// Build the tree. bounds holds 6 values per cluster, reportIds index
+  /// reportFiles and clusters is the cluster number inside its report.
+  void Build(const std::vector<double>& bounds, const std::vector<int>& reportIds,
+    const std::vector<int>& clusters, const std::vector<std::string>& reportFiles);
+  void Clear();
+
+  int GetNumberOfClusters() const;
+  const std::string& GetReportFile(int id) const;
+  int GetCluster(int id) const;
+  void GetBounds(int id, double bounds[6]) const;
+
+  /// Ids of the clusters whose box overlaps bounds.
+  void FindOverlapping(const double bounds[6], std::vector<int>& ids) const;
+  /// Ids of the k clusters whose box is closest to point, nearest first.
+  void FindNearest(const double point[3], int k, std::vector<int>& ids) const;
+
+  bool Save(const char* fileName) const;
+  bool Load(const char* fileName);
+
+  /// Maximum number of children of a tree node
+  static const int NodeCapacity = 16;
+
+protected:
+  struct Node
+  {
+    double Bounds[6];
+    /// first child node, or first cluster for leaves
+    int First;
+    int Count;
+    int Leaf;
+  };
+
+  void packLevel(std::vector<int>& items, const std::vector<double>& itemBounds, std::vector<Node>& level, bool leaf) const;
+  /// True if the sizes and indices of a loaded tree are in range.
+  bool isConsistent() const;
+
+  /// per cluster data, in leaf order
+  std::vector<double> Bounds;
+  std::vector<int> ReportIds;
+  std::vector<int> Clusters;
+  std::vector<std::string> ReportFiles;
+  /// nodes, the root is the last one
+  std::vector<Node> Nodes;
+};
+
+#endif
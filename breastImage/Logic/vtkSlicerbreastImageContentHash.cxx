@@ -0,0 +1,254 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageContentHash.h"
+#include "vtkSlicerbreastImageTaskPool.h"
+#include "vtkSlicerbreastImageTrace.h"
+
+// VTK includes
+#include <vtkImageData.h>
+
+// STD includes
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+const quint64 Prime1 = Q_UINT64_C(11400714785074694791);
+const quint64 Prime2 = Q_UINT64_C(14029467366897019727);
+const quint64 Prime3 = Q_UINT64_C(1609587929392839161);
+const quint64 Prime4 = Q_UINT64_C(9650029242287828579);
+const quint64 Prime5 = Q_UINT64_C(2870177450012600261);
+
+inline quint64 rotateLeft(quint64 value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+inline quint64 read64(const unsigned char* data)
+{
+	quint64 value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+inline quint32 read32(const unsigned char* data)
+{
+	quint32 value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+inline quint64 accumulate(quint64 accumulator, quint64 input)
+{
+	accumulator += input * Prime2;
+	accumulator = rotateLeft(accumulator, 31);
+	return accumulator * Prime1;
+}
+
+inline quint64 mergeRound(quint64 accumulator, quint64 value)
+{
+	accumulator ^= accumulate(0, value);
+	return accumulator * Prime1 + Prime4;
+}
+
+// Hash of a chunk of the rows of a slice, the last chunk may be shorter
+quint64 hashChunk(const unsigned char* slice, int chunk, int rows, int rowsPerChunk, size_t rowSize)
+{
+	int first = chunk * rowsPerChunk;
+	int count = std::min(rowsPerChunk, rows - first);
+	return vtkSlicerbreastImageContentHash::Hash(slice + first * rowSize, count * rowSize);
+}
+
+// at least one chunk, an empty one for a slice without rows
+int numberOfChunks(int rows, int rowsPerChunk)
+{
+	return std::max((rows + rowsPerChunk - 1) / rowsPerChunk, 1);
+}
+
+// the slice hash is the Hash of the hashes of its chunks
+quint64 combineChunkHashes(const quint64* chunkHashes, int chunks)
+{
+	return vtkSlicerbreastImageContentHash::Hash(chunkHashes, chunks * sizeof(quint64));
+}
+
+// the chunks of all slices, chunk i is chunk i % SliceChunks of slice i / SliceChunks
+class ChunkHashFunctor : public vtkSlicerbreastImageRangeFunctor
+{
+public:
+	ChunkHashFunctor(const unsigned char* scalars, int rows, size_t rowSize, int rowsPerChunk, quint64* hashes)
+		: Scalars(scalars), Rows(rows), RowSize(rowSize), RowsPerChunk(rowsPerChunk),
+		SliceChunks(numberOfChunks(rows, rowsPerChunk)), Hashes(hashes) {}
+	virtual void operator()(vtkIdType begin, vtkIdType end)
+	{
+		for (vtkIdType i = begin; i < end; i++)
+		{
+			vtkIdType slice = i / this->SliceChunks;
+			this->Hashes[i] = hashChunk(this->Scalars + slice * this->Rows * this->RowSize,
+				static_cast<int>(i % this->SliceChunks), this->Rows, this->RowsPerChunk, this->RowSize);
+		}
+	}
+	const unsigned char* Scalars;
+	int Rows;
+	size_t RowSize;
+	int RowsPerChunk;
+	int SliceChunks;
+	quint64* Hashes;
+};
+}
+
+const size_t vtkSlicerbreastImageContentHash::ChunkSize;
+
+//----------------------------------------------------------------------------
+quint64 vtkSlicerbreastImageContentHash::Hash(const void* data, size_t length, quint64 seed)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	const unsigned char* end = p + length;
+	quint64 hash;
+
+	if (length >= 32)
+	{
+		// four independent lanes, kept in flight together by the CPU
+		quint64 v1 = seed + Prime1 + Prime2;
+		quint64 v2 = seed + Prime2;
+		quint64 v3 = seed;
+		quint64 v4 = seed - Prime1;
+		const unsigned char* limit = end - 32;
+		do
+		{
+			v1 = accumulate(v1, read64(p));
+			v2 = accumulate(v2, read64(p + 8));
+			v3 = accumulate(v3, read64(p + 16));
+			v4 = accumulate(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+		hash = mergeRound(hash, v1);
+		hash = mergeRound(hash, v2);
+		hash = mergeRound(hash, v3);
+		hash = mergeRound(hash, v4);
+	}
+	else
+	{
+		hash = seed + Prime5;
+	}
+	hash += static_cast<quint64>(length);
+
+	for (; p + 8 <= end; p += 8)
+	{
+		hash ^= accumulate(0, read64(p));
+		hash = rotateLeft(hash, 27) * Prime1 + Prime4;
+	}
+	if (p + 4 <= end)
+	{
+		hash ^= static_cast<quint64>(read32(p)) * Prime1;
+		hash = rotateLeft(hash, 23) * Prime2 + Prime3;
+		p += 4;
+	}
+	for (; p < end; p++)
+	{
+		hash ^= (*p) * Prime5;
+		hash = rotateLeft(hash, 11) * Prime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= Prime2;
+	hash ^= hash >> 29;
+	hash *= Prime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+//----------------------------------------------------------------------------
+quint64 vtkSlicerbreastImageContentHash::HashImage(vtkImageData* image, vtkSlicerbreastImageTaskPool* pool)
+{
+	BREASTIMAGE_TRACE_SCOPE("HashImage");
+	if (!image || !image->GetScalarPointer())
+	{
+		return 0;
+	}
+	int* dims = image->GetDimensions();
+	size_t rowSize = static_cast<size_t>(dims[0]) * image->GetNumberOfScalarComponents() * image->GetScalarSize();
+	const unsigned char* scalars = static_cast<const unsigned char*>(image->GetScalarPointer());
+
+	// chunks of rows rather than slices, so that a single slice or a few
+	// large ones still keep the pool busy
+	int rowsPerChunk = GetRowsPerChunk(rowSize);
+	int sliceChunks = numberOfChunks(dims[1], rowsPerChunk);
+	vtkIdType chunks = static_cast<vtkIdType>(sliceChunks) * dims[2];
+	std::vector<quint64> chunkHashes(chunks);
+	ChunkHashFunctor functor(scalars, dims[1], rowSize, rowsPerChunk, &chunkHashes[0]);
+	if (pool)
+	{
+		pool->ParallelFor(0, chunks, 1, functor);
+	}
+	else
+	{
+		functor(0, chunks);
+	}
+	std::vector<quint64> sliceHashes(dims[2]);
+	for (int k = 0; k < dims[2]; k++)
+	{
+		sliceHashes[k] = combineChunkHashes(&chunkHashes[k * sliceChunks], sliceChunks);
+	}
+	return CombineSliceHashes(dims, image->GetScalarType(), image->GetNumberOfScalarComponents(), &sliceHashes[0]);
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerbreastImageContentHash::GetRowsPerChunk(size_t rowSize)
+{
+	return rowSize > 0 ? static_cast<int>(std::max(ChunkSize / rowSize, static_cast<size_t>(1))) : 1;
+}
+
+//----------------------------------------------------------------------------
+quint64 vtkSlicerbreastImageContentHash::HashSlice(const void* slice, int rows, size_t rowSize)
+{
+	// the same chunks and the same combination as HashImage
+	int rowsPerChunk = GetRowsPerChunk(rowSize);
+	int sliceChunks = numberOfChunks(rows, rowsPerChunk);
+	std::vector<quint64> chunkHashes(sliceChunks);
+	for (int chunk = 0; chunk < sliceChunks; chunk++)
+	{
+		chunkHashes[chunk] = hashChunk(static_cast<const unsigned char*>(slice), chunk, rows, rowsPerChunk, rowSize);
+	}
+	return combineChunkHashes(&chunkHashes[0], sliceChunks);
+}
+
+//----------------------------------------------------------------------------
+quint64 vtkSlicerbreastImageContentHash::CombineSliceHashes(const int dimensions[3], int scalarType, int numberOfComponents,
+	const quint64* sliceHashes)
+{
+	// geometry of the scalars followed by the hash of each slice
+	std::vector<quint64> hashes(dimensions[2] + 5);
+	hashes[0] = dimensions[0];
+	hashes[1] = dimensions[1];
+	hashes[2] = dimensions[2];
+	hashes[3] = scalarType;
+	hashes[4] = numberOfComponents;
+	std::copy(sliceHashes, sliceHashes + dimensions[2], hashes.begin() + 5);
+	return Hash(&hashes[0], hashes.size() * sizeof(quint64));
+}
+
+//----------------------------------------------------------------------------
+QString vtkSlicerbreastImageContentHash::ToString(quint64 hash)
+{
+	return QString("%1").arg(hash, 16, 16, QChar('0'));
+}
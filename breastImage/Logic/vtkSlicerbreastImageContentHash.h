@@ -0,0 +1,69 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// .NAME vtkSlicerbreastImageContentHash - fast hash of the voxels of a volume
+// .SECTION Description
+// XXH64 of the scalars of a vtkImageData. Each slice is cut into chunks of
+// rows hashed on the task pool, the chunk hashes of a slice are hashed into
+// the slice hash and the slice hashes are hashed again with the dimensions,
+// scalar type and number of components, so the result identifies the pixel
+// data exactly and changes after a flip or a resampling. The hash is not
+// cryptographic.
+
+#ifndef __vtkSlicerbreastImageContentHash_h
+#define __vtkSlicerbreastImageContentHash_h
+
+// QT includes
+#include <QString>
+
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+class vtkImageData;
+class vtkSlicerbreastImageTaskPool;
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageContentHash
+{
+public:
+  /// XXH64 of a buffer, read as little-endian.
+  static quint64 Hash(const void* data, size_t length, quint64 seed = 0);
+
+  /// Hash of the scalars of an image, 0 if it has none. The chunks of rows
+  /// are hashed in parallel when a pool is given.
+  static quint64 HashImage(vtkImageData* image, vtkSlicerbreastImageTaskPool* pool = NULL);
+
+  /// Rows hashed as one chunk, about ChunkSize bytes and at least one row.
+  static int GetRowsPerChunk(size_t rowSize);
+
+  /// Hash of a slice of rows from the Hash of each of its chunks.
+  static quint64 HashSlice(const void* slice, int rows, size_t rowSize);
+
+  /// Hash of an image from the HashSlice of each of its slices, for callers
+  /// that hash the slices as they stream them.
+  static quint64 CombineSliceHashes(const int dimensions[3], int scalarType, int numberOfComponents,
+    const quint64* sliceHashes);
+
+  /// 16 lowercase hexadecimal digits.
+  static QString ToString(quint64 hash);
+
+  /// Bytes of a chunk of rows, large enough to keep the overhead of the
+  /// chunk hashes small and small enough to split single slices.
+  static const size_t ChunkSize = 256 * 1024;
+};
+
+#endif
@@ -0,0 +1,292 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageDicomScanner.h"
+#include "vtkSlicerbreastImageTaskPool.h"
+#include "vtkSlicerbreastImageTrace.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+
+// DCMTK includes
+#include <dcmtk/config/osconfig.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+
+//QT includes
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QVector>
+
+// STD includes
+#include <algorithm>
+
+namespace
+{
+// string tags copied to the header maps
+struct HeaderTag
+{
+	const char* Keyword;
+	DcmTagKey Tag;
+};
+const HeaderTag headerTags[] = {
+	{ "PatientID", DCM_PatientID },
+	{ "PatientBirthDate", DCM_PatientBirthDate },
+	{ "StudyID", DCM_StudyID },
+	{ "StudyDate", DCM_StudyDate },
+	{ "SeriesNumber", DCM_SeriesNumber },
+	{ "ViewPosition", DCM_ViewPosition },
+	{ "ImageLaterality", DCM_ImageLaterality },
+	{ "Laterality", DCM_Laterality },
+	{ "SeriesDescription", DCM_SeriesDescription },
+	{ "PhotometricInterpretation", DCM_PhotometricInterpretation },
+	{ "RescaleSlope", DCM_RescaleSlope },
+	{ "RescaleIntercept", DCM_RescaleIntercept },
+	{ "VOILUTFunction", DCM_VOILUTFunction },
+	{ "SOPInstanceUID", DCM_SOPInstanceUID } };
+const int headerTagCount = sizeof(headerTags) / sizeof(headerTags[0]);
+
+class ScanFunctor : public vtkSlicerbreastImageRangeFunctor
+{
+public:
+	ScanFunctor(const QStringList& files, QVector< QMap<QString, QString> >& headers, QVector<bool>& scanned)
+		: Files(files), Headers(headers), Scanned(scanned) {}
+	virtual void operator()(vtkIdType begin, vtkIdType end)
+	{
+		for (vtkIdType i = begin; i < end; i++)
+		{
+			if (!this->Scanned[i])
+			{
+				this->Headers[i] = vtkSlicerbreastImageDicomScanner::ReadHeader(this->Files[i]);
+			}
+		}
+	}
+	const QStringList& Files;
+	QVector< QMap<QString, QString> >& Headers;
+	QVector<bool>& Scanned;
+};
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerbreastImageDicomScanner);
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageDicomScanner::vtkSlicerbreastImageDicomScanner()
+{
+	this->TaskPool = NULL;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageDicomScanner::~vtkSlicerbreastImageDicomScanner()
+{
+	this->SetTaskPool(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageDicomScanner::PrintSelf(ostream& os, vtkIndent indent)
+{
+	this->Superclass::PrintSelf(os, indent);
+	os << indent << "CachedHeaders: " << this->Headers.size() << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageDicomScanner::SetTaskPool(vtkSlicerbreastImageTaskPool* pool)
+{
+	if (pool == this->TaskPool)
+	{
+		return;
+	}
+	if (pool)
+	{
+		pool->Register(this);
+	}
+	if (this->TaskPool)
+	{
+		this->TaskPool->UnRegister(this);
+	}
+	this->TaskPool = pool;
+	this->Modified();
+}
+
+//----------------------------------------------------------------------------
+QMap<QString, QString> vtkSlicerbreastImageDicomScanner::ReadHeader(const QString& fileName)
+{
+	QMap<QString, QString> header;
+	DcmFileFormat fileFormat;
+	// the pixel data is not needed, stop parsing before it
+	OFCondition status = fileFormat.loadFileUntilTag(fileName.toLocal8Bit().constData(),
+		EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_autoDetect, DCM_PixelData);
+	if (status.bad())
+	{
+		return header;
+	}
+	DcmDataset* dataset = fileFormat.getDataset();
+	for (int i = 0; i < headerTagCount; i++)
+	{
+		OFString value;
+		if (dataset->findAndGetOFString(headerTags[i].Tag, value).good())
+		{
+			header.insert(headerTags[i].Keyword, QString::fromLatin1(value.c_str()).trimmed());
+		}
+	}
+	OFString spacing;
+	if (dataset->findAndGetOFStringArray(DCM_PixelSpacing, spacing).good())
+	{
+		header.insert("PixelSpacing", QString::fromLatin1(spacing.c_str()).trimmed());
+	}
+	Uint16 bitsStored = 0;
+	if (dataset->findAndGetUint16(DCM_BitsStored, bitsStored).good())
+	{
+		header.insert("BitsStored", QString::number(bitsStored));
+	}
+	Uint16 pixelRepresentation = 0;
+	if (dataset->findAndGetUint16(DCM_PixelRepresentation, pixelRepresentation).good())
+	{
+		header.insert("PixelRepresentation", QString::number(pixelRepresentation));
+	}
+	// the table itself is read by ReadVOILUT when it is applied
+	DcmItem* voiLUT = NULL;
+	Uint16 descriptor[3];
+	if (dataset->findAndGetSequenceItem(DCM_VOILUTSequence, voiLUT, 0).good() && voiLUT
+		&& voiLUT->findAndGetUint16(DCM_LUTDescriptor, descriptor[0], 0).good()
+		&& voiLUT->findAndGetUint16(DCM_LUTDescriptor, descriptor[1], 1).good()
+		&& voiLUT->findAndGetUint16(DCM_LUTDescriptor, descriptor[2], 2).good())
+	{
+		header.insert("VOILUTDescriptor", QString("%1\\%2\\%3").arg(descriptor[0]).arg(descriptor[1]).arg(descriptor[2]));
+	}
+	header.insert("FileName", fileName);
+	return header;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageDicomScanner::ReadVOILUT(const QString& fileName, int descriptor[3], QVector<quint16>& data)
+{
+	DcmFileFormat fileFormat;
+	OFCondition status = fileFormat.loadFileUntilTag(fileName.toLocal8Bit().constData(),
+		EXS_Unknown, EGL_noChange, DCM_MaxReadLength, ERM_autoDetect, DCM_PixelData);
+	DcmItem* voiLUT = NULL;
+	if (status.bad() || fileFormat.getDataset()->findAndGetSequenceItem(DCM_VOILUTSequence, voiLUT, 0).bad() || !voiLUT)
+	{
+		return false;
+	}
+	Uint16 values[3];
+	for (int i = 0; i < 3; i++)
+	{
+		if (voiLUT->findAndGetUint16(DCM_LUTDescriptor, values[i], i).bad())
+		{
+			return false;
+		}
+	}
+	Uint16 pixelRepresentation = 0;
+	fileFormat.getDataset()->findAndGetUint16(DCM_PixelRepresentation, pixelRepresentation);
+	// 0 entries stands for 65536, the first mapped value is signed for
+	// signed pixels
+	descriptor[0] = values[0] == 0 ? 65536 : values[0];
+	descriptor[1] = pixelRepresentation == 1 ? static_cast<Sint16>(values[1]) : values[1];
+	descriptor[2] = values[2];
+	const Uint16* table = NULL;
+	unsigned long count = 0;
+	if (voiLUT->findAndGetUint16Array(DCM_LUTData, table, &count).bad() || !table
+		|| count < static_cast<unsigned long>(descriptor[0]))
+	{
+		return false;
+	}
+	data.resize(descriptor[0]);
+	std::copy(table, table + descriptor[0], data.begin());
+	return true;
+}
+
+//----------------------------------------------------------------------------
+QList< QMap<QString, QString> > vtkSlicerbreastImageDicomScanner::ScanFiles(const QStringList& files)
+{
+	BREASTIMAGE_TRACE_SCOPE("ScanDicomFiles");
+	int count = files.size();
+	QVector< QMap<QString, QString> > headers(count);
+	QVector<bool> scanned(count, false);
+	QVector<QDateTime> lastModified(count);
+
+	// headers of files not modified since they were scanned
+	{
+		QMutexLocker locker(&this->CacheMutex);
+		for (int i = 0; i < count; i++)
+		{
+			lastModified[i] = QFileInfo(files[i]).lastModified();
+			QHash<QString, ScannedFile>::const_iterator file = this->Files.constFind(files[i]);
+			if (file != this->Files.constEnd() && file.value().LastModified == lastModified[i]
+				&& this->Headers.contains(file.value().SOPInstanceUID))
+			{
+				headers[i] = this->Headers.value(file.value().SOPInstanceUID);
+				scanned[i] = true;
+			}
+		}
+	}
+
+	ScanFunctor functor(files, headers, scanned);
+	if (this->TaskPool)
+	{
+		this->TaskPool->ParallelFor(0, count, 16, functor, vtkSlicerbreastImageTaskPool::BackgroundPriority);
+	}
+	else
+	{
+		functor(0, count);
+	}
+
+	QMutexLocker locker(&this->CacheMutex);
+	for (int i = 0; i < count; i++)
+	{
+		QString uid = headers[i].value("SOPInstanceUID");
+		if (scanned[i] || uid.isEmpty())
+		{
+			continue;
+		}
+		this->Headers.insert(uid, headers[i]);
+		ScannedFile file;
+		file.LastModified = lastModified[i];
+		file.SOPInstanceUID = uid;
+		this->Files.insert(files[i], file);
+	}
+	return headers.toList();
+}
+
+//----------------------------------------------------------------------------
+QList< QMap<QString, QString> > vtkSlicerbreastImageDicomScanner::ScanDirectory(const QString& directory)
+{
+	QStringList files;
+	QDirIterator iter(directory, QDir::Files, QDirIterator::Subdirectories);
+	while (iter.hasNext())
+	{
+		files << iter.next();
+	}
+	return this->ScanFiles(files);
+}
+
+//----------------------------------------------------------------------------
+QMap<QString, QString> vtkSlicerbreastImageDicomScanner::GetHeader(const QString& sopInstanceUID)
+{
+	QMutexLocker locker(&this->CacheMutex);
+	return this->Headers.value(sopInstanceUID);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageDicomScanner::ClearCache()
+{
+	QMutexLocker locker(&this->CacheMutex);
+	this->Headers.clear();
+	this->Files.clear();
+}
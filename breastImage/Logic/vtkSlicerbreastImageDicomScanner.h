@@ -0,0 +1,103 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkSlicerbreastImageDicomScanner - parallel DICOM header reader
+// .SECTION Description
+// Reads the few tags needed by the annotation reports directly from DICOM
+// files with DCMTK, without the DICOM database or the subject hierarchy.
+// Parsing stops before the pixel data and files are scanned in parallel on
+// the module task pool. Headers are cached per SOPInstanceUID, and files
+// already scanned and not modified since are not read again.
+
+#ifndef __vtkSlicerbreastImageDicomScanner_h
+#define __vtkSlicerbreastImageDicomScanner_h
+
+// VTK includes
+#include <vtkObject.h>
+
+// QT includes
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+class vtkSlicerbreastImageTaskPool;
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageDicomScanner :
+  public vtkObject
+{
+public:
+
+  static vtkSlicerbreastImageDicomScanner *New();
+  vtkTypeMacro(vtkSlicerbreastImageDicomScanner, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Pool used to scan the files, the scan is serial without pool.
+  void SetTaskPool(vtkSlicerbreastImageTaskPool* pool);
+
+  /// Read the header of each file. The returned maps, in the order of files,
+  /// are keyed by DICOM keyword (PatientID, PatientBirthDate, StudyID,
+  /// StudyDate, SeriesNumber, ViewPosition, ImageLaterality, Laterality,
+  /// SeriesDescription, PixelSpacing, BitsStored, PixelRepresentation,
+  /// PhotometricInterpretation, RescaleSlope, RescaleIntercept,
+  /// VOILUTFunction, SOPInstanceUID) plus FileName, and VOILUTDescriptor
+  /// when the file has a VOI LUT Sequence. Files that can not be read
+  /// give an empty map.
+  QList< QMap<QString, QString> > ScanFiles(const QStringList& files);
+  /// Scan every file below a directory.
+  QList< QMap<QString, QString> > ScanDirectory(const QString& directory);
+
+  /// Cached header of an instance, empty if it was not scanned.
+  QMap<QString, QString> GetHeader(const QString& sopInstanceUID);
+  void ClearCache();
+
+  /// Read one header, without cache.
+  static QMap<QString, QString> ReadHeader(const QString& fileName);
+  /// Read the first table of the VOI LUT Sequence of a file: descriptor is
+  /// the number of entries, the first mapped value and the bits of the
+  /// entries, data the entries.
+  static bool ReadVOILUT(const QString& fileName, int descriptor[3], QVector<quint16>& data);
+
+protected:
+  vtkSlicerbreastImageDicomScanner();
+  virtual ~vtkSlicerbreastImageDicomScanner();
+
+  struct ScannedFile
+  {
+    QDateTime LastModified;
+    QString SOPInstanceUID;
+  };
+
+  vtkSlicerbreastImageTaskPool* TaskPool;
+  QMutex CacheMutex;
+  QHash<QString, QMap<QString, QString> > Headers;
+  QHash<QString, ScannedFile> Files;
+
+private:
+
+  vtkSlicerbreastImageDicomScanner(const vtkSlicerbreastImageDicomScanner&); // Not implemented
+  void operator=(const vtkSlicerbreastImageDicomScanner&); // Not implemented
+};
+
+#endif
@@ -17,33 +17,734 @@
 
 // breastImage Logic includes
 #include "vtkSlicerbreastImageLogic.h"
+#include "vtkSlicerbreastImageAnnotationJournal.h"
+#include "vtkSlicerbreastImageAtomicFile.h"
+#include "vtkSlicerbreastImageReportIndex.h"
+#include "vtkSlicerbreastImageSharedVolume.h"
+#include "vtkSlicerbreastImageClusterTree.h"
+#include "vtkSlicerbreastImageContentHash.h"
+#include "vtkSlicerbreastImageBinaryReport.h"
+#include "vtkSlicerbreastImageDicomScanner.h"
+#include "vtkSlicerbreastImageSlabStream.h"
+#include "vtkSlicerbreastImageReorienter.h"
+#include "vtkSlicerbreastImageTaskPool.h"
+#include "vtkSlicerbreastImageTiler.h"
+#include "vtkSlicerbreastImageTrace.h"
+#include "vtkSlicerbreastImageVolumeCache.h"
 
 // MRML includes
 #include <vtkMRMLScene.h>
 
 // VTK includes
+#include <vtkCommand.h>
+#include <vtkDataArray.h>
+#include <vtkFloatArray.h>
 #include <vtkIntArray.h>
 #include <vtkNew.h>
 #include <vtkImageData.h>
 #include <vtkMatrix4x4.h>
 #include <vtkObjectFactory.h>
+#include <vtkObserverManager.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+#include <vtkWeakPointer.h>
 
 // MRML includes
 #include <vtkMRMLVolumeNode.h>
 #include <vtkMRMLAnnotationROINode.h>
 #include <vtkMRMLTransformNode.h>
 #include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLScalarVolumeDisplayNode.h>
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLStorableNode.h>
+#include <vtkMRMLStorageNode.h>
 
 // STD includes
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
 
 //QT includes
 #include <QDebug>
-#include <QMessageBox>
 #include <QDomDocument>
 #include <QFile>
 #include <QTextStream>
 #include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QRegExp>
+#include <QSet>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <QVector>
+#include <QXmlStreamReader>
+
+namespace
+{
+// views of the series descriptions written by the mammography and
+// tomosynthesis units, normalized and sorted for a binary search
+struct SeriesDescriptionView
+{
+	const char* Description;
+	const char* View;
+};
+const SeriesDescriptionView seriesDescriptionViews[] = {
+	{ "L CC", "L_CC" },
+	{ "L CC BREAST TOMOSYNTHESIS IMAGE", "L_CC" },
+	{ "L MLO", "L_MLO" },
+	{ "L MLO BREAST TOMOSYNTHESIS IMAGE", "L_MLO" },
+	{ "LCC", "L_CC" },
+	{ "LMLO", "L_MLO" },
+	{ "R CC", "R_CC" },
+	{ "R CC BREAST TOMOSYNTHESIS IMAGE", "R_CC" },
+	{ "R MLO", "R_MLO" },
+	{ "R MLO BREAST TOMOSYNTHESIS IMAGE", "R_MLO" },
+	{ "RCC", "R_CC" },
+	{ "RMLO", "R_MLO" } };
+const SeriesDescriptionView* seriesDescriptionViewsEnd =
+	seriesDescriptionViews + sizeof(seriesDescriptionViews) / sizeof(seriesDescriptionViews[0]);
+
+bool seriesDescriptionLess(const SeriesDescriptionView& entry, const char* description)
+{
+	return strcmp(entry.Description, description) < 0;
+}
+
+// add the first component of every pixel of a slice to its column
+template <class T>
+void sumColumns(const T* slice, int columns, int rows, int components, double* profile)
+{
+	for (int j = 0; j < rows; j++)
+	{
+		const T* row = slice + static_cast<vtkIdType>(j) * columns * components;
+		if (components == 1)
+		{
+			// contiguous, vectorized by the compiler
+			for (int i = 0; i < columns; i++)
+			{
+				profile[i] += row[i];
+			}
+		}
+		else
+		{
+			for (int i = 0; i < columns; i++)
+			{
+				profile[i] += row[i * components];
+			}
+		}
+	}
+}
+
+// breast of a slice: pixels of the first component above a threshold
+struct BreastExtent
+{
+	double Center[2];
+	double Size[2];
+	double Mean;
+	bool Valid;
+};
+
+template <class T>
+void measureBreast(const T* slice, int columns, int rows, int components, double threshold, BreastExtent& extent)
+{
+	double sum = 0.;
+	double sumI = 0.;
+	double sumJ = 0.;
+	vtkIdType count = 0;
+	int bounds[4] = { columns, -1, rows, -1 };
+	for (int j = 0; j < rows; j++)
+	{
+		const T* row = slice + static_cast<vtkIdType>(j) * columns * components;
+		for (int i = 0; i < columns; i++)
+		{
+			double value = row[i * components];
+			if (value > threshold)
+			{
+				sum += value;
+				sumI += i;
+				sumJ += j;
+				count++;
+				bounds[0] = std::min(bounds[0], i);
+				bounds[1] = std::max(bounds[1], i);
+				bounds[2] = std::min(bounds[2], j);
+				bounds[3] = std::max(bounds[3], j);
+			}
+		}
+	}
+	extent.Valid = count > 0 && sum > 0.;
+	if (!extent.Valid)
+	{
+		return;
+	}
+	extent.Center[0] = sumI / count;
+	extent.Center[1] = sumJ / count;
+	extent.Size[0] = bounds[1] - bounds[0] + 1;
+	extent.Size[1] = bounds[3] - bounds[2] + 1;
+	extent.Mean = sum / count;
+}
+
+// lowest value of the breast: the background of a mammogram is close to
+// the lowest value of the first component
+bool breastThreshold(vtkImageData* imageData, double range[2], double& threshold)
+{
+	vtkDataArray* scalars = imageData->GetPointData()->GetScalars();
+	if (!scalars)
+	{
+		return false;
+	}
+	scalars->GetRange(range, 0);
+	threshold = range[0] + 0.05 * (range[1] - range[0]);
+	return true;
+}
+
+bool measureVolumeBreast(vtkImageData* imageData, BreastExtent& extent)
+{
+	double range[2];
+	double threshold;
+	if (!breastThreshold(imageData, range, threshold))
+	{
+		return false;
+	}
+	int* dims = imageData->GetDimensions();
+	void* slice = imageData->GetScalarPointer(0, 0, dims[2] / 2);
+	switch (imageData->GetScalarType())
+	{
+		vtkTemplateMacro(measureBreast(static_cast<VTK_TT*>(slice), dims[0], dims[1],
+			imageData->GetNumberOfScalarComponents(), threshold, extent));
+	default:
+		extent.Valid = false;
+	}
+	return extent.Valid;
+}
+
+// first component of the pixels of columnMap in a row, 0 where it is -1
+template <class T>
+void gatherRow(const T* row, int components, const int* columnMap, int columns, float* out)
+{
+	for (int i = 0; i < columns; i++)
+	{
+		out[i] = columnMap[i] < 0 ? 0.f : static_cast<float>(row[columnMap[i] * components]);
+	}
+}
+
+template <class T>
+void absoluteDifferenceRow(const T* row, int components, const float* other, float gain, int columns, float* out)
+{
+	if (components == 1)
+	{
+		// contiguous, vectorized by the compiler
+		for (int i = 0; i < columns; i++)
+		{
+			out[i] = std::fabs(gain * row[i] - other[i]);
+		}
+		return;
+	}
+	for (int i = 0; i < columns; i++)
+	{
+		out[i] = std::fabs(gain * row[i * components] - other[i]);
+	}
+}
+
+// absolute difference between slices of a volume and the matching
+// slices of the mirrored contralateral volume, in intensities relative to
+// the mean of each breast
+class AsymmetryFunctor : public vtkSlicerbreastImageRangeFunctor
+{
+public:
+	virtual void operator()(vtkIdType begin, vtkIdType end)
+	{
+		std::vector<float> other(this->Columns);
+		for (vtkIdType k = begin; k < end; k++)
+		{
+			float* slice = this->Map + k * this->Columns * this->Rows;
+			for (int j = 0; j < this->Rows; j++)
+			{
+				float* out = slice + static_cast<vtkIdType>(j) * this->Columns;
+				if (this->RowMap[j] < 0)
+				{
+					std::fill(other.begin(), other.end(), 0.f);
+				}
+				else
+				{
+					void* otherRow = this->Other->GetScalarPointer(0, this->RowMap[j], this->SliceMap[k]);
+					switch (this->Other->GetScalarType())
+					{
+						vtkTemplateMacro(gatherRow(static_cast<VTK_TT*>(otherRow), this->Other->GetNumberOfScalarComponents(),
+							&this->ColumnMap[0], this->Columns, &other[0]));
+					}
+					for (int i = 0; i < this->Columns; i++)
+					{
+						other[i] *= this->OtherGain;
+					}
+				}
+				void* row = this->Image->GetScalarPointer(0, j, static_cast<int>(k));
+				switch (this->Image->GetScalarType())
+				{
+					vtkTemplateMacro(absoluteDifferenceRow(static_cast<VTK_TT*>(row), this->Image->GetNumberOfScalarComponents(),
+						&other[0], this->Gain, this->Columns, out));
+				}
+			}
+		}
+	}
+	vtkImageData* Image;
+	vtkImageData* Other;
+	float* Map;
+	int Columns;
+	int Rows;
+	float Gain;
+	float OtherGain;
+	// pixel of the contralateral volume of each column, row and slice, -1 outside
+	std::vector<int> ColumnMap;
+	std::vector<int> RowMap;
+	std::vector<int> SliceMap;
+};
+
+// add the first component of the breast pixels of rows to a histogram
+// of bins over [minimum, minimum + bins / binScale)
+template <class T>
+void accumulateHistogram(const T* scalars, vtkIdType values, int components, double threshold,
+	double minimum, double binScale, int bins, quint64* histogram)
+{
+	for (vtkIdType v = 0; v < values; v += components)
+	{
+		double value = scalars[v];
+		if (value > threshold)
+		{
+			int bin = static_cast<int>((value - minimum) * binScale);
+			histogram[std::min(bin, bins - 1)]++;
+		}
+	}
+}
+
+class HistogramFunctor : public vtkSlicerbreastImageRangeFunctor
+{
+public:
+	virtual void operator()(vtkIdType begin, vtkIdType end)
+	{
+		// merged once per chunk, the threads do not share counters
+		std::vector<quint64> histogram(this->Bins, 0);
+		vtkIdType rowValues = this->RowValues;
+		const char* first = static_cast<const char*>(this->Image->GetScalarPointer())
+			+ begin * rowValues * this->Image->GetScalarSize();
+		switch (this->Image->GetScalarType())
+		{
+			vtkTemplateMacro(accumulateHistogram(reinterpret_cast<const VTK_TT*>(first), (end - begin) * rowValues,
+				this->Image->GetNumberOfScalarComponents(), this->Threshold, this->Minimum, this->BinScale,
+				this->Bins, &histogram[0]));
+		}
+		QMutexLocker locker(&this->Mutex);
+		for (int bin = 0; bin < this->Bins; bin++)
+		{
+			this->Histogram[bin] += histogram[bin];
+		}
+	}
+	vtkImageData* Image;
+	vtkIdType RowValues;
+	double Threshold;
+	double Minimum;
+	double BinScale;
+	int Bins;
+	std::vector<quint64> Histogram;
+	QMutex Mutex;
+};
+
+// modality rescale, VOI LUT and MONOCHROME1 inversion of DICOM values
+struct IntensityTransform
+{
+	bool Rescale;
+	double Slope;
+	double Intercept;
+	const quint16* LUT;
+	int LUTSize;
+	double LUTFirst;
+	bool Invert;
+	double InvertSum;
+
+	double operator()(double value) const
+	{
+		if (this->Rescale)
+		{
+			value = value * this->Slope + this->Intercept;
+		}
+		if (this->LUT)
+		{
+			int index = static_cast<int>(std::floor(value - this->LUTFirst));
+			value = this->LUT[std::min(std::max(index, 0), this->LUTSize - 1)];
+		}
+		return this->Invert ? this->InvertSum - value : value;
+	}
+};
+
+template <class T>
+void fillTable(const std::vector<double>& mapped, T* table)
+{
+	for (size_t i = 0; i < mapped.size(); i++)
+	{
+		table[i] = static_cast<T>(mapped[i]);
+	}
+}
+
+// one table lookup per value, the table being indexed from the lowest value
+// of the type. The loops only load, index and store, vectorized by the
+// compiler with gathers where the target has them.
+template <class T>
+void lookupInPlace(T* values, vtkIdType count, const void* table, int offset)
+{
+	const T* typedTable = static_cast<const T*>(table);
+	for (vtkIdType i = 0; i < count; i++)
+	{
+		values[i] = typedTable[static_cast<int>(values[i]) - offset];
+	}
+}
+
+template <class T>
+void lookupToFloat(const T* values, float* output, vtkIdType count, const float* table, int offset)
+{
+	for (vtkIdType i = 0; i < count; i++)
+	{
+		output[i] = table[static_cast<int>(values[i]) - offset];
+	}
+}
+
+// types without table: wider integers and floating point values
+template <class T>
+void transformToFloat(const T* values, float* output, vtkIdType count, const IntensityTransform& transform)
+{
+	for (vtkIdType i = 0; i < count; i++)
+	{
+		output[i] = static_cast<float>(transform(values[i]));
+	}
+}
+
+template <class T>
+void transformInPlace(T* values, vtkIdType count, const IntensityTransform& transform)
+{
+	for (vtkIdType i = 0; i < count; i++)
+	{
+		values[i] = static_cast<T>(transform(values[i]));
+	}
+}
+
+class IntensityFunctor : public vtkSlicerbreastImageRangeFunctor
+{
+public:
+	virtual void operator()(vtkIdType begin, vtkIdType end)
+	{
+		vtkIdType first = begin * this->RowValues;
+		vtkIdType count = (end - begin) * this->RowValues;
+		void* input = static_cast<char*>(this->Input) + first * this->InputSize;
+		float* output = this->Output ? this->Output + first : NULL;
+		switch (this->ScalarType)
+		{
+			vtkTemplateMacro(
+				if (this->Table && !output)
+				{
+					lookupInPlace(static_cast<VTK_TT*>(input), count, this->Table, this->TableOffset);
+				}
+				else if (this->Table)
+				{
+					lookupToFloat(static_cast<VTK_TT*>(input), output, count, static_cast<const float*>(this->Table), this->TableOffset);
+				}
+				else if (!output)
+				{
+					transformInPlace(static_cast<VTK_TT*>(input), count, this->Transform);
+				}
+				else
+				{
+					transformToFloat(static_cast<VTK_TT*>(input), output, count, this->Transform);
+				});
+		}
+	}
+	void* Input;
+	int ScalarType;
+	int InputSize;
+	// NULL to write the input in place
+	float* Output;
+	vtkIdType RowValues;
+	// lookup table of the input type, or float with an output, NULL to
+	// transform each value
+	const void* Table;
+	int TableOffset;
+	IntensityTransform Transform;
+};
+
+// copy the pixels of extent, which both images contain
+void copyExtent(vtkImageData* from, vtkImageData* to, const int extent[6])
+{
+	size_t rowSize = static_cast<size_t>(extent[1] - extent[0] + 1) * from->GetScalarSize() * from->GetNumberOfScalarComponents();
+	for (int k = extent[4]; k <= extent[5]; k++)
+	{
+		for (int j = extent[2]; j <= extent[3]; j++)
+		{
+			memcpy(to->GetScalarPointer(extent[0], j, k), from->GetScalarPointer(extent[0], j, k), rowSize);
+		}
+	}
+}
+
+// boxes covering the part of extent outside of covered, at most 6
+QList<QVector<int> > uncoveredBoxes(const int extent[6], const int covered[6])
+{
+	QList<QVector<int> > boxes;
+	QVector<int> remaining(6);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (covered[2 * axis] > extent[2 * axis + 1] || covered[2 * axis + 1] < extent[2 * axis])
+		{
+			boxes.append(QVector<int>() << extent[0] << extent[1] << extent[2] << extent[3] << extent[4] << extent[5]);
+			return boxes;
+		}
+	}
+	for (int i = 0; i < 6; i++)
+	{
+		remaining[i] = extent[i];
+	}
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (remaining[2 * axis] < covered[2 * axis])
+		{
+			QVector<int> box = remaining;
+			box[2 * axis + 1] = covered[2 * axis] - 1;
+			boxes.append(box);
+			remaining[2 * axis] = covered[2 * axis];
+		}
+		if (remaining[2 * axis + 1] > covered[2 * axis + 1])
+		{
+			QVector<int> box = remaining;
+			box[2 * axis] = covered[2 * axis + 1] + 1;
+			boxes.append(box);
+			remaining[2 * axis + 1] = covered[2 * axis + 1];
+		}
+	}
+	return boxes;
+}
+
+// axis aligned box through a matrix whose 3x3 part is a scaled signed
+// permutation, as IJKToRAS: the flips only change the signs of the radius
+void transformBox(vtkMatrix4x4* matrix, const double center[3], const double radius[3],
+	double transformedCenter[3], double transformedRadius[3])
+{
+	double point[4] = { center[0], center[1], center[2], 1. };
+	double transformed[4];
+	matrix->MultiplyPoint(point, transformed);
+	for (int i = 0; i < 3; i++)
+	{
+		transformedCenter[i] = transformed[i];
+		transformedRadius[i] = 0;
+		for (int j = 0; j < 3; j++)
+		{
+			transformedRadius[i] += std::fabs(matrix->GetElement(i, j)) * radius[j];
+		}
+	}
+}
+
+// move the boxes of the clusters of m_annotationInf in the space of suffix
+// (Ijk or Ras) through matrix, clusters without box are left
+void transformAnnotationBoxes(QMap<QString, QString>& m_annotationInf, QString suffix, vtkMatrix4x4* matrix)
+{
+	QRegExp centerKey(QString("^(\\d+)-xCenter%1$").arg(suffix));
+	const char* axes[3] = { "x", "y", "z" };
+	foreach (const QString& key, m_annotationInf.keys())
+	{
+		if (!centerKey.exactMatch(key))
+		{
+			continue;
+		}
+		QString cluster = centerKey.cap(1);
+		double center[3];
+		double radius[3];
+		bool valid = true;
+		for (int i = 0; i < 3 && valid; i++)
+		{
+			bool centerValid = false;
+			bool radiusValid = false;
+			center[i] = m_annotationInf.value(QString("%1-%2Center%3").arg(cluster).arg(axes[i]).arg(suffix)).toDouble(&centerValid);
+			radius[i] = m_annotationInf.value(QString("%1-%2Radius%3").arg(cluster).arg(axes[i]).arg(suffix)).toDouble(&radiusValid);
+			valid = centerValid && radiusValid;
+		}
+		if (!valid)
+		{
+			continue;
+		}
+		double transformedCenter[3];
+		double transformedRadius[3];
+		transformBox(matrix, center, radius, transformedCenter, transformedRadius);
+		for (int i = 0; i < 3; i++)
+		{
+			QString centerValue = suffix == "Ijk" ? QString::number(qRound(transformedCenter[i]), 10) : QString::number(transformedCenter[i], 10, 4);
+			QString radiusValue = suffix == "Ijk" ? QString::number(qRound(transformedRadius[i]), 10) : QString::number(transformedRadius[i], 10, 4);
+			m_annotationInf[QString("%1-%2Center%3").arg(cluster).arg(axes[i]).arg(suffix)] = centerValue;
+			m_annotationInf[QString("%1-%2Radius%3").arg(cluster).arg(axes[i]).arg(suffix)] = radiusValue;
+		}
+	}
+}
+}
+
+//----------------------------------------------------------------------------
+struct vtkSlicerbreastImageFullResolutionVolume
+{
+	vtkSlicerbreastImageFullResolutionVolume() : Loaded(false), ContentHash(0) {}
+	vtkSmartPointer<vtkImageData> Image;
+	vtkSmartPointer<vtkMatrix4x4> IJKToRAS;
+	bool Loaded;
+	quint64 ContentHash;
+};
+
+//----------------------------------------------------------------------------
+struct vtkSlicerbreastImageEnhancementPreview
+{
+	vtkSlicerbreastImageEnhancementPreview() : SourceTime(0) {}
+	vtkWeakPointer<vtkMRMLScalarVolumeNode> Node;
+	// enhanced pixels of the volume, with the extent they have in the volume
+	vtkSmartPointer<vtkImageData> Enhanced;
+	unsigned long SourceTime;
+};
+
+//----------------------------------------------------------------------------
+struct vtkSlicerbreastImageReportWrite
+{
+	vtkSlicerbreastImageReportWrite() : Started(false), Sequence(0), Result(0) {}
+	QString FileName;
+	QString ReportDate;
+	QMap<QString, QString> DicomInformation;
+	QMap<QString, QString> PacasInformation;
+	QMap<QString, QString> AnnotationInformation;
+	// set by the task when it takes the report, later saves queue a new write
+	bool Started;
+	quint64 Sequence;
+	// vtkSlicerbreastImageLogic::ReportWriteResult
+	int Result;
+	QByteArray Content;
+	QFuture<void> Future;
+};
+
+//----------------------------------------------------------------------------
+// report of a journal written by CompactAnnotationJournal, up to Position
+struct vtkSlicerbreastImageJournalCompaction
+{
+	vtkSlicerbreastImageJournalCompaction() : Position(0), Written(false) {}
+	QString ReportFileName;
+	qint64 Position;
+	QMap<QString, QString> DicomInformation;
+	QMap<QString, QString> PacasInformation;
+	QMap<QString, QString> AnnotationInformation;
+	// set by the task, read once Future finished
+	bool Written;
+	QFuture<void> Future;
+};
+
+//----------------------------------------------------------------------------
+// writes of one report file
+struct vtkSlicerbreastImageReportFile
+{
+	vtkSlicerbreastImageReportFile() : WrittenSequence(0) {}
+	QMutex Mutex;
+	// guarded by Mutex, sequence of the last save written
+	quint64 WrittenSequence;
+};
+
+namespace
+{
+// attributes of an element sorted by name, as the order of a
+// QDomNamedNodeMap is not defined
+void appendAttributes(QByteArray& canonical, const QDomElement& element)
+{
+	QDomNamedNodeMap attributes = element.attributes();
+	QMap<QString, QString> sorted;
+	for (int i = 0; i < attributes.count(); i++)
+	{
+		QDomAttr attribute = attributes.item(i).toAttr();
+		sorted.insert(attribute.name(), attribute.value());
+	}
+	sorted.remove("reportDate");
+	sorted.remove("contentHash");
+	for (QMap<QString, QString>::const_iterator attribute = sorted.constBegin(); attribute != sorted.constEnd(); ++attribute)
+	{
+		// separated from the text by another byte
+		canonical += '\1' + attribute.key().toUtf8() + '\1' + attribute.value().toUtf8();
+	}
+}
+
+// hash of the content of a report, without its reportDate and contentHash
+// attributes: the tag and attributes of every element, and the text of the
+// elements without children
+quint64 annotationContentHash(const QDomDocument& doc)
+{
+	QDomElement root = doc.documentElement();
+	QByteArray canonical = root.tagName().toUtf8();
+	appendAttributes(canonical, root);
+	canonical += '\n';
+	QDomElement element = root.firstChildElement();
+	int depth = 1;
+	while (!element.isNull() && depth > 0)
+	{
+		canonical += QByteArray::number(depth) + '\0' + element.tagName().toUtf8();
+		appendAttributes(canonical, element);
+		QDomElement child = element.firstChildElement();
+		if (child.isNull())
+		{
+			canonical += '\0' + element.text().toUtf8();
+		}
+		canonical += '\n';
+		if (!child.isNull())
+		{
+			element = child;
+			depth++;
+			continue;
+		}
+		while (depth > 0 && element.nextSiblingElement().isNull())
+		{
+			element = element.parentNode().toElement();
+			depth--;
+		}
+		if (depth > 0)
+		{
+			element = element.nextSiblingElement();
+		}
+	}
+	return vtkSlicerbreastImageContentHash::Hash(canonical.constData(), canonical.size());
+}
+
+// compaction of an annotation journal
+QString annotationJournalReport(const QString& journalFileName)
+{
+	QFileInfo info(journalFileName);
+	return info.dir().filePath(info.completeBaseName() + ".xml");
+}
+
+// map the cached volume and touch all of its pages, while checking them
+// against the content hash of the cache
+class FullResolutionTask : public vtkSlicerbreastImageTask
+{
+public:
+	FullResolutionTask(vtkSlicerbreastImageVolumeCache* cache, const QString& key,
+		QSharedPointer<vtkSlicerbreastImageFullResolutionVolume> volume)
+		: Cache(cache), Key(key), Volume(volume) {}
+	virtual void Execute()
+	{
+		vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+		vtkSmartPointer<vtkMatrix4x4> ijkToRAS = vtkSmartPointer<vtkMatrix4x4>::New();
+		quint64 contentHash = 0;
+		if (!this->Cache->Read(this->Key, image, ijkToRAS, &contentHash) || this->IsCanceled())
+		{
+			return;
+		}
+		if (contentHash && vtkSlicerbreastImageContentHash::HashImage(image) != contentHash)
+		{
+			return;
+		}
+		this->Volume->Image = image;
+		this->Volume->IJKToRAS = ijkToRAS;
+		this->Volume->ContentHash = contentHash;
+		this->Volume->Loaded = true;
+	}
+	vtkSmartPointer<vtkSlicerbreastImageVolumeCache> Cache;
+	QString Key;
+	QSharedPointer<vtkSlicerbreastImageFullResolutionVolume> Volume;
+};
+
+}
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerbreastImageLogic);
@@ -51,11 +752,54 @@ vtkStandardNewMacro(vtkSlicerbreastImageLogic);
 //----------------------------------------------------------------------------
 vtkSlicerbreastImageLogic::vtkSlicerbreastImageLogic()
 {
+	this->ReportIndex = NULL;
+	this->ReportIndexFile = QDir::home().filePath(".breastImage/reportIndex.sqlite");
+	this->ClusterTrees[RASSpace] = NULL;
+	this->ClusterTrees[IJKSpace] = NULL;
+	this->ClusterTreesModified = false;
+	this->TaskPool = NULL;
+	this->DicomScanner = NULL;
+	this->VolumeCache = NULL;
+	this->SharedVolume = NULL;
+	this->ReportDryRun = false;
+	this->ReportWriteSequence = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		this->roiXYZIJK[i] = 0;
+		this->roiRadiusIJK[i] = 0;
+	}
 }
 
 //----------------------------------------------------------------------------
 vtkSlicerbreastImageLogic::~vtkSlicerbreastImageLogic()
 {
+	if (this->TaskPool)
+	{
+		// wait for the tasks which may use the logic
+		this->TaskPool->WaitForDone();
+	}
+	if (this->DicomScanner)
+	{
+		this->DicomScanner->Delete();
+	}
+	if (this->VolumeCache)
+	{
+		this->VolumeCache->Delete();
+	}
+	if (this->SharedVolume)
+	{
+		this->SharedVolume->Delete();
+	}
+	if (this->TaskPool)
+	{
+		this->TaskPool->Delete();
+	}
+	if (this->ReportIndex)
+	{
+		this->ReportIndex->Delete();
+	}
+	delete this->ClusterTrees[RASSpace];
+	delete this->ClusterTrees[IJKSpace];
 }
 
 //----------------------------------------------------------------------------
@@ -94,44 +838,138 @@ void vtkSlicerbreastImageLogic
 
 //---------------------------------------------------------------------------
 void vtkSlicerbreastImageLogic
-::OnMRMLSceneNodeRemoved(vtkMRMLNode* vtkNotUsed(node))
+::OnMRMLSceneNodeRemoved(vtkMRMLNode* node)
 {
+	this->removeNodeAttributeCache(node);
+	this->ContentHashTimes.remove(node);
+	this->FullResolutionVolumes.remove(node);
+	this->WindowLevelTimes.remove(node);
+	this->EnhancementPreviews.remove(node);
 }
 
 //---------------------------------------------------------------------------
 QMap< QString, QString> vtkSlicerbreastImageLogic
 ::GetNodeAttribute(vtkMRMLNode *node)
 {
+	BREASTIMAGE_TRACE_SCOPE("GetNodeAttribute");
+	QMap< QString, QString> map;
+	if (!node)
+	{
+		return map;
+	}
 	std::vector< std::string > attributeNames = node->GetAttributeNames();
 	if (attributeNames.size() == 0)
 	{
 		qDebug() << "this node do not have attributes";
-		QMessageBox::information(NULL, "Node Information", "this node do not have attributes!");
 	}
-	else
+	for (std::vector< std::string >::iterator iter = attributeNames.begin();
+		iter != attributeNames.end(); ++iter)
 	{
-		int row = 0;
-		QMap< QString, QString> map;
-		for (std::vector< std::string >::iterator iter = attributeNames.begin();
-			iter != attributeNames.end(); ++iter, ++row)
-		{
-			map.insert(QString(iter->c_str()), QString(node->GetAttribute(iter->c_str())));
-		}
-		return map;
+		map.insert(QString(iter->c_str()), QString(node->GetAttribute(iter->c_str())));
 	}
+	return map;
 }
 
 //---------------------------------------------------------------------------
-void vtkSlicerbreastImageLogic::acquireRoiLocation(vtkMRMLVolumeNode* inputVolume, vtkMRMLAnnotationROINode* inputROI)
+QString vtkSlicerbreastImageLogic::GetNodeAttributeValue(vtkMRMLNode *node, QString key)
 {
-	// make sure inputs are initialized
-	if (!inputVolume || !inputROI)
+	BREASTIMAGE_TRACE_SCOPE("GetNodeAttributeValue");
+	if (!node)
+	{
+		return QString();
+	}
+	QHash<vtkMRMLNode*, NodeAttributeCache>::iterator cache = this->NodeAttributeCaches.find(node);
+	if (cache == this->NodeAttributeCaches.end())
+	{
+		// the entry is dropped when the node is modified or removed
+		vtkNew<vtkIntArray> events;
+		events->InsertNextValue(vtkCommand::ModifiedEvent);
+		this->GetMRMLNodesObserverManager()->AddObjectEvents(node, events.GetPointer());
+		cache = this->NodeAttributeCaches.insert(node, NodeAttributeCache());
+		cache.value().MTime = node->GetMTime();
+	}
+	else if (cache.value().MTime != node->GetMTime())
+	{
+		cache.value().Values.clear();
+		cache.value().MTime = node->GetMTime();
+	}
+
+	QHash<QString, QString>::const_iterator value = cache.value().Values.constFind(key);
+	if (value != cache.value().Values.constEnd())
+	{
+		return value.value();
+	}
+	const char* attribute = node->GetAttribute(key.toLatin1().constData());
+	QString attributeValue = attribute ? QString(attribute) : QString();
+	cache.value().Values.insert(key, attributeValue);
+	return attributeValue;
+}
+
+//---------------------------------------------------------------------------
+QMap< QString, QString> vtkSlicerbreastImageLogic::GetNodeAttributeValues(vtkMRMLNode *node, QStringList keys)
+{
+	QMap< QString, QString> map;
+	foreach(QString key, keys)
+	{
+		map.insert(key, this->GetNodeAttributeValue(node, key));
+	}
+	return map;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::removeNodeAttributeCache(vtkMRMLNode* node)
+{
+	if (this->NodeAttributeCaches.remove(node) > 0)
+	{
+		this->GetMRMLNodesObserverManager()->RemoveObjectEvents(node);
+	}
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData)
+{
+	vtkMRMLNode* node = vtkMRMLNode::SafeDownCast(caller);
+	if (node && event == vtkCommand::ModifiedEvent)
+	{
+		this->removeNodeAttributeCache(node);
+		return;
+	}
+	this->Superclass::ProcessMRMLNodesEvents(caller, event, callData);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::acquireRoiLocation(vtkMRMLVolumeNode* inputVolume, vtkMRMLAnnotationROINode* inputROI)
+{
+	BREASTIMAGE_TRACE_SCOPE("acquireRoiLocation");
+	int outputWholeExtent[6];
+	if (!roiExtentIJK(inputVolume, inputROI, outputWholeExtent))
 	{
 		return;
 	}
 
-	vtkNew<vtkImageData> imageDataWorkingCopy;
-	imageDataWorkingCopy->DeepCopy(inputVolume->GetImageData());
+	//ijk
+	roiRadiusIJK[0] = ((outputWholeExtent[1] - outputWholeExtent[0]) / 2);
+	roiRadiusIJK[1] = ((outputWholeExtent[3] - outputWholeExtent[2]) / 2);
+	roiRadiusIJK[2] = ((outputWholeExtent[5] - outputWholeExtent[4]) / 2);
+	roiXYZIJK[0] = outputWholeExtent[0] + roiRadiusIJK[0];
+	roiXYZIJK[1] = outputWholeExtent[2] + roiRadiusIJK[1];
+	roiXYZIJK[2] = outputWholeExtent[4] + roiRadiusIJK[2];
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::roiExtentIJK(vtkMRMLVolumeNode* inputVolume, vtkMRMLAnnotationROINode* inputROI, int outputWholeExtent[6])
+{
+	// make sure inputs are initialized
+	if (!inputVolume || !inputROI)
+	{
+		return false;
+	}
+
+	vtkImageData* imageData = inputVolume->GetImageData();
+	if (!imageData)
+	{
+		return false;
+	}
 
 	vtkNew<vtkMatrix4x4> inputRASToIJK;
 	inputVolume->GetRASToIJKMatrix(inputRASToIJK.GetPointer());
@@ -174,7 +1012,7 @@ void vtkSlicerbreastImageLogic::acquireRoiLocation(vtkMRMLVolumeNode* inputVolum
 	double maxZ = std::max(minXYZIJK[2], maxXYZIJK[2]);
 
 	int originalImageExtents[6];
-	imageDataWorkingCopy->GetExtent(originalImageExtents);
+	imageData->GetExtent(originalImageExtents);
 
 	minX = std::max(minX, 0.);
 	maxX = std::min(maxX, static_cast<double>(originalImageExtents[1]));
@@ -183,41 +1021,147 @@ void vtkSlicerbreastImageLogic::acquireRoiLocation(vtkMRMLVolumeNode* inputVolum
 	minZ = std::max(minZ, 0.);
 	maxZ = std::min(maxZ, static_cast<double>(originalImageExtents[5]));
 
-	int outputWholeExtent[6] = {
-		static_cast<int>(minX),
-		static_cast<int>(maxX),
-		static_cast<int>(minY),
-		static_cast<int>(maxY),
-		static_cast<int>(minZ),
-		static_cast<int>(maxZ) };
+	outputWholeExtent[0] = static_cast<int>(minX);
+	outputWholeExtent[1] = static_cast<int>(maxX);
+	outputWholeExtent[2] = static_cast<int>(minY);
+	outputWholeExtent[3] = static_cast<int>(maxY);
+	outputWholeExtent[4] = static_cast<int>(minZ);
+	outputWholeExtent[5] = static_cast<int>(maxZ);
+	return true;
+}
 
-	//ijk
-	roiRadiusIJK[0] = ((outputWholeExtent[1] - outputWholeExtent[0]) / 2);
-	roiRadiusIJK[1] = ((outputWholeExtent[3] - outputWholeExtent[2]) / 2);
-	roiRadiusIJK[2] = ((outputWholeExtent[5] - outputWholeExtent[4]) / 2);
-	roiXYZIJK[0] = outputWholeExtent[0] + roiRadiusIJK[0];
-	roiXYZIJK[1] = outputWholeExtent[2] + roiRadiusIJK[1];
-	roiXYZIJK[2] = outputWholeExtent[4] + roiRadiusIJK[2];
+int vtkSlicerbreastImageLogic::writeAnnotationXML(QString dir, QString fileName, QMap<QString, QString> m_dicomInf, QMap<QString, QString> m_pacasInf, QMap<QString, QString> m_annotationInf)
+{
+	BREASTIMAGE_TRACE_SCOPE("writeAnnotationXML");
+	QDateTime current_date_time = QDateTime::currentDateTime();
+	QString current_date = current_date_time.toString("yyyyMMdd");
+	QDomDocument doc = this->createAnnotationDocument(fileName, current_date, m_dicomInf, m_pacasInf, m_annotationInf);
+
+	//output file  
+	int result = this->writeAnnotationDocument(dir, doc);
+	if (result != ReportWritten)
+		return result;
+
+	this->indexReport(dir, doc.toByteArray(4), m_dicomInf, m_pacasInf, m_annotationInf);
+	return result;
 }
 
-void vtkSlicerbreastImageLogic::writeAnnotationXML(QString dir, QString fileName, QMap<QString, QString> m_dicomInf, QMap<QString, QString> m_pacasInf, QMap<QString, QString> m_annotationInf)
+//---------------------------------------------------------------------------
+// serialize and write the latest report saved to a file
+class vtkSlicerbreastImageReportWriteTask : public vtkSlicerbreastImageTask
+{
+public:
+	vtkSlicerbreastImageReportWriteTask(vtkSlicerbreastImageLogic* logic, const QString& dir,
+		QSharedPointer<vtkSlicerbreastImageReportWrite> report)
+		: Logic(logic), Dir(dir), Report(report) {}
+	virtual void Execute()
+	{
+		BREASTIMAGE_TRACE_SCOPE("writeAnnotationXMLAsync");
+		QString fileName, reportDate;
+		QMap<QString, QString> dicomInformation, pacasInformation, annotationInformation;
+		quint64 sequence;
+		{
+			QMutexLocker locker(&this->Logic->ReportWriteMutex);
+			this->Report->Started = true;
+			// a later save of the file taken by another task is written
+			// instead of this one, whichever task reaches the file first
+			sequence = this->Report->Sequence = ++this->Logic->ReportWriteSequence;
+			fileName = this->Report->FileName;
+			reportDate = this->Report->ReportDate;
+			dicomInformation = this->Report->DicomInformation;
+			pacasInformation = this->Report->PacasInformation;
+			annotationInformation = this->Report->AnnotationInformation;
+		}
+		QDomDocument doc = vtkSlicerbreastImageLogic::createAnnotationDocument(fileName, reportDate,
+			dicomInformation, pacasInformation, annotationInformation);
+		int result = this->Logic->writeAnnotationDocument(this->Dir, doc, sequence);
+
+		QMutexLocker locker(&this->Logic->ReportWriteMutex);
+		// the index is up to date with an unchanged report
+		if (result == vtkSlicerbreastImageLogic::ReportWritten)
+		{
+			this->Report->Content = doc.toByteArray(4);
+		}
+		this->Report->Result = result;
+	}
+	vtkSlicerbreastImageLogic* Logic;
+	QString Dir;
+	QSharedPointer<vtkSlicerbreastImageReportWrite> Report;
+};
+
+//---------------------------------------------------------------------------
+// write the report of a journal compaction
+class vtkSlicerbreastImageJournalCompactionTask : public vtkSlicerbreastImageTask
+{
+public:
+	vtkSlicerbreastImageJournalCompactionTask(QSharedPointer<vtkSlicerbreastImageJournalCompaction> compaction)
+		: Compaction(compaction) {}
+	virtual void Execute()
+	{
+		BREASTIMAGE_TRACE_SCOPE("CompactAnnotationJournal");
+		QString reportFileName = this->Compaction->ReportFileName;
+		QString current_date = QDateTime::currentDateTime().toString("yyyyMMdd");
+		QDomDocument doc = vtkSlicerbreastImageLogic::createAnnotationDocument(QFileInfo(reportFileName).completeBaseName(),
+			current_date, this->Compaction->DicomInformation, this->Compaction->PacasInformation,
+			this->Compaction->AnnotationInformation);
+		this->Compaction->Written = vtkSlicerbreastImageAtomicFile::Write(reportFileName, doc.toByteArray(4));
+	}
+	QSharedPointer<vtkSlicerbreastImageJournalCompaction> Compaction;
+};
+
+//---------------------------------------------------------------------------
+QFuture<void> vtkSlicerbreastImageLogic::writeAnnotationXMLAsync(QString dir, QString fileName, QMap<QString, QString> m_dicomInf, QMap<QString, QString> m_pacasInf, QMap<QString, QString> m_annotationInf)
+{
+	QString current_date = QDateTime::currentDateTime().toString("yyyyMMdd");
+	QMutexLocker locker(&this->ReportWriteMutex);
+	QSharedPointer<vtkSlicerbreastImageReportWrite> report = this->ReportWrites.value(dir);
+	bool queued = report && !report->Started;
+	if (!queued)
+	{
+		report = QSharedPointer<vtkSlicerbreastImageReportWrite>(new vtkSlicerbreastImageReportWrite);
+		this->ReportWrites.insert(dir, report);
+	}
+	report->FileName = fileName;
+	report->ReportDate = current_date;
+	report->DicomInformation = m_dicomInf;
+	report->PacasInformation = m_pacasInf;
+	report->AnnotationInformation = m_annotationInf;
+	if (!queued)
+	{
+		locker.unlock();
+		report->Future = this->GetTaskPool()->Submit(new vtkSlicerbreastImageReportWriteTask(this, dir, report));
+	}
+	return report->Future;
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerbreastImageLogic::FinishAnnotationXMLWrite(QString dir)
+{
+	QSharedPointer<vtkSlicerbreastImageReportWrite> report = this->ReportWrites.value(dir);
+	if (!report || !report->Future.isFinished())
+	{
+		return ReportWriteFailed;
+	}
+	this->ReportWrites.remove(dir);
+	if (!report->Content.isEmpty())
+	{
+		this->indexReport(dir, report->Content, report->DicomInformation, report->PacasInformation, report->AnnotationInformation);
+	}
+	return report->Result;
+}
+
+//---------------------------------------------------------------------------
+QDomDocument vtkSlicerbreastImageLogic::createAnnotationDocument(QString fileName, QString reportDate, QMap<QString, QString> m_dicomInf, QMap<QString, QString> m_pacasInf, QMap<QString, QString> m_annotationInf)
 {
-	//file dir
-	QFile file(dir);
-	if (!file.open(QFile::WriteOnly | QFile::Truncate))
-		return;
 	QDomDocument doc;
 	QDomProcessingInstruction instruction;
 	instruction = doc.createProcessingInstruction("xml", "version=\"1.0\" encoding=\"UTF-8\"");
 	doc.appendChild(instruction);
 
-	QDateTime current_date_time = QDateTime::currentDateTime();
-	QString current_date = current_date_time.toString("yyyyMMdd");
-
 	//root node  
 	QDomElement rootNode = doc.createElement("BreastImageReport");
 	rootNode.setAttribute("reportName", fileName);
-	rootNode.setAttribute("reportDate", current_date);
+	rootNode.setAttribute("reportDate", reportDate);
 	rootNode.setAttribute("version", "1.0");
 	doc.appendChild(rootNode);
 
@@ -289,6 +1233,14 @@ void vtkSlicerbreastImageLogic::writeAnnotationXML(QString dir, QString fileName
 	dicomText = doc.createTextNode("70");
 	dicomInf.appendChild(dicomText);
 	dicomNode.appendChild(dicomInf);
+	if (m_dicomInf.contains("ContentHash"))
+	{
+		// ties the report to the exact pixel data it annotates
+		dicomInf = doc.createElement("ContentHash");
+		dicomText = doc.createTextNode(m_dicomInf.value("ContentHash"));
+		dicomInf.appendChild(dicomText);
+		dicomNode.appendChild(dicomInf);
+	}
 	rootNode.appendChild(dicomNode);
 
 	//pacas information node
@@ -392,15 +1344,115 @@ void vtkSlicerbreastImageLogic::writeAnnotationXML(QString dir, QString fileName
 	{
 		rootNode.appendChild(annotationNode);
 	}
+	// lets writers skip reports whose content did not change
+	rootNode.setAttribute("contentHash", AnnotationContentHash(doc));
+	return doc;
+}
 
-	//output file  
-	QTextStream out_stream(&file);
-	doc.save(out_stream, 4);
-	file.close();
+//---------------------------------------------------------------------------
+QString vtkSlicerbreastImageLogic::ReadAnnotationContentHash(QString fileName)
+{
+	QFile file(fileName);
+	if (!file.open(QFile::ReadOnly))
+	{
+		return QString();
+	}
+	// the hash is an attribute of the root element, the rest is not read
+	QXmlStreamReader reader(&file);
+	while (!reader.atEnd())
+	{
+		if (reader.readNext() == QXmlStreamReader::StartElement)
+		{
+			return reader.attributes().value("contentHash").toString();
+		}
+	}
+	return QString();
+}
+
+//---------------------------------------------------------------------------
+QString vtkSlicerbreastImageLogic::AnnotationContentHash(const QDomDocument& doc)
+{
+	return vtkSlicerbreastImageContentHash::ToString(annotationContentHash(doc));
+}
+
+//---------------------------------------------------------------------------
+QSharedPointer<vtkSlicerbreastImageReportFile> vtkSlicerbreastImageLogic::reportFile(const QString& fileName)
+{
+	QString path = QFileInfo(fileName).absoluteFilePath();
+	QMutexLocker fileLocker(&this->ReportFileMutex);
+	QSharedPointer<vtkSlicerbreastImageReportFile>& file = this->ReportFiles[path];
+	if (!file)
+	{
+		file = QSharedPointer<vtkSlicerbreastImageReportFile>(new vtkSlicerbreastImageReportFile);
+	}
+	return file;
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerbreastImageLogic::writeAnnotationDocument(QString fileName, const QDomDocument& doc, quint64 sequence)
+{
+	QByteArray content = doc.toByteArray(4);
+	QSharedPointer<vtkSlicerbreastImageReportFile> file = this->reportFile(fileName);
+	// only the compare and replace of this file is serialized
+	QMutexLocker locker(&file->Mutex);
+	if (sequence && sequence < file->WrittenSequence)
+	{
+		// a later save holds these changes
+		return ReportUnchanged;
+	}
+	QString contentHash = doc.documentElement().attribute("contentHash");
+	if (!contentHash.isEmpty() && ReadAnnotationContentHash(fileName) == contentHash)
+	{
+		file->WrittenSequence = std::max(file->WrittenSequence, sequence);
+		return ReportUnchanged;
+	}
+	{
+		QMutexLocker fileLocker(&this->ReportFileMutex);
+		if (this->ReportDryRun)
+		{
+			this->ChangedReports << fileName;
+			return ReportSkipped;
+		}
+	}
+	if (!vtkSlicerbreastImageAtomicFile::Write(fileName, content))
+	{
+		return ReportWriteFailed;
+	}
+	file->WrittenSequence = std::max(file->WrittenSequence, sequence);
+	return ReportWritten;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::SetReportDryRun(bool dryRun)
+{
+	QMutexLocker fileLocker(&this->ReportFileMutex);
+	this->ReportDryRun = dryRun;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::GetReportDryRun()
+{
+	QMutexLocker fileLocker(&this->ReportFileMutex);
+	return this->ReportDryRun;
+}
+
+//---------------------------------------------------------------------------
+QStringList vtkSlicerbreastImageLogic::GetChangedReports()
+{
+	QMutexLocker fileLocker(&this->ReportFileMutex);
+	return this->ChangedReports;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::ClearChangedReports()
+{
+	QMutexLocker fileLocker(&this->ReportFileMutex);
+	this->ChangedReports.clear();
 }
 
 void vtkSlicerbreastImageLogic::readAnnotationXML(QString fileName, QMap<QString, QString> &m_dicomInf, QMap<QString, QString> &m_pacasInf, QMap<QString, QString> &m_annotationInf)
 {
+	BREASTIMAGE_TRACE_SCOPE("readAnnotationXML");
 	QFile file(fileName);
 	if (!file.open(QFile::ReadOnly))
 		return;
@@ -413,10 +1465,21 @@ void vtkSlicerbreastImageLogic::readAnnotationXML(QString fileName, QMap<QString
 	}
 	file.close();
 
+	QMap<QString, QString> reportAttributes;
+	this->parseAnnotationDocument(doc, reportAttributes, m_dicomInf, m_pacasInf, m_annotationInf);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::parseAnnotationDocument(const QDomDocument& doc, QMap<QString, QString> &reportAttributes, QMap<QString, QString> &m_dicomInf, QMap<QString, QString> &m_pacasInf, QMap<QString, QString> &m_annotationInf)
+{
 	// root node
 	QDomElement root = doc.documentElement(); 
-	qDebug() << root.nodeName();
-	qDebug() << root.attributeNode("reportName").value();
+	QDomNamedNodeMap rootAttributes = root.attributes();
+	for (int i = 0; i < rootAttributes.count(); i++)
+	{
+		QDomAttr attribute = rootAttributes.item(i).toAttr();
+		reportAttributes.insert(attribute.name(), attribute.value());
+	}
 
 	QDomNode node = root.firstChild(); 
 	while (!node.isNull())
@@ -467,33 +1530,1579 @@ void vtkSlicerbreastImageLogic::readAnnotationXML(QString fileName, QMap<QString
 
 void vtkSlicerbreastImageLogic::coordinatesTransform(vtkMRMLVolumeNode* inputVolume)
 {
-	if (!inputVolume)
+	BREASTIMAGE_TRACE_SCOPE("coordinatesTransform");
+	if (!inputVolume || !inputVolume->GetImageData())
 	{
 		return;
 	}
 
-	vtkSmartPointer<vtkImageData> imageData = inputVolume->GetImageData();
-	vtkNew<vtkImageData> imageDataWorkingCopy;
-	imageDataWorkingCopy->DeepCopy(imageData);
+	// in place reversal of the rows and columns of every slice
+	const int permutation[3] = { 0, 1, 2 };
+	const bool flips[3] = { true, true, false };
+	vtkNew<vtkSlicerbreastImageReorienter> reorienter;
+	reorienter->SetTaskPool(this->GetTaskPool());
+	reorienter->Run(inputVolume->GetImageData(), permutation, flips);
 
-	int* dims = imageData->GetDimensions();
-	for (int k = 0; k < dims[2]; k++)
+	const char* orientation = inputVolume->GetAttribute("breastImage.Orientation");
+	if (orientation && strcmp(orientation, "Standard") == 0)
+	{
+		inputVolume->SetAttribute("breastImage.Orientation", "Flipped");
+	}
+	else if (orientation && strcmp(orientation, "Flipped") == 0)
+	{
+		inputVolume->SetAttribute("breastImage.Orientation", "Standard");
+	}
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::NormalizeReportInformation(QMap<QString, QString> &m_dicomInf, QMap<QString, QString> &m_pacasInf, QMap<QString, QString> &m_annotationInf)
+{
+	QMap<QString, QString> normalized;
+	for (QMap<QString, QString>::const_iterator iter = m_dicomInf.constBegin(); iter != m_dicomInf.constEnd(); ++iter)
+	{
+		QString key = iter.key();
+		if (key.startsWith("Image"))
+		{
+			key[0] = key[0].toLower();
+		}
+		normalized.insert(key, iter.value());
+	}
+	m_dicomInf = normalized;
+
+	normalized.clear();
+	for (QMap<QString, QString>::const_iterator iter = m_pacasInf.constBegin(); iter != m_pacasInf.constEnd(); ++iter)
+	{
+		QString key = iter.key();
+		if (!key.isEmpty())
+		{
+			key[0] = key[0].toLower();
+		}
+		normalized.insert(key, iter.value());
+	}
+	m_pacasInf = normalized;
+
+	// "xCenterRas-2" -> "2-xCenterRas"
+	normalized.clear();
+	QRegExp clusterKey("^([A-Za-z]+)-(\\d+)$");
+	for (QMap<QString, QString>::const_iterator iter = m_annotationInf.constBegin(); iter != m_annotationInf.constEnd(); ++iter)
 	{
-		for (int j = 0; j < dims[1]; j++)
+		QString key = iter.key();
+		if (clusterKey.exactMatch(key))
 		{
-			for (int i = 0; i < dims[0]; i++)
+			QString field = clusterKey.cap(1);
+			if (field == "zCenteIjk")
 			{
-				int a, b;
-				a = -i + dims[0]-1;
-				b = -j + dims[1]-1;
-				unsigned short* p = (unsigned short*)(imageDataWorkingCopy->GetScalarPointer(a, b, k));
-				unsigned short value = *p;
-				unsigned short* q = (unsigned short*)(imageData->GetScalarPointer(i, j, k));
-				*q = value;
+				field = "zCenterIjk";
 			}
+			key = clusterKey.cap(2) + "-" + field;
+		}
+		normalized.insert(key, iter.value());
+	}
+	m_annotationInf = normalized;
+}
+
+//---------------------------------------------------------------------------
+vtkSlicerbreastImageReportIndex* vtkSlicerbreastImageLogic::GetReportIndex()
+{
+	if (!this->ReportIndex)
+	{
+		this->ReportIndex = vtkSlicerbreastImageReportIndex::New();
+	}
+	if (!this->ReportIndex->IsOpen() && !this->ReportIndexFile.isEmpty())
+	{
+		this->ReportIndex->Open(this->ReportIndexFile);
+	}
+	return this->ReportIndex;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::SetReportIndexFile(QString fileName)
+{
+	this->ReportIndexFile = fileName;
+	if (this->ReportIndex)
+	{
+		this->ReportIndex->Close();
+	}
+	this->ClusterTreesModified = true;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::indexReport(QString fileName, const QByteArray& content, QMap<QString, QString> m_dicomInf, QMap<QString, QString> m_pacasInf, QMap<QString, QString> m_annotationInf)
+{
+	vtkSlicerbreastImageReportIndex* index = this->GetReportIndex();
+	if (!index->IsOpen())
+	{
+		return;
+	}
+	QByteArray contentHash = QCryptographicHash::hash(content, QCryptographicHash::Md5);
+	index->UpdateReport(fileName, QFileInfo(fileName).lastModified(), contentHash, m_dicomInf, m_pacasInf, m_annotationInf);
+	this->ClusterTreesModified = true;
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerbreastImageLogic::IndexReportDirectory(QString dir)
+{
+	vtkSlicerbreastImageReportIndex* index = this->GetReportIndex();
+	if (!index->IsOpen())
+	{
+		return 0;
+	}
+	int parsedReports = 0;
+	QSet<QString> indexedReports = index->GetIndexedReports(dir).toSet();
+	QDirIterator iter(dir, QStringList() << "*.xml", QDir::Files, QDirIterator::Subdirectories);
+	while (iter.hasNext())
+	{
+		QFileInfo info(iter.next());
+		QString fileName = info.absoluteFilePath();
+		indexedReports.remove(fileName);
 
+		QDateTime lastModified;
+		QByteArray contentHash;
+		bool indexed = index->GetReportStamp(fileName, lastModified, contentHash);
+		if (indexed && lastModified == info.lastModified())
+		{
+			continue;
+		}
+		QFile file(fileName);
+		if (!file.open(QFile::ReadOnly))
+		{
+			continue;
 		}
+		QByteArray content = file.readAll();
+		file.close();
+		if (indexed && contentHash == QCryptographicHash::hash(content, QCryptographicHash::Md5))
+		{
+			// touched but not modified
+			index->TouchReport(fileName, info.lastModified());
+			continue;
+		}
+
+		QMap<QString, QString> dicomInf, pacasInf, annotationInf;
+		this->readAnnotationXML(fileName, dicomInf, pacasInf, annotationInf);
+		NormalizeReportInformation(dicomInf, pacasInf, annotationInf);
+		this->indexReport(fileName, content, dicomInf, pacasInf, annotationInf);
+		parsedReports++;
+	}
+	// reports deleted since last indexing
+	foreach(QString fileName, indexedReports)
+	{
+		index->RemoveReport(fileName);
+		this->ClusterTreesModified = true;
+	}
+	return parsedReports;
+}
 
+//---------------------------------------------------------------------------
+QStringList vtkSlicerbreastImageLogic::FindReports(QMap<QString, QString> criteria)
+{
+	return this->GetReportIndex()->FindReports(criteria);
+}
+
+//---------------------------------------------------------------------------
+QString vtkSlicerbreastImageLogic::clusterTreeFile(int space) const
+{
+	return this->ReportIndexFile + (space == IJKSpace ? ".ijk.tree" : ".ras.tree");
+}
+
+//---------------------------------------------------------------------------
+vtkSlicerbreastImageClusterTree* vtkSlicerbreastImageLogic::GetClusterTree(int space)
+{
+	if (space != RASSpace && space != IJKSpace)
+	{
+		vtkErrorMacro("GetClusterTree: invalid coordinate space " << space);
+		return NULL;
+	}
+	if (!this->ClusterTrees[space] || this->ClusterTreesModified)
+	{
+		bool loaded = false;
+		if (!this->ClusterTreesModified)
+		{
+			// saved trees are valid as long as the index was not written after them
+			QFileInfo indexInfo(this->ReportIndexFile);
+			QFileInfo rasInfo(this->clusterTreeFile(RASSpace));
+			QFileInfo ijkInfo(this->clusterTreeFile(IJKSpace));
+			if (rasInfo.exists() && ijkInfo.exists()
+				&& rasInfo.lastModified() >= indexInfo.lastModified()
+				&& ijkInfo.lastModified() >= indexInfo.lastModified())
+			{
+				for (int i = RASSpace; i <= IJKSpace; i++)
+				{
+					if (!this->ClusterTrees[i])
+					{
+						this->ClusterTrees[i] = new vtkSlicerbreastImageClusterTree;
+					}
+				}
+				loaded = this->ClusterTrees[RASSpace]->Load(this->clusterTreeFile(RASSpace).toLocal8Bit().constData())
+					&& this->ClusterTrees[IJKSpace]->Load(this->clusterTreeFile(IJKSpace).toLocal8Bit().constData());
+			}
+		}
+		if (!loaded)
+		{
+			this->BuildClusterTrees();
+		}
 	}
+	return this->ClusterTrees[space];
+}
 
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::BuildClusterTrees()
+{
+	vtkSlicerbreastImageReportIndex* index = this->GetReportIndex();
+	for (int space = RASSpace; space <= IJKSpace; space++)
+	{
+		if (!this->ClusterTrees[space])
+		{
+			this->ClusterTrees[space] = new vtkSlicerbreastImageClusterTree;
+		}
+		std::vector<double> bounds;
+		std::vector<int> reportIds, clusters;
+		std::vector<std::string> reportFiles;
+		index->GetClusterBounds(space == IJKSpace, bounds, reportIds, clusters, reportFiles);
+		this->ClusterTrees[space]->Build(bounds, reportIds, clusters, reportFiles);
+		if (index->IsOpen())
+		{
+			this->ClusterTrees[space]->Save(this->clusterTreeFile(space).toLocal8Bit().constData());
+		}
+	}
+	this->ClusterTreesModified = false;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::FindOverlappingClusters(int space, double bounds[6], QStringList& reportFiles, QList<int>& clusters)
+{
+	reportFiles.clear();
+	clusters.clear();
+	vtkSlicerbreastImageClusterTree* tree = this->GetClusterTree(space);
+	if (!tree)
+	{
+		return;
+	}
+	std::vector<int> ids;
+	tree->FindOverlapping(bounds, ids);
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		reportFiles << QString::fromStdString(tree->GetReportFile(ids[i]));
+		clusters << tree->GetCluster(ids[i]);
+	}
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::FindNearestClusters(int space, double point[3], int k, QStringList& reportFiles, QList<int>& clusters)
+{
+	reportFiles.clear();
+	clusters.clear();
+	vtkSlicerbreastImageClusterTree* tree = this->GetClusterTree(space);
+	if (!tree)
+	{
+		return;
+	}
+	std::vector<int> ids;
+	tree->FindNearest(point, k, ids);
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		reportFiles << QString::fromStdString(tree->GetReportFile(ids[i]));
+		clusters << tree->GetCluster(ids[i]);
+	}
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::ConvertAnnotationXMLToBinary(QString xmlFileName, QString binaryFileName)
+{
+	QFile file(xmlFileName);
+	if (!file.open(QFile::ReadOnly))
+		return false;
+	QDomDocument doc;
+	if (!doc.setContent(&file))
+	{
+		file.close();
+		return false;
+	}
+	file.close();
+
+	QMap<QString, QString> reportAttributes, dicomInf, pacasInf, annotationInf;
+	this->parseAnnotationDocument(doc, reportAttributes, dicomInf, pacasInf, annotationInf);
+	NormalizeReportInformation(dicomInf, pacasInf, annotationInf);
+	return vtkSlicerbreastImageBinaryReport::Write(binaryFileName, reportAttributes, dicomInf, pacasInf, annotationInf);
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::ConvertAnnotationBinaryToXML(QString binaryFileName, QString xmlFileName)
+{
+	vtkSlicerbreastImageBinaryReport report;
+	if (!report.Open(binaryFileName))
+		return false;
+	QMap<QString, QString> reportAttributes, dicomInf, pacasInf, annotationInf;
+	report.ReadInformation(reportAttributes, dicomInf, pacasInf, annotationInf);
+	report.Close();
+
+	QDomDocument doc = this->createAnnotationDocument(reportAttributes.value("reportName"), reportAttributes.value("reportDate"), dicomInf, pacasInf, annotationInf);
+	return this->writeAnnotationDocument(xmlFileName, doc) != ReportWriteFailed;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::readAnnotationBinary(QString fileName, QMap<QString, QString> &m_dicomInf, QMap<QString, QString> &m_pacasInf, QMap<QString, QString> &m_annotationInf)
+{
+	vtkSlicerbreastImageBinaryReport report;
+	if (!report.Open(fileName))
+		return false;
+	QMap<QString, QString> reportAttributes;
+	report.ReadInformation(reportAttributes, m_dicomInf, m_pacasInf, m_annotationInf);
+	return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::WriteTrace(QString fileName)
+{
+	if (!vtkSlicerbreastImageTrace::IsEnabled())
+	{
+		vtkWarningMacro("WriteTrace: the module was built without breastImage_ENABLE_TRACE, the trace is empty");
+	}
+	return vtkSlicerbreastImageTrace::WriteChromeTrace(fileName);
+}
+
+//---------------------------------------------------------------------------
+vtkSlicerbreastImageTaskPool* vtkSlicerbreastImageLogic::GetTaskPool()
+{
+	if (!this->TaskPool)
+	{
+		this->TaskPool = vtkSlicerbreastImageTaskPool::New();
+	}
+	return this->TaskPool;
+}
+
+//---------------------------------------------------------------------------
+vtkSlicerbreastImageDicomScanner* vtkSlicerbreastImageLogic::GetDicomScanner()
+{
+	if (!this->DicomScanner)
+	{
+		this->DicomScanner = vtkSlicerbreastImageDicomScanner::New();
+		this->DicomScanner->SetTaskPool(this->GetTaskPool());
+	}
+	return this->DicomScanner;
+}
+
+//---------------------------------------------------------------------------
+QList< QMap<QString, QString> > vtkSlicerbreastImageLogic::ScanDicomFiles(QStringList files)
+{
+	QList< QMap<QString, QString> > headers = this->GetDicomScanner()->ScanFiles(files);
+	for (int i = 0; i < headers.size(); i++)
+	{
+		headers[i] = DicomInformationFromHeader(headers[i]);
+	}
+	return headers;
+}
+
+//---------------------------------------------------------------------------
+QList< QMap<QString, QString> > vtkSlicerbreastImageLogic::ScanDicomDirectory(QString dir)
+{
+	QList< QMap<QString, QString> > headers = this->GetDicomScanner()->ScanDirectory(dir);
+	for (int i = 0; i < headers.size(); i++)
+	{
+		headers[i] = DicomInformationFromHeader(headers[i]);
+	}
+	return headers;
+}
+
+//---------------------------------------------------------------------------
+QMap<QString, QString> vtkSlicerbreastImageLogic::DicomInformationFromHeader(QMap<QString, QString> header)
+{
+	QMap<QString, QString> m_dicomInf;
+	if (header.isEmpty())
+	{
+		return m_dicomInf;
+	}
+	m_dicomInf["PatientID"] = header.value("PatientID", "NA");
+	m_dicomInf["PatientBirthDate"] = header.value("PatientBirthDate", "NA");
+	m_dicomInf["StudyID"] = header.value("StudyID", "NA");
+	m_dicomInf["StudyDate"] = header.value("StudyDate", "NA");
+	m_dicomInf["SeriesNumber"] = header.value("SeriesNumber", "NA");
+	QString view = ViewFromHeader(header);
+	if (!view.isEmpty())
+	{
+		m_dicomInf["View"] = view;
+	}
+	// PixelSpacing is row spacing (the y step) \ column spacing (the x step).
+	// The widget fills imageRowSpaceing from the x step of the volume, keep
+	// the same convention
+	QStringList spacing = header.value("PixelSpacing").split("\\");
+	if (spacing.size() == 2)
+	{
+		m_dicomInf["imageRowSpaceing"] = QString::number(spacing[1].toDouble(), 'f', 4);
+		m_dicomInf["imageColumnSpaceing"] = QString::number(spacing[0].toDouble(), 'f', 4);
+	}
+	if (header.contains("BitsStored"))
+	{
+		m_dicomInf["PixelBits"] = header.value("BitsStored");
+	}
+	m_dicomInf["SOPInstanceUID"] = header.value("SOPInstanceUID");
+	m_dicomInf["FileName"] = header.value("FileName");
+	return m_dicomInf;
+}
+
+//---------------------------------------------------------------------------
+QString vtkSlicerbreastImageLogic::ViewFromHeader(QMap<QString, QString> header)
+{
+	QString laterality = header.value("ImageLaterality").toUpper();
+	if (laterality.isEmpty())
+	{
+		laterality = header.value("Laterality").toUpper();
+	}
+	QString viewPosition = header.value("ViewPosition").toUpper();
+	if ((laterality == "L" || laterality == "R") && (viewPosition == "CC" || viewPosition == "MLO"))
+	{
+		return laterality + "_" + viewPosition;
+	}
+	return QString();
+}
+
+//---------------------------------------------------------------------------
+QString vtkSlicerbreastImageLogic::ViewFromSeriesDescription(QString description)
+{
+	// "12: R_MLO  breast tomosynthesis image" -> "R MLO BREAST TOMOSYNTHESIS IMAGE"
+	description.remove(QRegExp("^\\s*\\d+:"));
+	description.replace('_', ' ');
+	description.replace('-', ' ');
+	QByteArray normalized = description.simplified().toUpper().toLatin1();
+	const SeriesDescriptionView* entry = std::lower_bound(seriesDescriptionViews, seriesDescriptionViewsEnd,
+		normalized.constData(), seriesDescriptionLess);
+	if (entry != seriesDescriptionViewsEnd && strcmp(entry->Description, normalized.constData()) == 0)
+	{
+		return QString(entry->View);
+	}
+	return QString();
+}
+
+//---------------------------------------------------------------------------
+QString vtkSlicerbreastImageLogic::ClassifyVolumeView(vtkMRMLVolumeNode* volume)
+{
+	BREASTIMAGE_TRACE_SCOPE("ClassifyVolumeView");
+	if (!volume)
+	{
+		return QString("NA");
+	}
+
+	QMap<QString, QString> header = this->volumeDicomHeader(volume);
+	QString view = ViewFromHeader(header);
+	if (view.isEmpty())
+	{
+		view = ViewFromSeriesDescription(header.value("SeriesDescription"));
+	}
+	if (view.isEmpty() && volume->GetName())
+	{
+		view = ViewFromSeriesDescription(volume->GetName());
+	}
+	if (view.isEmpty())
+	{
+		// not stored: the DICOM UIDs or the storage node may be set later
+		return QString("NA");
+	}
+	volume->SetAttribute("breastImage.View", view.toLatin1().constData());
+	return view;
+}
+
+//---------------------------------------------------------------------------
+QMap<QString, QString> vtkSlicerbreastImageLogic::volumeDicomHeader(vtkMRMLVolumeNode* volume)
+{
+	// header of the first instance, scanned when the series was indexed or
+	// read from the file of the volume
+	QMap<QString, QString> header;
+	QString instanceUIDs = volume->GetAttribute("DICOM.instanceUIDs");
+	if (!instanceUIDs.isEmpty())
+	{
+		header = this->GetDicomScanner()->GetHeader(instanceUIDs.section(' ', 0, 0, QString::SectionSkipEmpty));
+	}
+	vtkMRMLStorageNode* storageNode = volume->GetStorageNode();
+	if (header.isEmpty() && storageNode && storageNode->GetFileName())
+	{
+		header = this->GetDicomScanner()->ScanFiles(QStringList() << QString(storageNode->GetFileName())).value(0);
+	}
+	return header;
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerbreastImageLogic::DetectOrientation(vtkMRMLVolumeNode* volume)
+{
+	BREASTIMAGE_TRACE_SCOPE("DetectOrientation");
+	vtkImageData* imageData = volume ? volume->GetImageData() : NULL;
+	if (!imageData || !imageData->GetScalarPointer())
+	{
+		return OrientationUnknown;
+	}
+	QString view = this->GetNodeAttributeValue(volume, "breastImage.View");
+	if (view.isEmpty())
+	{
+		view = this->ClassifyVolumeView(volume);
+	}
+	if (!view.startsWith("L_") && !view.startsWith("R_"))
+	{
+		return OrientationUnknown;
+	}
+
+	int* dims = imageData->GetDimensions();
+	if (dims[0] < 4)
+	{
+		return OrientationUnknown;
+	}
+	std::vector<double> profile(dims[0], 0.);
+	void* slice = imageData->GetScalarPointer(0, 0, dims[2] / 2);
+	switch (imageData->GetScalarType())
+	{
+		vtkTemplateMacro(sumColumns(static_cast<VTK_TT*>(slice), dims[0], dims[1],
+			imageData->GetNumberOfScalarComponents(), &profile[0]));
+	}
+
+	// the chest wall side is covered by tissue on every row, the other side
+	// is mostly background
+	int band = dims[0] / 4;
+	double first = 0.;
+	double last = 0.;
+	for (int i = 0; i < band; i++)
+	{
+		first += profile[i];
+		last += profile[dims[0] - 1 - i];
+	}
+	double difference = first > last ? first - last : last - first;
+	if (difference <= 0.1 * std::max(std::abs(first), std::abs(last)))
+	{
+		return OrientationUnknown;
+	}
+	bool chestWallFirst = first > last;
+	bool right = view.startsWith("R_");
+	return chestWallFirst == right ? OrientationStandard : OrientationFlipped;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::ApplyOrientation(vtkMRMLVolumeNode* volume)
+{
+	if (!volume)
+	{
+		return false;
+	}
+	// detected once: a recorded orientation, conclusive or not, or one set
+	// by a manual flip is kept
+	if (volume->GetAttribute("breastImage.Orientation"))
+	{
+		return false;
+	}
+	// the chest wall is found from bright tissue
+	this->NormalizeVolumeIntensities(volume);
+	int orientation = this->DetectOrientation(volume);
+	bool flipped = false;
+	if (orientation == OrientationFlipped)
+	{
+		this->coordinatesTransform(volume);
+		orientation = OrientationStandard;
+		flipped = true;
+	}
+	volume->SetAttribute("breastImage.Orientation", orientation == OrientationStandard ? "Standard" : "Unknown");
+	return flipped;
+}
+
+//---------------------------------------------------------------------------
+QString vtkSlicerbreastImageLogic::GetVolumeContentHash(vtkMRMLVolumeNode* volume)
+{
+	vtkImageData* imageData = volume ? volume->GetImageData() : NULL;
+	if (!imageData)
+	{
+		return QString();
+	}
+	const char* stored = volume->GetAttribute("breastImage.ContentHash");
+	QHash<vtkMRMLNode*, unsigned long>::const_iterator time = this->ContentHashTimes.constFind(volume);
+	if (stored && time != this->ContentHashTimes.constEnd() && time.value() == imageData->GetMTime())
+	{
+		return QString(stored);
+	}
+	QString hash = vtkSlicerbreastImageContentHash::ToString(
+		vtkSlicerbreastImageContentHash::HashImage(imageData, this->GetTaskPool()));
+	volume->SetAttribute("breastImage.ContentHash", hash.toLatin1().constData());
+	this->ContentHashTimes.insert(volume, imageData->GetMTime());
+	return hash;
+}
+
+//---------------------------------------------------------------------------
+vtkSlicerbreastImageVolumeCache* vtkSlicerbreastImageLogic::GetVolumeCache()
+{
+	if (!this->VolumeCache)
+	{
+		this->VolumeCache = vtkSlicerbreastImageVolumeCache::New();
+	}
+	return this->VolumeCache;
+}
+
+//---------------------------------------------------------------------------
+QString vtkSlicerbreastImageLogic::GetVolumeCacheKey(vtkMRMLNode* node)
+{
+	if (!node)
+	{
+		return QString();
+	}
+	if (node->GetAttribute("breastImage.CacheKey"))
+	{
+		// opened from the cache
+		return QString(node->GetAttribute("breastImage.CacheKey"));
+	}
+	QString instanceUIDs = node->GetAttribute("DICOM.instanceUIDs");
+	QString key = instanceUIDs.section(' ', 0, 0, QString::SectionSkipEmpty);
+	vtkMRMLStorableNode* storable = vtkMRMLStorableNode::SafeDownCast(node);
+	vtkMRMLStorageNode* storageNode = storable ? storable->GetStorageNode() : NULL;
+	if (key.isEmpty() && storageNode && storageNode->GetFileName())
+	{
+		key = QFileInfo(storageNode->GetFileName()).absoluteFilePath();
+	}
+	return key;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::CacheVolume(vtkMRMLVolumeNode* volume)
+{
+	QString key = this->GetVolumeCacheKey(volume);
+	if (key.isEmpty() || !volume->GetImageData())
+	{
+		return false;
+	}
+	vtkNew<vtkMatrix4x4> ijkToRAS;
+	volume->GetIJKToRASMatrix(ijkToRAS.GetPointer());
+	quint64 contentHash = this->GetVolumeContentHash(volume).toULongLong(0, 16);
+	return this->GetVolumeCache()->Write(key, volume->GetImageData(), ijkToRAS.GetPointer(), contentHash);
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::LoadCachedVolume(vtkMRMLVolumeNode* volume, QString key)
+{
+	if (!volume)
+	{
+		return false;
+	}
+	vtkNew<vtkImageData> imageData;
+	vtkNew<vtkMatrix4x4> ijkToRAS;
+	quint64 contentHash = 0;
+	if (!this->GetVolumeCache()->Read(key, imageData.GetPointer(), ijkToRAS.GetPointer(), &contentHash))
+	{
+		return false;
+	}
+	volume->SetIJKToRASMatrix(ijkToRAS.GetPointer());
+	volume->SetAndObserveImageData(imageData.GetPointer());
+	if (contentHash)
+	{
+		// the pixels are those hashed when the volume was cached
+		volume->SetAttribute("breastImage.ContentHash", vtkSlicerbreastImageContentHash::ToString(contentHash).toLatin1().constData());
+		this->ContentHashTimes.insert(volume, imageData->GetMTime());
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::StreamVolumeFile(QString inputFileName, QString outputFileName, vtkSlicerbreastImageSlabFilter* filter)
+{
+	vtkNew<vtkSlicerbreastImageSlabStream> stream;
+	stream->SetTaskPool(this->GetTaskPool());
+	return stream->Run(inputFileName, outputFileName, filter);
+}
+
+//---------------------------------------------------------------------------
+vtkMRMLVolumeNode* vtkSlicerbreastImageLogic::GetCachedVolume(QString key)
+{
+	vtkMRMLScene* scene = this->GetMRMLScene();
+	if (!scene || key.isEmpty())
+	{
+		return NULL;
+	}
+	std::vector<vtkMRMLNode*> volumes;
+	scene->GetNodesByClass("vtkMRMLVolumeNode", volumes);
+	for (size_t i = 0; i < volumes.size(); i++)
+	{
+		if (this->GetNodeAttributeValue(volumes[i], "breastImage.CacheKey") == key)
+		{
+			return vtkMRMLVolumeNode::SafeDownCast(volumes[i]);
+		}
+	}
+	return NULL;
+}
+
+//---------------------------------------------------------------------------
+vtkMRMLVolumeNode* vtkSlicerbreastImageLogic::OpenCachedVolume(QString key, QString name, QFuture<void>& fullResolution)
+{
+	BREASTIMAGE_TRACE_SCOPE("OpenCachedVolume");
+	vtkMRMLScene* scene = this->GetMRMLScene();
+	vtkNew<vtkImageData> preview;
+	vtkNew<vtkMatrix4x4> ijkToRAS;
+	if (!scene || !this->GetVolumeCache()->ReadPreview(key, 4, preview.GetPointer(), ijkToRAS.GetPointer()))
+	{
+		return NULL;
+	}
+
+	vtkNew<vtkMRMLScalarVolumeDisplayNode> displayNode;
+	displayNode->SetAndObserveColorNodeID("vtkMRMLColorTableNodeGrey");
+	displayNode->SetAutoWindowLevel(1);
+	scene->AddNode(displayNode.GetPointer());
+	vtkNew<vtkMRMLScalarVolumeNode> volume;
+	volume->SetName(name.toLatin1().constData());
+	volume->SetAttribute("breastImage.CacheKey", key.toLatin1().constData());
+	// the cache holds volumes once flipped and normalized
+	volume->SetAttribute("breastImage.Orientation", "Standard");
+	volume->SetAttribute("breastImage.Intensities", "Normalized");
+	volume->SetIJKToRASMatrix(ijkToRAS.GetPointer());
+	volume->SetAndObserveImageData(preview.GetPointer());
+	volume->SetAndObserveDisplayNodeID(displayNode->GetID());
+	scene->AddNode(volume.GetPointer());
+
+	QSharedPointer<vtkSlicerbreastImageFullResolutionVolume> fullResolutionVolume(new vtkSlicerbreastImageFullResolutionVolume);
+	this->FullResolutionVolumes.insert(volume.GetPointer(), fullResolutionVolume);
+	fullResolution = this->GetTaskPool()->Submit(new FullResolutionTask(this->GetVolumeCache(), key, fullResolutionVolume),
+		vtkSlicerbreastImageTaskPool::InteractivePriority);
+	return volume.GetPointer();
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::SwapInFullResolution(vtkMRMLVolumeNode* volume)
+{
+	QHash<vtkMRMLNode*, QSharedPointer<vtkSlicerbreastImageFullResolutionVolume> >::iterator pending = this->FullResolutionVolumes.find(volume);
+	if (pending == this->FullResolutionVolumes.end() || !pending.value()->Loaded)
+	{
+		return false;
+	}
+	QSharedPointer<vtkSlicerbreastImageFullResolutionVolume> fullResolutionVolume = pending.value();
+	this->FullResolutionVolumes.erase(pending);
+
+	int wasModifying = volume->StartModify();
+	volume->SetIJKToRASMatrix(fullResolutionVolume->IJKToRAS);
+	volume->SetAndObserveImageData(fullResolutionVolume->Image);
+	if (fullResolutionVolume->ContentHash)
+	{
+		volume->SetAttribute("breastImage.ContentHash",
+			vtkSlicerbreastImageContentHash::ToString(fullResolutionVolume->ContentHash).toLatin1().constData());
+		this->ContentHashTimes.insert(volume, fullResolutionVolume->Image->GetMTime());
+	}
+	volume->EndModify(wasModifying);
+	return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::OpenAnnotationJournal(vtkMRMLVolumeNode* volume, vtkSlicerbreastImageAnnotationJournal* journal)
+{
+	QByteArray key = this->GetVolumeCacheKey(volume).toUtf8();
+	if (!journal || key.isEmpty())
+	{
+		return false;
+	}
+	QString name = vtkSlicerbreastImageContentHash::ToString(vtkSlicerbreastImageContentHash::Hash(key.constData(), key.size()));
+	QString fileName = QDir::home().filePath(QString(".breastImage/annotationJournal/%1.bij").arg(name));
+	// the report of a compaction still being written is read once written
+	QSharedPointer<vtkSlicerbreastImageJournalCompaction> compaction = this->JournalCompactions.take(fileName);
+	if (compaction)
+	{
+		compaction->Future.waitForFinished();
+	}
+	QMap<QString, QString> m_dicomInf, m_pacasInf, m_annotationInf;
+	QString reportFileName = annotationJournalReport(fileName);
+	if (QFile::exists(reportFileName))
+	{
+		this->readAnnotationXML(reportFileName, m_dicomInf, m_pacasInf, m_annotationInf);
+		vtkSlicerbreastImageLogic::NormalizeReportInformation(m_dicomInf, m_pacasInf, m_annotationInf);
+	}
+	if (!journal->Open(fileName, m_dicomInf, m_pacasInf, m_annotationInf))
+	{
+		return false;
+	}
+	if (compaction && compaction->Written)
+	{
+		journal->Discard(compaction->Position);
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::CompactAnnotationJournal(vtkSlicerbreastImageAnnotationJournal* journal)
+{
+	if (!journal || !journal->IsOpen())
+	{
+		return false;
+	}
+	QString fileName = journal->GetFileName();
+	QSharedPointer<vtkSlicerbreastImageJournalCompaction> compaction = this->JournalCompactions.value(fileName);
+	if (compaction)
+	{
+		// one compaction at a time, the records it holds are dropped once
+		// its report is written
+		if (compaction->Future.isFinished())
+		{
+			this->finishAnnotationJournalCompaction(fileName, journal);
+		}
+		return true;
+	}
+	// the maps are shared with the journal until it changes them
+	compaction = QSharedPointer<vtkSlicerbreastImageJournalCompaction>(new vtkSlicerbreastImageJournalCompaction);
+	compaction->ReportFileName = annotationJournalReport(fileName);
+	compaction->Position = journal->GetPosition();
+	compaction->DicomInformation = journal->GetDicomInformation();
+	compaction->PacasInformation = journal->GetPacasInformation();
+	compaction->AnnotationInformation = journal->GetAnnotationInformation();
+	compaction->Future = this->GetTaskPool()->Submit(new vtkSlicerbreastImageJournalCompactionTask(compaction));
+	this->JournalCompactions.insert(fileName, compaction);
+	return true;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::finishAnnotationJournalCompaction(const QString& fileName,
+	vtkSlicerbreastImageAnnotationJournal* journal)
+{
+	QSharedPointer<vtkSlicerbreastImageJournalCompaction> compaction = this->JournalCompactions.take(fileName);
+	if (!compaction)
+	{
+		return;
+	}
+	compaction->Future.waitForFinished();
+	// replaying the records over the new report would give the same report,
+	// so a crash before the discard loses nothing
+	if (compaction->Written && journal && journal->IsOpen())
+	{
+		journal->Discard(compaction->Position);
+	}
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::RemoveAnnotationJournal(vtkSlicerbreastImageAnnotationJournal* journal)
+{
+	if (!journal || !journal->IsOpen())
+	{
+		return;
+	}
+	QString fileName = journal->GetFileName();
+	// the compaction must not write the report again once it is removed
+	this->finishAnnotationJournalCompaction(fileName, NULL);
+	journal->Close();
+	QFile::remove(fileName);
+	QFile::remove(annotationJournalReport(fileName));
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::ReleaseAnnotationJournal(vtkSlicerbreastImageAnnotationJournal* journal, qint64 position,
+	QMap<QString, QString> m_dicomInf, QMap<QString, QString> m_pacasInf, QMap<QString, QString> m_annotationInf)
+{
+	if (!journal || !journal->IsOpen())
+	{
+		return false;
+	}
+	// the report of a compaction and the exported one are written in order
+	this->finishAnnotationJournalCompaction(journal->GetFileName(), journal);
+	if (journal->GetPosition() <= position)
+	{
+		this->RemoveAnnotationJournal(journal);
+		return true;
+	}
+	if (journal->GetFirstRecord() > position)
+	{
+		return true;
+	}
+	// replaying all the records over the exported report gives the same
+	// report as replaying the later ones, so a crash before the discard
+	// loses nothing
+	QString reportFileName = annotationJournalReport(journal->GetFileName());
+	QString current_date = QDateTime::currentDateTime().toString("yyyyMMdd");
+	QDomDocument doc = this->createAnnotationDocument(QFileInfo(reportFileName).completeBaseName(), current_date,
+		m_dicomInf, m_pacasInf, m_annotationInf);
+	if (!vtkSlicerbreastImageAtomicFile::Write(reportFileName, doc.toByteArray(4)))
+	{
+		return false;
+	}
+	return journal->Discard(position);
+}
+
+//---------------------------------------------------------------------------
+vtkSlicerbreastImageSharedVolume* vtkSlicerbreastImageLogic::GetSharedVolume()
+{
+	if (!this->SharedVolume)
+	{
+		this->SharedVolume = vtkSlicerbreastImageSharedVolume::New();
+	}
+	return this->SharedVolume;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::PublishSharedVolume(vtkMRMLVolumeNode* volume, QMap<QString, QString> m_annotationInf)
+{
+	if (!volume || !volume->GetImageData())
+	{
+		return false;
+	}
+	QVector<vtkSlicerbreastImageSharedVolume::Cluster> clusters;
+	int clusterNumber = m_annotationInf.value("clusterNumber").toInt();
+	const char* ijkKeys[6] = { "xCenterIjk", "yCenterIjk", "zCenterIjk", "xRadiusIjk", "yRadiusIjk", "zRadiusIjk" };
+	for (int i = 1; i <= clusterNumber; i++)
+	{
+		vtkSlicerbreastImageSharedVolume::Cluster cluster;
+		cluster.Number = i;
+		bool placed = true;
+		for (int j = 0; j < 6; j++)
+		{
+			bool ok = false;
+			int value = m_annotationInf.value(QString("%1-%2").arg(i).arg(ijkKeys[j])).toInt(&ok);
+			placed = placed && ok;
+			if (j < 3)
+			{
+				cluster.CenterIJK[j] = value;
+			}
+			else
+			{
+				cluster.RadiusIJK[j - 3] = value;
+			}
+		}
+		// clusters without an ROI yet are "NA"
+		if (placed)
+		{
+			clusters.append(cluster);
+		}
+	}
+	vtkNew<vtkMatrix4x4> ijkToRAS;
+	volume->GetIJKToRASMatrix(ijkToRAS.GetPointer());
+	quint64 contentHash = this->GetVolumeContentHash(volume).toULongLong(0, 16);
+	return this->GetSharedVolume()->Publish(volume->GetImageData(), ijkToRAS.GetPointer(), clusters, contentHash);
+}
+
+//---------------------------------------------------------------------------
+vtkMRMLAnnotationROINode* vtkSlicerbreastImageLogic::AddROIFromIJK(vtkMRMLVolumeNode* volume, const int centerIJK[3], const int radiusIJK[3], QString name)
+{
+	if (!volume || !this->GetMRMLScene())
+	{
+		return NULL;
+	}
+	vtkNew<vtkMatrix4x4> ijkToRAS;
+	volume->GetIJKToRASMatrix(ijkToRAS.GetPointer());
+	double center[3] = { double(centerIJK[0]), double(centerIJK[1]), double(centerIJK[2]) };
+	double radius[3] = { double(radiusIJK[0]), double(radiusIJK[1]), double(radiusIJK[2]) };
+	double centerRAS[3];
+	double radiusRAS[3];
+	transformBox(ijkToRAS.GetPointer(), center, radius, centerRAS, radiusRAS);
+	vtkNew<vtkMRMLAnnotationROINode> roiNode;
+	roiNode->SetName(name.toLatin1().constData());
+	this->GetMRMLScene()->AddNode(roiNode.GetPointer());
+	roiNode->SetXYZ(centerRAS);
+	roiNode->SetRadiusXYZ(radiusRAS);
+	return roiNode.GetPointer();
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::FilterImage(vtkImageData* input, vtkImageData* output, vtkSlicerbreastImageTileKernel* kernel, const int extent[6])
+{
+	vtkNew<vtkSlicerbreastImageTiler> tiler;
+	tiler->SetTaskPool(this->GetTaskPool());
+	return tiler->Run(input, output, kernel, extent);
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::ReorientVolume(vtkMRMLVolumeNode* volume, const int permutation[3], const bool flips[3],
+	QMap<QString, QString>* m_annotationInf, vtkMRMLAnnotationROINode* roi)
+{
+	BREASTIMAGE_TRACE_SCOPE("ReorientVolume");
+	if (!volume || !volume->GetImageData() || !vtkSlicerbreastImageReorienter::IsPermutation(permutation))
+	{
+		return false;
+	}
+	vtkImageData* imageData = volume->GetImageData();
+	int dims[3];
+	imageData->GetDimensions(dims);
+	vtkNew<vtkMatrix4x4> reorientedToIJK;
+	vtkSlicerbreastImageReorienter::GetOutputToInputMatrix(permutation, flips, dims, reorientedToIJK.GetPointer());
+	vtkNew<vtkMatrix4x4> ijkToReoriented;
+	vtkMatrix4x4::Invert(reorientedToIJK.GetPointer(), ijkToReoriented.GetPointer());
+	vtkNew<vtkMatrix4x4> rasToIJK;
+	volume->GetRASToIJKMatrix(rasToIJK.GetPointer());
+
+	vtkNew<vtkSlicerbreastImageReorienter> reorienter;
+	reorienter->SetTaskPool(this->GetTaskPool());
+	if (!reorienter->Run(imageData, permutation, flips))
+	{
+		return false;
+	}
+
+	int wasModifying = volume->StartModify();
+	// origin and directions are kept, so the image turns in the views
+	double spacing[3];
+	double reorientedSpacing[3];
+	volume->GetSpacing(spacing);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		reorientedSpacing[axis] = spacing[permutation[axis]];
+	}
+	volume->SetSpacing(reorientedSpacing);
+	// a half turn in the slices keeps the chest wall on a side, another
+	// orientation has to be detected again
+	const char* orientation = volume->GetAttribute("breastImage.Orientation");
+	bool identity = permutation[0] == 0 && permutation[1] == 1;
+	if (orientation && !(identity && !flips[0] && !flips[1]))
+	{
+		QString reoriented = "Unknown";
+		if (identity && flips[0] && flips[1] && strcmp(orientation, "Unknown") != 0)
+		{
+			reoriented = strcmp(orientation, "Standard") == 0 ? "Flipped" : "Standard";
+		}
+		volume->SetAttribute("breastImage.Orientation", reoriented.toLatin1().constData());
+	}
+	volume->Modified();
+	volume->EndModify(wasModifying);
+
+	// RAS point of a voxel before to the one of the voxel after
+	vtkNew<vtkMatrix4x4> reorientedIJKToRAS;
+	volume->GetIJKToRASMatrix(reorientedIJKToRAS.GetPointer());
+	vtkNew<vtkMatrix4x4> rasToReorientedIJK;
+	vtkMatrix4x4::Multiply4x4(ijkToReoriented.GetPointer(), rasToIJK.GetPointer(), rasToReorientedIJK.GetPointer());
+	vtkNew<vtkMatrix4x4> rasToReoriented;
+	vtkMatrix4x4::Multiply4x4(reorientedIJKToRAS.GetPointer(), rasToReorientedIJK.GetPointer(), rasToReoriented.GetPointer());
+
+	double center[3] = { double(this->roiXYZIJK[0]), double(this->roiXYZIJK[1]), double(this->roiXYZIJK[2]) };
+	double radius[3] = { double(this->roiRadiusIJK[0]), double(this->roiRadiusIJK[1]), double(this->roiRadiusIJK[2]) };
+	double reorientedCenter[3];
+	double reorientedRadius[3];
+	transformBox(ijkToReoriented.GetPointer(), center, radius, reorientedCenter, reorientedRadius);
+	for (int i = 0; i < 3; i++)
+	{
+		this->roiXYZIJK[i] = qRound(reorientedCenter[i]);
+		this->roiRadiusIJK[i] = qRound(reorientedRadius[i]);
+	}
+	if (m_annotationInf)
+	{
+		transformAnnotationBoxes(*m_annotationInf, "Ijk", ijkToReoriented.GetPointer());
+		transformAnnotationBoxes(*m_annotationInf, "Ras", rasToReoriented.GetPointer());
+	}
+	if (roi)
+	{
+		roi->GetXYZ(center);
+		roi->GetRadiusXYZ(radius);
+		transformBox(rasToReoriented.GetPointer(), center, radius, reorientedCenter, reorientedRadius);
+		int roiModifying = roi->StartModify();
+		roi->SetXYZ(reorientedCenter);
+		roi->SetRadiusXYZ(reorientedRadius);
+		roi->EndModify(roiModifying);
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------
+vtkMRMLVolumeNode* vtkSlicerbreastImageLogic::FindContralateralVolume(vtkMRMLVolumeNode* volume)
+{
+	vtkMRMLScene* scene = this->GetMRMLScene();
+	if (!scene || !volume)
+	{
+		return NULL;
+	}
+	QString view = this->GetNodeAttributeValue(volume, "breastImage.View");
+	if (view.isEmpty())
+	{
+		view = this->ClassifyVolumeView(volume);
+	}
+	QString contralateralView;
+	if (view.startsWith("L_"))
+	{
+		contralateralView = "R_" + view.mid(2);
+	}
+	else if (view.startsWith("R_"))
+	{
+		contralateralView = "L_" + view.mid(2);
+	}
+	else
+	{
+		return NULL;
+	}
+	std::vector<vtkMRMLNode*> volumes;
+	scene->GetNodesByClass("vtkMRMLVolumeNode", volumes);
+	for (size_t i = 0; i < volumes.size(); i++)
+	{
+		vtkMRMLVolumeNode* candidate = vtkMRMLVolumeNode::SafeDownCast(volumes[i]);
+		if (candidate == volume || !candidate->GetImageData()
+			|| !this->GetNodeAttributeValue(candidate, "breastImage.AsymmetryOf").isEmpty())
+		{
+			continue;
+		}
+		QString candidateView = this->GetNodeAttributeValue(candidate, "breastImage.View");
+		if (candidateView.isEmpty())
+		{
+			candidateView = this->ClassifyVolumeView(candidate);
+		}
+		if (candidateView == contralateralView)
+		{
+			return candidate;
+		}
+	}
+	return NULL;
+}
+
+//---------------------------------------------------------------------------
+vtkMRMLScalarVolumeNode* vtkSlicerbreastImageLogic::ComputeAsymmetryMap(vtkMRMLVolumeNode* volume, vtkMRMLVolumeNode* contralateral, int smoothingRadius)
+{
+	BREASTIMAGE_TRACE_SCOPE("ComputeAsymmetryMap");
+	vtkMRMLScene* scene = this->GetMRMLScene();
+	if (!scene || !volume || !contralateral || !volume->GetImageData() || !contralateral->GetImageData()
+		|| !volume->GetImageData()->GetScalarPointer() || !contralateral->GetImageData()->GetScalarPointer())
+	{
+		return NULL;
+	}
+	// in the standard orientation the chest walls of both sides are on
+	// opposite columns, so mirroring the columns puts them on the same one
+	this->ApplyOrientation(volume);
+	this->ApplyOrientation(contralateral);
+	vtkImageData* image = volume->GetImageData();
+	vtkImageData* other = contralateral->GetImageData();
+	BreastExtent extent;
+	BreastExtent otherExtent;
+	if (!measureVolumeBreast(image, extent) || !measureVolumeBreast(other, otherExtent))
+	{
+		vtkWarningMacro("ComputeAsymmetryMap: no breast found in " << volume->GetName() << " or " << contralateral->GetName());
+		return NULL;
+	}
+
+	int* dims = image->GetDimensions();
+	int* otherDims = other->GetDimensions();
+	AsymmetryFunctor functor;
+	functor.Image = image;
+	functor.Other = other;
+	functor.Columns = dims[0];
+	functor.Rows = dims[1];
+	functor.Gain = static_cast<float>(1. / extent.Mean);
+	functor.OtherGain = static_cast<float>(1. / otherExtent.Mean);
+	// coarse alignment: mirrored columns, breast centers matched and extents
+	// scaled to each other, nearest pixel
+	double scale[2] = { otherExtent.Size[0] / extent.Size[0], otherExtent.Size[1] / extent.Size[1] };
+	functor.ColumnMap.resize(dims[0]);
+	for (int i = 0; i < dims[0]; i++)
+	{
+		int column = static_cast<int>(std::floor(otherExtent.Center[0] - (i - extent.Center[0]) * scale[0] + 0.5));
+		functor.ColumnMap[i] = column >= 0 && column < otherDims[0] ? column : -1;
+	}
+	functor.RowMap.resize(dims[1]);
+	for (int j = 0; j < dims[1]; j++)
+	{
+		int row = static_cast<int>(std::floor(otherExtent.Center[1] + (j - extent.Center[1]) * scale[1] + 0.5));
+		functor.RowMap[j] = row >= 0 && row < otherDims[1] ? row : -1;
+	}
+	functor.SliceMap.resize(dims[2]);
+	for (int k = 0; k < dims[2]; k++)
+	{
+		functor.SliceMap[k] = dims[2] > 1 ? static_cast<int>(std::floor(k * (otherDims[2] - 1.) / (dims[2] - 1.) + 0.5)) : otherDims[2] / 2;
+	}
+
+	vtkNew<vtkFloatArray> scalars;
+	scalars->SetNumberOfTuples(static_cast<vtkIdType>(dims[0]) * dims[1] * dims[2]);
+	functor.Map = scalars->GetPointer(0);
+	this->GetTaskPool()->ParallelFor(0, dims[2], 1, functor);
+	vtkNew<vtkImageData> map;
+	map->SetDimensions(dims);
+	map->SetOrigin(0., 0., 0.);
+	map->SetSpacing(1., 1., 1.);
+	map->GetPointData()->SetScalars(scalars.GetPointer());
+	if (smoothingRadius > 0)
+	{
+		vtkNew<vtkImageData> smoothed;
+		vtkSlicerbreastImageTileBoxMeanKernel kernel(smoothingRadius);
+		if (!this->FilterImage(map.GetPointer(), smoothed.GetPointer(), &kernel))
+		{
+			return NULL;
+		}
+		map->ShallowCopy(smoothed.GetPointer());
+	}
+
+	// computing the map again replaces the previous one
+	vtkMRMLScalarVolumeNode* mapNode = NULL;
+	std::vector<vtkMRMLNode*> volumes;
+	scene->GetNodesByClass("vtkMRMLScalarVolumeNode", volumes);
+	for (size_t i = 0; i < volumes.size() && !mapNode; i++)
+	{
+		const char* asymmetryOf = volumes[i]->GetAttribute("breastImage.AsymmetryOf");
+		if (asymmetryOf && volume->GetID() && strcmp(asymmetryOf, volume->GetID()) == 0)
+		{
+			mapNode = vtkMRMLScalarVolumeNode::SafeDownCast(volumes[i]);
+		}
+	}
+	vtkNew<vtkMatrix4x4> ijkToRAS;
+	volume->GetIJKToRASMatrix(ijkToRAS.GetPointer());
+	if (mapNode)
+	{
+		mapNode->SetIJKToRASMatrix(ijkToRAS.GetPointer());
+		mapNode->SetAndObserveImageData(map.GetPointer());
+		return mapNode;
+	}
+	vtkNew<vtkMRMLScalarVolumeDisplayNode> displayNode;
+	displayNode->SetAndObserveColorNodeID("vtkMRMLColorTableNodeRainbow");
+	displayNode->SetAutoWindowLevel(1);
+	scene->AddNode(displayNode.GetPointer());
+	vtkNew<vtkMRMLScalarVolumeNode> newMapNode;
+	QString name = QString("%1_Asymmetry").arg(volume->GetName());
+	newMapNode->SetName(name.toLatin1().constData());
+	newMapNode->SetAttribute("breastImage.AsymmetryOf", volume->GetID());
+	// geometry of volume, never classified or flipped on its own
+	if (volume->GetAttribute("breastImage.View"))
+	{
+		newMapNode->SetAttribute("breastImage.View", volume->GetAttribute("breastImage.View"));
+	}
+	newMapNode->SetAttribute("breastImage.Orientation", "Standard");
+	newMapNode->SetIJKToRASMatrix(ijkToRAS.GetPointer());
+	newMapNode->SetAndObserveImageData(map.GetPointer());
+	newMapNode->SetAndObserveDisplayNodeID(displayNode->GetID());
+	scene->AddNode(newMapNode.GetPointer());
+	return newMapNode.GetPointer();
+}
+
+//---------------------------------------------------------------------------
+vtkMRMLScalarVolumeNode* vtkSlicerbreastImageLogic::UpdateEnhancementPreview(vtkMRMLVolumeNode* volume, vtkMRMLAnnotationROINode* roi, int margin)
+{
+	BREASTIMAGE_TRACE_SCOPE("UpdateEnhancementPreview");
+	vtkMRMLScene* scene = this->GetMRMLScene();
+	int extent[6];
+	if (!scene || !volume || !volume->GetImageData() || !volume->GetImageData()->GetScalarPointer()
+		|| !this->roiExtentIJK(volume, roi, extent))
+	{
+		return NULL;
+	}
+	vtkImageData* imageData = volume->GetImageData();
+	int wholeExtent[6];
+	imageData->GetExtent(wholeExtent);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		// the enhancement is done in slices, the margin is around them
+		int axisMargin = axis < 2 ? std::max(margin, 0) : 0;
+		extent[2 * axis] = std::max(extent[2 * axis] - axisMargin, wholeExtent[2 * axis]);
+		extent[2 * axis + 1] = std::min(extent[2 * axis + 1] + axisMargin, wholeExtent[2 * axis + 1]);
+		if (extent[2 * axis] > extent[2 * axis + 1])
+		{
+			// ROI outside of the volume
+			return NULL;
+		}
+	}
+
+	QSharedPointer<vtkSlicerbreastImageEnhancementPreview>& preview = this->EnhancementPreviews[volume];
+	if (!preview)
+	{
+		preview = QSharedPointer<vtkSlicerbreastImageEnhancementPreview>(new vtkSlicerbreastImageEnhancementPreview);
+	}
+	// the pixels already enhanced are kept while the volume is not modified,
+	// so moving the ROI only enhances the strips it uncovers
+	vtkSmartPointer<vtkImageData> previous = preview->Enhanced;
+	if (previous && preview->SourceTime != imageData->GetMTime())
+	{
+		previous = NULL;
+	}
+	vtkSmartPointer<vtkImageData> enhanced = vtkSmartPointer<vtkImageData>::New();
+	enhanced->SetExtent(extent);
+	enhanced->SetOrigin(imageData->GetOrigin());
+	enhanced->SetSpacing(imageData->GetSpacing());
+	vtkDataArray* scalars = imageData->GetPointData()->GetScalars()->NewInstance();
+	scalars->SetNumberOfComponents(imageData->GetNumberOfScalarComponents());
+	scalars->SetNumberOfTuples(enhanced->GetNumberOfPoints());
+	enhanced->GetPointData()->SetScalars(scalars);
+	scalars->Delete();
+
+	QList<QVector<int> > boxes;
+	if (previous)
+	{
+		int previousExtent[6];
+		previous->GetExtent(previousExtent);
+		int overlap[6];
+		bool overlaps = true;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			overlap[2 * axis] = std::max(extent[2 * axis], previousExtent[2 * axis]);
+			overlap[2 * axis + 1] = std::min(extent[2 * axis + 1], previousExtent[2 * axis + 1]);
+			overlaps = overlaps && overlap[2 * axis] <= overlap[2 * axis + 1];
+		}
+		if (overlaps)
+		{
+			copyExtent(previous, enhanced, overlap);
+		}
+		boxes = uncoveredBoxes(extent, previousExtent);
+	}
+	else
+	{
+		boxes.append(QVector<int>() << extent[0] << extent[1] << extent[2] << extent[3] << extent[4] << extent[5]);
+	}
+	vtkSlicerbreastImageTileUnsharpMaskKernel kernel(8, 1.5);
+	foreach (const QVector<int>& box, boxes)
+	{
+		if (!this->FilterImage(imageData, enhanced, &kernel, box.constData()))
+		{
+			return NULL;
+		}
+	}
+	preview->Enhanced = enhanced;
+	preview->SourceTime = imageData->GetMTime();
+
+	// the node shows the pixels from its own origin, placed at the box in RAS
+	vtkNew<vtkImageData> shown;
+	shown->ShallowCopy(enhanced);
+	shown->SetExtent(0, extent[1] - extent[0], 0, extent[3] - extent[2], 0, extent[5] - extent[4]);
+	vtkNew<vtkMatrix4x4> ijkToRAS;
+	volume->GetIJKToRASMatrix(ijkToRAS.GetPointer());
+	double boxOrigin[4] = { double(extent[0]), double(extent[2]), double(extent[4]), 1. };
+	double boxOriginRAS[4];
+	ijkToRAS->MultiplyPoint(boxOrigin, boxOriginRAS);
+	for (int i = 0; i < 3; i++)
+	{
+		ijkToRAS->SetElement(i, 3, boxOriginRAS[i]);
+	}
+	vtkMRMLScalarVolumeNode* previewNode = preview->Node;
+	if (!previewNode || !scene->IsNodePresent(previewNode))
+	{
+		vtkNew<vtkMRMLScalarVolumeDisplayNode> displayNode;
+		displayNode->SetAndObserveColorNodeID("vtkMRMLColorTableNodeGrey");
+		displayNode->SetAutoWindowLevel(1);
+		scene->AddNode(displayNode.GetPointer());
+		vtkNew<vtkMRMLScalarVolumeNode> newPreviewNode;
+		QString name = QString("%1_Enhanced").arg(volume->GetName());
+		newPreviewNode->SetName(name.toLatin1().constData());
+		newPreviewNode->SetAttribute("breastImage.EnhancementOf", volume->GetID());
+		// geometry of volume, never classified or flipped on its own
+		if (volume->GetAttribute("breastImage.View"))
+		{
+			newPreviewNode->SetAttribute("breastImage.View", volume->GetAttribute("breastImage.View"));
+		}
+		newPreviewNode->SetAttribute("breastImage.Orientation", "Standard");
+		newPreviewNode->SetAndObserveDisplayNodeID(displayNode->GetID());
+		newPreviewNode->SetIJKToRASMatrix(ijkToRAS.GetPointer());
+		newPreviewNode->SetAndObserveImageData(shown.GetPointer());
+		scene->AddNode(newPreviewNode.GetPointer());
+		preview->Node = newPreviewNode.GetPointer();
+		return newPreviewNode.GetPointer();
+	}
+	int wasModifying = previewNode->StartModify();
+	previewNode->SetIJKToRASMatrix(ijkToRAS.GetPointer());
+	previewNode->SetAndObserveImageData(shown.GetPointer());
+	previewNode->EndModify(wasModifying);
+	return previewNode;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerbreastImageLogic::RemoveEnhancementPreview(vtkMRMLVolumeNode* volume)
+{
+	QSharedPointer<vtkSlicerbreastImageEnhancementPreview> preview = this->EnhancementPreviews.take(volume);
+	if (preview && preview->Node && this->GetMRMLScene())
+	{
+		this->GetMRMLScene()->RemoveNode(preview->Node);
+	}
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::GetAutoWindowLevel(vtkMRMLVolumeNode* volume, int preset, double& window, double& level)
+{
+	vtkImageData* imageData = volume ? volume->GetImageData() : NULL;
+	if (!imageData || !imageData->GetScalarPointer() || preset < DenseWindowLevel || preset > FattyWindowLevel)
+	{
+		return false;
+	}
+	const char* presetAttributes[2] = { "breastImage.WindowLevel.Dense", "breastImage.WindowLevel.Fatty" };
+	QHash<vtkMRMLNode*, unsigned long>::const_iterator time = this->WindowLevelTimes.constFind(volume);
+	if (time == this->WindowLevelTimes.constEnd() || time.value() != imageData->GetMTime()
+		|| !volume->GetAttribute(presetAttributes[preset]))
+	{
+		BREASTIMAGE_TRACE_SCOPE("AutoWindowLevelHistogram");
+		HistogramFunctor functor;
+		double range[2];
+		if (!breastThreshold(imageData, range, functor.Threshold))
+		{
+			return false;
+		}
+		// a bin per value for the 12 to 16 bit integers of mammograms
+		functor.Minimum = range[0];
+		bool valuePerBin = imageData->GetScalarType() != VTK_FLOAT && imageData->GetScalarType() != VTK_DOUBLE
+			&& range[1] - range[0] < 65536;
+		functor.Bins = valuePerBin ? static_cast<int>(range[1] - range[0]) + 1 : 4096;
+		functor.BinScale = valuePerBin || range[1] <= range[0] ? 1. : functor.Bins / (range[1] - range[0]);
+		functor.Histogram.assign(functor.Bins, 0);
+		int* dims = imageData->GetDimensions();
+		functor.Image = imageData;
+		functor.RowValues = static_cast<vtkIdType>(dims[0]) * imageData->GetNumberOfScalarComponents();
+		// split by rows, a mammogram is a single slice. Chunks of at least
+		// about as many values as bins keep the per-chunk histograms cheap
+		vtkIdType rowGrain = std::max(static_cast<vtkIdType>(functor.Bins) / std::max(functor.RowValues, static_cast<vtkIdType>(1)),
+			static_cast<vtkIdType>(1));
+		this->GetTaskPool()->ParallelFor(0, static_cast<vtkIdType>(dims[1]) * dims[2], rowGrain, functor);
+
+		// percentiles of the breast, robust to the few saturated pixels
+		const double fractions[5] = { 0.01, 0.25, 0.5, 0.75, 0.995 };
+		double percentiles[5];
+		quint64 count = 0;
+		for (int bin = 0; bin < functor.Bins; bin++)
+		{
+			count += functor.Histogram[bin];
+		}
+		if (count == 0)
+		{
+			return false;
+		}
+		quint64 cumulated = 0;
+		int bin = 0;
+		for (int p = 0; p < 5; p++)
+		{
+			quint64 rank = static_cast<quint64>(fractions[p] * (count - 1));
+			while (bin < functor.Bins - 1 && cumulated + functor.Histogram[bin] <= rank)
+			{
+				cumulated += functor.Histogram[bin];
+				bin++;
+			}
+			percentiles[p] = functor.Minimum + (valuePerBin ? bin : bin + 0.5) / functor.BinScale;
+		}
+		// dense tissue is bright: the upper half of the breast values gets
+		// the display range. Fatty tissue spreads over the lower values.
+		double ranges[2][2] = { { percentiles[2], percentiles[4] }, { percentiles[0], percentiles[3] } };
+		for (int p = 0; p < 2; p++)
+		{
+			double presetWindow = std::max(ranges[p][1] - ranges[p][0], 1.);
+			double presetLevel = 0.5 * (ranges[p][0] + ranges[p][1]);
+			QString value = QString("%1 %2").arg(presetWindow, 0, 'g', 10).arg(presetLevel, 0, 'g', 10);
+			volume->SetAttribute(presetAttributes[p], value.toLatin1().constData());
+		}
+		this->WindowLevelTimes.insert(volume, imageData->GetMTime());
+	}
+	QStringList values = QString(volume->GetAttribute(presetAttributes[preset])).split(' ');
+	window = values.value(0).toDouble();
+	level = values.value(1).toDouble();
+	return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::ApplyAutoWindowLevel(vtkMRMLVolumeNode* volume, int preset)
+{
+	vtkMRMLScalarVolumeDisplayNode* displayNode = volume ? vtkMRMLScalarVolumeDisplayNode::SafeDownCast(volume->GetDisplayNode()) : NULL;
+	double window;
+	double level;
+	if (!displayNode || !this->GetAutoWindowLevel(volume, preset, window, level))
+	{
+		return false;
+	}
+	int wasModifying = displayNode->StartModify();
+	displayNode->SetAutoWindowLevel(0);
+	displayNode->SetWindowLevel(window, level);
+	displayNode->EndModify(wasModifying);
+	return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerbreastImageLogic::NormalizeVolumeIntensities(vtkMRMLVolumeNode* volume, bool applyRescale, bool inPlace)
+{
+	vtkImageData* imageData = volume ? volume->GetImageData() : NULL;
+	if (!imageData || !imageData->GetPointData()->GetScalars() || volume->GetAttribute("breastImage.Intensities"))
+	{
+		return false;
+	}
+	BREASTIMAGE_TRACE_SCOPE("NormalizeVolumeIntensities");
+	QMap<QString, QString> header = this->volumeDicomHeader(volume);
+	IntensityTransform transform;
+	transform.Slope = header.value("RescaleSlope", "1").toDouble();
+	transform.Intercept = header.value("RescaleIntercept", "0").toDouble();
+	if (transform.Slope == 0.)
+	{
+		transform.Slope = 1.;
+	}
+	transform.Rescale = applyRescale && (transform.Slope != 1. || transform.Intercept != 0.);
+	QVector<quint16> lut;
+	int descriptor[3];
+	transform.LUT = NULL;
+	if (header.contains("VOILUTDescriptor")
+		&& vtkSlicerbreastImageDicomScanner::ReadVOILUT(header.value("FileName"), descriptor, lut))
+	{
+		transform.LUT = lut.constData();
+		transform.LUTSize = descriptor[0];
+		transform.LUTFirst = descriptor[1];
+	}
+	transform.Invert = header.value("PhotometricInterpretation") == "MONOCHROME1";
+	transform.InvertSum = 0.;
+	if (transform.Invert)
+	{
+		// mirror the values in the range they can take
+		double range[2];
+		if (transform.LUT)
+		{
+			range[0] = *std::min_element(lut.constBegin(), lut.constEnd());
+			range[1] = *std::max_element(lut.constBegin(), lut.constEnd());
+		}
+		else if (header.contains("BitsStored"))
+		{
+			int bits = header.value("BitsStored").toInt();
+			bool isSigned = header.value("PixelRepresentation").toInt() == 1;
+			range[0] = isSigned ? -std::ldexp(1., bits - 1) : 0.;
+			range[1] = isSigned ? std::ldexp(1., bits - 1) - 1. : std::ldexp(1., bits) - 1.;
+			// Slicer's DICOM readers store the values rescaled
+			range[0] = range[0] * transform.Slope + transform.Intercept;
+			range[1] = range[1] * transform.Slope + transform.Intercept;
+		}
+		else
+		{
+			imageData->GetPointData()->GetScalars()->GetRange(range, 0);
+		}
+		transform.InvertSum = range[0] + range[1];
+	}
+	if (!transform.Rescale && !transform.LUT && !transform.Invert)
+	{
+		volume->SetAttribute("breastImage.Intensities", "Normalized");
+		return false;
+	}
+
+	vtkDataArray* scalars = imageData->GetPointData()->GetScalars();
+	int scalarType = imageData->GetScalarType();
+	IntensityFunctor functor;
+	functor.Input = imageData->GetScalarPointer();
+	functor.ScalarType = scalarType;
+	functor.InputSize = imageData->GetScalarSize();
+	functor.Output = NULL;
+	functor.Table = NULL;
+	functor.TableOffset = 0;
+	functor.Transform = transform;
+	int* dims = imageData->GetDimensions();
+	functor.RowValues = static_cast<vtkIdType>(dims[0]) * imageData->GetNumberOfScalarComponents();
+
+	// 8 and 16 bit values go through a table of every value of the type,
+	// which fuses the three steps in one lookup
+	std::vector<double> mapped;
+	std::vector<char> table;
+	bool tabulated = functor.InputSize <= 2 && scalarType != VTK_FLOAT && scalarType != VTK_DOUBLE;
+	bool fitsInput = scalarType == VTK_FLOAT || scalarType == VTK_DOUBLE;
+	if (tabulated)
+	{
+		double typeMinimum = scalars->GetDataTypeMin();
+		double typeMaximum = scalars->GetDataTypeMax();
+		functor.TableOffset = static_cast<int>(typeMinimum);
+		mapped.resize(static_cast<size_t>(typeMaximum - typeMinimum) + 1);
+		fitsInput = true;
+		for (size_t i = 0; i < mapped.size(); i++)
+		{
+			mapped[i] = transform(typeMinimum + i);
+			fitsInput = fitsInput && mapped[i] == std::floor(mapped[i]) && mapped[i] >= typeMinimum && mapped[i] <= typeMaximum;
+		}
+	}
+	bool writeInPlace = inPlace && fitsInput;
+	if (tabulated)
+	{
+		table.resize(mapped.size() * (writeInPlace ? functor.InputSize : sizeof(float)));
+		if (writeInPlace)
+		{
+			switch (scalarType)
+			{
+				vtkTemplateMacro(fillTable(mapped, reinterpret_cast<VTK_TT*>(&table[0])));
+			}
+		}
+		else
+		{
+			fillTable(mapped, reinterpret_cast<float*>(&table[0]));
+		}
+		functor.Table = &table[0];
+	}
+	vtkSmartPointer<vtkFloatArray> output;
+	if (!writeInPlace)
+	{
+		output = vtkSmartPointer<vtkFloatArray>::New();
+		output->SetName(scalars->GetName());
+		output->SetNumberOfComponents(scalars->GetNumberOfComponents());
+		output->SetNumberOfTuples(scalars->GetNumberOfTuples());
+		functor.Output = output->GetPointer(0);
+	}
+	// split by rows like the histogram, a mammogram is a single slice
+	this->GetTaskPool()->ParallelFor(0, static_cast<vtkIdType>(dims[1]) * dims[2], 1, functor);
+	if (output)
+	{
+		imageData->GetPointData()->SetScalars(output);
+	}
+	else
+	{
+		scalars->Modified();
+	}
+	imageData->Modified();
+	volume->SetAttribute("breastImage.Intensities", "Normalized");
+	return true;
 }
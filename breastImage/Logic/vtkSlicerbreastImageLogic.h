@@ -32,15 +32,39 @@
 
 // QT includes
 #include <QString>
+#include <QStringList>
+#include <QByteArray>
 #include <QMap>
+#include <QHash>
+#include <QList>
+#include <QFuture>
+#include <QMutex>
+#include <QSharedPointer>
 
 // STD includes
 #include <cstdlib>
 
 #include "vtkSlicerbreastImageModuleLogicExport.h"
 
+class vtkImageData;
 class vtkMRMLVolumeNode;
+class vtkMRMLScalarVolumeNode;
 class vtkMRMLAnnotationROINode;
+class vtkSlicerbreastImageReportIndex;
+class vtkSlicerbreastImageClusterTree;
+class vtkSlicerbreastImageTaskPool;
+class vtkSlicerbreastImageDicomScanner;
+class vtkSlicerbreastImageVolumeCache;
+class vtkSlicerbreastImageSlabFilter;
+class vtkSlicerbreastImageTileKernel;
+class vtkSlicerbreastImageAnnotationJournal;
+class vtkSlicerbreastImageSharedVolume;
+struct vtkSlicerbreastImageFullResolutionVolume;
+struct vtkSlicerbreastImageEnhancementPreview;
+struct vtkSlicerbreastImageReportWrite;
+struct vtkSlicerbreastImageReportFile;
+struct vtkSlicerbreastImageJournalCompaction;
+class QDomDocument;
 
 /// \ingroup Slicer_QtModules_ExtensionTemplate
 class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageLogic :
@@ -51,11 +75,280 @@ public:
   static vtkSlicerbreastImageLogic *New();
   vtkTypeMacro(vtkSlicerbreastImageLogic, vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent);
+  /// Copy of all the attributes of a node, empty if it has none.
   QMap< QString, QString> GetNodeAttribute(vtkMRMLNode *node);
+  /// Attribute of a node, null string if not set. Values are cached per node
+  /// until the node is modified, so repeated lookups are hash lookups.
+  QString GetNodeAttributeValue(vtkMRMLNode *node, QString key);
+  /// Cached values of the given attributes.
+  QMap< QString, QString> GetNodeAttributeValues(vtkMRMLNode *node, QStringList keys);
+  /// Rotate every slice of the volume by 180 degrees in place. The
+  /// "breastImage.Orientation" attribute, when set, is toggled.
   void coordinatesTransform(vtkMRMLVolumeNode* inputVolume);
   void acquireRoiLocation(vtkMRMLVolumeNode* inputVolume, vtkMRMLAnnotationROINode* inputROI);
-  void writeAnnotationXML(QString dir,QString fileName, QMap<QString, QString> m_dicomInf, QMap<QString, QString> m_pacasInf, QMap<QString, QString> m_annotationInf);
+  /// Write a report to the file dir. The report is written to a temporary
+  /// file that replaces dir once synced to disk, so a crash leaves either
+  /// the previous or the new report. A report whose content, apart from its
+  /// date, is the one of the file is not written again. Returns a
+  /// ReportWriteResult.
+  int writeAnnotationXML(QString dir,QString fileName, QMap<QString, QString> m_dicomInf, QMap<QString, QString> m_pacasInf, QMap<QString, QString> m_annotationInf);
+  /// Same as writeAnnotationXML on a worker thread of the task pool. Saves
+  /// of a file made before its write started are merged into one write of
+  /// the latest report and share its future. Once the future has finished,
+  /// FinishAnnotationXMLWrite must be called from the main thread.
+  QFuture<void> writeAnnotationXMLAsync(QString dir, QString fileName, QMap<QString, QString> m_dicomInf, QMap<QString, QString> m_pacasInf, QMap<QString, QString> m_annotationInf);
+  enum ReportWriteResult
+  {
+    ReportWriteFailed = 0,
+    ReportWritten,
+    /// the file already holds the report
+    ReportUnchanged,
+    /// nothing was written in a dry run (see SetReportDryRun)
+    ReportSkipped
+  };
+  /// Index the report written by writeAnnotationXMLAsync and return the
+  /// ReportWriteResult of the write, ReportWriteFailed as well while the
+  /// write has not finished.
+  int FinishAnnotationXMLWrite(QString dir);
+  /// Hash of the report content without its date, stored in the
+  /// "contentHash" attribute of the report root. Read without parsing the
+  /// report, empty for reports written without it.
+  static QString ReadAnnotationContentHash(QString fileName);
+  /// The hash stored by the writers, it does not depend on the order of the
+  /// attributes nor on the whitespace between the elements.
+  static QString AnnotationContentHash(const QDomDocument& doc);
+  /// In a dry run the report writers (writeAnnotationXML and its async
+  /// variant, ConvertAnnotationBinaryToXML) write nothing and add the files
+  /// they would have changed to GetChangedReports.
+  void SetReportDryRun(bool dryRun);
+  bool GetReportDryRun();
+  QStringList GetChangedReports();
+  void ClearChangedReports();
   void readAnnotationXML(QString fileName, QMap<QString, QString> &m_dicomInf, QMap<QString, QString> &m_pacasInf, QMap<QString, QString> &m_annotationInf);
+  /// Convert the keys returned by readAnnotationXML (XML tag names) to the
+  /// keys expected by writeAnnotationXML. Already normalized keys are kept.
+  static void NormalizeReportInformation(QMap<QString, QString> &m_dicomInf, QMap<QString, QString> &m_pacasInf, QMap<QString, QString> &m_annotationInf);
+
+  /// Binary report format, see vtkSlicerbreastImageBinaryReport.
+  /// The conversions round-trip with readAnnotationXML/writeAnnotationXML.
+  bool ConvertAnnotationXMLToBinary(QString xmlFileName, QString binaryFileName);
+  bool ConvertAnnotationBinaryToXML(QString binaryFileName, QString xmlFileName);
+  /// Read a binary report, the maps use the keys of writeAnnotationXML.
+  bool readAnnotationBinary(QString fileName, QMap<QString, QString> &m_dicomInf, QMap<QString, QString> &m_pacasInf, QMap<QString, QString> &m_annotationInf);
+
+  /// Report index updated by writeAnnotationXML, opened on first use in
+  /// ~/.breastImage/reportIndex.sqlite unless SetReportIndexFile was called.
+  vtkSlicerbreastImageReportIndex* GetReportIndex();
+  void SetReportIndexFile(QString fileName);
+  /// Index every report below a directory. Reports whose modification time
+  /// or content hash did not change are not parsed again, entries of deleted
+  /// reports are removed. Return the number of parsed reports.
+  int IndexReportDirectory(QString dir);
+  /// Report files matching the criteria, see vtkSlicerbreastImageReportIndex::FindReports.
+  QStringList FindReports(QMap<QString, QString> criteria);
+
+  enum CoordinateSpace
+  {
+    RASSpace = 0,
+    IJKSpace
+  };
+  /// R-tree over the cluster boxes of the indexed reports. Built from the
+  /// report index on first use, or loaded from the tree file saved next to
+  /// the index when the index was not modified since.
+  vtkSlicerbreastImageClusterTree* GetClusterTree(int space);
+  /// Rebuild both cluster trees from the report index and save them.
+  void BuildClusterTrees();
+  /// Clusters overlapping bounds (xmin, xmax, ymin, ymax, zmin, zmax), as
+  /// report files and cluster numbers.
+  void FindOverlappingClusters(int space, double bounds[6], QStringList& reportFiles, QList<int>& clusters);
+  /// k clusters nearest to point, nearest first.
+  void FindNearestClusters(int space, double point[3], int k, QStringList& reportFiles, QList<int>& clusters);
+
+  /// Export the timings recorded by BREASTIMAGE_TRACE_SCOPE as a Chrome
+  /// trace_event JSON file, see vtkSlicerbreastImageTrace.
+  bool WriteTrace(QString fileName);
+
+  /// Worker threads shared by every compute feature of the module.
+  vtkSlicerbreastImageTaskPool* GetTaskPool();
+
+  /// DICOM header reader working directly on files, see vtkSlicerbreastImageDicomScanner.
+  vtkSlicerbreastImageDicomScanner* GetDicomScanner();
+  /// Scan the headers of DICOM files in parallel and return, for each file,
+  /// the report DicomInformation it gives (see DicomInformationFromHeader).
+  QList< QMap<QString, QString> > ScanDicomFiles(QStringList files);
+  QList< QMap<QString, QString> > ScanDicomDirectory(QString dir);
+  /// Convert a header of vtkSlicerbreastImageDicomScanner to the keys of
+  /// the m_dicomInf map of writeAnnotationXML.
+  static QMap<QString, QString> DicomInformationFromHeader(QMap<QString, QString> header);
+
+  /// View of a volume ("L_CC", "L_MLO", "R_CC", "R_MLO" or "NA" when
+  /// unknown), from the ViewPosition and ImageLaterality tags of its DICOM
+  /// file or, without them, from its series description. Volumes are
+  /// classified when the module needs their view, not when they are added
+  /// to the scene, so loading data does not pay for the DICOM scans. A known
+  /// view is stored in the "breastImage.View" attribute, "NA" is not, so the
+  /// volume is classified again once its DICOM UIDs or storage node are set.
+  QString ClassifyVolumeView(vtkMRMLVolumeNode* volume);
+  /// View given by the ViewPosition and (Image)Laterality of a header of
+  /// vtkSlicerbreastImageDicomScanner, null string if they are not usable.
+  static QString ViewFromHeader(QMap<QString, QString> header);
+  /// View given by a series description such as "L MLO" or
+  /// "R CC Breast Tomosynthesis Image", null string if it is not known.
+  /// The "<series number>: " prefix of volume names is ignored.
+  static QString ViewFromSeriesDescription(QString description);
+
+  enum Orientation
+  {
+    OrientationUnknown = 0,
+    OrientationStandard,
+    OrientationFlipped
+  };
+  /// Orientation of the pixel data. Standard follows the DICOM mammography
+  /// convention: the chest wall of a right breast is at the first column and
+  /// the chest wall of a left breast at the last one. The chest wall side is
+  /// found from the column intensity profile of the middle slice and compared
+  /// with the laterality of the volume view. Unknown when the view is not
+  /// known or the profile is not conclusive.
+  int DetectOrientation(vtkMRMLVolumeNode* volume);
+  /// Normalize the intensities of the volume (NormalizeVolumeIntensities),
+  /// flip the volume if DetectOrientation finds it flipped, and record the
+  /// orientation in the "breastImage.Orientation" attribute ("Standard" or
+  /// "Unknown"). A volume with a recorded orientation is left alone, so the
+  /// detection runs once per volume and calling it again never touches the
+  /// voxels. Return true if it flipped.
+  bool ApplyOrientation(vtkMRMLVolumeNode* volume);
+
+  /// Bring the scalars of a volume to display values, brighter for denser
+  /// tissue, from the tags of its DICOM file: the first VOI LUT of the VOI
+  /// LUT Sequence is applied and MONOCHROME1 values are inverted. The
+  /// modality rescale (slope and intercept) is applied only with
+  /// applyRescale, Slicer's DICOM readers already store rescaled values.
+  /// Window center and width are left to the display. 8 and 16 bit scalars
+  /// go through one table fusing the steps, in one pass over the slices on
+  /// the task pool. With inPlace the input scalars are overwritten when the
+  /// results fit their type, otherwise the volume gets float scalars. The
+  /// volume is marked by the "breastImage.Intensities" attribute and never
+  /// normalized twice. Return true if the scalars changed.
+  bool NormalizeVolumeIntensities(vtkMRMLVolumeNode* volume, bool applyRescale = false, bool inPlace = true);
+
+  /// Hash of the voxels of a volume (see vtkSlicerbreastImageContentHash),
+  /// also stored in its "breastImage.ContentHash" attribute. The hash is
+  /// computed again only when the image data was modified since.
+  QString GetVolumeContentHash(vtkMRMLVolumeNode* volume);
+
+  enum WindowLevelPreset
+  {
+    DenseWindowLevel = 0,
+    FattyWindowLevel
+  };
+  /// Window and level of a volume for dense or fatty tissue, from the
+  /// percentiles of the breast values (first component, above the
+  /// background) counted in a histogram over the task pool. Dense spans the
+  /// 50th to 99.5th percentiles, fatty the 1st to 75th. The presets are
+  /// stored in the "breastImage.WindowLevel.Dense" and
+  /// "breastImage.WindowLevel.Fatty" attributes ("<window> <level>") and
+  /// computed again only when the image data was modified since.
+  bool GetAutoWindowLevel(vtkMRMLVolumeNode* volume, int preset, double& window, double& level);
+  /// Set the window and level of GetAutoWindowLevel on the display node of volume.
+  bool ApplyAutoWindowLevel(vtkMRMLVolumeNode* volume, int preset = DenseWindowLevel);
+
+  /// Raw cache of processed volumes, see vtkSlicerbreastImageVolumeCache.
+  /// Files are in ~/.breastImage/volumeCache by default.
+  vtkSlicerbreastImageVolumeCache* GetVolumeCache();
+  /// Cache key of a volume or of a subject hierarchy series: the first of
+  /// its DICOM instance UIDs, or the file it was loaded from. Empty if it
+  /// has neither.
+  QString GetVolumeCacheKey(vtkMRMLNode* node);
+  /// Write the volume as it is now to the cache, under its cache key.
+  bool CacheVolume(vtkMRMLVolumeNode* volume);
+  /// Replace the image and geometry of volume by the cached volume of key.
+  /// The scalars are mapped from the cache file, not read.
+  bool LoadCachedVolume(vtkMRMLVolumeNode* volume, QString key);
+  /// Volume of the scene opened from the cache under key, NULL if none.
+  vtkMRMLVolumeNode* GetCachedVolume(QString key);
+  /// Progressive opening of a cached volume: a new volume node named name
+  /// is added to the scene with a preview read from every fourth row and
+  /// column, and the full resolution volume is loaded in the background.
+  /// Once the returned future has finished, SwapInFullResolution replaces the
+  /// preview on the GUI thread. The geometry of both is the same in RAS, so
+  /// ROIs placed on the preview stay in place. Return NULL if key is not cached.
+  vtkMRMLVolumeNode* OpenCachedVolume(QString key, QString name, QFuture<void>& fullResolution);
+  /// Replace the preview of a volume opened by OpenCachedVolume by its full
+  /// resolution image. Return false if it is not loaded (yet).
+  bool SwapInFullResolution(vtkMRMLVolumeNode* volume);
+  /// Run filter over a volume file of the cache a slab of slices at a time,
+  /// with bounded memory, see vtkSlicerbreastImageSlabStream.
+  bool StreamVolumeFile(QString inputFileName, QString outputFileName, vtkSlicerbreastImageSlabFilter* filter);
+  /// Run kernel over input, or its extent only, into output tile by tile on
+  /// the task pool, see vtkSlicerbreastImageTiler.
+  bool FilterImage(vtkImageData* input, vtkImageData* output, vtkSlicerbreastImageTileKernel* kernel, const int extent[6] = 0);
+  /// Reorient the voxels of volume: axis a becomes the axis permutation[a],
+  /// reversed when flips[a] (see vtkSlicerbreastImageReorienter for the 48
+  /// orientations). The spacing follows the axes while origin and directions
+  /// are kept, so the image turns in the views as with coordinatesTransform.
+  /// The IJK and RAS boxes of the clusters of m_annotationInf (keys of
+  /// writeAnnotationXML), roi and the box of the last acquireRoiLocation are
+  /// moved with their voxels. The "breastImage.Orientation" attribute is
+  /// toggled by half turns in the slices and reset to "Unknown" by other
+  /// orientations.
+  bool ReorientVolume(vtkMRMLVolumeNode* volume, const int permutation[3], const bool flips[3],
+    QMap<QString, QString>* m_annotationInf = NULL, vtkMRMLAnnotationROINode* roi = NULL);
+
+  /// Open the annotation journal of a volume, a file of
+  /// ~/.breastImage/annotationJournal named after its cache key. The journal
+  /// is replayed over its last compaction, an XML report next to it.
+  bool OpenAnnotationJournal(vtkMRMLVolumeNode* volume, vtkSlicerbreastImageAnnotationJournal* journal);
+  /// Write the report replayed from the journal to its XML report on the
+  /// task pool, off the edit path. The records it holds are dropped by the
+  /// next call once it is written, or when the journal is opened again or
+  /// released, records appended meanwhile are kept. Return false if the
+  /// journal is not open.
+  bool CompactAnnotationJournal(vtkSlicerbreastImageAnnotationJournal* journal);
+  /// Close the journal and delete it with its XML report, once the report
+  /// was exported.
+  void RemoveAnnotationJournal(vtkSlicerbreastImageAnnotationJournal* journal);
+  /// Once the report m_*Inf, journaled up to position (GetPosition when
+  /// its save was queued), was exported: the journal is removed when no
+  /// record follows position. Otherwise the exported report becomes the
+  /// report the journal replays over and only the later records are kept.
+  /// A journal compacted after position already holds later edits in its
+  /// report and is left as it is.
+  bool ReleaseAnnotationJournal(vtkSlicerbreastImageAnnotationJournal* journal, qint64 position,
+    QMap<QString, QString> m_dicomInf, QMap<QString, QString> m_pacasInf, QMap<QString, QString> m_annotationInf);
+
+  /// Shared memory segment for local inference processes, see
+  /// vtkSlicerbreastImageSharedVolume.
+  vtkSlicerbreastImageSharedVolume* GetSharedVolume();
+  /// Publish a volume and the IJK boxes of the clusters of m_annotationInf
+  /// (keys of writeAnnotationXML) in the shared volume.
+  bool PublishSharedVolume(vtkMRMLVolumeNode* volume, QMap<QString, QString> m_annotationInf);
+  /// Add to the scene an ROI node around the IJK box of a volume, such as a
+  /// candidate returned by an inference process. Return NULL on failure.
+  vtkMRMLAnnotationROINode* AddROIFromIJK(vtkMRMLVolumeNode* volume, const int centerIJK[3], const int radiusIJK[3], QString name);
+
+  /// Volume of the scene with the contralateral view of volume (R_CC for
+  /// L_CC, L_MLO for R_MLO...), NULL if there is none.
+  vtkMRMLVolumeNode* FindContralateralVolume(vtkMRMLVolumeNode* volume);
+  /// Bilateral asymmetry map: the contralateral volume is mirrored, aligned
+  /// on the breast of volume by the center and extent of the breast of their
+  /// middle slices, and the absolute difference of their intensities,
+  /// relative to the mean breast intensity of each, is averaged over squares
+  /// of (2 smoothingRadius + 1) pixels (vtkSlicerbreastImageTileBoxMeanKernel). Both volumes are brought to the
+  /// standard orientation first (see ApplyOrientation). The map is a float
+  /// volume with the geometry of volume, added to the scene for an overlay,
+  /// and replaced when computed again. Return NULL on failure.
+  vtkMRMLScalarVolumeNode* ComputeAsymmetryMap(vtkMRMLVolumeNode* volume, vtkMRMLVolumeNode* contralateral, int smoothingRadius = 8);
+
+  /// Contrast enhanced preview of the pixels of volume inside roi and a
+  /// margin of pixels around it in each slice, an unsharp mask
+  /// (vtkSlicerbreastImageTileUnsharpMaskKernel) of the volume. The preview
+  /// is a volume node placed over the ROI, added to the scene for an
+  /// overlay. While volume is not modified the enhanced pixels are kept, so
+  /// calling it again after the ROI moved only enhances the pixels it
+  /// uncovered. Return NULL if the ROI is outside of volume.
+  vtkMRMLScalarVolumeNode* UpdateEnhancementPreview(vtkMRMLVolumeNode* volume, vtkMRMLAnnotationROINode* roi, int margin = 16);
+  /// Remove the enhancement preview of volume from the scene.
+  void RemoveEnhancementPreview(vtkMRMLVolumeNode* volume);
 
   //ijk
   int roiXYZIJK[3];
@@ -70,10 +363,77 @@ protected:
   virtual void UpdateFromMRMLScene();
   virtual void OnMRMLSceneNodeAdded(vtkMRMLNode* node);
   virtual void OnMRMLSceneNodeRemoved(vtkMRMLNode* node);
+  virtual void ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData);
 private:
 
   vtkSlicerbreastImageLogic(const vtkSlicerbreastImageLogic&); // Not implemented
   void operator=(const vtkSlicerbreastImageLogic&); // Not implemented
+
+  static QDomDocument createAnnotationDocument(QString fileName, QString reportDate, QMap<QString, QString> m_dicomInf, QMap<QString, QString> m_pacasInf, QMap<QString, QString> m_annotationInf);
+  void parseAnnotationDocument(const QDomDocument& doc, QMap<QString, QString> &reportAttributes, QMap<QString, QString> &m_dicomInf, QMap<QString, QString> &m_pacasInf, QMap<QString, QString> &m_annotationInf);
+
+  // write a document of createAnnotationDocument unless the file has the
+  // same content hash, under the lock of the file. A save of sequence
+  // older than the last written one is not written, 0 always is.
+  int writeAnnotationDocument(QString fileName, const QDomDocument& doc, quint64 sequence = 0);
+  // writes of a report file, created on first use
+  QSharedPointer<vtkSlicerbreastImageReportFile> reportFile(const QString& fileName);
+  // wait for the compaction of the journal file, and drop the records it
+  // holds from journal when it is given and open
+  void finishAnnotationJournalCompaction(const QString& fileName, vtkSlicerbreastImageAnnotationJournal* journal);
+
+  void indexReport(QString fileName, const QByteArray& content, QMap<QString, QString> m_dicomInf, QMap<QString, QString> m_pacasInf, QMap<QString, QString> m_annotationInf);
+
+  QString clusterTreeFile(int space) const;
+  void removeNodeAttributeCache(vtkMRMLNode* node);
+  // DICOM header of the first instance of a volume, empty if unknown
+  QMap<QString, QString> volumeDicomHeader(vtkMRMLVolumeNode* volume);
+  // IJK extent of the ROI in the volume, clipped to its lower and upper
+  // bounds, as computed by acquireRoiLocation
+  bool roiExtentIJK(vtkMRMLVolumeNode* inputVolume, vtkMRMLAnnotationROINode* inputROI, int outputWholeExtent[6]);
+
+  struct NodeAttributeCache
+  {
+    unsigned long MTime;
+    QHash<QString, QString> Values;
+  };
+  QHash<vtkMRMLNode*, NodeAttributeCache> NodeAttributeCaches;
+  // image data modification time of the stored content hash of each volume
+  QHash<vtkMRMLNode*, unsigned long> ContentHashTimes;
+  // image data modification time of the window level presets of each volume
+  QHash<vtkMRMLNode*, unsigned long> WindowLevelTimes;
+
+  vtkSlicerbreastImageReportIndex* ReportIndex;
+  QString ReportIndexFile;
+  vtkSlicerbreastImageClusterTree* ClusterTrees[2];
+  bool ClusterTreesModified;
+  vtkSlicerbreastImageTaskPool* TaskPool;
+  vtkSlicerbreastImageDicomScanner* DicomScanner;
+  vtkSlicerbreastImageVolumeCache* VolumeCache;
+  vtkSlicerbreastImageSharedVolume* SharedVolume;
+  // full resolution images loading for OpenCachedVolume
+  QHash<vtkMRMLNode*, QSharedPointer<vtkSlicerbreastImageFullResolutionVolume> > FullResolutionVolumes;
+  // enhancement previews of UpdateEnhancementPreview by volume
+  QHash<vtkMRMLNode*, QSharedPointer<vtkSlicerbreastImageEnhancementPreview> > EnhancementPreviews;
+  // writes of writeAnnotationXMLAsync by file, used from the main thread.
+  // ReportWriteMutex guards the reports shared with the write tasks.
+  QHash<QString, QSharedPointer<vtkSlicerbreastImageReportWrite> > ReportWrites;
+  QMutex ReportWriteMutex;
+  // numbers the saves in the order the write tasks take them, guarded by
+  // ReportWriteMutex
+  quint64 ReportWriteSequence;
+  // guards the state below for short sections, files are written under
+  // their own lock so saves of other files never wait for a write
+  QMutex ReportFileMutex;
+  QHash<QString, QSharedPointer<vtkSlicerbreastImageReportFile> > ReportFiles;
+  // background writes of CompactAnnotationJournal by journal file name,
+  // used from the main thread
+  QHash<QString, QSharedPointer<vtkSlicerbreastImageJournalCompaction> > JournalCompactions;
+  bool ReportDryRun;
+  QStringList ChangedReports;
+
+  friend class vtkSlicerbreastImageReportWriteTask;
+  friend class vtkSlicerbreastImageJournalCompactionTask;
 };
 
 #endif
@@ -0,0 +1,399 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageReorienter.h"
+#include "vtkSlicerbreastImageTaskPool.h"
+#include "vtkSlicerbreastImageTrace.h"
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+
+// STD includes
+#include <algorithm>
+
+namespace
+{
+const int Permutations[6][3] = {
+	{0, 1, 2}, {1, 0, 2}, {0, 2, 1}, {2, 1, 0}, {1, 2, 0}, {2, 0, 1} };
+
+// reverse the order of count pixels of components values
+template <class T>
+void reversePixels(T* pixels, vtkIdType count, int components)
+{
+	if (components == 1)
+	{
+		std::reverse(pixels, pixels + count);
+		return;
+	}
+	for (vtkIdType first = 0, last = count - 1; first < last; first++, last--)
+	{
+		std::swap_ranges(pixels + first * components, pixels + (first + 1) * components, pixels + last * components);
+	}
+}
+
+// swap the rows a and b, reversed when reverse is set
+template <class T>
+void swapRows(T* a, T* b, vtkIdType count, int components, bool reverse)
+{
+	if (a == b)
+	{
+		if (reverse)
+		{
+			reversePixels(a, count, components);
+		}
+		return;
+	}
+	if (!reverse)
+	{
+		std::swap_ranges(a, a + count * components, b);
+		return;
+	}
+	for (vtkIdType i = 0; i < count; i++)
+	{
+		std::swap_ranges(a + i * components, a + (i + 1) * components, b + (count - 1 - i) * components);
+	}
+}
+
+// in place flips of i and j: unit u is row (or pair of rows when j flips)
+// u % rows of slice u / rows
+template <class T>
+void flipRows(void* scalars, const int dims[3], int components, const bool flips[3], vtkIdType begin, vtkIdType end)
+{
+	T* data = static_cast<T*>(scalars);
+	vtkIdType rowSize = static_cast<vtkIdType>(dims[0]) * components;
+	vtkIdType sliceSize = rowSize * dims[1];
+	vtkIdType rows = flips[1] ? (dims[1] + 1) / 2 : dims[1];
+	for (vtkIdType u = begin; u < end; u++)
+	{
+		T* slice = data + (u / rows) * sliceSize;
+		vtkIdType j = u % rows;
+		vtkIdType other = flips[1] ? dims[1] - 1 - j : j;
+		swapRows(slice + j * rowSize, slice + other * rowSize, dims[0], components, flips[0]);
+	}
+}
+
+// in place flip of k: unit k swaps the slices k and dims[2] - 1 - k
+template <class T>
+void flipSlices(void* scalars, const int dims[3], int components, vtkIdType begin, vtkIdType end)
+{
+	T* data = static_cast<T*>(scalars);
+	vtkIdType sliceSize = static_cast<vtkIdType>(dims[0]) * dims[1] * components;
+	for (vtkIdType k = begin; k < end; k++)
+	{
+		T* slice = data + k * sliceSize;
+		std::swap_ranges(slice, slice + sliceSize, data + (dims[2] - 1 - k) * sliceSize);
+	}
+}
+
+template <class T>
+void flipRange(void* scalars, const int dims[3], int components, const bool flips[3], bool slices,
+	vtkIdType begin, vtkIdType end)
+{
+	if (slices)
+	{
+		flipSlices<T>(scalars, dims, components, begin, end);
+	}
+	else
+	{
+		flipRows<T>(scalars, dims, components, flips, begin, end);
+	}
+}
+
+class FlipFunctor : public vtkSlicerbreastImageRangeFunctor
+{
+public:
+	virtual void operator()(vtkIdType begin, vtkIdType end)
+	{
+		switch (this->ScalarType)
+		{
+			vtkTemplateMacro(flipRange<VTK_TT>(this->Scalars, this->Dimensions, this->Components, this->Flips,
+				this->Slices, begin, end));
+		}
+	}
+	void* Scalars;
+	int ScalarType;
+	int Components;
+	int Dimensions[3];
+	bool Flips[3];
+	bool Slices;
+};
+
+// output pixel o is input pixel base + o[0] * steps[0] + o[1] * steps[1]
+// + o[2] * steps[2], steps in pixels. Unit u holds block rows u % blockRows
+// of output slice u / blockRows, copied in blocks of block x block pixels:
+// the strided reads of a block stay in the cache while it is written.
+template <class T>
+void permuteBlocks(const void* input, void* output, const int dims[3], int components,
+	vtkIdType base, const vtkIdType steps[3], int block, vtkIdType begin, vtkIdType end)
+{
+	const T* in = static_cast<const T*>(input);
+	T* out = static_cast<T*>(output);
+	vtkIdType blockRows = (dims[1] + block - 1) / block;
+	// rows read in order need no blocking
+	int columns = (steps[0] == 1 || steps[0] == -1) ? dims[0] : block;
+	for (vtkIdType u = begin; u < end; u++)
+	{
+		vtkIdType k = u / blockRows;
+		int firstRow = static_cast<int>(u % blockRows) * block;
+		int lastRow = std::min(firstRow + block, dims[1]);
+		for (int firstColumn = 0; firstColumn < dims[0]; firstColumn += columns)
+		{
+			int lastColumn = std::min(firstColumn + columns, dims[0]);
+			for (int j = firstRow; j < lastRow; j++)
+			{
+				vtkIdType source = base + k * steps[2] + j * steps[1] + firstColumn * steps[0];
+				T* target = out + ((k * dims[1] + j) * dims[0] + firstColumn) * components;
+				if (components == 1)
+				{
+					for (int i = firstColumn; i < lastColumn; i++, source += steps[0])
+					{
+						*target++ = in[source];
+					}
+					continue;
+				}
+				for (int i = firstColumn; i < lastColumn; i++, source += steps[0])
+				{
+					target = std::copy(in + source * components, in + (source + 1) * components, target);
+				}
+			}
+		}
+	}
+}
+
+class PermuteFunctor : public vtkSlicerbreastImageRangeFunctor
+{
+public:
+	virtual void operator()(vtkIdType begin, vtkIdType end)
+	{
+		switch (this->ScalarType)
+		{
+			vtkTemplateMacro(permuteBlocks<VTK_TT>(this->Input, this->Output, this->Dimensions, this->Components,
+				this->Base, this->Steps, this->Block, begin, end));
+		}
+	}
+	const void* Input;
+	void* Output;
+	int ScalarType;
+	int Components;
+	// output dimensions
+	int Dimensions[3];
+	vtkIdType Base;
+	vtkIdType Steps[3];
+	int Block;
+};
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerbreastImageReorienter);
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageReorienter::vtkSlicerbreastImageReorienter()
+{
+	this->TaskPool = NULL;
+	this->BlockSize = 32;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageReorienter::~vtkSlicerbreastImageReorienter()
+{
+	this->SetTaskPool(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageReorienter::PrintSelf(ostream& os, vtkIndent indent)
+{
+	this->Superclass::PrintSelf(os, indent);
+	os << indent << "BlockSize: " << this->BlockSize << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageReorienter::SetTaskPool(vtkSlicerbreastImageTaskPool* pool)
+{
+	if (pool == this->TaskPool)
+	{
+		return;
+	}
+	if (pool)
+	{
+		pool->Register(this);
+	}
+	if (this->TaskPool)
+	{
+		this->TaskPool->UnRegister(this);
+	}
+	this->TaskPool = pool;
+	this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageReorienter::GetOrientation(int index, int permutation[3], bool flips[3])
+{
+	if (index < 0 || index >= NumberOfOrientations)
+	{
+		index = 0;
+	}
+	for (int axis = 0; axis < 3; axis++)
+	{
+		permutation[axis] = Permutations[index / 8][axis];
+		flips[axis] = (((index % 8) >> axis) & 1) != 0;
+	}
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageReorienter::IsPermutation(const int permutation[3])
+{
+	bool seen[3] = { false, false, false };
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (permutation[axis] < 0 || permutation[axis] > 2 || seen[permutation[axis]])
+		{
+			return false;
+		}
+		seen[permutation[axis]] = true;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageReorienter::GetOutputDimensions(const int permutation[3], const int inputDimensions[3],
+	int outputDimensions[3])
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		outputDimensions[axis] = inputDimensions[permutation[axis]];
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageReorienter::GetOutputToInputMatrix(const int permutation[3], const bool flips[3],
+	const int inputDimensions[3], vtkMatrix4x4* outputToInput)
+{
+	outputToInput->Zero();
+	outputToInput->SetElement(3, 3, 1.);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		int input = permutation[axis];
+		outputToInput->SetElement(input, axis, flips[axis] ? -1. : 1.);
+		outputToInput->SetElement(input, 3, flips[axis] ? inputDimensions[input] - 1. : 0.);
+	}
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageReorienter::Run(vtkImageData* image, const int permutation[3], const bool flips[3])
+{
+	BREASTIMAGE_TRACE_SCOPE("Reorient");
+	vtkDataArray* scalars = image ? image->GetPointData()->GetScalars() : NULL;
+	if (!scalars || !IsPermutation(permutation))
+	{
+		vtkErrorMacro("Run: invalid image or permutation");
+		return false;
+	}
+	int dims[3];
+	image->GetDimensions(dims);
+	if (scalars->GetNumberOfTuples() != static_cast<vtkIdType>(dims[0]) * dims[1] * dims[2])
+	{
+		vtkErrorMacro("Run: scalars do not match the image dimensions");
+		return false;
+	}
+	bool identity = permutation[0] == 0 && permutation[1] == 1 && permutation[2] == 2;
+
+	if (identity)
+	{
+		FlipFunctor functor;
+		functor.Scalars = scalars->GetVoidPointer(0);
+		functor.ScalarType = scalars->GetDataType();
+		functor.Components = scalars->GetNumberOfComponents();
+		std::copy(dims, dims + 3, functor.Dimensions);
+		std::copy(flips, flips + 3, functor.Flips);
+		// rows are swapped or reversed in one pass and whole slices in a
+		// second one, both in place
+		for (int pass = 0; pass < 2; pass++)
+		{
+			functor.Slices = pass == 1;
+			vtkIdType units;
+			if (functor.Slices)
+			{
+				units = flips[2] ? dims[2] / 2 : 0;
+			}
+			else
+			{
+				units = (flips[0] || flips[1]) ? static_cast<vtkIdType>(flips[1] ? (dims[1] + 1) / 2 : dims[1]) * dims[2] : 0;
+			}
+			if (units == 0)
+			{
+				continue;
+			}
+			if (this->TaskPool)
+			{
+				this->TaskPool->ParallelFor(0, units, functor.Slices ? 1 : 16, functor);
+			}
+			else
+			{
+				functor(0, units);
+			}
+		}
+		scalars->Modified();
+		image->Modified();
+		return true;
+	}
+
+	PermuteFunctor functor;
+	functor.ScalarType = scalars->GetDataType();
+	functor.Components = scalars->GetNumberOfComponents();
+	GetOutputDimensions(permutation, dims, functor.Dimensions);
+	functor.Block = std::max(this->BlockSize, 1);
+	vtkIdType increments[3] = { 1, dims[0], static_cast<vtkIdType>(dims[0]) * dims[1] };
+	functor.Base = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		int input = permutation[axis];
+		functor.Steps[axis] = flips[axis] ? -increments[input] : increments[input];
+		if (flips[axis])
+		{
+			functor.Base += (dims[input] - 1) * increments[input];
+		}
+	}
+
+	vtkDataArray* permuted = scalars->NewInstance();
+	permuted->SetName(scalars->GetName());
+	permuted->SetNumberOfComponents(functor.Components);
+	permuted->SetNumberOfTuples(scalars->GetNumberOfTuples());
+	functor.Input = scalars->GetVoidPointer(0);
+	functor.Output = permuted->GetVoidPointer(0);
+	vtkIdType units = static_cast<vtkIdType>(functor.Dimensions[2])
+		* ((functor.Dimensions[1] + functor.Block - 1) / functor.Block);
+	if (this->TaskPool)
+	{
+		this->TaskPool->ParallelFor(0, units, 1, functor);
+	}
+	else
+	{
+		functor(0, units);
+	}
+
+	image->SetDimensions(functor.Dimensions);
+	image->GetPointData()->SetScalars(permuted);
+	permuted->Delete();
+	image->Modified();
+	return true;
+}
@@ -0,0 +1,92 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkSlicerbreastImageReorienter - axis permutations and flips of images
+// .SECTION Description
+// Applies any of the 48 orientations of the voxel grid: a permutation of
+// the i, j and k axes combined with a reversal of any of them, such as 90
+// degree rotations, left-right flips or a reversed slice order. Output axis
+// a is input axis Permutation[a], reversed when Flips[a] is set.
+// Flips without permutation are done in place. Permutations write a new
+// array: the output is written in order while the input is read in square
+// blocks of BlockSize x BlockSize voxels, so the strided reads of a
+// transpose stay in the cache and the copy is bound by memory bandwidth.
+// Slices, or blocks of rows of single slice images, run on the task pool.
+
+#ifndef __vtkSlicerbreastImageReorienter_h
+#define __vtkSlicerbreastImageReorienter_h
+
+// VTK includes
+#include <vtkObject.h>
+
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+class vtkImageData;
+class vtkMatrix4x4;
+class vtkSlicerbreastImageTaskPool;
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageReorienter :
+  public vtkObject
+{
+public:
+
+  static vtkSlicerbreastImageReorienter *New();
+  vtkTypeMacro(vtkSlicerbreastImageReorienter, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Number of orientations, GetOrientation enumerates them.
+  static const int NumberOfOrientations = 48;
+  /// Orientation index of [0, 48): index / 8 selects one of the 6
+  /// permutations (0 being the identity), the bits of index % 8 the flips
+  /// of the output axes. Indices out of range give the identity.
+  static void GetOrientation(int index, int permutation[3], bool flips[3]);
+  /// True if permutation holds 0, 1 and 2.
+  static bool IsPermutation(const int permutation[3]);
+  /// Dimensions of the reoriented image.
+  static void GetOutputDimensions(const int permutation[3], const int inputDimensions[3], int outputDimensions[3]);
+  /// Index transform from output voxels to input voxels (homogeneous, the
+  /// 3x3 part is a signed permutation). The inverse is its transpose for the
+  /// 3x3 part.
+  static void GetOutputToInputMatrix(const int permutation[3], const bool flips[3],
+    const int inputDimensions[3], vtkMatrix4x4* outputToInput);
+
+  /// Pool running the copy, everything runs in the calling thread without pool.
+  void SetTaskPool(vtkSlicerbreastImageTaskPool* pool);
+
+  /// Side of the blocks of the transposes, 32 voxels by default.
+  vtkSetMacro(BlockSize, int);
+  vtkGetMacro(BlockSize, int);
+
+  /// Reorient the scalars of image, whose dimensions become the output
+  /// dimensions. Origin and spacing are left to the caller.
+  bool Run(vtkImageData* image, const int permutation[3], const bool flips[3]);
+
+protected:
+  vtkSlicerbreastImageReorienter();
+  virtual ~vtkSlicerbreastImageReorienter();
+
+  vtkSlicerbreastImageTaskPool* TaskPool;
+  int BlockSize;
+
+private:
+
+  vtkSlicerbreastImageReorienter(const vtkSlicerbreastImageReorienter&); // Not implemented
+  void operator=(const vtkSlicerbreastImageReorienter&); // Not implemented
+};
+
+#endif
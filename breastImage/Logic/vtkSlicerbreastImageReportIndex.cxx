@@ -0,0 +1,430 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageReportIndex.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+
+//QT includes
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+
+namespace
+{
+// connections opened by all the index instances, guarded by connectionsMutex
+QMutex connectionsMutex;
+QMap<QString, QStringList> openedConnections;
+
+// report columns that can be used as exact match criteria
+const char* reportCriteria[][2] = {
+	{ "PatientID", "patientId" },
+	{ "StudyID", "studyId" },
+	{ "SeriesNumber", "seriesNumber" },
+	{ "View", "view" },
+	{ "Modality", "modality" },
+	{ "pathology", "pathology" },
+	{ "assessment", "assessment" },
+	{ "density", "density" },
+	{ "subtlety", "subtlety" } };
+const int reportCriteriaCount = sizeof(reportCriteria) / sizeof(reportCriteria[0]);
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerbreastImageReportIndex);
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageReportIndex::vtkSlicerbreastImageReportIndex()
+{
+	this->ConnectionName = QString("breastImageReportIndex_%1").arg(reinterpret_cast<quintptr>(this));
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageReportIndex::~vtkSlicerbreastImageReportIndex()
+{
+	this->Close();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageReportIndex::PrintSelf(ostream& os, vtkIndent indent)
+{
+	this->Superclass::PrintSelf(os, indent);
+	os << indent << "DatabaseFile: " << this->DatabaseFile.toStdString() << "\n";
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageReportIndex::Open(const QString& databaseFile)
+{
+	this->Close();
+	QFileInfo info(databaseFile);
+	if (!info.absoluteDir().exists() && !QDir().mkpath(info.absolutePath()))
+	{
+		vtkErrorMacro("Open: can not create directory " << info.absolutePath().toStdString());
+		return false;
+	}
+	this->DatabaseFile = info.absoluteFilePath();
+	if (!this->database().isOpen() || !this->createTables())
+	{
+		this->Close();
+		return false;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageReportIndex::Close()
+{
+	QMutexLocker locker(&connectionsMutex);
+	foreach(QString connectionName, openedConnections.take(this->ConnectionName))
+	{
+		QSqlDatabase::removeDatabase(connectionName);
+	}
+	this->DatabaseFile.clear();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageReportIndex::IsOpen() const
+{
+	return !this->DatabaseFile.isEmpty();
+}
+
+//----------------------------------------------------------------------------
+QString vtkSlicerbreastImageReportIndex::GetDatabaseFile() const
+{
+	return this->DatabaseFile;
+}
+
+//----------------------------------------------------------------------------
+QSqlDatabase vtkSlicerbreastImageReportIndex::database()
+{
+	QString connectionName = QString("%1_%2").arg(this->ConnectionName)
+		.arg(reinterpret_cast<quintptr>(QThread::currentThreadId()));
+	if (QSqlDatabase::contains(connectionName))
+	{
+		return QSqlDatabase::database(connectionName);
+	}
+	QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+	db.setDatabaseName(this->DatabaseFile);
+	if (!db.open())
+	{
+		vtkErrorMacro("database: can not open " << this->DatabaseFile.toStdString()
+			<< ": " << db.lastError().text().toStdString());
+	}
+	else
+	{
+		// the index can always be rebuilt from the reports, favor speed
+		QSqlQuery pragma(db);
+		pragma.exec("PRAGMA synchronous = OFF");
+		pragma.exec("PRAGMA foreign_keys = ON");
+	}
+	QMutexLocker locker(&connectionsMutex);
+	openedConnections[this->ConnectionName].append(connectionName);
+	return db;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageReportIndex::createTables()
+{
+	QSqlQuery query(this->database());
+	const char* statements[] = {
+		"CREATE TABLE IF NOT EXISTS Reports ("
+		" file TEXT PRIMARY KEY, lastModified INTEGER, contentHash BLOB,"
+		" patientId TEXT, patientBirthDate TEXT, studyId TEXT, studyDate TEXT, seriesNumber TEXT,"
+		" view TEXT, modality TEXT, subtlety TEXT, density TEXT, assessment TEXT, pathology TEXT,"
+		" clusterNumber INTEGER)",
+		"CREATE TABLE IF NOT EXISTS Clusters ("
+		" file TEXT REFERENCES Reports(file) ON DELETE CASCADE, cluster INTEGER,"
+		" number INTEGER, size REAL, shape TEXT, distribution TEXT,"
+		" xCenterRas REAL, yCenterRas REAL, zCenterRas REAL, xRadiusRas REAL, yRadiusRas REAL, zRadiusRas REAL,"
+		" xCenterIjk INTEGER, yCenterIjk INTEGER, zCenterIjk INTEGER, xRadiusIjk INTEGER, yRadiusIjk INTEGER, zRadiusIjk INTEGER,"
+		" PRIMARY KEY (file, cluster))",
+		"CREATE INDEX IF NOT EXISTS ReportsPatient ON Reports (patientId, studyId)",
+		"CREATE INDEX IF NOT EXISTS ReportsView ON Reports (view, modality, pathology)",
+		"CREATE INDEX IF NOT EXISTS ClustersShape ON Clusters (shape, distribution)" };
+	for (unsigned int i = 0; i < sizeof(statements) / sizeof(statements[0]); i++)
+	{
+		if (!query.exec(statements[i]))
+		{
+			vtkErrorMacro("createTables: " << query.lastError().text().toStdString());
+			return false;
+		}
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageReportIndex::UpdateReport(const QString& reportFile, const QDateTime& lastModified, const QByteArray& contentHash,
+	const QMap<QString, QString>& m_dicomInf, const QMap<QString, QString>& m_pacasInf, const QMap<QString, QString>& m_annotationInf)
+{
+	if (!this->IsOpen())
+	{
+		return false;
+	}
+	QString file = QFileInfo(reportFile).absoluteFilePath();
+	QSqlDatabase db = this->database();
+	db.transaction();
+
+	QSqlQuery query(db);
+	query.prepare("DELETE FROM Clusters WHERE file = ?");
+	query.addBindValue(file);
+	query.exec();
+
+	int number = m_annotationInf.value("clusterNumber").toInt();
+	query.prepare("INSERT OR REPLACE INTO Reports VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+	query.addBindValue(file);
+	query.addBindValue(lastModified.toMSecsSinceEpoch());
+	query.addBindValue(contentHash);
+	query.addBindValue(m_dicomInf.value("PatientID"));
+	query.addBindValue(m_dicomInf.value("PatientBirthDate"));
+	query.addBindValue(m_dicomInf.value("StudyID"));
+	query.addBindValue(m_dicomInf.value("StudyDate"));
+	query.addBindValue(m_dicomInf.value("SeriesNumber"));
+	query.addBindValue(m_dicomInf.value("View"));
+	query.addBindValue(m_dicomInf.value("Modality"));
+	query.addBindValue(m_pacasInf.value("subtlety"));
+	query.addBindValue(m_pacasInf.value("density"));
+	query.addBindValue(m_pacasInf.value("assessment"));
+	query.addBindValue(m_pacasInf.value("pathology"));
+	query.addBindValue(number);
+	if (!query.exec())
+	{
+		vtkErrorMacro("UpdateReport: " << query.lastError().text().toStdString());
+		db.rollback();
+		return false;
+	}
+
+	const char* clusterFields[] = { "number", "size", "shape", "distribution",
+		"xCenterRas", "yCenterRas", "zCenterRas", "xRadiusRas", "yRadiusRas", "zRadiusRas",
+		"xCenterIjk", "yCenterIjk", "zCenterIjk", "xRadiusIjk", "yRadiusIjk", "zRadiusIjk" };
+	query.prepare("INSERT INTO Clusters VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+	for (int i = 1; i <= number; i++)
+	{
+		query.addBindValue(file);
+		query.addBindValue(i);
+		for (unsigned int field = 0; field < sizeof(clusterFields) / sizeof(clusterFields[0]); field++)
+		{
+			query.addBindValue(m_annotationInf.value(QString("%1-%2").arg(i).arg(clusterFields[field])));
+		}
+		if (!query.exec())
+		{
+			vtkErrorMacro("UpdateReport: " << query.lastError().text().toStdString());
+			db.rollback();
+			return false;
+		}
+	}
+	return db.commit();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageReportIndex::RemoveReport(const QString& reportFile)
+{
+	if (!this->IsOpen())
+	{
+		return false;
+	}
+	QSqlQuery query(this->database());
+	query.prepare("DELETE FROM Reports WHERE file = ?");
+	query.addBindValue(QFileInfo(reportFile).absoluteFilePath());
+	return query.exec();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageReportIndex::GetReportStamp(const QString& reportFile, QDateTime& lastModified, QByteArray& contentHash)
+{
+	if (!this->IsOpen())
+	{
+		return false;
+	}
+	QSqlQuery query(this->database());
+	query.prepare("SELECT lastModified, contentHash FROM Reports WHERE file = ?");
+	query.addBindValue(QFileInfo(reportFile).absoluteFilePath());
+	if (!query.exec() || !query.next())
+	{
+		return false;
+	}
+	lastModified = QDateTime::fromMSecsSinceEpoch(query.value(0).toLongLong());
+	contentHash = query.value(1).toByteArray();
+	return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageReportIndex::TouchReport(const QString& reportFile, const QDateTime& lastModified)
+{
+	if (!this->IsOpen())
+	{
+		return false;
+	}
+	QSqlQuery query(this->database());
+	query.prepare("UPDATE Reports SET lastModified = ? WHERE file = ?");
+	query.addBindValue(lastModified.toMSecsSinceEpoch());
+	query.addBindValue(QFileInfo(reportFile).absoluteFilePath());
+	return query.exec();
+}
+
+//----------------------------------------------------------------------------
+QStringList vtkSlicerbreastImageReportIndex::GetIndexedReports(const QString& directory)
+{
+	QStringList files;
+	if (!this->IsOpen())
+	{
+		return files;
+	}
+	QString prefix = QDir(directory).absolutePath() + "/";
+	QSqlQuery query(this->database());
+	query.prepare("SELECT file FROM Reports WHERE substr(file, 1, ?) = ?");
+	query.addBindValue(prefix.length());
+	query.addBindValue(prefix);
+	query.exec();
+	while (query.next())
+	{
+		files << query.value(0).toString();
+	}
+	return files;
+}
+
+//----------------------------------------------------------------------------
+QStringList vtkSlicerbreastImageReportIndex::FindReports(const QMap<QString, QString>& criteria)
+{
+	QStringList files;
+	if (!this->IsOpen())
+	{
+		return files;
+	}
+	QStringList conditions;
+	QList<QVariant> values;
+	for (int i = 0; i < reportCriteriaCount; i++)
+	{
+		if (criteria.contains(reportCriteria[i][0]))
+		{
+			conditions << QString("r.%1 = ?").arg(reportCriteria[i][1]);
+			values << criteria.value(reportCriteria[i][0]);
+		}
+	}
+	if (criteria.contains("minClusterNumber"))
+	{
+		conditions << "r.clusterNumber >= ?";
+		values << criteria.value("minClusterNumber").toInt();
+	}
+	QStringList clusterConditions;
+	if (criteria.contains("shape"))
+	{
+		clusterConditions << "c.shape = ?";
+		values << criteria.value("shape");
+	}
+	if (criteria.contains("distribution"))
+	{
+		clusterConditions << "c.distribution = ?";
+		values << criteria.value("distribution");
+	}
+	if (criteria.contains("minClusterSize"))
+	{
+		clusterConditions << "c.size >= ?";
+		values << criteria.value("minClusterSize").toDouble();
+	}
+	if (!clusterConditions.isEmpty())
+	{
+		conditions << QString("EXISTS (SELECT 1 FROM Clusters c WHERE c.file = r.file AND %1)")
+			.arg(clusterConditions.join(" AND "));
+	}
+
+	QString statement = "SELECT r.file FROM Reports r";
+	if (!conditions.isEmpty())
+	{
+		statement += " WHERE " + conditions.join(" AND ");
+	}
+	statement += " ORDER BY r.file";
+	QSqlQuery query(this->database());
+	query.prepare(statement);
+	foreach(QVariant value, values)
+	{
+		query.addBindValue(value);
+	}
+	if (!query.exec())
+	{
+		vtkErrorMacro("FindReports: " << query.lastError().text().toStdString());
+		return files;
+	}
+	while (query.next())
+	{
+		files << query.value(0).toString();
+	}
+	return files;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageReportIndex::GetClusterBounds(bool ijk, std::vector<double>& bounds, std::vector<int>& reportIds,
+	std::vector<int>& clusters, std::vector<std::string>& reportFiles)
+{
+	bounds.clear();
+	reportIds.clear();
+	clusters.clear();
+	reportFiles.clear();
+	if (!this->IsOpen())
+	{
+		return false;
+	}
+	QSqlQuery query(this->database());
+	query.setForwardOnly(true);
+	if (!query.exec(ijk ?
+		"SELECT file, cluster, xCenterIjk, yCenterIjk, zCenterIjk, xRadiusIjk, yRadiusIjk, zRadiusIjk FROM Clusters ORDER BY file" :
+		"SELECT file, cluster, xCenterRas, yCenterRas, zCenterRas, xRadiusRas, yRadiusRas, zRadiusRas FROM Clusters ORDER BY file"))
+	{
+		vtkErrorMacro("GetClusterBounds: " << query.lastError().text().toStdString());
+		return false;
+	}
+	QString currentFile;
+	while (query.next())
+	{
+		bool valid = true;
+		double center[3], radius[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			bool centerOk, radiusOk;
+			center[axis] = query.value(2 + axis).toDouble(&centerOk);
+			radius[axis] = query.value(5 + axis).toDouble(&radiusOk);
+			valid = valid && centerOk && radiusOk;
+		}
+		if (!valid)
+		{
+			// cluster without location ("NA")
+			continue;
+		}
+		QString file = query.value(0).toString();
+		if (reportFiles.empty() || file != currentFile)
+		{
+			currentFile = file;
+			reportFiles.push_back(file.toStdString());
+		}
+		for (int axis = 0; axis < 3; axis++)
+		{
+			bounds.push_back(center[axis] - radius[axis]);
+			bounds.push_back(center[axis] + radius[axis]);
+		}
+		reportIds.push_back(static_cast<int>(reportFiles.size()) - 1);
+		clusters.push_back(query.value(1).toInt());
+	}
+	return true;
+}
@@ -0,0 +1,109 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkSlicerbreastImageReportIndex - on-disk index of annotation reports
+// .SECTION Description
+// SQLite database holding the searchable fields of every annotation report
+// (patient, study, view, pathology and clusters) so that corpus lookups are
+// index queries instead of re-parsing every XML file. Each report entry is
+// stamped with the file modification time and a content hash to allow
+// incremental re-indexing of a report directory.
+
+#ifndef __vtkSlicerbreastImageReportIndex_h
+#define __vtkSlicerbreastImageReportIndex_h
+
+// VTK includes
+#include <vtkObject.h>
+
+// QT includes
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QDateTime>
+#include <QByteArray>
+
+// STD includes
+#include <string>
+#include <vector>
+
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+class QSqlDatabase;
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageReportIndex :
+  public vtkObject
+{
+public:
+
+  static vtkSlicerbreastImageReportIndex *New();
+  vtkTypeMacro(vtkSlicerbreastImageReportIndex, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Open (and create if needed) the index database file.
+  bool Open(const QString& databaseFile);
+  void Close();
+  bool IsOpen() const;
+  QString GetDatabaseFile() const;
+
+  /// Store or replace the entry of one report. The information maps use the
+  /// keys of vtkSlicerbreastImageLogic::writeAnnotationXML.
+  bool UpdateReport(const QString& reportFile, const QDateTime& lastModified, const QByteArray& contentHash,
+    const QMap<QString, QString>& m_dicomInf, const QMap<QString, QString>& m_pacasInf, const QMap<QString, QString>& m_annotationInf);
+  bool RemoveReport(const QString& reportFile);
+
+  /// Modification time, stored in milliseconds as QFileInfo::lastModified
+  /// gives it, and content hash stored for a report.
+  /// Return false if the report is not indexed.
+  bool GetReportStamp(const QString& reportFile, QDateTime& lastModified, QByteArray& contentHash);
+  /// Update the stored modification time of a report whose content did not change.
+  bool TouchReport(const QString& reportFile, const QDateTime& lastModified);
+
+  /// Reports indexed below a directory.
+  QStringList GetIndexedReports(const QString& directory);
+
+  /// Report files matching all the given criteria. Supported keys are
+  /// PatientID, StudyID, SeriesNumber, View, Modality, pathology, assessment,
+  /// density, subtlety (exact match), minClusterNumber, and the cluster
+  /// attributes shape, distribution and minClusterSize which must hold for
+  /// at least one cluster of the report.
+  QStringList FindReports(const QMap<QString, QString>& criteria);
+
+  /// Boxes of every indexed cluster in RAS or IJK coordinates, 6 bounds per
+  /// cluster, with the index of its report in reportFiles and its number.
+  bool GetClusterBounds(bool ijk, std::vector<double>& bounds, std::vector<int>& reportIds,
+    std::vector<int>& clusters, std::vector<std::string>& reportFiles);
+
+protected:
+  vtkSlicerbreastImageReportIndex();
+  virtual ~vtkSlicerbreastImageReportIndex();
+
+  /// Connection to the database for the calling thread, SQLite connections
+  /// can not be shared between threads.
+  QSqlDatabase database();
+  bool createTables();
+
+  QString DatabaseFile;
+  QString ConnectionName;
+
+private:
+
+  vtkSlicerbreastImageReportIndex(const vtkSlicerbreastImageReportIndex&); // Not implemented
+  void operator=(const vtkSlicerbreastImageReportIndex&); // Not implemented
+};
+
+#endif
@@ -0,0 +1,214 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageSharedVolume.h"
+#include "vtkSlicerbreastImageTrace.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+
+//QT includes
+#include <QCoreApplication>
+#include <QFile>
+
+// STD includes
+#include <cstddef>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+const char sharedVolumeMagic[4] = { 'B', 'I', 'S', 'V' };
+
+#ifndef _WIN32
+// the sequence is read by other processes while the segment is written
+void storeSequence(void* address, quint32 sequence)
+{
+	__sync_synchronize();
+	*reinterpret_cast<volatile quint32*>(static_cast<char*>(address) + offsetof(vtkSlicerbreastImageSharedVolume::Header, Sequence)) = sequence;
+	__sync_synchronize();
+}
+#endif
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerbreastImageSharedVolume);
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageSharedVolume::vtkSlicerbreastImageSharedVolume()
+{
+	this->Name = QString("/breastImage-%1").arg(QCoreApplication::applicationPid());
+	this->FileDescriptor = -1;
+	this->Address = NULL;
+	this->Size = 0;
+	this->Sequence = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageSharedVolume::~vtkSlicerbreastImageSharedVolume()
+{
+	this->Unpublish();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageSharedVolume::PrintSelf(ostream& os, vtkIndent indent)
+{
+	this->Superclass::PrintSelf(os, indent);
+	os << indent << "Name: " << this->Name.toLocal8Bit().constData() << "\n";
+	os << indent << "Size: " << this->Size << "\n";
+	os << indent << "Sequence: " << this->Sequence << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageSharedVolume::SetName(const QString& name)
+{
+	if (name == this->Name)
+	{
+		return;
+	}
+	this->Unpublish();
+	this->Name = name;
+	this->Modified();
+}
+
+//----------------------------------------------------------------------------
+QString vtkSlicerbreastImageSharedVolume::GetName() const
+{
+	return this->Name;
+}
+
+//----------------------------------------------------------------------------
+quint32 vtkSlicerbreastImageSharedVolume::GetSequence() const
+{
+	return this->Sequence;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageSharedVolume::Publish(vtkImageData* image, vtkMatrix4x4* ijkToRAS, const QVector<Cluster>& clusters, quint64 contentHash)
+{
+#ifdef _WIN32
+	(void)image;
+	(void)ijkToRAS;
+	(void)clusters;
+	(void)contentHash;
+	return false;
+#else
+	BREASTIMAGE_TRACE_SCOPE("PublishSharedVolume");
+	if (!image || !image->GetPointData()->GetScalars() || !ijkToRAS)
+	{
+		return false;
+	}
+	Header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.Magic, sharedVolumeMagic, sizeof(sharedVolumeMagic));
+	header.Version = Version;
+	header.HeaderSize = HeaderSize;
+	image->GetDimensions(header.Dimensions);
+	header.ScalarType = image->GetScalarType();
+	header.NumberOfComponents = image->GetNumberOfScalarComponents();
+	header.ScalarSize = image->GetScalarSize();
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			header.IJKToRAS[i * 4 + j] = ijkToRAS->GetElement(i, j);
+		}
+	}
+	header.ContentHash = contentHash;
+	header.ScalarOffset = HeaderSize;
+	header.ScalarBytes = static_cast<quint64>(header.ScalarSize) * header.NumberOfComponents
+		* header.Dimensions[0] * header.Dimensions[1] * header.Dimensions[2];
+	// keep the clusters aligned
+	header.ClusterOffset = (header.ScalarOffset + header.ScalarBytes + 63) & ~quint64(63);
+	header.ClusterCount = clusters.size();
+	size_t size = header.ClusterOffset + clusters.size() * sizeof(Cluster);
+
+	if (this->FileDescriptor < 0)
+	{
+		// readable by the user only, like the files of the cache
+		this->FileDescriptor = shm_open(QFile::encodeName(this->Name).constData(), O_CREAT | O_RDWR, 0600);
+		if (this->FileDescriptor < 0)
+		{
+			vtkErrorMacro("Publish: cannot open the shared memory segment " << this->Name.toLocal8Bit().constData());
+			return false;
+		}
+	}
+	if (size > this->Size)
+	{
+		if (this->Address)
+		{
+			munmap(this->Address, this->Size);
+			this->Address = NULL;
+			this->Size = 0;
+		}
+		void* address = MAP_FAILED;
+		if (ftruncate(this->FileDescriptor, size) == 0)
+		{
+			address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->FileDescriptor, 0);
+		}
+		if (address == MAP_FAILED)
+		{
+			vtkErrorMacro("Publish: cannot map " << size << " bytes of shared memory");
+			return false;
+		}
+		this->Address = address;
+		this->Size = size;
+	}
+	header.SegmentSize = this->Size;
+
+	char* segment = static_cast<char*>(this->Address);
+	storeSequence(segment, ++this->Sequence);
+	header.Sequence = this->Sequence;
+	std::memcpy(segment, &header, sizeof(header));
+	std::memcpy(segment + header.ScalarOffset, image->GetScalarPointer(), header.ScalarBytes);
+	if (!clusters.isEmpty())
+	{
+		std::memcpy(segment + header.ClusterOffset, clusters.constData(), clusters.size() * sizeof(Cluster));
+	}
+	storeSequence(segment, ++this->Sequence);
+	return true;
+#endif
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageSharedVolume::Unpublish()
+{
+#ifndef _WIN32
+	if (this->Address)
+	{
+		munmap(this->Address, this->Size);
+	}
+	if (this->FileDescriptor >= 0)
+	{
+		close(this->FileDescriptor);
+		shm_unlink(QFile::encodeName(this->Name).constData());
+	}
+#endif
+	this->Address = NULL;
+	this->Size = 0;
+	this->FileDescriptor = -1;
+	this->Sequence = 0;
+}
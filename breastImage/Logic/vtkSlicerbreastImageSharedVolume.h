@@ -0,0 +1,124 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkSlicerbreastImageSharedVolume - volume published in shared memory
+// .SECTION Description
+// Publishes a volume and the IJK boxes of its clusters in a POSIX shared
+// memory segment, for local processes such as a detection model. The
+// segment is a Header padded to HeaderSize (one page), the scalars in VTK
+// order (i fastest, native byte order) at ScalarOffset, and ClusterCount
+// Cluster records at ClusterOffset. Readers map the segment read-only and
+// use the scalars in place.
+// Sequence is a sequence lock: it is odd while the segment is written and
+// moves to the next even value once the segment is consistent. A reader
+// reads Sequence, uses the segment, and retries if Sequence was odd or
+// changed meanwhile. The segment only grows: a reader whose mapping is
+// smaller than SegmentSize maps it again.
+// Shared memory is not available on Windows, where Publish fails.
+
+#ifndef __vtkSlicerbreastImageSharedVolume_h
+#define __vtkSlicerbreastImageSharedVolume_h
+
+// VTK includes
+#include <vtkObject.h>
+
+// QT includes
+#include <QString>
+#include <QVector>
+
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+class vtkImageData;
+class vtkMatrix4x4;
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageSharedVolume :
+  public vtkObject
+{
+public:
+
+  static vtkSlicerbreastImageSharedVolume *New();
+  vtkTypeMacro(vtkSlicerbreastImageSharedVolume, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  static const quint16 Version = 1;
+  /// Offset of the scalars, page aligned.
+  static const quint32 HeaderSize = 4096;
+
+#pragma pack(push, 1)
+  struct Header
+  {
+    /// "BISV"
+    char Magic[4];
+    quint16 Version;
+    quint16 Reserved;
+    quint32 HeaderSize;
+    quint32 Sequence;
+    quint64 SegmentSize;
+    qint32 Dimensions[3];
+    qint32 ScalarType;
+    qint32 NumberOfComponents;
+    qint32 ScalarSize;
+    /// Row major IJK to RAS matrix of the volume node.
+    double IJKToRAS[16];
+    /// vtkSlicerbreastImageContentHash of the scalars, 0 if unknown.
+    quint64 ContentHash;
+    quint64 ScalarOffset;
+    quint64 ScalarBytes;
+    quint64 ClusterOffset;
+    quint32 ClusterCount;
+    quint32 Reserved2;
+  };
+
+  /// Cluster box of the report, in voxels.
+  struct Cluster
+  {
+    qint32 Number;
+    qint32 CenterIJK[3];
+    qint32 RadiusIJK[3];
+  };
+#pragma pack(pop)
+
+  /// Name of the segment given to shm_open, "/breastImage-<pid>" by default.
+  /// Changing it removes the published segment.
+  void SetName(const QString& name);
+  QString GetName() const;
+
+  /// Copy the volume and clusters in the segment, created on first use.
+  bool Publish(vtkImageData* image, vtkMatrix4x4* ijkToRAS, const QVector<Cluster>& clusters, quint64 contentHash = 0);
+  /// Sequence of the last publication, 0 before the first one.
+  quint32 GetSequence() const;
+  /// Unmap and remove the segment, the sequence starts again at 0.
+  void Unpublish();
+
+protected:
+  vtkSlicerbreastImageSharedVolume();
+  virtual ~vtkSlicerbreastImageSharedVolume();
+
+  QString Name;
+  int FileDescriptor;
+  void* Address;
+  size_t Size;
+  quint32 Sequence;
+
+private:
+
+  vtkSlicerbreastImageSharedVolume(const vtkSlicerbreastImageSharedVolume&); // Not implemented
+  void operator=(const vtkSlicerbreastImageSharedVolume&); // Not implemented
+};
+
+#endif
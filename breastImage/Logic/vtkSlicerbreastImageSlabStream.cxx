@@ -0,0 +1,553 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageSlabStream.h"
+#include "vtkSlicerbreastImageAtomicFile.h"
+#include "vtkSlicerbreastImageContentHash.h"
+#include "vtkSlicerbreastImageTaskPool.h"
+#include "vtkSlicerbreastImageTrace.h"
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+
+//QT includes
+#include <QFile>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+typedef vtkSlicerbreastImageVolumeCache::Header Header;
+
+vtkIdType slicePixels(const Header& header)
+{
+	return static_cast<vtkIdType>(header.Dimensions[0]) * header.Dimensions[1];
+}
+
+qint64 rowSize(const Header& header)
+{
+	return static_cast<qint64>(header.Dimensions[0]) * header.NumberOfComponents * header.ScalarSize;
+}
+
+qint64 sliceSize(const Header& header)
+{
+	return static_cast<qint64>(slicePixels(header)) * header.NumberOfComponents * header.ScalarSize;
+}
+
+template <class T>
+void flipSlices(const T* input, T* output, vtkIdType pixels, int components, vtkIdType begin, vtkIdType end)
+{
+	for (vtkIdType k = begin; k < end; k++)
+	{
+		const T* source = input + k * pixels * components;
+		T* destination = output + k * pixels * components;
+		if (components == 1)
+		{
+			std::reverse_copy(source, source + pixels, destination);
+			continue;
+		}
+		for (vtkIdType p = 0; p < pixels; p++)
+		{
+			std::copy(source + (pixels - 1 - p) * components, source + (pixels - p) * components, destination + p * components);
+		}
+	}
+}
+
+template <class T>
+T roundValue(double value)
+{
+	if (std::numeric_limits<T>::is_integer)
+	{
+		return static_cast<T>(std::floor(value + 0.5));
+	}
+	return static_cast<T>(value);
+}
+
+template <class T>
+void downsampleSlices(const T* input, T* output, const Header& in, const Header& out, int factor,
+	vtkIdType begin, vtkIdType end)
+{
+	int components = in.NumberOfComponents;
+	double blockSize = factor * factor;
+	for (vtkIdType k = begin; k < end; k++)
+	{
+		const T* source = input + k * slicePixels(in) * components;
+		T* destination = output + k * slicePixels(out) * components;
+		for (int j = 0; j < out.Dimensions[1]; j++)
+		{
+			for (int i = 0; i < out.Dimensions[0]; i++)
+			{
+				for (int c = 0; c < components; c++)
+				{
+					double sum = 0.;
+					for (int bj = 0; bj < factor; bj++)
+					{
+						const T* row = source + (static_cast<vtkIdType>(j * factor + bj) * in.Dimensions[0] + i * factor) * components + c;
+						for (int bi = 0; bi < factor; bi++)
+						{
+							sum += row[bi * components];
+						}
+					}
+					destination[(static_cast<vtkIdType>(j) * out.Dimensions[0] + i) * components + c] = roundValue<T>(sum / blockSize);
+				}
+			}
+		}
+	}
+}
+
+template <class T>
+void accumulateStatistics(const T* input, vtkIdType values, int components,
+	double& minimum, double& maximum, double& sum, double& sumOfSquares)
+{
+	for (vtkIdType v = 0; v < values; v += components)
+	{
+		double value = input[v];
+		minimum = std::min(minimum, value);
+		maximum = std::max(maximum, value);
+		sum += value;
+		sumOfSquares += value * value;
+	}
+}
+
+template <class T>
+void projectSlices(const T* input, vtkIdType pixels, int components, int count, double* maximum)
+{
+	for (int k = 0; k < count; k++)
+	{
+		const T* slice = input + k * pixels * components;
+		for (vtkIdType p = 0; p < pixels; p++)
+		{
+			maximum[p] = std::max(maximum[p], static_cast<double>(slice[p * components]));
+		}
+	}
+}
+
+template <class T>
+void copyProjection(const std::vector<double>& maximum, T* output)
+{
+	for (size_t p = 0; p < maximum.size(); p++)
+	{
+		output[p] = static_cast<T>(maximum[p]);
+	}
+}
+
+class FlipFunctor : public vtkSlicerbreastImageRangeFunctor
+{
+public:
+	FlipFunctor(const Header& header, const void* input, void* output)
+		: Input(header), InputScalars(input), OutputScalars(output) {}
+	virtual void operator()(vtkIdType begin, vtkIdType end)
+	{
+		switch (this->Input.ScalarType)
+		{
+			vtkTemplateMacro(flipSlices(static_cast<const VTK_TT*>(this->InputScalars), static_cast<VTK_TT*>(this->OutputScalars),
+				slicePixels(this->Input), this->Input.NumberOfComponents, begin, end));
+		}
+	}
+	const Header& Input;
+	const void* InputScalars;
+	void* OutputScalars;
+};
+
+class DownsampleFunctor : public vtkSlicerbreastImageRangeFunctor
+{
+public:
+	DownsampleFunctor(const Header& input, const Header& output, int factor, const void* inputScalars, void* outputScalars)
+		: Input(input), Output(output), Factor(factor), InputScalars(inputScalars), OutputScalars(outputScalars) {}
+	virtual void operator()(vtkIdType begin, vtkIdType end)
+	{
+		switch (this->Input.ScalarType)
+		{
+			vtkTemplateMacro(downsampleSlices(static_cast<const VTK_TT*>(this->InputScalars), static_cast<VTK_TT*>(this->OutputScalars),
+				this->Input, this->Output, this->Factor, begin, end));
+		}
+	}
+	const Header& Input;
+	const Header& Output;
+	int Factor;
+	const void* InputScalars;
+	void* OutputScalars;
+};
+
+// read or write of one slab
+class SlabTask : public vtkSlicerbreastImageTask
+{
+public:
+	SlabTask(QFile* file, qint64 offset, char* buffer, qint64 size, bool write, bool* ok)
+		: File(file), Offset(offset), Buffer(buffer), Size(size), Write(write), Ok(ok) {}
+	virtual void Execute()
+	{
+		*this->Ok = this->File->seek(this->Offset)
+			&& (this->Write ? this->File->write(this->Buffer, this->Size) : this->File->read(this->Buffer, this->Size)) == this->Size;
+	}
+	QFile* File;
+	qint64 Offset;
+	char* Buffer;
+	qint64 Size;
+	bool Write;
+	bool* Ok;
+};
+
+QFuture<void> startTask(vtkSlicerbreastImageTaskPool* pool, vtkSlicerbreastImageTask* task)
+{
+	if (pool)
+	{
+		return pool->Submit(task, vtkSlicerbreastImageTaskPool::BackgroundPriority);
+	}
+	QFuture<void> future = task->GetFuture();
+	task->run();
+	delete task;
+	return future;
+}
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageSlabFlipFilter::Initialize(const Header& input, Header& vtkNotUsed(output))
+{
+	this->Input = input;
+	return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageSlabFlipFilter::ProcessSlab(const void* input, int vtkNotUsed(first), int count, void* output,
+	vtkSlicerbreastImageTaskPool* pool)
+{
+	FlipFunctor functor(this->Input, input, output);
+	if (pool)
+	{
+		pool->ParallelFor(0, count, 1, functor);
+	}
+	else
+	{
+		functor(0, count);
+	}
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageSlabDownsampleFilter::vtkSlicerbreastImageSlabDownsampleFilter(int factor)
+{
+	this->Factor = std::max(factor, 1);
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageSlabDownsampleFilter::Initialize(const Header& input, Header& output)
+{
+	this->Input = input;
+	output.Dimensions[0] = std::max(input.Dimensions[0] / this->Factor, 1);
+	output.Dimensions[1] = std::max(input.Dimensions[1] / this->Factor, 1);
+	// a block is centered between the centers of its first and last pixels
+	double shift = (this->Factor - 1) / 2.;
+	for (int i = 0; i < 3; i++)
+	{
+		output.IJKToRAS[i * 4 + 3] += shift * (input.IJKToRAS[i * 4] + input.IJKToRAS[i * 4 + 1]);
+		output.IJKToRAS[i * 4] *= this->Factor;
+		output.IJKToRAS[i * 4 + 1] *= this->Factor;
+	}
+	this->Output = output;
+	return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageSlabDownsampleFilter::ProcessSlab(const void* input, int vtkNotUsed(first), int count, void* output,
+	vtkSlicerbreastImageTaskPool* pool)
+{
+	DownsampleFunctor functor(this->Input, this->Output, this->Factor, input, output);
+	if (pool)
+	{
+		pool->ParallelFor(0, count, 1, functor);
+	}
+	else
+	{
+		functor(0, count);
+	}
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageSlabStatisticsFilter::vtkSlicerbreastImageSlabStatisticsFilter()
+{
+	this->Minimum = 0.;
+	this->Maximum = 0.;
+	this->Sum = 0.;
+	this->SumOfSquares = 0.;
+	this->Count = 0;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageSlabStatisticsFilter::Initialize(const Header& input, Header& vtkNotUsed(output))
+{
+	this->Input = input;
+	this->Minimum = std::numeric_limits<double>::max();
+	this->Maximum = -std::numeric_limits<double>::max();
+	this->Sum = 0.;
+	this->SumOfSquares = 0.;
+	this->Count = 0;
+	return false;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageSlabStatisticsFilter::ProcessSlab(const void* input, int vtkNotUsed(first), int count,
+	void* vtkNotUsed(output), vtkSlicerbreastImageTaskPool* vtkNotUsed(pool))
+{
+	vtkIdType values = slicePixels(this->Input) * count * this->Input.NumberOfComponents;
+	switch (this->Input.ScalarType)
+	{
+		vtkTemplateMacro(accumulateStatistics(static_cast<const VTK_TT*>(input), values, this->Input.NumberOfComponents,
+			this->Minimum, this->Maximum, this->Sum, this->SumOfSquares));
+	}
+	this->Count += slicePixels(this->Input) * count;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerbreastImageSlabStatisticsFilter::GetMinimum() const
+{
+	return this->Count > 0 ? this->Minimum : 0.;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerbreastImageSlabStatisticsFilter::GetMaximum() const
+{
+	return this->Count > 0 ? this->Maximum : 0.;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerbreastImageSlabStatisticsFilter::GetMean() const
+{
+	return this->Count > 0 ? this->Sum / this->Count : 0.;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerbreastImageSlabStatisticsFilter::GetStandardDeviation() const
+{
+	if (this->Count == 0)
+	{
+		return 0.;
+	}
+	double mean = this->GetMean();
+	return std::sqrt(std::max(this->SumOfSquares / this->Count - mean * mean, 0.));
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkSlicerbreastImageSlabStatisticsFilter::GetNumberOfValues() const
+{
+	return this->Count;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageSlabProjectionFilter::Initialize(const Header& input, Header& vtkNotUsed(output))
+{
+	this->Input = input;
+	this->Maximum.assign(slicePixels(input), -std::numeric_limits<double>::max());
+	return false;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageSlabProjectionFilter::ProcessSlab(const void* input, int vtkNotUsed(first), int count,
+	void* vtkNotUsed(output), vtkSlicerbreastImageTaskPool* vtkNotUsed(pool))
+{
+	switch (this->Input.ScalarType)
+	{
+		vtkTemplateMacro(projectSlices(static_cast<const VTK_TT*>(input), slicePixels(this->Input),
+			this->Input.NumberOfComponents, count, &this->Maximum[0]));
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageSlabProjectionFilter::GetProjection(vtkImageData* image) const
+{
+	vtkDataArray* scalars = vtkDataArray::CreateDataArray(this->Input.ScalarType);
+	if (!image || !scalars)
+	{
+		return;
+	}
+	scalars->SetNumberOfTuples(static_cast<vtkIdType>(this->Maximum.size()));
+	switch (this->Input.ScalarType)
+	{
+		vtkTemplateMacro(copyProjection(this->Maximum, static_cast<VTK_TT*>(scalars->GetVoidPointer(0))));
+	}
+	image->SetDimensions(this->Input.Dimensions[0], this->Input.Dimensions[1], 1);
+	image->GetPointData()->SetScalars(scalars);
+	scalars->Delete();
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerbreastImageSlabStream);
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageSlabStream::vtkSlicerbreastImageSlabStream()
+{
+	this->TaskPool = NULL;
+	this->MaximumSlabSize = 64 * 1024 * 1024;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageSlabStream::~vtkSlicerbreastImageSlabStream()
+{
+	this->SetTaskPool(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageSlabStream::PrintSelf(ostream& os, vtkIndent indent)
+{
+	this->Superclass::PrintSelf(os, indent);
+	os << indent << "MaximumSlabSize: " << this->MaximumSlabSize << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageSlabStream::SetTaskPool(vtkSlicerbreastImageTaskPool* pool)
+{
+	if (pool == this->TaskPool)
+	{
+		return;
+	}
+	if (pool)
+	{
+		pool->Register(this);
+	}
+	if (this->TaskPool)
+	{
+		this->TaskPool->UnRegister(this);
+	}
+	this->TaskPool = pool;
+	this->Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageSlabStream::Run(const QString& inputFileName, const QString& outputFileName,
+	vtkSlicerbreastImageSlabFilter* filter)
+{
+	BREASTIMAGE_TRACE_SCOPE("SlabStream");
+	Header input;
+	if (!filter || !vtkSlicerbreastImageVolumeCache::ReadHeader(inputFileName, input)
+		|| input.Dimensions[2] < 1 || sliceSize(input) <= 0)
+	{
+		vtkErrorMacro("Run: can not read " << inputFileName.toLocal8Bit().constData());
+		return false;
+	}
+	Header output = input;
+	bool writes = filter->Initialize(input, output);
+	int slices = input.Dimensions[2];
+	qint64 inputSliceSize = sliceSize(input);
+	qint64 outputSliceSize = writes ? sliceSize(output) : 0;
+	output.Dimensions[2] = slices;
+	output.DataSize = outputSliceSize * slices;
+	int slabSlices = static_cast<int>(std::min(static_cast<qint64>(slices),
+		std::max(static_cast<qint64>(this->MaximumSlabSize) / (inputSliceSize + outputSliceSize), static_cast<qint64>(1))));
+
+	QFile inputFile(inputFileName);
+	if (!inputFile.open(QFile::ReadOnly))
+	{
+		return false;
+	}
+	QString temporaryName = vtkSlicerbreastImageAtomicFile::TemporaryFileName(outputFileName);
+	QFile outputFile(temporaryName);
+	if (writes && !outputFile.open(QFile::WriteOnly | QFile::Truncate))
+	{
+		vtkErrorMacro("Run: can not write " << outputFileName.toLocal8Bit().constData());
+		return false;
+	}
+
+	// double buffered: slab n is processed while n + 1 is read and n - 1 written
+	std::vector<char> inputSlabs[2];
+	std::vector<char> outputSlabs[2];
+	for (int i = 0; i < 2; i++)
+	{
+		inputSlabs[i].resize(slabSlices * inputSliceSize);
+		outputSlabs[i].resize(writes ? slabSlices * outputSliceSize : 0);
+	}
+	std::vector<quint64> sliceHashes(slices);
+	bool read[2] = { false, false };
+	bool written = true;
+	QFuture<void> writeFuture;
+	QFuture<void> readFuture = startTask(this->TaskPool, new SlabTask(&inputFile, vtkSlicerbreastImageVolumeCache::HeaderSize,
+		&inputSlabs[0][0], slabSlices * inputSliceSize, false, &read[0]));
+
+	bool ok = true;
+	int count = 0;
+	for (int first = 0, slab = 0; first < slices; first += count, slab++)
+	{
+		count = std::min(slabSlices, slices - first);
+		int current = slab % 2;
+		readFuture.waitForFinished();
+		if (!read[current])
+		{
+			ok = false;
+			break;
+		}
+		int next = first + count;
+		if (next < slices)
+		{
+			readFuture = startTask(this->TaskPool, new SlabTask(&inputFile,
+				vtkSlicerbreastImageVolumeCache::HeaderSize + next * inputSliceSize, &inputSlabs[1 - current][0],
+				std::min(slabSlices, slices - next) * inputSliceSize, false, &read[1 - current]));
+		}
+
+		char* outputSlab = writes ? &outputSlabs[current][0] : NULL;
+		filter->ProcessSlab(&inputSlabs[current][0], first, count, outputSlab, this->TaskPool);
+		if (!writes)
+		{
+			continue;
+		}
+		for (int k = 0; k < count; k++)
+		{
+			sliceHashes[first + k] = vtkSlicerbreastImageContentHash::HashSlice(outputSlab + k * outputSliceSize,
+				output.Dimensions[1], rowSize(output));
+		}
+		// the other output buffer is free once the previous write is done
+		writeFuture.waitForFinished();
+		if (!written)
+		{
+			ok = false;
+			break;
+		}
+		writeFuture = startTask(this->TaskPool, new SlabTask(&outputFile,
+			vtkSlicerbreastImageVolumeCache::HeaderSize + first * outputSliceSize, outputSlab,
+			count * outputSliceSize, true, &written));
+	}
+	readFuture.waitForFinished();
+	writeFuture.waitForFinished();
+	filter->Finalize();
+	if (!writes)
+	{
+		return ok;
+	}
+
+	ok = ok && written;
+	if (ok)
+	{
+		// the header last, a complete file has a valid header
+		output.ContentHash = vtkSlicerbreastImageContentHash::CombineSliceHashes(output.Dimensions, output.ScalarType,
+			output.NumberOfComponents, &sliceHashes[0]);
+		QByteArray page(vtkSlicerbreastImageVolumeCache::HeaderSize, '\0');
+		memcpy(page.data(), &output, sizeof(Header));
+		ok = outputFile.seek(0) && outputFile.write(page) == page.size();
+	}
+	outputFile.close();
+	if (!ok || outputFile.error() != QFile::NoError)
+	{
+		QFile::remove(temporaryName);
+		return false;
+	}
+	return vtkSlicerbreastImageAtomicFile::Replace(temporaryName, outputFileName);
+}
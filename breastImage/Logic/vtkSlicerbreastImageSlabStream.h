@@ -0,0 +1,179 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// .NAME vtkSlicerbreastImageSlabStream - process cached volumes a slab at a time
+// .SECTION Description
+// Runs a vtkSlicerbreastImageSlabFilter over a volume file of
+// vtkSlicerbreastImageVolumeCache without loading the volume: slabs of
+// consecutive slices are read, processed and written in turn, so the memory
+// used is four slab buffers whatever the size of the volume. The read of the
+// next slab and the write of the previous one run on the task pool while the
+// current slab is processed. The output file is written under a temporary
+// name, its header and content hash last, and renamed once complete.
+//
+// The filters below flip, downsample, and reduce volumes to statistics or a
+// maximum intensity projection. Filters only see whole slices, operations
+// which need neighbouring slices do not fit this model.
+
+#ifndef __vtkSlicerbreastImageSlabStream_h
+#define __vtkSlicerbreastImageSlabStream_h
+
+// VTK includes
+#include <vtkObject.h>
+
+// QT includes
+#include <QString>
+
+// STD includes
+#include <vector>
+
+#include "vtkSlicerbreastImageVolumeCache.h"
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+class vtkImageData;
+class vtkSlicerbreastImageTaskPool;
+
+/// Operation of vtkSlicerbreastImageSlabStream.
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageSlabFilter
+{
+public:
+  typedef vtkSlicerbreastImageVolumeCache::Header Header;
+
+  virtual ~vtkSlicerbreastImageSlabFilter() {}
+  /// Called before the first slab. output is a copy of input to adjust to
+  /// the output volume, which keeps the number of slices. Return false if
+  /// the filter writes no volume.
+  virtual bool Initialize(const Header& input, Header& output) = 0;
+  /// Process slices [first, first + count). input holds their scalars,
+  /// output has room for the same slices of the output volume or is NULL.
+  /// pool may be NULL.
+  virtual void ProcessSlab(const void* input, int first, int count, void* output,
+    vtkSlicerbreastImageTaskPool* pool) = 0;
+  /// Called after the last slab.
+  virtual void Finalize() {}
+};
+
+/// Rotate every slice by 180 degrees, as vtkSlicerbreastImageLogic::coordinatesTransform.
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageSlabFlipFilter :
+  public vtkSlicerbreastImageSlabFilter
+{
+public:
+  virtual bool Initialize(const Header& input, Header& output);
+  virtual void ProcessSlab(const void* input, int first, int count, void* output,
+    vtkSlicerbreastImageTaskPool* pool);
+
+protected:
+  Header Input;
+};
+
+/// Average blocks of Factor x Factor pixels of each slice. The geometry is
+/// updated so that the volume keeps its place in RAS.
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageSlabDownsampleFilter :
+  public vtkSlicerbreastImageSlabFilter
+{
+public:
+  vtkSlicerbreastImageSlabDownsampleFilter(int factor = 2);
+  virtual bool Initialize(const Header& input, Header& output);
+  virtual void ProcessSlab(const void* input, int first, int count, void* output,
+    vtkSlicerbreastImageTaskPool* pool);
+
+protected:
+  int Factor;
+  Header Input;
+  Header Output;
+};
+
+/// Minimum, maximum, mean and standard deviation of the first component.
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageSlabStatisticsFilter :
+  public vtkSlicerbreastImageSlabFilter
+{
+public:
+  vtkSlicerbreastImageSlabStatisticsFilter();
+  virtual bool Initialize(const Header& input, Header& output);
+  virtual void ProcessSlab(const void* input, int first, int count, void* output,
+    vtkSlicerbreastImageTaskPool* pool);
+
+  double GetMinimum() const;
+  double GetMaximum() const;
+  double GetMean() const;
+  double GetStandardDeviation() const;
+  vtkIdType GetNumberOfValues() const;
+
+protected:
+  Header Input;
+  double Minimum;
+  double Maximum;
+  double Sum;
+  double SumOfSquares;
+  vtkIdType Count;
+};
+
+/// Maximum intensity projection of the first component along the slices.
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageSlabProjectionFilter :
+  public vtkSlicerbreastImageSlabFilter
+{
+public:
+  virtual bool Initialize(const Header& input, Header& output);
+  virtual void ProcessSlab(const void* input, int first, int count, void* output,
+    vtkSlicerbreastImageTaskPool* pool);
+
+  /// Single slice image of the input scalar type holding the projection.
+  void GetProjection(vtkImageData* image) const;
+
+protected:
+  Header Input;
+  std::vector<double> Maximum;
+};
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageSlabStream :
+  public vtkObject
+{
+public:
+
+  static vtkSlicerbreastImageSlabStream *New();
+  vtkTypeMacro(vtkSlicerbreastImageSlabStream, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Pool running the reads, writes and filters, everything runs in the
+  /// calling thread without pool.
+  void SetTaskPool(vtkSlicerbreastImageTaskPool* pool);
+
+  /// Upper bound of the size of a slab, 64 MB by default. A slab holds at
+  /// least one slice.
+  vtkSetMacro(MaximumSlabSize, vtkIdType);
+  vtkGetMacro(MaximumSlabSize, vtkIdType);
+
+  /// Run filter over the volume file inputFileName. outputFileName is
+  /// ignored when the filter writes no volume.
+  bool Run(const QString& inputFileName, const QString& outputFileName, vtkSlicerbreastImageSlabFilter* filter);
+
+protected:
+  vtkSlicerbreastImageSlabStream();
+  virtual ~vtkSlicerbreastImageSlabStream();
+
+  vtkSlicerbreastImageTaskPool* TaskPool;
+  vtkIdType MaximumSlabSize;
+
+private:
+
+  vtkSlicerbreastImageSlabStream(const vtkSlicerbreastImageSlabStream&); // Not implemented
+  void operator=(const vtkSlicerbreastImageSlabStream&); // Not implemented
+};
+
+#endif
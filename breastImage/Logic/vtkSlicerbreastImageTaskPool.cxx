@@ -0,0 +1,225 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageTaskPool.h"
+
+// VTK includes
+#include <vtkObjectFactory.h>
+
+//QT includes
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSharedPointer>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+// STD includes
+#include <algorithm>
+
+namespace
+{
+// chunks of a ParallelFor, shared by the calling thread and the helper tasks
+// which may start after the call returned
+struct ParallelForState
+{
+	ParallelForState() : NextChunk(0), ActiveHelpers(0), Closed(false) {}
+
+	// run chunks until none is left
+	void RunChunks()
+	{
+		for (;;)
+		{
+			vtkIdType chunk = this->NextChunk.fetchAndAddOrdered(1);
+			if (chunk >= this->Chunks)
+			{
+				return;
+			}
+			vtkIdType first = this->Begin + chunk * this->ChunkSize;
+			vtkIdType last = std::min(first + this->ChunkSize, this->End);
+			(*this->Functor)(first, last);
+		}
+	}
+
+	vtkIdType Begin;
+	vtkIdType End;
+	vtkIdType ChunkSize;
+	vtkIdType Chunks;
+	vtkSlicerbreastImageRangeFunctor* Functor;
+	QAtomicInt NextChunk;
+	QMutex Mutex;
+	QWaitCondition HelpersDone;
+	int ActiveHelpers;
+	bool Closed;
+};
+
+class ParallelForHelper : public vtkSlicerbreastImageTask
+{
+public:
+	ParallelForHelper(QSharedPointer<ParallelForState> state) : State(state) {}
+	virtual void Execute()
+	{
+		{
+			QMutexLocker locker(&this->State->Mutex);
+			if (this->State->Closed)
+			{
+				// the caller already ran every chunk
+				return;
+			}
+			this->State->ActiveHelpers++;
+		}
+		this->State->RunChunks();
+		QMutexLocker locker(&this->State->Mutex);
+		this->State->ActiveHelpers--;
+		this->State->HelpersDone.wakeAll();
+	}
+	QSharedPointer<ParallelForState> State;
+};
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageTask::vtkSlicerbreastImageTask()
+{
+	this->setAutoDelete(true);
+	this->Interface.reportStarted();
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageTask::~vtkSlicerbreastImageTask()
+{
+	if (!this->Interface.isFinished())
+	{
+		// never run, do not leave waiters blocked
+		this->Interface.reportFinished();
+	}
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageTask::IsCanceled() const
+{
+	return this->Interface.isCanceled();
+}
+
+//----------------------------------------------------------------------------
+QFuture<void> vtkSlicerbreastImageTask::GetFuture()
+{
+	return this->Interface.future();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageTask::run()
+{
+	if (!this->IsCanceled())
+	{
+		this->Execute();
+	}
+	this->Interface.reportFinished();
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerbreastImageTaskPool);
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageTaskPool::vtkSlicerbreastImageTaskPool()
+{
+	this->Pool = new QThreadPool;
+	this->Pool->setMaxThreadCount(QThread::idealThreadCount());
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageTaskPool::~vtkSlicerbreastImageTaskPool()
+{
+	// waits for the running tasks
+	delete this->Pool;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageTaskPool::PrintSelf(ostream& os, vtkIndent indent)
+{
+	this->Superclass::PrintSelf(os, indent);
+	os << indent << "MaximumThreadCount: " << this->Pool->maxThreadCount() << "\n";
+	os << indent << "ActiveThreadCount: " << this->Pool->activeThreadCount() << "\n";
+}
+
+//----------------------------------------------------------------------------
+QFuture<void> vtkSlicerbreastImageTaskPool::Submit(vtkSlicerbreastImageTask* task, int priority)
+{
+	QFuture<void> future = task->GetFuture();
+	this->Pool->start(task, priority);
+	return future;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageTaskPool::ParallelFor(vtkIdType begin, vtkIdType end, vtkIdType grain,
+	vtkSlicerbreastImageRangeFunctor& functor, int priority)
+{
+	if (end <= begin)
+	{
+		return;
+	}
+	int threads = this->Pool->maxThreadCount();
+	grain = std::max(grain, static_cast<vtkIdType>(1));
+	// a few chunks per thread to balance uneven work
+	vtkIdType chunkSize = std::max(grain, (end - begin + 4 * threads - 1) / (4 * threads));
+	vtkIdType chunks = (end - begin + chunkSize - 1) / chunkSize;
+	if (chunks == 1 || threads <= 1)
+	{
+		functor(begin, end);
+		return;
+	}
+
+	QSharedPointer<ParallelForState> state(new ParallelForState);
+	state->Begin = begin;
+	state->End = end;
+	state->ChunkSize = chunkSize;
+	state->Chunks = chunks;
+	state->Functor = &functor;
+	int helpers = static_cast<int>(std::min(static_cast<vtkIdType>(threads), chunks - 1));
+	for (int i = 0; i < helpers; i++)
+	{
+		this->Pool->start(new ParallelForHelper(state), priority);
+	}
+	state->RunChunks();
+
+	QMutexLocker locker(&state->Mutex);
+	state->Closed = true;
+	while (state->ActiveHelpers > 0)
+	{
+		state->HelpersDone.wait(&state->Mutex);
+	}
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageTaskPool::SetMaximumThreadCount(int count)
+{
+	this->Pool->setMaxThreadCount(std::max(count, 1));
+	this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerbreastImageTaskPool::GetMaximumThreadCount() const
+{
+	return this->Pool->maxThreadCount();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageTaskPool::WaitForDone()
+{
+	this->Pool->waitForDone();
+}
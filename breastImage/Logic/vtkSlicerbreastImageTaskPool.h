@@ -0,0 +1,116 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkSlicerbreastImageTaskPool - worker threads shared by the module
+// .SECTION Description
+// Pool of worker threads sized to the machine and owned by
+// vtkSlicerbreastImageLogic, so that every compute feature of the module
+// shares the same threads. Tasks are queued with a priority (interactive
+// work runs ahead of background work) and return a QFuture that can be
+// canceled, waited on, or watched from the GUI with a QFutureWatcher whose
+// finished() signal is delivered queued to the GUI thread.
+// The pool only depends on QtCore and can be used by headless tools.
+
+#ifndef __vtkSlicerbreastImageTaskPool_h
+#define __vtkSlicerbreastImageTaskPool_h
+
+// VTK includes
+#include <vtkObject.h>
+
+// QT includes
+#include <QFuture>
+#include <QFutureInterface>
+#include <QRunnable>
+
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+class QThreadPool;
+
+/// Unit of work run by vtkSlicerbreastImageTaskPool. The pool deletes the
+/// task once it has run.
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageTask : public QRunnable
+{
+public:
+  vtkSlicerbreastImageTask();
+  virtual ~vtkSlicerbreastImageTask();
+
+  /// Work of the task. Long tasks should poll IsCanceled() and return early.
+  virtual void Execute() = 0;
+  /// Cancellation token, set when the future of the task is canceled.
+  bool IsCanceled() const;
+  QFuture<void> GetFuture();
+
+  virtual void run();
+
+protected:
+  QFutureInterface<void> Interface;
+};
+
+/// Body of vtkSlicerbreastImageTaskPool::ParallelFor, called concurrently
+/// on disjoint [begin, end) ranges.
+class vtkSlicerbreastImageRangeFunctor
+{
+public:
+  virtual ~vtkSlicerbreastImageRangeFunctor() {}
+  virtual void operator()(vtkIdType begin, vtkIdType end) = 0;
+};
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageTaskPool :
+  public vtkObject
+{
+public:
+
+  static vtkSlicerbreastImageTaskPool *New();
+  vtkTypeMacro(vtkSlicerbreastImageTaskPool, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  enum Priority
+  {
+    BackgroundPriority = 0,
+    InteractivePriority = 10
+  };
+
+  /// Queue a task, the pool takes ownership of it.
+  QFuture<void> Submit(vtkSlicerbreastImageTask* task, int priority = BackgroundPriority);
+
+  /// Run functor over [begin, end) split in chunks of at least grain items.
+  /// The calling thread takes part in the work and idle workers pick the
+  /// remaining chunks, so nested calls from a task can not dead-lock.
+  void ParallelFor(vtkIdType begin, vtkIdType end, vtkIdType grain,
+    vtkSlicerbreastImageRangeFunctor& functor, int priority = InteractivePriority);
+
+  /// Number of worker threads, defaults to the number of cores.
+  void SetMaximumThreadCount(int count);
+  int GetMaximumThreadCount() const;
+
+  /// Block until all the queued tasks have run.
+  void WaitForDone();
+
+protected:
+  vtkSlicerbreastImageTaskPool();
+  virtual ~vtkSlicerbreastImageTaskPool();
+
+  QThreadPool* Pool;
+
+private:
+
+  vtkSlicerbreastImageTaskPool(const vtkSlicerbreastImageTaskPool&); // Not implemented
+  void operator=(const vtkSlicerbreastImageTaskPool&); // Not implemented
+};
+
+#endif
@@ -0,0 +1,367 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageTiler.h"
+#include "vtkSlicerbreastImageTaskPool.h"
+#include "vtkSlicerbreastImageTrace.h"
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace
+{
+template <class T>
+T clampValue(double value)
+{
+	if (std::numeric_limits<T>::is_integer)
+	{
+		value = std::floor(value + 0.5);
+		value = std::max(value, static_cast<double>(std::numeric_limits<T>::min()));
+		value = std::min(value, static_cast<double>(std::numeric_limits<T>::max()));
+	}
+	return static_cast<T>(value);
+}
+
+// box mean of radius over the rows of a tile, or the unsharp mask
+// input + amount * (input - mean) when sharpen is set. Column sums of the
+// input extent are kept for the current row, so the cost does not depend
+// on radius.
+template <class T>
+void boxMeanTile(const vtkSlicerbreastImageTile& tile, int radius, bool sharpen, double amount)
+{
+	const T* input = static_cast<const T*>(tile.Input);
+	T* output = static_cast<T*>(tile.Output);
+	const int* extent = tile.Extent;
+	const int* whole = tile.WholeExtent;
+	int first = tile.InputExtent[0];
+	int width = tile.InputExtent[1] - first + 1;
+	std::vector<double> sums(width);
+	for (int k = extent[4]; k <= extent[5]; k++)
+	{
+		const T* slice = input + (k - extent[4]) * tile.InputIncrements[2];
+		T* outputSlice = output + (k - extent[4]) * tile.OutputIncrements[2];
+		for (int c = 0; c < tile.InputComponents; c++)
+		{
+			// input pixel (i, j) of the slice, component c
+			const T* origin = slice - extent[0] * tile.InputIncrements[0] - extent[2] * tile.InputIncrements[1] + c;
+			std::fill(sums.begin(), sums.end(), 0.);
+			for (int j = std::max(extent[2] - radius, whole[2]); j <= std::min(extent[2] + radius, whole[3]); j++)
+			{
+				const T* row = origin + j * tile.InputIncrements[1] + first * tile.InputIncrements[0];
+				for (int i = 0; i < width; i++)
+				{
+					sums[i] += row[i * tile.InputIncrements[0]];
+				}
+			}
+			for (int j = extent[2]; j <= extent[3]; j++)
+			{
+				int rows = std::min(j + radius, whole[3]) - std::max(j - radius, whole[2]) + 1;
+				const T* row = origin + j * tile.InputIncrements[1];
+				T* outputRow = outputSlice + (j - extent[2]) * tile.OutputIncrements[1] + c;
+				double sum = 0.;
+				for (int i = std::max(extent[0] - radius, whole[0]); i <= std::min(extent[0] + radius, whole[1]); i++)
+				{
+					sum += sums[i - first];
+				}
+				for (int i = extent[0]; i <= extent[1]; i++)
+				{
+					int columns = std::min(i + radius, whole[1]) - std::max(i - radius, whole[0]) + 1;
+					double mean = sum / (static_cast<double>(rows) * columns);
+					double value = mean;
+					if (sharpen)
+					{
+						double pixel = row[i * tile.InputIncrements[0]];
+						value = pixel + amount * (pixel - mean);
+					}
+					outputRow[(i - extent[0]) * tile.OutputIncrements[0]] = clampValue<T>(value);
+					if (i + radius + 1 <= whole[1])
+					{
+						sum += sums[i + radius + 1 - first];
+					}
+					if (i - radius >= whole[0])
+					{
+						sum -= sums[i - radius - first];
+					}
+				}
+				// move the column sums to the next row, whole rows are added and
+				// removed
+				if (j + radius + 1 <= whole[3])
+				{
+					const T* added = origin + (j + radius + 1) * tile.InputIncrements[1] + first * tile.InputIncrements[0];
+					for (int i = 0; i < width; i++)
+					{
+						sums[i] += added[i * tile.InputIncrements[0]];
+					}
+				}
+				if (j - radius >= whole[2])
+				{
+					const T* removed = origin + (j - radius) * tile.InputIncrements[1] + first * tile.InputIncrements[0];
+					for (int i = 0; i < width; i++)
+					{
+						sums[i] -= removed[i * tile.InputIncrements[0]];
+					}
+				}
+			}
+		}
+	}
+}
+
+class TileFunctor : public vtkSlicerbreastImageRangeFunctor
+{
+public:
+	virtual void operator()(vtkIdType begin, vtkIdType end)
+	{
+		for (vtkIdType t = begin; t < end; t++)
+		{
+			vtkIdType tileI = t % this->Tiles[0];
+			vtkIdType tileJ = (t / this->Tiles[0]) % this->Tiles[1];
+			vtkIdType k = t / (this->Tiles[0] * this->Tiles[1]);
+			vtkSlicerbreastImageTile tile = this->Tile;
+			tile.Extent[0] = this->Extent[0] + static_cast<int>(tileI) * this->TileSize[0];
+			tile.Extent[1] = std::min(tile.Extent[0] + this->TileSize[0] - 1, this->Extent[1]);
+			tile.Extent[2] = this->Extent[2] + static_cast<int>(tileJ) * this->TileSize[1];
+			tile.Extent[3] = std::min(tile.Extent[2] + this->TileSize[1] - 1, this->Extent[3]);
+			tile.Extent[4] = tile.Extent[5] = this->Extent[4] + static_cast<int>(k);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				tile.InputExtent[2 * axis] = std::max(tile.Extent[2 * axis] - this->Halo[axis], tile.WholeExtent[2 * axis]);
+				tile.InputExtent[2 * axis + 1] = std::min(tile.Extent[2 * axis + 1] + this->Halo[axis], tile.WholeExtent[2 * axis + 1]);
+			}
+			vtkIdType inputOffset = 0;
+			vtkIdType outputOffset = 0;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				inputOffset += (tile.Extent[2 * axis] - tile.WholeExtent[2 * axis]) * tile.InputIncrements[axis];
+				outputOffset += (tile.Extent[2 * axis] - this->OutputOrigin[axis]) * tile.OutputIncrements[axis];
+			}
+			tile.Input = static_cast<const char*>(this->Tile.Input) + inputOffset * this->InputScalarSize;
+			tile.Output = static_cast<char*>(this->Tile.Output) + outputOffset * this->OutputScalarSize;
+			this->Kernel->ProcessTile(tile);
+		}
+	}
+	vtkSlicerbreastImageTileKernel* Kernel;
+	// pointers of the tile at the origin of the whole extent, and of the
+	// output extent for the output
+	vtkSlicerbreastImageTile Tile;
+	int OutputOrigin[3];
+	int InputScalarSize;
+	int OutputScalarSize;
+	int Extent[6];
+	int Halo[3];
+	int TileSize[2];
+	vtkIdType Tiles[2];
+};
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageTileBoxMeanKernel::vtkSlicerbreastImageTileBoxMeanKernel(int radius)
+{
+	this->Radius = std::max(radius, 0);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageTileBoxMeanKernel::GetHalo(int halo[3])
+{
+	halo[0] = halo[1] = this->Radius;
+	halo[2] = 0;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageTileBoxMeanKernel::ProcessTile(const vtkSlicerbreastImageTile& tile)
+{
+	switch (tile.InputScalarType)
+	{
+		vtkTemplateMacro(boxMeanTile<VTK_TT>(tile, this->Radius, false, 0.));
+	}
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageTileUnsharpMaskKernel::vtkSlicerbreastImageTileUnsharpMaskKernel(int radius, double amount)
+	: vtkSlicerbreastImageTileBoxMeanKernel(radius)
+{
+	this->Amount = amount;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageTileUnsharpMaskKernel::ProcessTile(const vtkSlicerbreastImageTile& tile)
+{
+	switch (tile.InputScalarType)
+	{
+		vtkTemplateMacro(boxMeanTile<VTK_TT>(tile, this->Radius, true, this->Amount));
+	}
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerbreastImageTiler);
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageTiler::vtkSlicerbreastImageTiler()
+{
+	this->TaskPool = NULL;
+	this->MaximumTileSize = 256 * 1024;
+	this->Halo[0] = this->Halo[1] = this->Halo[2] = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageTiler::~vtkSlicerbreastImageTiler()
+{
+	this->SetTaskPool(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageTiler::PrintSelf(ostream& os, vtkIndent indent)
+{
+	this->Superclass::PrintSelf(os, indent);
+	os << indent << "MaximumTileSize: " << this->MaximumTileSize << "\n";
+	os << indent << "Halo: " << this->Halo[0] << " " << this->Halo[1] << " " << this->Halo[2] << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageTiler::SetTaskPool(vtkSlicerbreastImageTaskPool* pool)
+{
+	if (pool == this->TaskPool)
+	{
+		return;
+	}
+	if (pool)
+	{
+		pool->Register(this);
+	}
+	if (this->TaskPool)
+	{
+		this->TaskPool->UnRegister(this);
+	}
+	this->TaskPool = pool;
+	this->Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageTiler::Run(vtkImageData* input, vtkImageData* output, vtkSlicerbreastImageTileKernel* kernel,
+	const int extent[6])
+{
+	BREASTIMAGE_TRACE_SCOPE("Tiler");
+	if (!input || !output || !kernel || input == output || !input->GetPointData()->GetScalars())
+	{
+		vtkErrorMacro("Run: invalid input, output or kernel");
+		return false;
+	}
+	TileFunctor functor;
+	functor.Kernel = kernel;
+	vtkSlicerbreastImageTile& tile = functor.Tile;
+	input->GetExtent(tile.WholeExtent);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		int first = extent ? std::max(extent[2 * axis], tile.WholeExtent[2 * axis]) : tile.WholeExtent[2 * axis];
+		int last = extent ? std::min(extent[2 * axis + 1], tile.WholeExtent[2 * axis + 1]) : tile.WholeExtent[2 * axis + 1];
+		if (first > last)
+		{
+			// nothing to do
+			return true;
+		}
+		functor.Extent[2 * axis] = first;
+		functor.Extent[2 * axis + 1] = last;
+	}
+
+	tile.InputScalarType = input->GetScalarType();
+	tile.InputComponents = input->GetNumberOfScalarComponents();
+	kernel->GetOutputScalarType(tile.InputScalarType, tile.InputComponents, tile.OutputScalarType, tile.OutputComponents);
+	int* dims = input->GetDimensions();
+	vtkDataArray* outputScalars = output->GetPointData()->GetScalars();
+	int outputExtent[6];
+	output->GetExtent(outputExtent);
+	bool outputContainsExtent = outputScalars
+		&& outputScalars->GetNumberOfTuples() == static_cast<vtkIdType>(output->GetNumberOfPoints());
+	for (int axis = 0; axis < 3; axis++)
+	{
+		outputContainsExtent = outputContainsExtent && outputExtent[2 * axis] <= functor.Extent[2 * axis]
+			&& outputExtent[2 * axis + 1] >= functor.Extent[2 * axis + 1];
+	}
+	if (!outputContainsExtent || outputScalars->GetDataType() != tile.OutputScalarType
+		|| outputScalars->GetNumberOfComponents() != tile.OutputComponents)
+	{
+		outputScalars = vtkDataArray::CreateDataArray(tile.OutputScalarType);
+		outputScalars->SetNumberOfComponents(tile.OutputComponents);
+		outputScalars->SetNumberOfTuples(static_cast<vtkIdType>(dims[0]) * dims[1] * dims[2]);
+		output->SetExtent(tile.WholeExtent);
+		output->SetOrigin(input->GetOrigin());
+		output->SetSpacing(input->GetSpacing());
+		output->GetPointData()->SetScalars(outputScalars);
+		outputScalars->Delete();
+		output->GetExtent(outputExtent);
+	}
+	int outputDims[3];
+	output->GetDimensions(outputDims);
+
+	tile.Input = input->GetScalarPointer();
+	tile.Output = output->GetScalarPointer();
+	tile.InputIncrements[0] = tile.InputComponents;
+	tile.InputIncrements[1] = tile.InputIncrements[0] * dims[0];
+	tile.InputIncrements[2] = tile.InputIncrements[1] * dims[1];
+	tile.OutputIncrements[0] = tile.OutputComponents;
+	tile.OutputIncrements[1] = tile.OutputIncrements[0] * outputDims[0];
+	tile.OutputIncrements[2] = tile.OutputIncrements[1] * outputDims[1];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		functor.OutputOrigin[axis] = outputExtent[2 * axis];
+	}
+	functor.InputScalarSize = input->GetScalarSize();
+	functor.OutputScalarSize = output->GetScalarSize();
+
+	int kernelHalo[3];
+	kernel->GetHalo(kernelHalo);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		functor.Halo[axis] = std::max(this->Halo[axis], 0) + std::max(kernelHalo[axis], 0);
+	}
+	// square tiles whose input with halo and output fit in MaximumTileSize,
+	// narrowed to the extent, taller when the extent is narrow
+	vtkIdType pixelSize = static_cast<vtkIdType>(functor.InputScalarSize) * tile.InputComponents
+		+ static_cast<vtkIdType>(functor.OutputScalarSize) * tile.OutputComponents;
+	vtkIdType pixels = std::max(this->MaximumTileSize / pixelSize, vtkIdType(1));
+	int side = static_cast<int>(std::sqrt(static_cast<double>(pixels))) - 2 * std::max(functor.Halo[0], functor.Halo[1]);
+	// a tile much smaller than its halo mostly reads the halo
+	side = std::max(side, 16);
+	int width = functor.Extent[1] - functor.Extent[0] + 1;
+	int height = functor.Extent[3] - functor.Extent[2] + 1;
+	functor.TileSize[0] = std::min(side, width);
+	functor.TileSize[1] = static_cast<int>(pixels / (functor.TileSize[0] + 2 * functor.Halo[0])) - 2 * functor.Halo[1];
+	functor.TileSize[1] = std::min(std::max(functor.TileSize[1], 1), height);
+	functor.Tiles[0] = (width + functor.TileSize[0] - 1) / functor.TileSize[0];
+	functor.Tiles[1] = (height + functor.TileSize[1] - 1) / functor.TileSize[1];
+	vtkIdType tiles = functor.Tiles[0] * functor.Tiles[1] * (functor.Extent[5] - functor.Extent[4] + 1);
+
+	if (this->TaskPool)
+	{
+		this->TaskPool->ParallelFor(0, tiles, 1, functor);
+	}
+	else
+	{
+		functor(0, tiles);
+	}
+	output->Modified();
+	return true;
+}
@@ -0,0 +1,156 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkSlicerbreastImageTiler - run neighbourhood filters tile by tile
+// .SECTION Description
+// Splits the extent of a vtkImageData in tiles of a few hundred kilobytes,
+// so that the pixels a kernel reads and writes stay in the cache of the
+// core running it, and runs a vtkSlicerbreastImageTileKernel over the tiles
+// on the task pool. Tiles are rectangles of one slice, their halo is the
+// border of input pixels around them which the kernel may read.
+// Each tile writes only its own pixels of a separate output image while the
+// halos read the unmodified input, so the output is the one of a filter run
+// over the whole image, without seams between tiles.
+//
+// The kernels below compute a box mean and an unsharp mask.
+
+#ifndef __vtkSlicerbreastImageTiler_h
+#define __vtkSlicerbreastImageTiler_h
+
+// VTK includes
+#include <vtkObject.h>
+
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+class vtkImageData;
+class vtkSlicerbreastImageTaskPool;
+
+/// Region handed to vtkSlicerbreastImageTileKernel::ProcessTile. Pointers
+/// are to the first pixel of Extent, in the input and in the output image
+/// whose extent may be smaller. Increments are in scalars, so the
+/// pixel (i, j, k) of the image, component c, is at
+/// Input[(i - Extent[0]) * InputIncrements[0] + (j - Extent[2]) * InputIncrements[1]
+///   + (k - Extent[4]) * InputIncrements[2] + c]. Negative offsets reach the halo.
+struct vtkSlicerbreastImageTile
+{
+  /// Pixels written by the kernel, (imin, imax, jmin, jmax, kmin, kmax).
+  int Extent[6];
+  /// Pixels which may be read: Extent grown by the halo, clipped to the image.
+  int InputExtent[6];
+  /// Extent of the whole image.
+  int WholeExtent[6];
+  const void* Input;
+  vtkIdType InputIncrements[3];
+  int InputScalarType;
+  int InputComponents;
+  void* Output;
+  vtkIdType OutputIncrements[3];
+  int OutputScalarType;
+  int OutputComponents;
+};
+
+/// Operation of vtkSlicerbreastImageTiler, called concurrently on disjoint tiles.
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageTileKernel
+{
+public:
+  virtual ~vtkSlicerbreastImageTileKernel() {}
+  /// Pixels read around each output pixel along i, j and k.
+  virtual void GetHalo(int halo[3]) { halo[0] = halo[1] = halo[2] = 0; }
+  /// Scalar type and number of components of the output, by default the
+  /// ones of the input.
+  virtual void GetOutputScalarType(int inputScalarType, int inputComponents,
+    int& outputScalarType, int& outputComponents)
+  {
+    outputScalarType = inputScalarType;
+    outputComponents = inputComponents;
+  }
+  virtual void ProcessTile(const vtkSlicerbreastImageTile& tile) = 0;
+};
+
+/// Mean of every component over a (2 Radius + 1) square of each slice,
+/// clipped at the image borders.
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageTileBoxMeanKernel :
+  public vtkSlicerbreastImageTileKernel
+{
+public:
+  vtkSlicerbreastImageTileBoxMeanKernel(int radius = 1);
+  virtual void GetHalo(int halo[3]);
+  virtual void ProcessTile(const vtkSlicerbreastImageTile& tile);
+
+protected:
+  int Radius;
+};
+
+/// Unsharp mask: input + Amount * (input - box mean over Radius), clamped
+/// to the range of the scalar type.
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageTileUnsharpMaskKernel :
+  public vtkSlicerbreastImageTileBoxMeanKernel
+{
+public:
+  vtkSlicerbreastImageTileUnsharpMaskKernel(int radius = 4, double amount = 1.);
+  virtual void ProcessTile(const vtkSlicerbreastImageTile& tile);
+
+protected:
+  double Amount;
+};
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageTiler :
+  public vtkObject
+{
+public:
+
+  static vtkSlicerbreastImageTiler *New();
+  vtkTypeMacro(vtkSlicerbreastImageTiler, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Pool running the tiles, everything runs in the calling thread without pool.
+  void SetTaskPool(vtkSlicerbreastImageTaskPool* pool);
+
+  /// Upper bound of the input and output bytes of a tile with its halo,
+  /// 256 KB (a level 2 cache) by default. A tile holds at least one row.
+  vtkSetMacro(MaximumTileSize, vtkIdType);
+  vtkGetMacro(MaximumTileSize, vtkIdType);
+
+  /// Halo along i, j and k added to the one the kernel asks for.
+  vtkSetVector3Macro(Halo, int);
+  vtkGetVector3Macro(Halo, int);
+
+  /// Run kernel over every pixel of input, or over extent (imin, imax, jmin,
+  /// jmax, kmin, kmax) of input only. An output whose scalars have the type
+  /// and components of the kernel output and whose extent contains the
+  /// processed extent is written in place, such as a small image covering an
+  /// ROI. Otherwise output gets the geometry of input and new scalars.
+  /// Pixels outside extent are left as they are. output can not be input.
+  bool Run(vtkImageData* input, vtkImageData* output, vtkSlicerbreastImageTileKernel* kernel,
+    const int extent[6] = 0);
+
+protected:
+  vtkSlicerbreastImageTiler();
+  virtual ~vtkSlicerbreastImageTiler();
+
+  vtkSlicerbreastImageTaskPool* TaskPool;
+  vtkIdType MaximumTileSize;
+  int Halo[3];
+
+private:
+
+  vtkSlicerbreastImageTiler(const vtkSlicerbreastImageTiler&); // Not implemented
+  void operator=(const vtkSlicerbreastImageTiler&); // Not implemented
+};
+
+#endif
@@ -0,0 +1,204 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageTrace.h"
+
+//QT includes
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThreadStorage>
+
+namespace
+{
+// slots of the ring are indexed by the low bits of the ticket
+const quint32 bufferMask = vtkSlicerbreastImageTrace::BufferSize - 1;
+
+struct TraceEvent
+{
+	TraceEvent() : Sequence(0) {}
+	// ticket + 1 of the event once written, 0 while it is written
+	QAtomicInt Sequence;
+	const char* Name;
+	qint64 Start;
+	qint64 Duration;
+};
+
+// events of one thread. Tickets are claimed atomically and counted modulo
+// 2^32, which BufferSize divides, so the count wraps with the ring
+struct ThreadBuffer
+{
+	ThreadBuffer(int threadId) : ThreadId(threadId), Count(0), Cleared(0) {}
+	int ThreadId;
+	// tickets claimed
+	QAtomicInt Count;
+	// first ticket after the last Clear
+	QAtomicInt Cleared;
+	TraceEvent Events[vtkSlicerbreastImageTrace::BufferSize];
+};
+
+// the buffers outlive their thread so that the events of finished worker
+// threads can still be exported, the thread storage only holds a handle
+struct ThreadBufferHandle
+{
+	ThreadBuffer* Buffer;
+};
+
+struct TraceRegistry
+{
+	TraceRegistry()
+	{
+		this->Clock.start();
+	}
+	~TraceRegistry()
+	{
+		qDeleteAll(this->Buffers);
+	}
+	QElapsedTimer Clock;
+	QMutex Mutex;
+	QList<ThreadBuffer*> Buffers;
+	QThreadStorage<ThreadBufferHandle*> Current;
+};
+Q_GLOBAL_STATIC(TraceRegistry, traceRegistry);
+
+ThreadBuffer* currentBuffer()
+{
+	TraceRegistry* registry = traceRegistry();
+	if (!registry->Current.hasLocalData())
+	{
+		ThreadBufferHandle* handle = new ThreadBufferHandle;
+		QMutexLocker locker(&registry->Mutex);
+		handle->Buffer = new ThreadBuffer(registry->Buffers.size() + 1);
+		registry->Buffers.append(handle->Buffer);
+		registry->Current.setLocalData(handle);
+	}
+	return registry->Current.localData()->Buffer;
+}
+
+QString escapeJson(const char* name)
+{
+	QString escaped = QString::fromLatin1(name);
+	escaped.replace('\\', "\\\\");
+	escaped.replace('"', "\\\"");
+	return escaped;
+}
+}
+
+//----------------------------------------------------------------------------
+const int vtkSlicerbreastImageTrace::BufferSize;
+
+//----------------------------------------------------------------------------
+qint64 vtkSlicerbreastImageTrace::Now()
+{
+	return traceRegistry()->Clock.nsecsElapsed();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageTrace::Record(const char* name, qint64 start, qint64 end)
+{
+	ThreadBuffer* buffer = currentBuffer();
+	quint32 ticket = static_cast<quint32>(buffer->Count.fetchAndAddOrdered(1));
+	TraceEvent& event = buffer->Events[ticket & bufferMask];
+	// a reader skips the slot while it is written, then checks that the
+	// sequence did not change while it copied the event
+	event.Sequence.fetchAndStoreOrdered(0);
+	event.Name = name;
+	event.Start = start;
+	event.Duration = end - start;
+	event.Sequence.fetchAndStoreRelease(static_cast<int>(ticket + 1));
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageTrace::WriteChromeTrace(const QString& fileName)
+{
+	QFile file(fileName);
+	if (!file.open(QFile::WriteOnly | QFile::Truncate | QFile::Text))
+	{
+		return false;
+	}
+	QTextStream out(&file);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	qint64 pid = QCoreApplication::applicationPid();
+	bool first = true;
+
+	TraceRegistry* registry = traceRegistry();
+	QMutexLocker locker(&registry->Mutex);
+	foreach(ThreadBuffer* buffer, registry->Buffers)
+	{
+		quint32 count = static_cast<quint32>(buffer->Count.fetchAndAddAcquire(0));
+		quint32 cleared = static_cast<quint32>(buffer->Cleared.fetchAndAddAcquire(0));
+		// the last BufferSize tickets since the last Clear
+		quint32 events = qMin(count - cleared, static_cast<quint32>(BufferSize));
+		for (quint32 ticket = count - events; ticket != count; ticket++)
+		{
+			TraceEvent& slot = buffer->Events[ticket & bufferMask];
+			int sequence = slot.Sequence.fetchAndAddAcquire(0);
+			if (sequence != static_cast<int>(ticket + 1))
+			{
+				// being written, or overwritten by a later ticket
+				continue;
+			}
+			TraceEvent event;
+			event.Name = slot.Name;
+			event.Start = slot.Start;
+			event.Duration = slot.Duration;
+			if (slot.Sequence.fetchAndAddOrdered(0) != sequence)
+			{
+				// torn by a writer
+				continue;
+			}
+			out << (first ? "" : ",") << "\n{\"name\":\"" << escapeJson(event.Name)
+				<< "\",\"cat\":\"breastImage\",\"ph\":\"X\",\"ts\":" << QString::number(event.Start / 1000., 'f', 3)
+				<< ",\"dur\":" << QString::number(event.Duration / 1000., 'f', 3)
+				<< ",\"pid\":" << pid << ",\"tid\":" << buffer->ThreadId << "}";
+			first = false;
+		}
+	}
+	out << "\n]}\n";
+	out.flush();
+	file.close();
+	return out.status() == QTextStream::Ok;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageTrace::Clear()
+{
+	TraceRegistry* registry = traceRegistry();
+	QMutexLocker locker(&registry->Mutex);
+	foreach(ThreadBuffer* buffer, registry->Buffers)
+	{
+		// the tickets keep counting, so the slots of earlier events can not
+		// be taken for later ones
+		buffer->Cleared.fetchAndStoreRelease(buffer->Count.fetchAndAddAcquire(0));
+	}
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageTrace::IsEnabled()
+{
+#ifdef BREASTIMAGE_ENABLE_TRACE
+	return true;
+#else
+	return false;
+#endif
+}
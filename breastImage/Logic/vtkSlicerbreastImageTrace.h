@@ -0,0 +1,87 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// .NAME vtkSlicerbreastImageTrace - scoped timers exported as Chrome trace
+// .SECTION Description
+// Lightweight instrumentation of the module hot paths. A scope is timed with
+//   BREASTIMAGE_TRACE_SCOPE("name");
+// and the event is stored in a ring buffer owned by the calling thread, so
+// recording never takes a lock. Slots are claimed with an atomic ticket and
+// published with a per-slot sequence, so an export running alongside skips
+// the events being written instead of reading them torn. WriteChromeTrace
+// exports the buffered events in the Chrome trace_event JSON format
+// (chrome://tracing, Perfetto).
+// The macro compiles to nothing unless the module is configured with
+// breastImage_ENABLE_TRACE.
+
+#ifndef __vtkSlicerbreastImageTrace_h
+#define __vtkSlicerbreastImageTrace_h
+
+// QT includes
+#include <QtGlobal>
+#include <QString>
+
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageTrace
+{
+public:
+  /// Number of events kept per thread, older events are overwritten. A
+  /// power of two.
+  static const int BufferSize = 16384;
+
+  /// Nanoseconds since the first use of the trace.
+  static qint64 Now();
+  /// Record a complete event of the calling thread. name must be a string literal.
+  static void Record(const char* name, qint64 start, qint64 end);
+  /// Write the buffered events of all the threads, return false on error.
+  static bool WriteChromeTrace(const QString& fileName);
+  /// Drop the buffered events.
+  static void Clear();
+  /// Whether the trace was compiled in.
+  static bool IsEnabled();
+};
+
+/// RAII timer of the enclosing scope
+class vtkSlicerbreastImageTraceScope
+{
+public:
+  vtkSlicerbreastImageTraceScope(const char* name)
+    : Name(name), Start(vtkSlicerbreastImageTrace::Now())
+  {
+  }
+  ~vtkSlicerbreastImageTraceScope()
+  {
+    vtkSlicerbreastImageTrace::Record(this->Name, this->Start, vtkSlicerbreastImageTrace::Now());
+  }
+private:
+  const char* Name;
+  qint64 Start;
+};
+
+#define BREASTIMAGE_TRACE_CONCAT_(a, b) a##b
+#define BREASTIMAGE_TRACE_CONCAT(a, b) BREASTIMAGE_TRACE_CONCAT_(a, b)
+
+#ifdef BREASTIMAGE_ENABLE_TRACE
+#define BREASTIMAGE_TRACE_SCOPE(name) \
+  vtkSlicerbreastImageTraceScope BREASTIMAGE_TRACE_CONCAT(breastImageTraceScope, __LINE__)(name)
+#else
+#define BREASTIMAGE_TRACE_SCOPE(name)
+#endif
+
+#endif
@@ -0,0 +1,350 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageVolumeCache.h"
+#include "vtkSlicerbreastImageAtomicFile.h"
+#include "vtkSlicerbreastImageContentHash.h"
+#include "vtkSlicerbreastImageTrace.h"
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+
+//QT includes
+#include <QDir>
+#include <QFile>
+
+// STD includes
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifndef _WIN32
+struct MappedRegion
+{
+	void* Address;
+	size_t Length;
+};
+
+// observer of the scalar array deletion
+void unmapRegion(vtkObject* vtkNotUsed(caller), unsigned long vtkNotUsed(eventId), void* clientData, void* vtkNotUsed(callData))
+{
+	MappedRegion* region = static_cast<MappedRegion*>(clientData);
+	munmap(region->Address, region->Length);
+	delete region;
+}
+
+// map the file privately, NULL on failure
+void* mapFile(const QString& fileName, size_t length)
+{
+	int fd = open(QFile::encodeName(fileName).constData(), O_RDONLY);
+	if (fd < 0)
+	{
+		return NULL;
+	}
+	void* address = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	// the mapping keeps the file referenced
+	close(fd);
+	return address == MAP_FAILED ? NULL : address;
+}
+#endif
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerbreastImageVolumeCache);
+
+//----------------------------------------------------------------------------
+const quint16 vtkSlicerbreastImageVolumeCache::Version;
+const quint32 vtkSlicerbreastImageVolumeCache::HeaderSize;
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageVolumeCache::vtkSlicerbreastImageVolumeCache()
+{
+	this->Directory = QDir::home().filePath(".breastImage/volumeCache");
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerbreastImageVolumeCache::~vtkSlicerbreastImageVolumeCache()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageVolumeCache::PrintSelf(ostream& os, vtkIndent indent)
+{
+	this->Superclass::PrintSelf(os, indent);
+	os << indent << "Directory: " << this->Directory.toLocal8Bit().constData() << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageVolumeCache::SetDirectory(const QString& directory)
+{
+	if (directory == this->Directory)
+	{
+		return;
+	}
+	this->Directory = directory;
+	this->Modified();
+}
+
+//----------------------------------------------------------------------------
+QString vtkSlicerbreastImageVolumeCache::GetDirectory() const
+{
+	return this->Directory;
+}
+
+//----------------------------------------------------------------------------
+QString vtkSlicerbreastImageVolumeCache::GetFileName(const QString& key) const
+{
+	QByteArray utf8 = key.toUtf8();
+	QString name = vtkSlicerbreastImageContentHash::ToString(vtkSlicerbreastImageContentHash::Hash(utf8.constData(), utf8.size()));
+	return QDir(this->Directory).filePath(name + ".bivc");
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageVolumeCache::Contains(const QString& key) const
+{
+	Header header;
+	return ReadHeader(this->GetFileName(key), header);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerbreastImageVolumeCache::Remove(const QString& key)
+{
+	// open mappings keep their pages
+	QFile::remove(this->GetFileName(key));
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageVolumeCache::ReadHeader(const QString& fileName, Header& header)
+{
+	QFile file(fileName);
+	if (!file.open(QFile::ReadOnly)
+		|| file.read(reinterpret_cast<char*>(&header), sizeof(Header)) != sizeof(Header))
+	{
+		return false;
+	}
+	if (memcmp(header.Magic, "BIVC", 4) != 0 || header.Version != Version || header.HeaderSize != HeaderSize)
+	{
+		return false;
+	}
+	quint64 dataSize = static_cast<quint64>(header.ScalarSize) * header.NumberOfComponents;
+	for (int i = 0; i < 3; i++)
+	{
+		dataSize *= header.Dimensions[i];
+	}
+	return header.DataSize == dataSize && static_cast<quint64>(file.size()) >= HeaderSize + dataSize;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageVolumeCache::Write(const QString& key, vtkImageData* image, vtkMatrix4x4* ijkToRAS, quint64 contentHash)
+{
+	BREASTIMAGE_TRACE_SCOPE("WriteVolumeCache");
+	if (!image || !image->GetScalarPointer() || !ijkToRAS)
+	{
+		return false;
+	}
+	if (!QDir().mkpath(this->Directory))
+	{
+		vtkErrorMacro("Write: can not create " << this->Directory.toLocal8Bit().constData());
+		return false;
+	}
+
+	Header header;
+	memset(&header, 0, sizeof(Header));
+	memcpy(header.Magic, "BIVC", 4);
+	header.Version = Version;
+	header.HeaderSize = HeaderSize;
+	image->GetDimensions(header.Dimensions);
+	header.ScalarType = image->GetScalarType();
+	header.NumberOfComponents = image->GetNumberOfScalarComponents();
+	header.ScalarSize = image->GetScalarSize();
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			header.IJKToRAS[i * 4 + j] = ijkToRAS->GetElement(i, j);
+		}
+	}
+	header.ContentHash = contentHash;
+	header.DataSize = static_cast<quint64>(header.ScalarSize) * header.NumberOfComponents
+		* header.Dimensions[0] * header.Dimensions[1] * header.Dimensions[2];
+
+	QString fileName = this->GetFileName(key);
+	QString temporaryName = vtkSlicerbreastImageAtomicFile::TemporaryFileName(fileName);
+	QFile file(temporaryName);
+	if (!file.open(QFile::WriteOnly | QFile::Truncate))
+	{
+		return false;
+	}
+	QByteArray page(HeaderSize, '\0');
+	memcpy(page.data(), &header, sizeof(Header));
+	bool written = file.write(page) == page.size()
+		&& file.write(static_cast<const char*>(image->GetScalarPointer()), header.DataSize) == static_cast<qint64>(header.DataSize);
+	file.close();
+	if (!written || file.error() != QFile::NoError)
+	{
+		QFile::remove(temporaryName);
+		return false;
+	}
+	return vtkSlicerbreastImageAtomicFile::Replace(temporaryName, fileName);
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageVolumeCache::Read(const QString& key, vtkImageData* image, vtkMatrix4x4* ijkToRAS, quint64* contentHash)
+{
+	BREASTIMAGE_TRACE_SCOPE("ReadVolumeCache");
+	QString fileName = this->GetFileName(key);
+	Header header;
+	if (!image || !ijkToRAS || !ReadHeader(fileName, header))
+	{
+		return false;
+	}
+	vtkDataArray* scalars = vtkDataArray::CreateDataArray(header.ScalarType);
+	if (!scalars)
+	{
+		return false;
+	}
+	if (scalars->GetDataTypeSize() != header.ScalarSize)
+	{
+		scalars->Delete();
+		return false;
+	}
+	scalars->SetNumberOfComponents(header.NumberOfComponents);
+	vtkIdType tuples = static_cast<vtkIdType>(header.Dimensions[0]) * header.Dimensions[1] * header.Dimensions[2];
+
+	bool mapped = false;
+#ifndef _WIN32
+	// whole file from offset 0, which is aligned for any page size
+	size_t length = HeaderSize + header.DataSize;
+	void* address = mapFile(fileName, length);
+	if (address)
+	{
+		// save = 1: the array does not free the mapping, the observer unmaps it
+		scalars->SetVoidArray(static_cast<char*>(address) + HeaderSize, tuples * header.NumberOfComponents, 1);
+		MappedRegion* region = new MappedRegion;
+		region->Address = address;
+		region->Length = length;
+		vtkCallbackCommand* unmap = vtkCallbackCommand::New();
+		unmap->SetCallback(unmapRegion);
+		unmap->SetClientData(region);
+		scalars->AddObserver(vtkCommand::DeleteEvent, unmap);
+		unmap->Delete();
+		mapped = true;
+	}
+#endif
+	if (!mapped)
+	{
+		scalars->SetNumberOfTuples(tuples);
+		QFile file(fileName);
+		if (!file.open(QFile::ReadOnly) || !file.seek(HeaderSize)
+			|| file.read(static_cast<char*>(scalars->GetVoidPointer(0)), header.DataSize) != static_cast<qint64>(header.DataSize))
+		{
+			scalars->Delete();
+			return false;
+		}
+	}
+
+	image->SetDimensions(header.Dimensions);
+	image->SetOrigin(0., 0., 0.);
+	image->SetSpacing(1., 1., 1.);
+	image->GetPointData()->SetScalars(scalars);
+	scalars->Delete();
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			ijkToRAS->SetElement(i, j, header.IJKToRAS[i * 4 + j]);
+		}
+	}
+	if (contentHash)
+	{
+		*contentHash = header.ContentHash;
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerbreastImageVolumeCache::ReadPreview(const QString& key, int factor, vtkImageData* image, vtkMatrix4x4* ijkToRAS)
+{
+	BREASTIMAGE_TRACE_SCOPE("ReadVolumeCachePreview");
+	QFile file(this->GetFileName(key));
+	Header header;
+	if (!image || !ijkToRAS || factor < 1 || !ReadHeader(file.fileName(), header) || !file.open(QFile::ReadOnly))
+	{
+		return false;
+	}
+	const uchar* data = file.map(HeaderSize, header.DataSize);
+	vtkDataArray* scalars = vtkDataArray::CreateDataArray(header.ScalarType);
+	if (!data || !scalars)
+	{
+		if (scalars)
+		{
+			scalars->Delete();
+		}
+		return false;
+	}
+
+	int dimensions[3] = {
+		(header.Dimensions[0] + factor - 1) / factor,
+		(header.Dimensions[1] + factor - 1) / factor,
+		header.Dimensions[2] };
+	size_t pixelSize = static_cast<size_t>(header.ScalarSize) * header.NumberOfComponents;
+	size_t rowSize = pixelSize * header.Dimensions[0];
+	size_t sliceSize = rowSize * header.Dimensions[1];
+	scalars->SetNumberOfComponents(header.NumberOfComponents);
+	scalars->SetNumberOfTuples(static_cast<vtkIdType>(dimensions[0]) * dimensions[1] * dimensions[2]);
+	char* destination = static_cast<char*>(scalars->GetVoidPointer(0));
+	for (int k = 0; k < dimensions[2]; k++)
+	{
+		for (int j = 0; j < dimensions[1]; j++)
+		{
+			const uchar* row = data + k * sliceSize + j * factor * rowSize;
+			for (int i = 0; i < dimensions[0]; i++)
+			{
+				memcpy(destination, row + i * factor * pixelSize, pixelSize);
+				destination += pixelSize;
+			}
+		}
+	}
+	file.unmap(const_cast<uchar*>(data));
+
+	image->SetDimensions(dimensions);
+	image->SetOrigin(0., 0., 0.);
+	image->SetSpacing(1., 1., 1.);
+	image->GetPointData()->SetScalars(scalars);
+	scalars->Delete();
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			double scale = j < 2 && i < 3 ? factor : 1.;
+			ijkToRAS->SetElement(i, j, header.IJKToRAS[i * 4 + j] * scale);
+		}
+	}
+	return true;
+}
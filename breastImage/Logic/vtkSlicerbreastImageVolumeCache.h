@@ -0,0 +1,116 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// .NAME vtkSlicerbreastImageVolumeCache - raw cache of processed volumes
+// .SECTION Description
+// Stores volumes, once flipped and with their spacing fixed, as raw files in
+// a local directory. A file is a Header padded to HeaderSize (one page)
+// followed by the scalars in VTK order, little-endian. Reading maps the file
+// privately in memory and hands the mapping to the vtkImageData scalar array
+// without copying: cached volumes open without reading the pixels, share
+// the page cache between processes, and writes to the array stay private.
+// The mapping is released when the array is deleted. Where mmap is not
+// available the scalars are read into a regular array.
+
+#ifndef __vtkSlicerbreastImageVolumeCache_h
+#define __vtkSlicerbreastImageVolumeCache_h
+
+// VTK includes
+#include <vtkObject.h>
+
+// QT includes
+#include <QString>
+
+#include "vtkSlicerbreastImageModuleLogicExport.h"
+
+class vtkImageData;
+class vtkMatrix4x4;
+
+/// \ingroup Slicer_QtModules_ExtensionTemplate
+class VTK_SLICER_BREASTIMAGE_MODULE_LOGIC_EXPORT vtkSlicerbreastImageVolumeCache :
+  public vtkObject
+{
+public:
+
+  static vtkSlicerbreastImageVolumeCache *New();
+  vtkTypeMacro(vtkSlicerbreastImageVolumeCache, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// 2 since the content hash is made of chunks of rows.
+  static const quint16 Version = 2;
+  /// Offset of the scalars, page aligned.
+  static const quint32 HeaderSize = 4096;
+
+#pragma pack(push, 1)
+  struct Header
+  {
+    char Magic[4];
+    quint16 Version;
+    quint16 Reserved;
+    quint32 HeaderSize;
+    qint32 Dimensions[3];
+    qint32 ScalarType;
+    qint32 NumberOfComponents;
+    qint32 ScalarSize;
+    /// Row major IJK to RAS matrix of the volume node.
+    double IJKToRAS[16];
+    /// vtkSlicerbreastImageContentHash of the scalars.
+    quint64 ContentHash;
+    quint64 DataSize;
+  };
+#pragma pack(pop)
+
+  /// Directory of the cache files, created on first write.
+  void SetDirectory(const QString& directory);
+  QString GetDirectory() const;
+
+  /// Cache file of a key, such as the SOPInstanceUID of the first instance
+  /// of a series.
+  QString GetFileName(const QString& key) const;
+  bool Contains(const QString& key) const;
+  void Remove(const QString& key);
+
+  /// Write a volume. The file is written under a temporary name and renamed,
+  /// so readers never see a partial file.
+  bool Write(const QString& key, vtkImageData* image, vtkMatrix4x4* ijkToRAS, quint64 contentHash = 0);
+
+  /// Replace the scalars of image by the cached ones and set ijkToRAS. The
+  /// image origin and spacing are reset, the geometry is in the matrix.
+  bool Read(const QString& key, vtkImageData* image, vtkMatrix4x4* ijkToRAS, quint64* contentHash = 0);
+
+  /// Read every factor-th pixel of every factor-th row of each slice. Only
+  /// the pages holding those rows are read. ijkToRAS has the same origin and
+  /// factor times the in-plane spacing of the cached volume.
+  bool ReadPreview(const QString& key, int factor, vtkImageData* image, vtkMatrix4x4* ijkToRAS);
+
+  /// Read and check the header of a cache file.
+  static bool ReadHeader(const QString& fileName, Header& header);
+
+protected:
+  vtkSlicerbreastImageVolumeCache();
+  virtual ~vtkSlicerbreastImageVolumeCache();
+
+  QString Directory;
+
+private:
+
+  vtkSlicerbreastImageVolumeCache(const vtkSlicerbreastImageVolumeCache&); // Not implemented
+  void operator=(const vtkSlicerbreastImageVolumeCache&); // Not implemented
+};
+
+#endif
@@ -0,0 +1,209 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageAnnotationJournal.h"
+
+// QT includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+typedef QMap<QString, QString> Information;
+
+bool sameReport(const vtkSlicerbreastImageAnnotationJournal& journal,
+	const Information& m_dicomInf, const Information& m_pacasInf, const Information& m_annotationInf)
+{
+	return journal.GetDicomInformation() == m_dicomInf && journal.GetPacasInformation() == m_pacasInf
+		&& journal.GetAnnotationInformation() == m_annotationInf;
+}
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerbreastImageAnnotationJournalTest1(int, char*[])
+{
+	QString fileName = QDir::temp().absoluteFilePath(
+		QString("vtkSlicerbreastImageAnnotationJournalTest1-%1.bij").arg(QCoreApplication::applicationPid()));
+	QFile::remove(fileName);
+
+	// report saved before the journal was opened
+	Information savedDicom;
+	savedDicom["PatientID"] = "P1";
+	savedDicom["View"] = "L_CC";
+	Information savedPacas;
+	savedPacas["density"] = "2";
+	Information savedAnnotation;
+	savedAnnotation["clusterNumber"] = "1";
+	savedAnnotation["1-shape"] = "round";
+
+	vtkSlicerbreastImageAnnotationJournal journal;
+	if (!journal.Open(fileName, savedDicom, savedPacas, savedAnnotation) || journal.GetNumberOfRecords() != 0
+		|| journal.GetPosition() != 0 || !sameReport(journal, savedDicom, savedPacas, savedAnnotation))
+	{
+		std::cerr << "Line " << __LINE__ << ": can not create the journal " << fileName.toStdString() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// one record per changed, added or removed key
+	Information dicom = savedDicom;
+	Information pacas = savedPacas;
+	Information annotation = savedAnnotation;
+	dicom["View"] = "R_CC";
+	pacas["pathology"] = QString::fromUtf8("b\xc3\xa9nin");
+	annotation.remove("1-shape");
+	if (journal.Append(dicom, pacas, annotation) != 3 || journal.Append(dicom, pacas, annotation) != 0
+		|| journal.GetNumberOfRecords() != 3 || journal.GetPosition() != 3 || !sameReport(journal, dicom, pacas, annotation))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong records appended" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// the replay over the saved report gives the edited one, and so does a
+	// replay over a report that already contains the records
+	journal.Close();
+	if (!journal.Open(fileName, savedDicom, savedPacas, savedAnnotation) || journal.GetNumberOfRecords() != 3
+		|| !sameReport(journal, dicom, pacas, annotation))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong replay over the saved report" << std::endl;
+		return EXIT_FAILURE;
+	}
+	journal.Close();
+	if (!journal.Open(fileName, dicom, pacas, annotation) || journal.GetNumberOfRecords() != 3
+		|| !sameReport(journal, dicom, pacas, annotation))
+	{
+		std::cerr << "Line " << __LINE__ << ": replaying the records twice changed the report" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// a record torn by a crash ends the replay and is cut from the file
+	qint64 validSize = QFileInfo(fileName).size();
+	Information tornAnnotation = annotation;
+	tornAnnotation["1-distribution"] = "grouped";
+	if (journal.Append(dicom, pacas, tornAnnotation) != 1)
+	{
+		std::cerr << "Line " << __LINE__ << ": can not append" << std::endl;
+		return EXIT_FAILURE;
+	}
+	journal.Close();
+	QFile file(fileName);
+	if (!file.resize(QFileInfo(fileName).size() - 1))
+	{
+		std::cerr << "Line " << __LINE__ << ": can not tear the last record" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!journal.Open(fileName, savedDicom, savedPacas, savedAnnotation) || journal.GetNumberOfRecords() != 3
+		|| journal.GetPosition() != 3 || !sameReport(journal, dicom, pacas, annotation)
+		|| QFileInfo(fileName).size() != validSize)
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong replay of a torn journal" << std::endl;
+		return EXIT_FAILURE;
+	}
+	// the next appends follow the valid records
+	if (journal.Append(dicom, pacas, tornAnnotation) != 1)
+	{
+		std::cerr << "Line " << __LINE__ << ": can not append after a torn record" << std::endl;
+		return EXIT_FAILURE;
+	}
+	journal.Close();
+	if (!journal.Open(fileName, savedDicom, savedPacas, savedAnnotation) || journal.GetNumberOfRecords() != 4
+		|| !sameReport(journal, dicom, pacas, tornAnnotation))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong replay after a torn record" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// a corrupted record ends the replay as well
+	journal.Close();
+	if (!file.open(QFile::ReadWrite))
+	{
+		std::cerr << "Line " << __LINE__ << ": can not open " << fileName.toStdString() << std::endl;
+		return EXIT_FAILURE;
+	}
+	QByteArray content = file.readAll();
+	// a bit of the checksum of the fourth record
+	content[static_cast<int>(validSize) + 1] = static_cast<char>(content.at(static_cast<int>(validSize) + 1) ^ 0x10);
+	file.seek(0);
+	file.write(content);
+	file.close();
+	if (!journal.Open(fileName, savedDicom, savedPacas, savedAnnotation) || journal.GetNumberOfRecords() != 3
+		|| !sameReport(journal, dicom, pacas, annotation) || QFileInfo(fileName).size() != validSize)
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong replay of a corrupted journal" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// discarding the records of a report saved elsewhere keeps the later
+	// ones and their numbers
+	qint64 exported = journal.GetPosition();
+	Information exportedAnnotation = annotation;
+	annotation["clusterNumber"] = "2";
+	annotation["2-shape"] = "oval";
+	if (journal.Append(dicom, pacas, annotation) != 2 || !journal.Discard(exported)
+		|| journal.GetFirstRecord() != 3 || journal.GetNumberOfRecords() != 2 || journal.GetPosition() != 5
+		|| !journal.Discard(exported - 1) || journal.GetNumberOfRecords() != 2)
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong discard of the exported records" << std::endl;
+		return EXIT_FAILURE;
+	}
+	journal.Close();
+	if (!journal.Open(fileName, dicom, pacas, exportedAnnotation) || journal.GetFirstRecord() != 3
+		|| journal.GetNumberOfRecords() != 2 || !sameReport(journal, dicom, pacas, annotation))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong replay after a discard" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// a truncated journal replays nothing and keeps numbering its records
+	if (!journal.Truncate() || journal.GetNumberOfRecords() != 0 || journal.GetPosition() != 5)
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong truncation" << std::endl;
+		return EXIT_FAILURE;
+	}
+	journal.Close();
+	if (!journal.Open(fileName, savedDicom, savedPacas, savedAnnotation) || journal.GetFirstRecord() != 5
+		|| journal.GetNumberOfRecords() != 0 || !sameReport(journal, savedDicom, savedPacas, savedAnnotation))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong replay after a truncation" << std::endl;
+		return EXIT_FAILURE;
+	}
+	journal.Close();
+
+	// a file that is not a journal is not replayed nor overwritten
+	if (!file.open(QFile::WriteOnly | QFile::Truncate) || file.write("not a journal at all") != 20)
+	{
+		std::cerr << "Line " << __LINE__ << ": can not write " << fileName.toStdString() << std::endl;
+		return EXIT_FAILURE;
+	}
+	file.close();
+	if (journal.Open(fileName, savedDicom, savedPacas, savedAnnotation) || journal.IsOpen()
+		|| QFileInfo(fileName).size() != 20)
+	{
+		std::cerr << "Line " << __LINE__ << ": foreign file opened as a journal" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	QFile::remove(fileName);
+	return EXIT_SUCCESS;
+}
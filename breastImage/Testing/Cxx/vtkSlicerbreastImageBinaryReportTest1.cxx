@@ -0,0 +1,187 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageBinaryReport.h"
+
+// QT includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+
+// STD includes
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+void setCluster(QMap<QString, QString>& m_annotationInf, int number, const char* field, const QString& value)
+{
+	m_annotationInf[QString("%1-%2").arg(number).arg(field)] = value;
+}
+
+bool sameMaps(const QMap<QString, QString>& read, const QMap<QString, QString>& written, const char* name)
+{
+	if (read == written)
+	{
+		return true;
+	}
+	std::cerr << "Section " << name << " differs after the round trip:" << std::endl;
+	QStringList keys = (read.keys() + written.keys()).toSet().toList();
+	keys.sort();
+	foreach(QString key, keys)
+	{
+		if (read.value(key, "<none>") != written.value(key, "<none>"))
+		{
+			std::cerr << "  " << key.toStdString() << ": read \"" << read.value(key, "<none>").toStdString()
+				<< "\", written \"" << written.value(key, "<none>").toStdString() << "\"" << std::endl;
+		}
+	}
+	return false;
+}
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerbreastImageBinaryReportTest1(int, char*[])
+{
+	QString fileName = QDir::temp().absoluteFilePath(
+		QString("vtkSlicerbreastImageBinaryReportTest1-%1.bir").arg(QCoreApplication::applicationPid()));
+
+	QMap<QString, QString> reportAttributes;
+	reportAttributes["reportName"] = QString::fromUtf8("Mammographie \xc3\xa9t\xc3\xa9");
+	reportAttributes["reportDate"] = "2017-07-14T10:00:00";
+	QMap<QString, QString> m_dicomInf;
+	m_dicomInf["PatientID"] = "P1";
+	m_dicomInf["PatientBirthDate"] = "";
+	m_dicomInf["View"] = "L_CC";
+	QMap<QString, QString> m_pacasInf;
+	m_pacasInf["pathology"] = "benign";
+	m_pacasInf["density"] = "2";
+	QMap<QString, QString> m_annotationInf;
+	m_annotationInf["clusterNumber"] = "3";
+	m_annotationInf["comment"] = "round";
+	// the canonical formatting of the module, stored as numbers
+	const char* rasFields[6] = { "xCenterRas", "yCenterRas", "zCenterRas", "xRadiusRas", "yRadiusRas", "zRadiusRas" };
+	const char* ijkFields[6] = { "xCenterIjk", "yCenterIjk", "zCenterIjk", "xRadiusIjk", "yRadiusIjk", "zRadiusIjk" };
+	setCluster(m_annotationInf, 1, "number", "1");
+	setCluster(m_annotationInf, 1, "size", "2.5000");
+	setCluster(m_annotationInf, 1, "shape", "round");
+	setCluster(m_annotationInf, 1, "distribution", "grouped");
+	for (int axis = 0; axis < 6; axis++)
+	{
+		setCluster(m_annotationInf, 1, rasFields[axis], QString::number(-12.3456 + axis, 'f', 4));
+		setCluster(m_annotationInf, 1, ijkFields[axis], QString::number(-3 + 100 * axis));
+	}
+	// other formattings are kept as text
+	setCluster(m_annotationInf, 2, "number", "02");
+	setCluster(m_annotationInf, 2, "size", "NA");
+	setCluster(m_annotationInf, 2, "shape", "round");
+	setCluster(m_annotationInf, 2, "distribution", "");
+	setCluster(m_annotationInf, 2, "xCenterRas", "1.5");
+	setCluster(m_annotationInf, 2, "xCenterIjk", "12.5");
+	setCluster(m_annotationInf, 2, "yCenterIjk", "NA");
+	// fields that are not set stay unset
+	setCluster(m_annotationInf, 3, "number", "3");
+	// beyond clusterNumber, an ordinary entry
+	setCluster(m_annotationInf, 4, "shape", "linear");
+
+	if (!vtkSlicerbreastImageBinaryReport::Write(fileName, reportAttributes, m_dicomInf, m_pacasInf, m_annotationInf))
+	{
+		std::cerr << "Line " << __LINE__ << ": can not write " << fileName.toStdString() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	vtkSlicerbreastImageBinaryReport report;
+	if (!report.Open(fileName) || !report.IsOpen() || report.GetNumberOfClusters() != 3)
+	{
+		std::cerr << "Line " << __LINE__ << ": can not open " << fileName.toStdString() << std::endl;
+		QFile::remove(fileName);
+		return EXIT_FAILURE;
+	}
+	QMap<QString, QString> readAttributes, readDicomInf, readPacasInf, readAnnotationInf;
+	report.ReadInformation(readAttributes, readDicomInf, readPacasInf, readAnnotationInf);
+	if (!sameMaps(readAttributes, reportAttributes, "report") || !sameMaps(readDicomInf, m_dicomInf, "DicomInformation")
+		|| !sameMaps(readPacasInf, m_pacasInf, "PacasInformation") || !sameMaps(readAnnotationInf, m_annotationInf, "annotation"))
+	{
+		report.Close();
+		QFile::remove(fileName);
+		return EXIT_FAILURE;
+	}
+
+	// records read in place
+	typedef vtkSlicerbreastImageBinaryReport Report;
+	const Report::Cluster* first = report.GetCluster(0);
+	const Report::Cluster* second = report.GetCluster(1);
+	const Report::Cluster* third = report.GetCluster(2);
+	quint32 length = 0;
+	const char* shape = report.GetString(first->Shape, &length);
+	if (first->TextMask != ((1u << Report::ShapeField) | (1u << Report::DistributionField))
+		|| first->Number != 1 || first->Size != 2.5 || first->Ras[0] != -12.3456 || first->Ijk[5] != 497
+		|| !shape || length != 5 || std::strcmp(shape, "round") != 0)
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong record of the first cluster" << std::endl;
+		report.Close();
+		QFile::remove(fileName);
+		return EXIT_FAILURE;
+	}
+	const char* size = report.GetString(static_cast<quint32>(second->Size));
+	if (!(second->TextMask & (1u << Report::NumberField)) || !(second->TextMask & (1u << Report::SizeField))
+		|| !size || std::strcmp(size, "NA") != 0
+		|| second->Shape != first->Shape
+		|| (third->TextMask & (1u << Report::NumberField)) || third->Number != 3
+		|| third->Shape != Report::NoString || report.GetString(Report::NoString) != NULL)
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong record of the text or missing cluster fields" << std::endl;
+		report.Close();
+		QFile::remove(fileName);
+		return EXIT_FAILURE;
+	}
+	report.Close();
+	if (report.IsOpen())
+	{
+		std::cerr << "Line " << __LINE__ << ": report still open" << std::endl;
+		QFile::remove(fileName);
+		return EXIT_FAILURE;
+	}
+
+	// a truncated file is rejected
+	QFile file(fileName);
+	if (!file.resize(file.size() - 1) || report.Open(fileName))
+	{
+		std::cerr << "Line " << __LINE__ << ": truncated report opened" << std::endl;
+		QFile::remove(fileName);
+		return EXIT_FAILURE;
+	}
+	// so is a file of another format
+	if (!file.open(QFile::WriteOnly | QFile::Truncate) || file.write(QByteArray(256, 'x')) != 256)
+	{
+		std::cerr << "Line " << __LINE__ << ": can not write " << fileName.toStdString() << std::endl;
+		QFile::remove(fileName);
+		return EXIT_FAILURE;
+	}
+	file.close();
+	if (report.Open(fileName))
+	{
+		std::cerr << "Line " << __LINE__ << ": report of another format opened" << std::endl;
+		QFile::remove(fileName);
+		return EXIT_FAILURE;
+	}
+	QFile::remove(fileName);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,265 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageClusterTree.h"
+
+// QT includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+
+// STD includes
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <set>
+#include <utility>
+
+namespace
+{
+typedef std::pair<std::string, int> ClusterKey;
+
+// deterministic pseudo random value in [0, 1)
+double randomValue(unsigned int& state)
+{
+	state = state * 1103515245u + 12345u;
+	return ((state >> 8) & 0xffff) / 65536.;
+}
+
+double squaredDistance(const double* bounds, const double point[3])
+{
+	double distance = 0.;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		double delta = std::max(std::max(bounds[2 * axis] - point[axis], point[axis] - bounds[2 * axis + 1]), 0.);
+		distance += delta * delta;
+	}
+	return distance;
+}
+
+bool overlaps(const double* a, const double* b)
+{
+	return a[0] <= b[1] && b[0] <= a[1] && a[2] <= b[3] && b[2] <= a[3] && a[4] <= b[5] && b[4] <= a[5];
+}
+
+// compare the queries of tree with a scan of every box
+bool checkQueries(const vtkSlicerbreastImageClusterTree& tree, const std::vector<double>& bounds,
+	const std::vector<int>& reportIds, const std::vector<int>& clusters, const std::vector<std::string>& reportFiles)
+{
+	int count = static_cast<int>(clusters.size());
+	if (tree.GetNumberOfClusters() != count)
+	{
+		std::cerr << "Line " << __LINE__ << ": " << tree.GetNumberOfClusters() << " clusters instead of " << count << std::endl;
+		return false;
+	}
+	// ids are in leaf order, clusters are identified by report and number
+	std::map<ClusterKey, int> inputIndex;
+	for (int i = 0; i < count; i++)
+	{
+		inputIndex[ClusterKey(reportFiles[reportIds[i]], clusters[i])] = i;
+	}
+	std::vector<int> idToInput(count, -1);
+	for (int id = 0; id < count; id++)
+	{
+		std::map<ClusterKey, int>::const_iterator input = inputIndex.find(ClusterKey(tree.GetReportFile(id), tree.GetCluster(id)));
+		double box[6];
+		tree.GetBounds(id, box);
+		if (input == inputIndex.end() || !std::equal(box, box + 6, &bounds[6 * input->second]))
+		{
+			std::cerr << "Line " << __LINE__ << ": cluster " << id << " does not match its input" << std::endl;
+			return false;
+		}
+		idToInput[id] = input->second;
+	}
+
+	unsigned int state = 7;
+	for (int query = 0; query < 50; query++)
+	{
+		double box[6];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			box[2 * axis] = 120. * randomValue(state) - 10.;
+			box[2 * axis + 1] = box[2 * axis] + 30. * randomValue(state);
+		}
+		std::vector<int> ids;
+		tree.FindOverlapping(box, ids);
+		std::set<int> found;
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			found.insert(idToInput[ids[i]]);
+		}
+		std::set<int> expected;
+		for (int i = 0; i < count; i++)
+		{
+			if (overlaps(&bounds[6 * i], box))
+			{
+				expected.insert(i);
+			}
+		}
+		if (found != expected || ids.size() != found.size())
+		{
+			std::cerr << "Line " << __LINE__ << ": query " << query << " found " << ids.size()
+				<< " overlapping clusters instead of " << expected.size() << std::endl;
+			return false;
+		}
+
+		// the k nearest have the k smallest distances, nearest first
+		const int k = 7;
+		double point[3] = { box[0], box[2], box[4] };
+		tree.FindNearest(point, k, ids);
+		std::vector<double> distances(count);
+		for (int i = 0; i < count; i++)
+		{
+			distances[i] = squaredDistance(&bounds[6 * i], point);
+		}
+		std::sort(distances.begin(), distances.end());
+		if (static_cast<int>(ids.size()) != std::min(k, count))
+		{
+			std::cerr << "Line " << __LINE__ << ": query " << query << " found " << ids.size() << " nearest clusters" << std::endl;
+			return false;
+		}
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			if (squaredDistance(&bounds[6 * idToInput[ids[i]]], point) != distances[i])
+			{
+				std::cerr << "Line " << __LINE__ << ": query " << query << " nearest " << i << " is not the expected one" << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerbreastImageClusterTreeTest1(int, char*[])
+{
+	// enough clusters for three levels of nodes
+	const int count = 1000;
+	std::vector<double> bounds;
+	std::vector<int> reportIds;
+	std::vector<int> clusters;
+	std::vector<std::string> reportFiles;
+	reportFiles.push_back("first.xml");
+	reportFiles.push_back("second.xml");
+	reportFiles.push_back("third.xml");
+	unsigned int state = 1;
+	for (int i = 0; i < count; i++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			double center = 100. * randomValue(state);
+			double radius = 5. * randomValue(state);
+			bounds.push_back(center - radius);
+			bounds.push_back(center + radius);
+		}
+		reportIds.push_back(i % 3);
+		clusters.push_back(i / 3 + 1);
+	}
+
+	vtkSlicerbreastImageClusterTree tree;
+	std::vector<int> ids;
+	double everywhere[6] = { -1e9, 1e9, -1e9, 1e9, -1e9, 1e9 };
+	double origin[3] = { 0., 0., 0. };
+	tree.FindOverlapping(everywhere, ids);
+	if (tree.GetNumberOfClusters() != 0 || !ids.empty())
+	{
+		std::cerr << "Line " << __LINE__ << ": empty tree returned clusters" << std::endl;
+		return EXIT_FAILURE;
+	}
+	tree.FindNearest(origin, 3, ids);
+	if (!ids.empty())
+	{
+		std::cerr << "Line " << __LINE__ << ": empty tree returned nearest clusters" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// fewer clusters than a node holds, then a full tree
+	std::vector<double> fewBounds(bounds.begin(), bounds.begin() + 6 * 5);
+	std::vector<int> fewReportIds(reportIds.begin(), reportIds.begin() + 5);
+	std::vector<int> fewClusters(clusters.begin(), clusters.begin() + 5);
+	tree.Build(fewBounds, fewReportIds, fewClusters, reportFiles);
+	if (!checkQueries(tree, fewBounds, fewReportIds, fewClusters, reportFiles))
+	{
+		return EXIT_FAILURE;
+	}
+	tree.Build(bounds, reportIds, clusters, reportFiles);
+	if (!checkQueries(tree, bounds, reportIds, clusters, reportFiles))
+	{
+		return EXIT_FAILURE;
+	}
+
+	// a saved tree answers the same after loading
+	QString fileName = QDir::temp().absoluteFilePath(
+		QString("vtkSlicerbreastImageClusterTreeTest1-%1.tree").arg(QCoreApplication::applicationPid()));
+	QByteArray localFileName = QFile::encodeName(fileName);
+	vtkSlicerbreastImageClusterTree loaded;
+	if (!tree.Save(localFileName.constData()) || !loaded.Load(localFileName.constData()))
+	{
+		std::cerr << "Line " << __LINE__ << ": can not save and load " << localFileName.constData() << std::endl;
+		QFile::remove(fileName);
+		return EXIT_FAILURE;
+	}
+	if (!checkQueries(loaded, bounds, reportIds, clusters, reportFiles))
+	{
+		QFile::remove(fileName);
+		return EXIT_FAILURE;
+	}
+
+	// a file whose first leaf points past the clusters is refused and leaves an empty tree,
+	// First follows the magic, the version, the node count and the bounds of the node
+	QFile file(fileName);
+	int badFirst = 0x7fffffff;
+	if (!file.open(QIODevice::ReadWrite) || !file.seek(12 + 6 * sizeof(double))
+		|| file.write(reinterpret_cast<const char*>(&badFirst), sizeof(badFirst)) != sizeof(badFirst))
+	{
+		std::cerr << "Line " << __LINE__ << ": can not change " << localFileName.constData() << std::endl;
+		QFile::remove(fileName);
+		return EXIT_FAILURE;
+	}
+	file.close();
+	if (loaded.Load(localFileName.constData()) || loaded.GetNumberOfClusters() != 0)
+	{
+		std::cerr << "Line " << __LINE__ << ": loaded a tree with a node out of range" << std::endl;
+		QFile::remove(fileName);
+		return EXIT_FAILURE;
+	}
+
+	// so is a file whose clusters name more reports than it lists
+	std::vector<std::string> fewReportFiles(reportFiles.begin(), reportFiles.begin() + 1);
+	tree.Build(bounds, reportIds, clusters, fewReportFiles);
+	if (!tree.Save(localFileName.constData()) || loaded.Load(localFileName.constData())
+		|| loaded.GetNumberOfClusters() != 0)
+	{
+		std::cerr << "Line " << __LINE__ << ": loaded a tree with a report out of range" << std::endl;
+		QFile::remove(fileName);
+		return EXIT_FAILURE;
+	}
+	QFile::remove(fileName);
+
+	tree.Clear();
+	tree.FindOverlapping(everywhere, ids);
+	if (tree.GetNumberOfClusters() != 0 || !ids.empty())
+	{
+		std::cerr << "Line " << __LINE__ << ": cleared tree returned clusters" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
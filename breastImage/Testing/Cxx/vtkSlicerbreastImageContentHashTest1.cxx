@@ -0,0 +1,140 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageContentHash.h"
+#include "vtkSlicerbreastImageTaskPool.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkUnsignedShortArray.h>
+
+// STD includes
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+int vtkSlicerbreastImageContentHashTest1(int, char*[])
+{
+	// reference values of XXH64
+	struct Vector
+	{
+		const char* Data;
+		quint64 Seed;
+		quint64 Hash;
+	};
+	const Vector vectors[] = {
+		{ "", 0, Q_UINT64_C(0xef46db3751d8e999) },
+		{ "a", 0, Q_UINT64_C(0xd24ec4f1a98c6e5b) },
+		{ "abc", 0, Q_UINT64_C(0x44bc2cf5ad770999) },
+		{ "abc", 1, Q_UINT64_C(0xbea9ca8199328908) },
+		// 8 and 4 byte tails
+		{ "Nobody inspects the spammish repetition", 0, Q_UINT64_C(0xfbcea83c8a378bf1) },
+		// the four lanes
+		{ "The quick brown fox jumps over the lazy dog", 0, Q_UINT64_C(0x0b242d361fda71bc) },
+		{ "The quick brown fox jumps over the lazy dog. The quick brown fox jumps over the lazy dog. "
+			"The quick brown fox jumps over the lazy dog. ", 42, Q_UINT64_C(0x60bc7ef16f5d9ab7) } };
+	for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++)
+	{
+		size_t length = std::strlen(vectors[i].Data);
+		quint64 hash = vtkSlicerbreastImageContentHash::Hash(vectors[i].Data, length, vectors[i].Seed);
+		// unaligned input
+		std::vector<char> shifted(length + 1);
+		std::memcpy(&shifted[1], vectors[i].Data, length);
+		quint64 shiftedHash = vtkSlicerbreastImageContentHash::Hash(&shifted[1], length, vectors[i].Seed);
+		if (hash != vectors[i].Hash || shiftedHash != vectors[i].Hash)
+		{
+			std::cerr << "Line " << __LINE__ << ": hash of \"" << vectors[i].Data << "\" is "
+				<< vtkSlicerbreastImageContentHash::ToString(hash).toStdString() << " instead of "
+				<< vtkSlicerbreastImageContentHash::ToString(vectors[i].Hash).toStdString() << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (vtkSlicerbreastImageContentHash::ToString(Q_UINT64_C(0xabc)) != "0000000000000abc")
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong string of a hash" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// an image hashes chunks of rows, in parallel with a pool, here two per
+	// slice and the second one shorter
+	const int dims[3] = { 1000, 150, 3 };
+	size_t rowSize = dims[0] * sizeof(unsigned short);
+	int rowsPerChunk = vtkSlicerbreastImageContentHash::GetRowsPerChunk(rowSize);
+	if (rowsPerChunk < dims[1] / 2 || rowsPerChunk >= dims[1])
+	{
+		std::cerr << "Line " << __LINE__ << ": " << rowsPerChunk << " rows per chunk" << std::endl;
+		return EXIT_FAILURE;
+	}
+	vtkNew<vtkUnsignedShortArray> scalars;
+	scalars->SetNumberOfTuples(dims[0] * dims[1] * dims[2]);
+	for (vtkIdType i = 0; i < scalars->GetNumberOfTuples(); i++)
+	{
+		scalars->SetValue(i, static_cast<unsigned short>((i * 2654435761u) >> 16));
+	}
+	vtkNew<vtkImageData> image;
+	image->SetDimensions(dims[0], dims[1], dims[2]);
+	image->GetPointData()->SetScalars(scalars.GetPointer());
+
+	vtkNew<vtkSlicerbreastImageTaskPool> pool;
+	quint64 hash = vtkSlicerbreastImageContentHash::HashImage(image.GetPointer());
+	if (hash == 0 || vtkSlicerbreastImageContentHash::HashImage(image.GetPointer(), pool.GetPointer()) != hash)
+	{
+		std::cerr << "Line " << __LINE__ << ": the hash depends on the pool" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::vector<quint64> sliceHashes(dims[2]);
+	for (int k = 0; k < dims[2]; k++)
+	{
+		sliceHashes[k] = vtkSlicerbreastImageContentHash::HashSlice(scalars->GetPointer(0) + k * dims[0] * dims[1],
+			dims[1], rowSize);
+	}
+	const unsigned short* slice = scalars->GetPointer(0);
+	quint64 chunkHashes[2] = {
+		vtkSlicerbreastImageContentHash::Hash(slice, rowsPerChunk * rowSize),
+		vtkSlicerbreastImageContentHash::Hash(slice + rowsPerChunk * dims[0], (dims[1] - rowsPerChunk) * rowSize) };
+	if (vtkSlicerbreastImageContentHash::Hash(chunkHashes, sizeof(chunkHashes)) != sliceHashes[0])
+	{
+		std::cerr << "Line " << __LINE__ << ": a slice hash is not the hash of its chunks" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (vtkSlicerbreastImageContentHash::CombineSliceHashes(dims, VTK_UNSIGNED_SHORT, 1, &sliceHashes[0]) != hash)
+	{
+		std::cerr << "Line " << __LINE__ << ": streamed slice hashes do not give the image hash" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// the same bytes in another geometry, or other bytes, hash differently
+	image->SetDimensions(dims[1], dims[0], dims[2]);
+	quint64 transposedHash = vtkSlicerbreastImageContentHash::HashImage(image.GetPointer());
+	image->SetDimensions(dims[0], dims[1], dims[2]);
+	unsigned short first = scalars->GetValue(0);
+	scalars->SetValue(0, scalars->GetValue(1));
+	scalars->SetValue(1, first);
+	quint64 swappedHash = vtkSlicerbreastImageContentHash::HashImage(image.GetPointer(), pool.GetPointer());
+	if (transposedHash == hash || swappedHash == hash || first == scalars->GetValue(0))
+	{
+		std::cerr << "Line " << __LINE__ << ": the hash did not change" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
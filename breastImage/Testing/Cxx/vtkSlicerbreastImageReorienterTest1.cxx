@@ -0,0 +1,166 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageReorienter.h"
+#include "vtkSlicerbreastImageTaskPool.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkIntArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <vector>
+
+namespace
+{
+// voxels holding their index and its opposite
+void fillImage(vtkImageData* image, const int dims[3])
+{
+	vtkNew<vtkIntArray> scalars;
+	scalars->SetNumberOfComponents(2);
+	scalars->SetNumberOfTuples(static_cast<vtkIdType>(dims[0]) * dims[1] * dims[2]);
+	for (vtkIdType index = 0; index < scalars->GetNumberOfTuples(); index++)
+	{
+		scalars->SetValue(2 * index, static_cast<int>(index));
+		scalars->SetValue(2 * index + 1, -static_cast<int>(index));
+	}
+	image->SetDimensions(const_cast<int*>(dims));
+	image->GetPointData()->SetScalars(scalars.GetPointer());
+}
+
+// check every voxel of the reoriented image against the input voxel the
+// index transform gives
+bool checkOrientation(vtkSlicerbreastImageReorienter* reorienter, const int dims[3], int orientation)
+{
+	int permutation[3];
+	bool flips[3];
+	vtkSlicerbreastImageReorienter::GetOrientation(orientation, permutation, flips);
+	vtkNew<vtkImageData> image;
+	fillImage(image.GetPointer(), dims);
+	if (!reorienter->Run(image.GetPointer(), permutation, flips))
+	{
+		std::cerr << "Orientation " << orientation << " failed" << std::endl;
+		return false;
+	}
+	int outputDims[3];
+	vtkSlicerbreastImageReorienter::GetOutputDimensions(permutation, dims, outputDims);
+	int* imageDims = image->GetDimensions();
+	if (imageDims[0] != outputDims[0] || imageDims[1] != outputDims[1] || imageDims[2] != outputDims[2])
+	{
+		std::cerr << "Orientation " << orientation << ": wrong dimensions " << imageDims[0] << " "
+			<< imageDims[1] << " " << imageDims[2] << std::endl;
+		return false;
+	}
+	vtkNew<vtkMatrix4x4> outputToInput;
+	vtkSlicerbreastImageReorienter::GetOutputToInputMatrix(permutation, flips, dims, outputToInput.GetPointer());
+	const int* values = static_cast<int*>(image->GetScalarPointer());
+	for (int k = 0; k < outputDims[2]; k++)
+	{
+		for (int j = 0; j < outputDims[1]; j++)
+		{
+			for (int i = 0; i < outputDims[0]; i++)
+			{
+				double voxel[4] = { static_cast<double>(i), static_cast<double>(j), static_cast<double>(k), 1. };
+				double input[4];
+				outputToInput->MultiplyPoint(voxel, input);
+				int expected = static_cast<int>(input[0]) + dims[0] * (static_cast<int>(input[1])
+					+ dims[1] * static_cast<int>(input[2]));
+				const int* value = values + 2 * (i + outputDims[0] * (j + outputDims[1] * k));
+				if (value[0] != expected || value[1] != -expected)
+				{
+					std::cerr << "Orientation " << orientation << ": voxel " << i << " " << j << " " << k
+						<< " is " << value[0] << " instead of " << expected << std::endl;
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerbreastImageReorienterTest1(int, char*[])
+{
+	// the orientations are distinct signed permutations, the first one is
+	// the identity and the ones out of range as well
+	const int dims[3] = { 13, 7, 5 };
+	std::set<std::vector<double> > matrices;
+	for (int orientation = -1; orientation <= vtkSlicerbreastImageReorienter::NumberOfOrientations; orientation++)
+	{
+		int permutation[3];
+		bool flips[3];
+		vtkSlicerbreastImageReorienter::GetOrientation(orientation, permutation, flips);
+		if (!vtkSlicerbreastImageReorienter::IsPermutation(permutation))
+		{
+			std::cerr << "Line " << __LINE__ << ": orientation " << orientation << " is not a permutation" << std::endl;
+			return EXIT_FAILURE;
+		}
+		bool inRange = orientation >= 0 && orientation < vtkSlicerbreastImageReorienter::NumberOfOrientations;
+		if ((orientation <= 0 || !inRange) && (permutation[0] != 0 || permutation[1] != 1 || permutation[2] != 2
+			|| flips[0] || flips[1] || flips[2]))
+		{
+			std::cerr << "Line " << __LINE__ << ": orientation " << orientation << " is not the identity" << std::endl;
+			return EXIT_FAILURE;
+		}
+		vtkNew<vtkMatrix4x4> outputToInput;
+		vtkSlicerbreastImageReorienter::GetOutputToInputMatrix(permutation, flips, dims, outputToInput.GetPointer());
+		if (inRange)
+		{
+			matrices.insert(std::vector<double>(&outputToInput->Element[0][0], &outputToInput->Element[0][0] + 16));
+		}
+	}
+	const int notPermutations[3][3] = { { 0, 0, 2 }, { 0, 1, 3 }, { -1, 1, 2 } };
+	if (static_cast<int>(matrices.size()) != vtkSlicerbreastImageReorienter::NumberOfOrientations
+		|| vtkSlicerbreastImageReorienter::IsPermutation(notPermutations[0])
+		|| vtkSlicerbreastImageReorienter::IsPermutation(notPermutations[1])
+		|| vtkSlicerbreastImageReorienter::IsPermutation(notPermutations[2]))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong orientations" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// every orientation of a volume and of a single slice image, with blocks
+	// cut by the odd dimensions and with the default ones, on the pool
+	const int sliceDims[3] = { 11, 6, 1 };
+	vtkNew<vtkSlicerbreastImageTaskPool> pool;
+	vtkNew<vtkSlicerbreastImageReorienter> reorienter;
+	for (int run = 0; run < 4; run++)
+	{
+		reorienter->SetBlockSize(run % 2 ? 3 : 32);
+		reorienter->SetTaskPool(run / 2 ? pool.GetPointer() : NULL);
+		for (int orientation = 0; orientation < vtkSlicerbreastImageReorienter::NumberOfOrientations; orientation++)
+		{
+			if (!checkOrientation(reorienter.GetPointer(), dims, orientation)
+				|| !checkOrientation(reorienter.GetPointer(), sliceDims, orientation))
+			{
+				std::cerr << "Line " << __LINE__ << ": wrong orientation, block size " << reorienter->GetBlockSize()
+					<< ", pool " << run / 2 << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	return EXIT_SUCCESS;
+}
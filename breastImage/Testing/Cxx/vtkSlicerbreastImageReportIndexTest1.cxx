@@ -0,0 +1,234 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageReportIndex.h"
+
+// VTK includes
+#include <vtkNew.h>
+
+// QT includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+// report with one located cluster per entry of shapes, centered at x = 10 i
+void fillReport(const QString& view, const QString& pathology, const QStringList& shapes,
+	QMap<QString, QString>& m_dicomInf, QMap<QString, QString>& m_pacasInf, QMap<QString, QString>& m_annotationInf)
+{
+	m_dicomInf["PatientID"] = "P1";
+	m_dicomInf["StudyID"] = "S1";
+	m_dicomInf["View"] = view;
+	m_dicomInf["Modality"] = "MG";
+	m_pacasInf["pathology"] = pathology;
+	m_pacasInf["density"] = "2";
+	m_annotationInf["clusterNumber"] = QString::number(shapes.size());
+	for (int i = 1; i <= shapes.size(); i++)
+	{
+		QString prefix = QString("%1-").arg(i);
+		m_annotationInf[prefix + "number"] = QString::number(i);
+		m_annotationInf[prefix + "size"] = QString::number(2.5 * i, 'f', 4);
+		m_annotationInf[prefix + "shape"] = shapes[i - 1];
+		m_annotationInf[prefix + "distribution"] = "grouped";
+		m_annotationInf[prefix + "xCenterRas"] = QString::number(10. * i, 'f', 4);
+		m_annotationInf[prefix + "yCenterRas"] = "0.0000";
+		m_annotationInf[prefix + "zCenterRas"] = "0.0000";
+		m_annotationInf[prefix + "xRadiusRas"] = "1.0000";
+		m_annotationInf[prefix + "yRadiusRas"] = "2.0000";
+		m_annotationInf[prefix + "zRadiusRas"] = "3.0000";
+		m_annotationInf[prefix + "xCenterIjk"] = QString::number(100 * i);
+		m_annotationInf[prefix + "yCenterIjk"] = "50";
+		m_annotationInf[prefix + "zCenterIjk"] = "0";
+		m_annotationInf[prefix + "xRadiusIjk"] = "5";
+		m_annotationInf[prefix + "yRadiusIjk"] = "5";
+		m_annotationInf[prefix + "zRadiusIjk"] = "0";
+	}
+}
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerbreastImageReportIndexTest1(int argc, char* argv[])
+{
+	// the SQLite driver is a plugin
+	QCoreApplication app(argc, argv);
+	QDir directory(QDir::temp().absoluteFilePath(
+		QString("vtkSlicerbreastImageReportIndexTest1-%1").arg(QCoreApplication::applicationPid())));
+	QString databaseFile = directory.absoluteFilePath("index.sqlite");
+	QString firstReport = directory.absoluteFilePath("reports/first.xml");
+	QString secondReport = directory.absoluteFilePath("reports/second.xml");
+
+	vtkNew<vtkSlicerbreastImageReportIndex> index;
+	if (!index->Open(databaseFile))
+	{
+		std::cerr << "Line " << __LINE__ << ": can not open " << databaseFile.toStdString() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	QMap<QString, QString> m_dicomInf, m_pacasInf, m_annotationInf;
+	fillReport("L_CC", "benign", QStringList() << "round" << "linear", m_dicomInf, m_pacasInf, m_annotationInf);
+	// milliseconds are kept, as QFileInfo::lastModified gives them
+	QDateTime firstModified = QDateTime::fromMSecsSinceEpoch(Q_INT64_C(1500000000123));
+	if (!index->UpdateReport(firstReport, firstModified, "hash1", m_dicomInf, m_pacasInf, m_annotationInf))
+	{
+		std::cerr << "Line " << __LINE__ << ": UpdateReport failed" << std::endl;
+		return EXIT_FAILURE;
+	}
+	m_dicomInf.clear();
+	m_pacasInf.clear();
+	m_annotationInf.clear();
+	fillReport("R_MLO", "malignant", QStringList() << "linear", m_dicomInf, m_pacasInf, m_annotationInf);
+	// a cluster without location is indexed but has no bounds
+	m_annotationInf["clusterNumber"] = "2";
+	m_annotationInf["2-shape"] = "round";
+	m_annotationInf["2-size"] = "1.0000";
+	m_annotationInf["2-xCenterRas"] = "NA";
+	m_annotationInf["2-xCenterIjk"] = "NA";
+	if (!index->UpdateReport(secondReport, firstModified, "hash2", m_dicomInf, m_pacasInf, m_annotationInf))
+	{
+		std::cerr << "Line " << __LINE__ << ": UpdateReport failed" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	QDateTime lastModified;
+	QByteArray contentHash;
+	if (!index->GetReportStamp(firstReport, lastModified, contentHash)
+		|| lastModified != firstModified || contentHash != "hash1")
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong stamp " << lastModified.toMSecsSinceEpoch()
+			<< " " << contentHash.constData() << std::endl;
+		return EXIT_FAILURE;
+	}
+	QDateTime touched = firstModified.addMSecs(1);
+	if (!index->TouchReport(firstReport, touched) || !index->GetReportStamp(firstReport, lastModified, contentHash)
+		|| lastModified != touched || contentHash != "hash1")
+	{
+		std::cerr << "Line " << __LINE__ << ": TouchReport did not update the stamp" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (index->GetReportStamp(directory.absoluteFilePath("reports/unknown.xml"), lastModified, contentHash))
+	{
+		std::cerr << "Line " << __LINE__ << ": stamp of a report not indexed" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (index->GetIndexedReports(directory.absoluteFilePath("reports")) != QStringList() << firstReport << secondReport
+		&& index->GetIndexedReports(directory.absoluteFilePath("reports")) != QStringList() << secondReport << firstReport)
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong indexed reports" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// report and cluster criteria
+	QMap<QString, QString> criteria;
+	criteria["View"] = "L_CC";
+	if (index->FindReports(criteria) != QStringList(firstReport))
+	{
+		std::cerr << "Line " << __LINE__ << ": View criterion" << std::endl;
+		return EXIT_FAILURE;
+	}
+	criteria.clear();
+	criteria["shape"] = "round";
+	if (index->FindReports(criteria) != QStringList() << firstReport << secondReport)
+	{
+		std::cerr << "Line " << __LINE__ << ": shape criterion" << std::endl;
+		return EXIT_FAILURE;
+	}
+	// shape and size have to hold for the same cluster
+	criteria["minClusterSize"] = "4";
+	if (!index->FindReports(criteria).isEmpty())
+	{
+		std::cerr << "Line " << __LINE__ << ": cluster criteria matched different clusters" << std::endl;
+		return EXIT_FAILURE;
+	}
+	criteria["shape"] = "linear";
+	if (index->FindReports(criteria) != QStringList(firstReport))
+	{
+		std::cerr << "Line " << __LINE__ << ": shape and size criteria" << std::endl;
+		return EXIT_FAILURE;
+	}
+	criteria.clear();
+	criteria["pathology"] = "malignant";
+	criteria["minClusterNumber"] = "2";
+	if (index->FindReports(criteria) != QStringList(secondReport))
+	{
+		std::cerr << "Line " << __LINE__ << ": pathology and cluster number criteria" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<double> bounds;
+	std::vector<int> reportIds;
+	std::vector<int> clusters;
+	std::vector<std::string> reportFiles;
+	if (!index->GetClusterBounds(false, bounds, reportIds, clusters, reportFiles)
+		|| clusters.size() != 3 || bounds.size() != 18 || reportFiles.size() != 2)
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong number of located clusters " << clusters.size() << std::endl;
+		return EXIT_FAILURE;
+	}
+	for (size_t i = 0; i < clusters.size(); i++)
+	{
+		// the center x is 10 times the cluster number, the radii 1, 2 and 3
+		const double* box = &bounds[6 * i];
+		if (box[0] != 10. * clusters[i] - 1. || box[1] != 10. * clusters[i] + 1.
+			|| box[2] != -2. || box[3] != 2. || box[4] != -3. || box[5] != 3.)
+		{
+			std::cerr << "Line " << __LINE__ << ": wrong bounds of cluster " << clusters[i] << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	// a report updated again replaces its clusters
+	m_annotationInf.clear();
+	fillReport("R_MLO", "malignant", QStringList() << "linear", m_dicomInf, m_pacasInf, m_annotationInf);
+	if (!index->UpdateReport(secondReport, firstModified, "hash3", m_dicomInf, m_pacasInf, m_annotationInf))
+	{
+		std::cerr << "Line " << __LINE__ << ": UpdateReport failed" << std::endl;
+		return EXIT_FAILURE;
+	}
+	criteria.clear();
+	criteria["shape"] = "round";
+	if (index->FindReports(criteria) != QStringList(firstReport))
+	{
+		std::cerr << "Line " << __LINE__ << ": clusters not replaced" << std::endl;
+		return EXIT_FAILURE;
+	}
+	criteria.clear();
+	criteria["minClusterNumber"] = "2";
+	if (index->FindReports(criteria) != QStringList(firstReport))
+	{
+		std::cerr << "Line " << __LINE__ << ": cluster number not replaced" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (!index->RemoveReport(firstReport) || index->GetReportStamp(firstReport, lastModified, contentHash))
+	{
+		std::cerr << "Line " << __LINE__ << ": RemoveReport failed" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	index->Close();
+	QFile::remove(databaseFile);
+	QDir().rmdir(directory.absolutePath());
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageLogic.h"
+
+// VTK includes
+#include <vtkNew.h>
+
+// QT includes
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QDomDocument>
+#include <QFile>
+#include <QFileInfo>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+typedef QMap<QString, QString> Information;
+
+QString annotationContentHash(const char* xml)
+{
+	QDomDocument doc;
+	doc.setContent(QByteArray(xml));
+	return vtkSlicerbreastImageLogic::AnnotationContentHash(doc);
+}
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerbreastImageReportWriteTest1(int, char*[])
+{
+	// the hash ignores the order of the attributes, the whitespace between
+	// the elements, the date and the stored hash, but not the content
+	QString hash = annotationContentHash(
+		"<BreastImageReport reportName=\"r\" reportDate=\"20260101\" version=\"1.0\">"
+		"<DicomInformation><PatientID>P1</PatientID><View side=\"L\" projection=\"CC\">L_CC</View></DicomInformation>"
+		"</BreastImageReport>");
+	QString reorderedHash = annotationContentHash(
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<BreastImageReport version=\"1.0\" contentHash=\"0123456789abcdef\" reportDate=\"20261019\" reportName=\"r\">\n"
+		"    <DicomInformation>\n"
+		"        <PatientID>P1</PatientID>\n"
+		"\t\t<View projection=\"CC\"   side=\"L\">L_CC</View>\n"
+		"    </DicomInformation>\n"
+		"</BreastImageReport>\n");
+	QString changedHash = annotationContentHash(
+		"<BreastImageReport reportName=\"r\" reportDate=\"20260101\" version=\"1.0\">"
+		"<DicomInformation><PatientID>P1</PatientID><View side=\"R\" projection=\"CC\">L_CC</View></DicomInformation>"
+		"</BreastImageReport>");
+	if (hash.isEmpty() || reorderedHash != hash || changedHash == hash)
+	{
+		std::cerr << "Line " << __LINE__ << ": hashes " << hash.toStdString() << ", " << reorderedHash.toStdString()
+			<< " and " << changedHash.toStdString() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	QString fileName = QDir::temp().absoluteFilePath(
+		QString("vtkSlicerbreastImageReportWriteTest1-%1.xml").arg(QCoreApplication::applicationPid()));
+	QString indexFileName = QDir::temp().absoluteFilePath(
+		QString("vtkSlicerbreastImageReportWriteTest1-%1.sqlite").arg(QCoreApplication::applicationPid()));
+	QFile::remove(fileName);
+	QFile::remove(indexFileName);
+	vtkNew<vtkSlicerbreastImageLogic> logic;
+	logic->SetReportIndexFile(indexFileName);
+
+	Information dicom;
+	dicom["PatientID"] = "P1";
+	dicom["View"] = "L_CC";
+	Information pacas;
+	pacas["density"] = "2";
+	Information annotation;
+	annotation["clusterNumber"] = "1";
+	annotation["1-shape"] = "round";
+	if (logic->writeAnnotationXML(fileName, "report", dicom, pacas, annotation) != vtkSlicerbreastImageLogic::ReportWritten)
+	{
+		std::cerr << "Line " << __LINE__ << ": can not write " << fileName.toStdString() << std::endl;
+		return EXIT_FAILURE;
+	}
+	QString writtenHash = vtkSlicerbreastImageLogic::ReadAnnotationContentHash(fileName);
+	QDateTime lastModified = QFileInfo(fileName).lastModified();
+
+	// the same report again leaves the file alone
+	if (logic->writeAnnotationXML(fileName, "report", dicom, pacas, annotation) != vtkSlicerbreastImageLogic::ReportUnchanged
+		|| QFileInfo(fileName).lastModified() != lastModified || writtenHash.isEmpty())
+	{
+		std::cerr << "Line " << __LINE__ << ": an unchanged report was written again" << std::endl;
+		QFile::remove(fileName);
+		QFile::remove(indexFileName);
+		return EXIT_FAILURE;
+	}
+
+	// a dry run lists a changed report without writing it
+	logic->SetReportDryRun(true);
+	annotation["1-shape"] = "oval";
+	int result = logic->writeAnnotationXML(fileName, "report", dicom, pacas, annotation);
+	QStringList changedReports = logic->GetChangedReports();
+	logic->SetReportDryRun(false);
+	if (result != vtkSlicerbreastImageLogic::ReportSkipped || changedReports != QStringList(fileName)
+		|| vtkSlicerbreastImageLogic::ReadAnnotationContentHash(fileName) != writtenHash
+		|| QFileInfo(fileName).lastModified() != lastModified)
+	{
+		std::cerr << "Line " << __LINE__ << ": the dry run wrote the report or did not list it" << std::endl;
+		QFile::remove(fileName);
+		QFile::remove(indexFileName);
+		return EXIT_FAILURE;
+	}
+
+	// out of the dry run the change is written
+	logic->ClearChangedReports();
+	if (logic->writeAnnotationXML(fileName, "report", dicom, pacas, annotation) != vtkSlicerbreastImageLogic::ReportWritten
+		|| vtkSlicerbreastImageLogic::ReadAnnotationContentHash(fileName) == writtenHash
+		|| !logic->GetChangedReports().isEmpty())
+	{
+		std::cerr << "Line " << __LINE__ << ": the changed report was not written" << std::endl;
+		QFile::remove(fileName);
+		QFile::remove(indexFileName);
+		return EXIT_FAILURE;
+	}
+	QFile::remove(fileName);
+	QFile::remove(indexFileName);
+	return EXIT_SUCCESS;
+}
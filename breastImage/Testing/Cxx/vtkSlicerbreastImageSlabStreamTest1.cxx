@@ -0,0 +1,153 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageContentHash.h"
+#include "vtkSlicerbreastImageSlabStream.h"
+#include "vtkSlicerbreastImageTaskPool.h"
+#include "vtkSlicerbreastImageVolumeCache.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkShortArray.h>
+
+// QT includes
+#include <QCoreApplication>
+#include <QDir>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+// value of component c of voxel (i, j, k)
+short voxelValue(int i, int j, int k, int c)
+{
+	return static_cast<short>(i * 7 - j * 131 + k * 1009 + c * 5000);
+}
+
+// two component image of voxelValue, rotated by 180 degrees in each slice
+void fillImage(vtkImageData* image, const int dims[3], bool rotated)
+{
+	vtkNew<vtkShortArray> scalars;
+	scalars->SetNumberOfComponents(2);
+	scalars->SetNumberOfTuples(dims[0] * dims[1] * dims[2]);
+	for (int k = 0; k < dims[2]; k++)
+	{
+		for (int j = 0; j < dims[1]; j++)
+		{
+			for (int i = 0; i < dims[0]; i++)
+			{
+				vtkIdType tuple = (static_cast<vtkIdType>(k) * dims[1] + j) * dims[0] + i;
+				int sourceI = rotated ? dims[0] - 1 - i : i;
+				int sourceJ = rotated ? dims[1] - 1 - j : j;
+				scalars->SetComponent(tuple, 0, voxelValue(sourceI, sourceJ, k, 0));
+				scalars->SetComponent(tuple, 1, voxelValue(sourceI, sourceJ, k, 1));
+			}
+		}
+	}
+	image->SetDimensions(dims[0], dims[1], dims[2]);
+	image->GetPointData()->SetScalars(scalars.GetPointer());
+}
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerbreastImageSlabStreamTest1(int, char*[])
+{
+	QDir directory(QDir::temp().absoluteFilePath(
+		QString("vtkSlicerbreastImageSlabStreamTest1-%1").arg(QCoreApplication::applicationPid())));
+	vtkNew<vtkSlicerbreastImageVolumeCache> cache;
+	cache->SetDirectory(directory.absolutePath());
+	const QString inputKey = "input";
+	const QString outputKey = "flipped";
+
+	const int dims[3] = { 23, 17, 7 };
+	vtkNew<vtkImageData> image;
+	fillImage(image.GetPointer(), dims, false);
+	vtkNew<vtkImageData> expected;
+	fillImage(expected.GetPointer(), dims, true);
+	quint64 expectedHash = vtkSlicerbreastImageContentHash::HashImage(expected.GetPointer());
+	vtkNew<vtkMatrix4x4> ijkToRAS;
+	if (!cache->Write(inputKey, image.GetPointer(), ijkToRAS.GetPointer()))
+	{
+		std::cerr << "Line " << __LINE__ << ": can not write " << cache->GetFileName(inputKey).toStdString() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// slabs of three slices, the input and output slices of a slab fill the
+	// maximum size, and a last slab of one slice
+	vtkIdType sliceSize = dims[0] * dims[1] * 2 * sizeof(short);
+	vtkNew<vtkSlicerbreastImageSlabStream> stream;
+	stream->SetMaximumSlabSize(3 * 2 * sliceSize);
+	vtkNew<vtkSlicerbreastImageTaskPool> pool;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		// in the calling thread, then on the pool
+		stream->SetTaskPool(pass ? pool.GetPointer() : NULL);
+		vtkSlicerbreastImageSlabFlipFilter filter;
+		cache->Remove(outputKey);
+		if (!stream->Run(cache->GetFileName(inputKey), cache->GetFileName(outputKey), &filter))
+		{
+			std::cerr << "Line " << __LINE__ << ": can not flip the volume, pass " << pass << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		vtkNew<vtkImageData> flipped;
+		vtkNew<vtkMatrix4x4> flippedIJKToRAS;
+		quint64 contentHash = 0;
+		if (!cache->Read(outputKey, flipped.GetPointer(), flippedIJKToRAS.GetPointer(), &contentHash))
+		{
+			std::cerr << "Line " << __LINE__ << ": can not read the flipped volume, pass " << pass << std::endl;
+			return EXIT_FAILURE;
+		}
+		int* flippedDims = flipped->GetDimensions();
+		if (flippedDims[0] != dims[0] || flippedDims[1] != dims[1] || flippedDims[2] != dims[2]
+			|| flipped->GetScalarType() != VTK_SHORT || flipped->GetNumberOfScalarComponents() != 2)
+		{
+			std::cerr << "Line " << __LINE__ << ": wrong geometry of the flipped volume, pass " << pass << std::endl;
+			return EXIT_FAILURE;
+		}
+		const short* flippedValues = static_cast<const short*>(flipped->GetScalarPointer());
+		const short* expectedValues = static_cast<const short*>(expected->GetScalarPointer());
+		for (vtkIdType value = 0; value < expected->GetPointData()->GetScalars()->GetNumberOfValues(); value++)
+		{
+			if (flippedValues[value] != expectedValues[value])
+			{
+				std::cerr << "Line " << __LINE__ << ": wrong value " << value << " of the flipped volume, pass " << pass << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		// the hash streamed slice by slice is the one of the whole image
+		if (contentHash != expectedHash || vtkSlicerbreastImageContentHash::HashImage(flipped.GetPointer()) != expectedHash)
+		{
+			std::cerr << "Line " << __LINE__ << ": the header hash " << vtkSlicerbreastImageContentHash::ToString(contentHash).toStdString()
+				<< " is not the image hash " << vtkSlicerbreastImageContentHash::ToString(expectedHash).toStdString()
+				<< ", pass " << pass << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	stream->SetTaskPool(NULL);
+
+	cache->Remove(inputKey);
+	cache->Remove(outputKey);
+	QDir().rmdir(directory.absolutePath());
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,202 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageTaskPool.h"
+#include "vtkSlicerbreastImageTiler.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkUnsignedShortArray.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+const int dims[3] = { 70, 53, 2 };
+
+unsigned short inputValue(int i, int j, int k)
+{
+	return static_cast<unsigned short>((i * 37 + j * j * 11 + k * 503) % 1000);
+}
+
+// box mean or unsharp mask of pixel (i, j, k) of the input, computed on the
+// whole image the way the kernels do
+unsigned short expectedValue(int i, int j, int k, int radius, bool sharpen, double amount)
+{
+	double sum = 0.;
+	int count = 0;
+	for (int y = std::max(j - radius, 0); y <= std::min(j + radius, dims[1] - 1); y++)
+	{
+		for (int x = std::max(i - radius, 0); x <= std::min(i + radius, dims[0] - 1); x++)
+		{
+			sum += inputValue(x, y, k);
+			count++;
+		}
+	}
+	double value = sum / count;
+	if (sharpen)
+	{
+		double pixel = inputValue(i, j, k);
+		value = pixel + amount * (pixel - value);
+	}
+	value = std::floor(value + 0.5);
+	return static_cast<unsigned short>(std::min(std::max(value, 0.), 65535.));
+}
+
+// check the pixels of output in extent, and that the other ones of output
+// still hold their input value
+bool checkOutput(vtkImageData* output, const int extent[6], int radius, bool sharpen, double amount, const char* name)
+{
+	int outputExtent[6];
+	output->GetExtent(outputExtent);
+	for (int k = outputExtent[4]; k <= outputExtent[5]; k++)
+	{
+		for (int j = outputExtent[2]; j <= outputExtent[3]; j++)
+		{
+			for (int i = outputExtent[0]; i <= outputExtent[1]; i++)
+			{
+				bool processed = i >= extent[0] && i <= extent[1] && j >= extent[2] && j <= extent[3]
+					&& k >= extent[4] && k <= extent[5];
+				unsigned short expected = processed ? expectedValue(i, j, k, radius, sharpen, amount) : inputValue(i, j, k);
+				unsigned short value = *static_cast<unsigned short*>(output->GetScalarPointer(i, j, k));
+				if (value != expected)
+				{
+					std::cerr << name << ": pixel " << i << " " << j << " " << k << " is " << value
+						<< " instead of " << expected << std::endl;
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void fillImage(vtkImageData* image, const int extent[6])
+{
+	vtkNew<vtkUnsignedShortArray> scalars;
+	scalars->SetNumberOfTuples(static_cast<vtkIdType>(extent[1] - extent[0] + 1) * (extent[3] - extent[2] + 1)
+		* (extent[5] - extent[4] + 1));
+	image->SetExtent(const_cast<int*>(extent));
+	image->GetPointData()->SetScalars(scalars.GetPointer());
+	for (int k = extent[4]; k <= extent[5]; k++)
+	{
+		for (int j = extent[2]; j <= extent[3]; j++)
+		{
+			for (int i = extent[0]; i <= extent[1]; i++)
+			{
+				*static_cast<unsigned short*>(image->GetScalarPointer(i, j, k)) = inputValue(i, j, k);
+			}
+		}
+	}
+}
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerbreastImageTilerTest1(int, char*[])
+{
+	const int wholeExtent[6] = { 0, dims[0] - 1, 0, dims[1] - 1, 0, dims[2] - 1 };
+	vtkNew<vtkImageData> input;
+	fillImage(input.GetPointer(), wholeExtent);
+	vtkNew<vtkSlicerbreastImageTaskPool> pool;
+	vtkNew<vtkSlicerbreastImageTiler> tiler;
+
+	// tiles of a few dozen pixels and their halos, on both sides of which
+	// the output must not show seams, then a single tile
+	const vtkIdType tileSizes[2] = { 4 * 30 * 30, 256 * 1024 };
+	for (int size = 0; size < 2; size++)
+	{
+		tiler->SetMaximumTileSize(tileSizes[size]);
+		for (int pooled = 0; pooled < 2; pooled++)
+		{
+			tiler->SetTaskPool(pooled ? pool.GetPointer() : NULL);
+			vtkSlicerbreastImageTileBoxMeanKernel mean(3);
+			vtkNew<vtkImageData> output;
+			tiler->SetHalo(0, 0, 0);
+			if (!tiler->Run(input.GetPointer(), output.GetPointer(), &mean)
+				|| !checkOutput(output.GetPointer(), wholeExtent, 3, false, 0., "box mean"))
+			{
+				std::cerr << "Line " << __LINE__ << ": wrong box mean, tile size " << tileSizes[size]
+					<< ", pool " << pooled << std::endl;
+				return EXIT_FAILURE;
+			}
+			// an extra halo is read but does not change the output
+			tiler->SetHalo(2, 5, 1);
+			if (!tiler->Run(input.GetPointer(), output.GetPointer(), &mean)
+				|| !checkOutput(output.GetPointer(), wholeExtent, 3, false, 0., "box mean with halo"))
+			{
+				std::cerr << "Line " << __LINE__ << ": wrong box mean with an extra halo, tile size " << tileSizes[size]
+					<< ", pool " << pooled << std::endl;
+				return EXIT_FAILURE;
+			}
+			// sharpened values out of the scalar range are clamped
+			tiler->SetHalo(0, 0, 0);
+			vtkSlicerbreastImageTileUnsharpMaskKernel unsharp(2, 1.5);
+			if (!tiler->Run(input.GetPointer(), output.GetPointer(), &unsharp)
+				|| !checkOutput(output.GetPointer(), wholeExtent, 2, true, 1.5, "unsharp mask"))
+			{
+				std::cerr << "Line " << __LINE__ << ": wrong unsharp mask, tile size " << tileSizes[size]
+					<< ", pool " << pooled << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	// an extent of the input, whose halo reads the pixels around it, written
+	// in place into a copy of the input and into an image covering only it
+	tiler->SetMaximumTileSize(tileSizes[0]);
+	tiler->SetTaskPool(pool.GetPointer());
+	const int extent[6] = { 10, 40, 5, 30, 1, 1 };
+	vtkSlicerbreastImageTileBoxMeanKernel mean(3);
+	vtkNew<vtkImageData> output;
+	output->DeepCopy(input.GetPointer());
+	void* outputScalars = output->GetScalarPointer();
+	if (!tiler->Run(input.GetPointer(), output.GetPointer(), &mean, extent)
+		|| output->GetScalarPointer() != outputScalars
+		|| !checkOutput(output.GetPointer(), extent, 3, false, 0., "box mean of an extent"))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong box mean of an extent" << std::endl;
+		return EXIT_FAILURE;
+	}
+	vtkNew<vtkImageData> roi;
+	fillImage(roi.GetPointer(), extent);
+	outputScalars = roi->GetScalarPointer();
+	if (!tiler->Run(input.GetPointer(), roi.GetPointer(), &mean, extent)
+		|| roi->GetScalarPointer() != outputScalars
+		|| !std::equal(extent, extent + 6, roi->GetExtent())
+		|| !checkOutput(roi.GetPointer(), extent, 3, false, 0., "box mean of an ROI"))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong box mean of an ROI" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// the halos read the input, which no tile writes
+	const int noExtent[6] = { 0, -1, 0, -1, 0, -1 };
+	if (!checkOutput(input.GetPointer(), noExtent, 0, false, 0., "input"))
+	{
+		std::cerr << "Line " << __LINE__ << ": the input was modified" << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,320 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageLogic.h"
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLVolumeArchetypeStorageNode.h>
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+
+// DCMTK includes
+#include <dcmtk/config/osconfig.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+
+// QT includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+const int dims[3] = { 9, 5, 2 };
+
+// DICOM file holding the tags NormalizeVolumeIntensities reads, with a VOI
+// LUT when lut is not empty
+bool writeDicom(const QString& fileName, const char* photometricInterpretation, Uint16 pixelRepresentation,
+	Uint16 firstMapped, const std::vector<Uint16>& lut, const char* rescaleSlope = NULL, const char* rescaleIntercept = NULL)
+{
+	static int instance = 0;
+	QString sopInstanceUID = QString("1.2.826.0.1.3680043.2.1125.%1.%2").arg(QCoreApplication::applicationPid()).arg(++instance);
+	DcmFileFormat fileFormat;
+	DcmDataset* dataset = fileFormat.getDataset();
+	// digital mammography X-ray image, for presentation
+	dataset->putAndInsertString(DCM_SOPClassUID, "1.2.840.10008.5.1.4.1.1.1.2");
+	dataset->putAndInsertString(DCM_SOPInstanceUID, sopInstanceUID.toLatin1().constData());
+	dataset->putAndInsertString(DCM_PhotometricInterpretation, photometricInterpretation);
+	dataset->putAndInsertUint16(DCM_BitsStored, 12);
+	dataset->putAndInsertUint16(DCM_PixelRepresentation, pixelRepresentation);
+	if (rescaleSlope)
+	{
+		dataset->putAndInsertString(DCM_RescaleSlope, rescaleSlope);
+		dataset->putAndInsertString(DCM_RescaleIntercept, rescaleIntercept);
+	}
+	if (!lut.empty())
+	{
+		const Uint16 descriptor[3] = { static_cast<Uint16>(lut.size()), firstMapped, 12 };
+		DcmItem* voiLUT = NULL;
+		if (dataset->findOrCreateSequenceItem(DCM_VOILUTSequence, voiLUT, -2).bad() || !voiLUT
+			|| voiLUT->putAndInsertUint16Array(DcmTag(DCM_LUTDescriptor, EVR_US), descriptor, 3).bad()
+			|| voiLUT->putAndInsertUint16Array(DcmTag(DCM_LUTData, EVR_OW), &lut[0], lut.size()).bad())
+		{
+			return false;
+		}
+	}
+	return fileFormat.saveFile(fileName.toLocal8Bit().constData(), EXS_LittleEndianExplicit).good();
+}
+
+// volume of the scene read from fileName, whose scalars of scalarType
+// range over [80, 200), or [-20, 30] for signed scalars
+vtkMRMLScalarVolumeNode* addVolume(vtkMRMLScene* scene, const QString& fileName, int scalarType)
+{
+	vtkSmartPointer<vtkDataArray> scalars;
+	scalars.TakeReference(vtkDataArray::CreateDataArray(scalarType));
+	scalars->SetNumberOfTuples(dims[0] * dims[1] * dims[2]);
+	for (vtkIdType index = 0; index < scalars->GetNumberOfTuples(); index++)
+	{
+		double value = 80. + (index * 7) % 120;
+		if (scalarType == VTK_SHORT)
+		{
+			value = (index * 7) % 51 - 20.;
+		}
+		else if (scalarType == VTK_FLOAT)
+		{
+			value = 80. + (index * 37) % 1200 / 10.;
+		}
+		scalars->SetTuple1(index, value);
+	}
+	vtkNew<vtkImageData> image;
+	image->SetDimensions(const_cast<int*>(dims));
+	image->GetPointData()->SetScalars(scalars);
+
+	vtkNew<vtkMRMLVolumeArchetypeStorageNode> storageNode;
+	storageNode->SetFileName(fileName.toLocal8Bit().constData());
+	scene->AddNode(storageNode.GetPointer());
+	vtkNew<vtkMRMLScalarVolumeNode> volume;
+	volume->SetAndObserveImageData(image.GetPointer());
+	volume->SetAndObserveStorageNodeID(storageNode->GetID());
+	scene->AddNode(volume.GetPointer());
+	return volume.GetPointer();
+}
+
+std::vector<double> scalarValues(vtkMRMLVolumeNode* volume)
+{
+	vtkDataArray* scalars = volume->GetImageData()->GetPointData()->GetScalars();
+	std::vector<double> values(scalars->GetNumberOfTuples());
+	for (vtkIdType index = 0; index < scalars->GetNumberOfTuples(); index++)
+	{
+		values[index] = scalars->GetTuple1(index);
+	}
+	return values;
+}
+
+double lutValue(const std::vector<Uint16>& lut, int firstMapped, double value)
+{
+	int index = static_cast<int>(std::floor(value - firstMapped));
+	return lut[std::min(std::max(index, 0), static_cast<int>(lut.size()) - 1)];
+}
+
+// the scalars of volume have scalarType and the values of expected
+bool checkValues(vtkMRMLVolumeNode* volume, const std::vector<double>& expected, int scalarType, const char* name)
+{
+	vtkDataArray* scalars = volume->GetImageData()->GetPointData()->GetScalars();
+	if (scalars->GetDataType() != scalarType || scalars->GetNumberOfTuples() != static_cast<vtkIdType>(expected.size())
+		|| !volume->GetAttribute("breastImage.Intensities"))
+	{
+		std::cerr << name << ": wrong scalar type " << scalars->GetDataTypeAsString() << " or volume not marked" << std::endl;
+		return false;
+	}
+	for (vtkIdType index = 0; index < scalars->GetNumberOfTuples(); index++)
+	{
+		if (scalars->GetTuple1(index) != expected[index])
+		{
+			std::cerr << name << ": value " << index << " is " << scalars->GetTuple1(index)
+				<< " instead of " << expected[index] << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerbreastImageVOILUTTest1(int, char*[])
+{
+	vtkNew<vtkMRMLScene> scene;
+	vtkNew<vtkSlicerbreastImageLogic> logic;
+	logic->SetMRMLScene(scene.GetPointer());
+
+	QStringList fileNames;
+	for (int i = 0; i < 6; i++)
+	{
+		fileNames << QDir::temp().absoluteFilePath(
+			QString("vtkSlicerbreastImageVOILUTTest1-%1-%2.dcm").arg(QCoreApplication::applicationPid()).arg(i));
+	}
+	// a table covering part of the values, which are clamped to its ends
+	const int firstMapped = 100;
+	std::vector<Uint16> lut(64);
+	for (size_t i = 0; i < lut.size(); i++)
+	{
+		lut[i] = static_cast<Uint16>(i * i);
+	}
+	// table of signed pixels, whose first mapped value is negative
+	const int signedFirstMapped = -10;
+	std::vector<Uint16> signedLUT(16);
+	for (size_t i = 0; i < signedLUT.size(); i++)
+	{
+		signedLUT[i] = static_cast<Uint16>(1000 + 10 * i);
+	}
+	if (!writeDicom(fileNames[0], "MONOCHROME2", 0, firstMapped, lut)
+		|| !writeDicom(fileNames[1], "MONOCHROME1", 0, firstMapped, lut)
+		|| !writeDicom(fileNames[2], "MONOCHROME2", 1, static_cast<Uint16>(signedFirstMapped), signedLUT)
+		|| !writeDicom(fileNames[3], "MONOCHROME1", 0, 0, std::vector<Uint16>())
+		|| !writeDicom(fileNames[4], "MONOCHROME2", 0, 0, std::vector<Uint16>(), "2", "10")
+		|| !writeDicom(fileNames[5], "MONOCHROME2", 0, 0, std::vector<Uint16>()))
+	{
+		std::cerr << "Line " << __LINE__ << ": can not write the DICOM files" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// the table is applied in place to 16 bit values, once
+	vtkMRMLScalarVolumeNode* volume = addVolume(scene.GetPointer(), fileNames[0], VTK_UNSIGNED_SHORT);
+	std::vector<double> values = scalarValues(volume);
+	std::vector<double> expected(values.size());
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		expected[i] = lutValue(lut, firstMapped, values[i]);
+	}
+	void* scalars = volume->GetImageData()->GetScalarPointer();
+	if (!logic->NormalizeVolumeIntensities(volume) || volume->GetImageData()->GetScalarPointer() != scalars
+		|| !checkValues(volume, expected, VTK_UNSIGNED_SHORT, "VOI LUT")
+		|| logic->NormalizeVolumeIntensities(volume) || !checkValues(volume, expected, VTK_UNSIGNED_SHORT, "VOI LUT twice"))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong VOI LUT" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// float values go through the same table, without the rounding of the
+	// 16 bit lookups
+	volume = addVolume(scene.GetPointer(), fileNames[0], VTK_FLOAT);
+	values = scalarValues(volume);
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		expected[i] = lutValue(lut, firstMapped, values[i]);
+	}
+	if (!logic->NormalizeVolumeIntensities(volume) || !checkValues(volume, expected, VTK_FLOAT, "VOI LUT of float values"))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong VOI LUT of float values" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// without inPlace the volume gets float scalars
+	volume = addVolume(scene.GetPointer(), fileNames[0], VTK_UNSIGNED_SHORT);
+	values = scalarValues(volume);
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		expected[i] = lutValue(lut, firstMapped, values[i]);
+	}
+	if (!logic->NormalizeVolumeIntensities(volume, false, false) || !checkValues(volume, expected, VTK_FLOAT, "VOI LUT to float"))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong VOI LUT to float scalars" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// MONOCHROME1 values are mirrored in the range of the table
+	volume = addVolume(scene.GetPointer(), fileNames[1], VTK_UNSIGNED_SHORT);
+	values = scalarValues(volume);
+	double lutSum = *std::min_element(lut.begin(), lut.end()) + *std::max_element(lut.begin(), lut.end());
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		expected[i] = lutSum - lutValue(lut, firstMapped, values[i]);
+	}
+	if (!logic->NormalizeVolumeIntensities(volume) || !checkValues(volume, expected, VTK_UNSIGNED_SHORT, "inverted VOI LUT"))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong inverted VOI LUT" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// the first mapped value of signed pixels is signed
+	volume = addVolume(scene.GetPointer(), fileNames[2], VTK_SHORT);
+	values = scalarValues(volume);
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		expected[i] = lutValue(signedLUT, signedFirstMapped, values[i]);
+	}
+	if (!logic->NormalizeVolumeIntensities(volume) || !checkValues(volume, expected, VTK_SHORT, "signed VOI LUT"))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong VOI LUT of signed pixels" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// without table MONOCHROME1 values are mirrored in the range of the
+	// stored bits. Mirrored values of the whole 16 bit range do not fit it,
+	// so the scalars become float.
+	volume = addVolume(scene.GetPointer(), fileNames[3], VTK_UNSIGNED_SHORT);
+	values = scalarValues(volume);
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		expected[i] = 4095. - values[i];
+	}
+	if (!logic->NormalizeVolumeIntensities(volume) || !checkValues(volume, expected, VTK_FLOAT, "MONOCHROME1"))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong MONOCHROME1 inversion" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// the modality rescale is applied only on request
+	volume = addVolume(scene.GetPointer(), fileNames[4], VTK_UNSIGNED_SHORT);
+	values = scalarValues(volume);
+	if (logic->NormalizeVolumeIntensities(volume) || !checkValues(volume, values, VTK_UNSIGNED_SHORT, "rescale not requested"))
+	{
+		std::cerr << "Line " << __LINE__ << ": rescale applied without request" << std::endl;
+		return EXIT_FAILURE;
+	}
+	volume = addVolume(scene.GetPointer(), fileNames[4], VTK_UNSIGNED_SHORT);
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		expected[i] = 2. * values[i] + 10.;
+	}
+	if (!logic->NormalizeVolumeIntensities(volume, true) || !checkValues(volume, expected, VTK_FLOAT, "rescale"))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong rescale" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// nothing to apply
+	volume = addVolume(scene.GetPointer(), fileNames[5], VTK_UNSIGNED_SHORT);
+	values = scalarValues(volume);
+	if (logic->NormalizeVolumeIntensities(volume) || !checkValues(volume, values, VTK_UNSIGNED_SHORT, "MONOCHROME2"))
+	{
+		std::cerr << "Line " << __LINE__ << ": MONOCHROME2 values changed" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	foreach(QString fileName, fileNames)
+	{
+		QFile::remove(fileName);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,206 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageVolumeCache.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkShortArray.h>
+
+// QT includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+// value of component c of voxel (i, j, k)
+short voxelValue(int i, int j, int k, int c)
+{
+	return static_cast<short>(i * 7 - j * 131 + k * 1009 + c * 5000);
+}
+
+bool checkMatrix(vtkMatrix4x4* read, vtkMatrix4x4* written, double inPlaneScale)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			double scale = j < 2 && i < 3 ? inPlaneScale : 1.;
+			if (read->GetElement(i, j) != written->GetElement(i, j) * scale)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerbreastImageVolumeCacheTest1(int, char*[])
+{
+	QDir directory(QDir::temp().absoluteFilePath(
+		QString("vtkSlicerbreastImageVolumeCacheTest1-%1").arg(QCoreApplication::applicationPid())));
+	vtkNew<vtkSlicerbreastImageVolumeCache> cache;
+	cache->SetDirectory(directory.absolutePath());
+	const QString key = "1.2.840.113619.2.1.1";
+
+	const int dims[3] = { 19, 13, 3 };
+	vtkNew<vtkShortArray> scalars;
+	scalars->SetNumberOfComponents(2);
+	scalars->SetNumberOfTuples(dims[0] * dims[1] * dims[2]);
+	for (int k = 0; k < dims[2]; k++)
+	{
+		for (int j = 0; j < dims[1]; j++)
+		{
+			for (int i = 0; i < dims[0]; i++)
+			{
+				vtkIdType tuple = (static_cast<vtkIdType>(k) * dims[1] + j) * dims[0] + i;
+				scalars->SetComponent(tuple, 0, voxelValue(i, j, k, 0));
+				scalars->SetComponent(tuple, 1, voxelValue(i, j, k, 1));
+			}
+		}
+	}
+	vtkNew<vtkImageData> image;
+	image->SetDimensions(dims[0], dims[1], dims[2]);
+	image->GetPointData()->SetScalars(scalars.GetPointer());
+	vtkNew<vtkMatrix4x4> ijkToRAS;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			ijkToRAS->SetElement(i, j, 0.1 * (i + 1) + 0.01 * j - (i == j ? 1. : 0.));
+		}
+	}
+
+	if (cache->Contains(key) || !cache->Write(key, image.GetPointer(), ijkToRAS.GetPointer(), Q_UINT64_C(0x0123456789abcdef))
+		|| !cache->Contains(key))
+	{
+		std::cerr << "Line " << __LINE__ << ": can not write " << cache->GetFileName(key).toStdString() << std::endl;
+		return EXIT_FAILURE;
+	}
+	// the temporary file was renamed
+	if (directory.entryList(QDir::Files) != QStringList(QFileInfo(cache->GetFileName(key)).fileName()))
+	{
+		std::cerr << "Line " << __LINE__ << ": unexpected files in the cache: "
+			<< directory.entryList(QDir::Files).join(" ").toStdString() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	vtkNew<vtkImageData> read;
+	read->SetOrigin(1., 2., 3.);
+	vtkNew<vtkMatrix4x4> readIJKToRAS;
+	quint64 contentHash = 0;
+	if (!cache->Read(key, read.GetPointer(), readIJKToRAS.GetPointer(), &contentHash))
+	{
+		std::cerr << "Line " << __LINE__ << ": can not read the cached volume" << std::endl;
+		return EXIT_FAILURE;
+	}
+	int* readDims = read->GetDimensions();
+	double* origin = read->GetOrigin();
+	if (readDims[0] != dims[0] || readDims[1] != dims[1] || readDims[2] != dims[2]
+		|| read->GetScalarType() != VTK_SHORT || read->GetNumberOfScalarComponents() != 2
+		|| origin[0] != 0. || origin[1] != 0. || origin[2] != 0.
+		|| contentHash != Q_UINT64_C(0x0123456789abcdef) || !checkMatrix(readIJKToRAS.GetPointer(), ijkToRAS.GetPointer(), 1.))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong geometry or hash of the cached volume" << std::endl;
+		return EXIT_FAILURE;
+	}
+	vtkDataArray* readScalars = read->GetPointData()->GetScalars();
+	for (vtkIdType value = 0; value < scalars->GetNumberOfValues(); value++)
+	{
+		if (static_cast<short*>(readScalars->GetVoidPointer(0))[value] != scalars->GetValue(value))
+		{
+			std::cerr << "Line " << __LINE__ << ": wrong value " << value << " of the cached volume" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	// writes to the scalars stay private to the image
+	static_cast<short*>(readScalars->GetVoidPointer(0))[0] = -1;
+	vtkNew<vtkImageData> readAgain;
+	if (!cache->Read(key, readAgain.GetPointer(), readIJKToRAS.GetPointer())
+		|| static_cast<short*>(readAgain->GetScalarPointer())[0] != scalars->GetValue(0))
+	{
+		std::cerr << "Line " << __LINE__ << ": a write to the read scalars reached the cache" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// every fourth pixel of every fourth row
+	const int factor = 4;
+	vtkNew<vtkImageData> preview;
+	vtkNew<vtkMatrix4x4> previewIJKToRAS;
+	if (!cache->ReadPreview(key, factor, preview.GetPointer(), previewIJKToRAS.GetPointer()))
+	{
+		std::cerr << "Line " << __LINE__ << ": can not read the preview" << std::endl;
+		return EXIT_FAILURE;
+	}
+	int* previewDims = preview->GetDimensions();
+	if (previewDims[0] != 5 || previewDims[1] != 4 || previewDims[2] != dims[2]
+		|| preview->GetNumberOfScalarComponents() != 2
+		|| !checkMatrix(previewIJKToRAS.GetPointer(), ijkToRAS.GetPointer(), factor))
+	{
+		std::cerr << "Line " << __LINE__ << ": wrong geometry of the preview" << std::endl;
+		return EXIT_FAILURE;
+	}
+	for (int k = 0; k < previewDims[2]; k++)
+	{
+		for (int j = 0; j < previewDims[1]; j++)
+		{
+			for (int i = 0; i < previewDims[0]; i++)
+			{
+				short* pixel = static_cast<short*>(preview->GetScalarPointer(i, j, k));
+				if (pixel[0] != voxelValue(factor * i, factor * j, k, 0) || pixel[1] != voxelValue(factor * i, factor * j, k, 1))
+				{
+					std::cerr << "Line " << __LINE__ << ": wrong preview pixel " << i << " " << j << " " << k << std::endl;
+					return EXIT_FAILURE;
+				}
+			}
+		}
+	}
+
+	// a volume written again under the same key replaces the cached one,
+	// while the images read before keep their pixels
+	scalars->SetValue(0, 4242);
+	if (!cache->Write(key, image.GetPointer(), ijkToRAS.GetPointer())
+		|| !cache->Read(key, readAgain.GetPointer(), readIJKToRAS.GetPointer(), &contentHash)
+		|| static_cast<short*>(readAgain->GetScalarPointer())[0] != 4242 || contentHash != 0
+		|| static_cast<short*>(readScalars->GetVoidPointer(0))[1] != scalars->GetValue(1))
+	{
+		std::cerr << "Line " << __LINE__ << ": the cached volume was not replaced" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	cache->Remove(key);
+	if (cache->Contains(key) || cache->Read(key, readAgain.GetPointer(), readIJKToRAS.GetPointer())
+		|| cache->ReadPreview(key, factor, preview.GetPointer(), previewIJKToRAS.GetPointer()))
+	{
+		std::cerr << "Line " << __LINE__ << ": removed volume still cached" << std::endl;
+		return EXIT_FAILURE;
+	}
+	QDir().rmdir(directory.absolutePath());
+	return EXIT_SUCCESS;
+}
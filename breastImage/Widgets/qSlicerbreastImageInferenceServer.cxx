@@ -0,0 +1,269 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// breastImage Widgets includes
+#include "qSlicerbreastImageInferenceServer.h"
+
+// breastImage Logic includes
+#include "vtkSlicerbreastImageLogic.h"
+#include "vtkSlicerbreastImageSharedVolume.h"
+
+// Qt includes
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QStringList>
+
+// MRML includes
+#include <vtkMRMLVolumeNode.h>
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkWeakPointer.h>
+
+//-----------------------------------------------------------------------------
+/// \ingroup Slicer_QtModules_breastImage
+class qSlicerbreastImageInferenceServerPrivate
+{
+  Q_DECLARE_PUBLIC(qSlicerbreastImageInferenceServer);
+protected:
+  qSlicerbreastImageInferenceServer* const q_ptr;
+
+public:
+  qSlicerbreastImageInferenceServerPrivate(qSlicerbreastImageInferenceServer& object);
+
+  QString publish();
+  QString addBoxes(const QStringList& lines);
+
+  QLocalServer Server;
+  vtkWeakPointer<vtkSlicerbreastImageLogic> Logic;
+  vtkWeakPointer<vtkMRMLVolumeNode> Volume;
+  QMap<QString, QString> Annotations;
+  // what the segment holds, so unchanged volumes are not copied again
+  vtkWeakPointer<vtkMRMLVolumeNode> PublishedVolume;
+  unsigned long PublishedTime;
+  bool AnnotationsModified;
+  int CandidateCount;
+};
+
+// --------------------------------------------------------------------------
+qSlicerbreastImageInferenceServerPrivate
+::qSlicerbreastImageInferenceServerPrivate(qSlicerbreastImageInferenceServer& object)
+  : q_ptr(&object)
+{
+  this->PublishedTime = 0;
+  this->AnnotationsModified = true;
+  this->CandidateCount = 0;
+}
+
+// --------------------------------------------------------------------------
+QString qSlicerbreastImageInferenceServerPrivate::publish()
+{
+  if (!this->Logic || !this->Volume || !this->Volume->GetImageData())
+    {
+    return "ERROR no volume";
+    }
+  vtkSlicerbreastImageSharedVolume* sharedVolume = this->Logic->GetSharedVolume();
+  unsigned long time = this->Volume->GetImageData()->GetMTime();
+  if (this->PublishedVolume != this->Volume || this->PublishedTime != time
+    || this->AnnotationsModified || sharedVolume->GetSequence() == 0)
+    {
+    if (!this->Logic->PublishSharedVolume(this->Volume, this->Annotations))
+      {
+      return "ERROR cannot publish the volume";
+      }
+    this->PublishedVolume = this->Volume;
+    this->PublishedTime = time;
+    this->AnnotationsModified = false;
+    }
+  return QString("OK %1 %2").arg(sharedVolume->GetName()).arg(sharedVolume->GetSequence());
+}
+
+// --------------------------------------------------------------------------
+QString qSlicerbreastImageInferenceServerPrivate::addBoxes(const QStringList& lines)
+{
+  Q_Q(qSlicerbreastImageInferenceServer);
+  // the boxes are in the voxels of the published volume
+  if (!this->Logic || !this->PublishedVolume)
+    {
+    return "ERROR no published volume";
+    }
+  int count = 0;
+  foreach (const QString& line, lines)
+    {
+    QStringList values = line.split(' ', QString::SkipEmptyParts);
+    int box[6];
+    bool valid = values.size() == 6;
+    for (int i = 0; valid && i < 6; i++)
+      {
+      box[i] = values[i].toInt(&valid);
+      }
+    if (!valid)
+      {
+      continue;
+      }
+    QString name = QString("Candidate_%1").arg(++this->CandidateCount);
+    if (this->Logic->AddROIFromIJK(this->PublishedVolume, box, box + 3, name))
+      {
+      count++;
+      }
+    }
+  if (count)
+    {
+    emit q->candidatesAdded(count);
+    }
+  return QString("OK %1").arg(count);
+}
+
+//-----------------------------------------------------------------------------
+// qSlicerbreastImageInferenceServer methods
+
+//-----------------------------------------------------------------------------
+qSlicerbreastImageInferenceServer
+::qSlicerbreastImageInferenceServer(QObject* parentObject)
+  : Superclass( parentObject )
+  , d_ptr( new qSlicerbreastImageInferenceServerPrivate(*this) )
+{
+  Q_D(qSlicerbreastImageInferenceServer);
+  QObject::connect(&d->Server, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+}
+
+//-----------------------------------------------------------------------------
+qSlicerbreastImageInferenceServer
+::~qSlicerbreastImageInferenceServer()
+{
+  this->close();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageInferenceServer::setLogic(vtkSlicerbreastImageLogic* logic)
+{
+  Q_D(qSlicerbreastImageInferenceServer);
+  d->Logic = logic;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageInferenceServer::setVolume(vtkMRMLVolumeNode* volume)
+{
+  Q_D(qSlicerbreastImageInferenceServer);
+  d->Volume = volume;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageInferenceServer::setAnnotations(const QMap<QString, QString>& annotationInf)
+{
+  Q_D(qSlicerbreastImageInferenceServer);
+  if (annotationInf != d->Annotations)
+    {
+    d->Annotations = annotationInf;
+    d->AnnotationsModified = true;
+    }
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerbreastImageInferenceServer::listen(const QString& name)
+{
+  Q_D(qSlicerbreastImageInferenceServer);
+  // a socket file left by a crashed session
+  QLocalServer::removeServer(name);
+  return d->Server.listen(name);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageInferenceServer::close()
+{
+  Q_D(qSlicerbreastImageInferenceServer);
+  d->Server.close();
+  if (d->Logic)
+    {
+    d->Logic->GetSharedVolume()->Unpublish();
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageInferenceServer::onNewConnection()
+{
+  Q_D(qSlicerbreastImageInferenceServer);
+  while (QLocalSocket* socket = d->Server.nextPendingConnection())
+    {
+    QObject::connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    QObject::connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageInferenceServer::onReadyRead()
+{
+  Q_D(qSlicerbreastImageInferenceServer);
+  QLocalSocket* socket = qobject_cast<QLocalSocket*>(this->sender());
+  if (!socket)
+    {
+    return;
+    }
+  while (socket->canReadLine())
+    {
+    QString line = QString::fromLatin1(socket->readLine()).trimmed();
+    // lines of a BOXES request
+    int pendingBoxes = socket->property("pendingBoxes").toInt();
+    if (pendingBoxes > 0)
+      {
+      QStringList boxes = socket->property("boxes").toStringList();
+      boxes << line;
+      socket->setProperty("pendingBoxes", pendingBoxes - 1);
+      socket->setProperty("boxes", pendingBoxes > 1 ? boxes : QStringList());
+      if (pendingBoxes == 1)
+        {
+        socket->write((d->addBoxes(boxes) + "\n").toLatin1());
+        }
+      continue;
+      }
+
+    QString response;
+    if (line == "PING")
+      {
+      response = "PONG";
+      }
+    else if (line == "VOLUME")
+      {
+      response = d->publish();
+      }
+    else if (line.startsWith("BOXES"))
+      {
+      bool ok = false;
+      int count = line.section(' ', 1, 1).toInt(&ok);
+      if (!ok || count < 0)
+        {
+        response = "ERROR invalid box count";
+        }
+      else if (count == 0)
+        {
+        response = "OK 0";
+        }
+      else
+        {
+        socket->setProperty("pendingBoxes", count);
+        }
+      }
+    else
+      {
+      response = "ERROR unknown request";
+      }
+    if (!response.isEmpty())
+      {
+      socket->write((response + "\n").toLatin1());
+      }
+    }
+}
@@ -0,0 +1,83 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __qSlicerbreastImageInferenceServer_h
+#define __qSlicerbreastImageInferenceServer_h
+
+// Qt includes
+#include <QMap>
+#include <QObject>
+#include <QString>
+
+// breastImage Widgets includes
+#include "qSlicerbreastImageModuleWidgetsExport.h"
+
+class qSlicerbreastImageInferenceServerPrivate;
+class vtkMRMLVolumeNode;
+class vtkSlicerbreastImageLogic;
+
+/// Local socket (a Unix domain socket on Unix) through which a local process,
+/// such as a detection model, reads the selected volume from shared memory
+/// and returns candidate boxes. Requests and responses are ASCII lines:
+///
+///   PING                 -> PONG
+///   VOLUME               -> OK <segment> <sequence> | ERROR <reason>
+///       publish the selected volume and its cluster boxes in the shared
+///       memory segment given to shm_open, see vtkSlicerbreastImageSharedVolume
+///       for its layout. The volume is copied again only when it changed.
+///   BOXES <n>            followed by n lines "<i> <j> <k> <ri> <rj> <rk>"
+///                        -> OK <n> | ERROR <reason>
+///       center and radius, in voxels of the published volume, of the
+///       candidates. Each box is added to the scene as an ROI node.
+///
+/// \ingroup Slicer_QtModules_breastImage
+class Q_SLICER_MODULE_BREASTIMAGE_WIDGETS_EXPORT qSlicerbreastImageInferenceServer
+  : public QObject
+{
+  Q_OBJECT
+public:
+  typedef QObject Superclass;
+  qSlicerbreastImageInferenceServer(QObject *parent=0);
+  virtual ~qSlicerbreastImageInferenceServer();
+
+  void setLogic(vtkSlicerbreastImageLogic* logic);
+  /// Volume published on request, with the clusters of the annotations
+  /// (keys of vtkSlicerbreastImageLogic::writeAnnotationXML).
+  void setVolume(vtkMRMLVolumeNode* volume);
+  void setAnnotations(const QMap<QString, QString>& annotationInf);
+
+  /// Listen on the local socket name, see QLocalServer::listen.
+  bool listen(const QString& name);
+  void close();
+
+signals:
+  /// Candidate boxes received and added to the scene as ROI nodes.
+  void candidatesAdded(int count);
+
+protected slots:
+  void onNewConnection();
+  void onReadyRead();
+
+protected:
+  QScopedPointer<qSlicerbreastImageInferenceServerPrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(qSlicerbreastImageInferenceServer);
+  Q_DISABLE_COPY(qSlicerbreastImageInferenceServer);
+};
+
+#endif
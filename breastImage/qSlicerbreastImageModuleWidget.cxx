@@ -26,16 +26,28 @@
 #include <QtGui/QTableWidget>
 #include <QtGui/QSpinBox>
 #include <QDateTime>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QPointer>
+#include <QTimer>
 
 //vtk includes
 #include "vtkMRMLScene.h"
 #include "vtkImageData.h"
+#include <vtkCommand.h>
 #include <vtkNew.h>
 #include <vtkMatrix4x4.h>
 #include <vtkSmartPointer.h>
+#include <vtkWeakPointer.h>
 
 //vtkSlicerbreastImageLogic includes
 #include "vtkSlicerbreastImageLogic.h"
+#include "vtkSlicerbreastImageAnnotationJournal.h"
+#include "vtkSlicerbreastImageReorienter.h"
+#include "vtkSlicerbreastImageTrace.h"
+
+// breastImage Widgets includes
+#include "qSlicerbreastImageInferenceServer.h"
 
 // MRMLLogic includes
 #include <vtkMRMLApplicationLogic.h>
@@ -52,6 +64,8 @@
 #include <vtkMRMLAnnotationROINode.h>
 #include <vtkMRMLAnnotationRulerNode.h>
 #include <vtkMRMLSelectionNode.h>
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLSliceCompositeNode.h>
 
 // qMRML includes
 #include <qMRMLNodeFactory.h>
@@ -64,6 +78,44 @@ class qSlicerbreastImageModuleWidgetPrivate: public Ui_qSlicerbreastImageModuleW
 public:
 	qSlicerbreastImageModuleWidgetPrivate(qSlicerbreastImageModuleWidget& object);
     vtkSlicerbreastImageLogic* logic() const;
+	// window level preset of the density selected in the report
+	int windowLevelPreset() const;
+
+	// loads of the full resolution of the volumes opened from the cache with
+	// a preview, by volume node ID
+	QHash<QString, QFutureWatcher<void>*> FullResolutionWatchers;
+	// connections and tables are set up on the first enter()
+	bool Initialized;
+	// selections of the four input comboboxes in one event loop iteration
+	// update the inputs once
+	QTimer InputNodeUpdateTimer;
+	// volume last made active in the slice views
+	vtkWeakPointer<vtkMRMLVolumeNode> ShownVolume;
+	// owned by imageInfTableWidget
+	QPointer<QComboBox> ScalarTypeComboBox;
+	// reports being written in the background, by file name
+	QHash<QString, QFutureWatcher<void>*> ReportWriteWatchers;
+	// journal of the volume of a report being written, up to the save
+	struct JournaledReport
+	{
+		vtkWeakPointer<vtkMRMLVolumeNode> Volume;
+		qint64 Position;
+		QMap<QString, QString> DicomInformation;
+		QMap<QString, QString> PacasInformation;
+		QMap<QString, QString> AnnotationInformation;
+	};
+	QHash<QString, JournaledReport> ReportWriteJournals;
+	// annotation edits of the selected volume, kept until its report is exported
+	vtkSlicerbreastImageAnnotationJournal Journal;
+	vtkWeakPointer<vtkMRMLVolumeNode> JournalVolume;
+	// socket of a local detection model, when BREASTIMAGE_INFERENCE_SOCKET is set
+	qSlicerbreastImageInferenceServer* InferenceServer;
+	// ROI enhancement preview, updated once per event loop iteration while
+	// the ROI is moved
+	QTimer EnhancementUpdateTimer;
+	vtkWeakPointer<vtkMRMLAnnotationROINode> EnhancedROI;
+	vtkWeakPointer<vtkMRMLVolumeNode> EnhancedVolume;
+	vtkWeakPointer<vtkMRMLScalarVolumeNode> EnhancementNode;
 
 protected:
 	qSlicerbreastImageModuleWidget* const q_ptr;
@@ -75,7 +127,21 @@ protected:
 //-----------------------------------------------------------------------------
 qSlicerbreastImageModuleWidgetPrivate::qSlicerbreastImageModuleWidgetPrivate(qSlicerbreastImageModuleWidget& object) : q_ptr(&object)
 {
+	this->Initialized = false;
+	this->InferenceServer = NULL;
+	this->InputNodeUpdateTimer.setSingleShot(true);
+	this->InputNodeUpdateTimer.setInterval(0);
+	this->EnhancementUpdateTimer.setSingleShot(true);
+	this->EnhancementUpdateTimer.setInterval(0);
+}
 
+//-----------------------------------------------------------------------------
+int qSlicerbreastImageModuleWidgetPrivate::windowLevelPreset() const
+{
+	// "3-Heterogeneously Dense" and "4-Extremely Dense" of the report
+	QString density = this->densityComboBox->currentText();
+	return density.startsWith("3") || density.startsWith("4")
+		? vtkSlicerbreastImageLogic::DenseWindowLevel : vtkSlicerbreastImageLogic::FattyWindowLevel;
 }
 
 //-----------------------------------------------------------------------------
@@ -105,9 +171,19 @@ qSlicerbreastImageModuleWidget::~qSlicerbreastImageModuleWidget()
 //-----------------------------------------------------------------------------
 void qSlicerbreastImageModuleWidget::setup()
 {
+  BREASTIMAGE_TRACE_SCOPE("setup");
   Q_D(qSlicerbreastImageModuleWidget);
   d->setupUi(this);
   this->Superclass::setup();
+  // the rest waits for the first enter(), most sessions never open the module
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageModuleWidget::lazySetup()
+{
+  BREASTIMAGE_TRACE_SCOPE("lazySetup");
+  Q_D(qSlicerbreastImageModuleWidget);
+  d->Initialized = true;
   QObject::connect(this, SIGNAL(mrmlSceneChanged(vtkMRMLScene*)), d->inputPatientNodeComboBox, SLOT(setMRMLScene(vtkMRMLScene*)));
   QObject::connect(this, SIGNAL(mrmlSceneChanged(vtkMRMLScene*)), d->inputStudyNodeComboBox, SLOT(setMRMLScene(vtkMRMLScene*)));
   QObject::connect(this, SIGNAL(mrmlSceneChanged(vtkMRMLScene*)), d->inputImageNodeComboBox, SLOT(setMRMLScene(vtkMRMLScene*)));
@@ -116,23 +192,51 @@ void qSlicerbreastImageModuleWidget::setup()
   QObject::connect(d->inputEditROINodeComboBox->nodeFactory(), SIGNAL(nodeInitialized(vtkMRMLNode*)), this, SLOT(initializeNode(vtkMRMLNode*)));
   QObject::connect(d->inputEditRulerNodeComboBox->nodeFactory(), SIGNAL(nodeInitialized(vtkMRMLNode*)), this, SLOT(initializeNode(vtkMRMLNode*)));
   QObject::connect(this, SIGNAL(mrmlSceneChanged(vtkMRMLScene*)), d->inputEditRulerNodeComboBox, SLOT(setMRMLScene(vtkMRMLScene*)));
-  QObject::connect(d->inputPatientNodeComboBox, SIGNAL(currentNodeChanged(vtkMRMLNode*)), this, SLOT(onInputNodeChanged()));
-  QObject::connect(d->inputStudyNodeComboBox, SIGNAL(currentNodeChanged(vtkMRMLNode*)), this, SLOT(onInputNodeChanged()));
-  QObject::connect(d->inputImageNodeComboBox, SIGNAL(currentNodeChanged(vtkMRMLNode*)), this, SLOT(onInputNodeChanged()));
-  QObject::connect(d->inputEditVolumeNodeComboBox, SIGNAL(currentNodeChanged(vtkMRMLNode*)), this, SLOT(onInputNodeChanged()));
+  QObject::connect(d->inputPatientNodeComboBox, SIGNAL(currentNodeChanged(vtkMRMLNode*)), &d->InputNodeUpdateTimer, SLOT(start()));
+  QObject::connect(d->inputStudyNodeComboBox, SIGNAL(currentNodeChanged(vtkMRMLNode*)), &d->InputNodeUpdateTimer, SLOT(start()));
+  QObject::connect(d->inputImageNodeComboBox, SIGNAL(currentNodeChanged(vtkMRMLNode*)), &d->InputNodeUpdateTimer, SLOT(start()));
+  QObject::connect(d->inputEditVolumeNodeComboBox, SIGNAL(currentNodeChanged(vtkMRMLNode*)), &d->InputNodeUpdateTimer, SLOT(start()));
   QObject::connect(d->inputEditVolumeNodeComboBox, SIGNAL(nodeAdded(vtkMRMLNode*)), this, SLOT(onInputVolumeAdded(vtkMRMLNode*)));
   QObject::connect(d->inputEditROINodeComboBox, SIGNAL(currentNodeChanged(vtkMRMLNode*)), this, SLOT(onInputROIChanged()));
   QObject::connect(d->inputEditROINodeComboBox, SIGNAL(nodeAdded(vtkMRMLNode*)), this, SLOT(onInputROIAdded(vtkMRMLNode*)));
   QObject::connect(d->inputEditRulerNodeComboBox, SIGNAL(currentNodeChanged(vtkMRMLNode*)), this, SLOT(onInputRulerChanged()));
   QObject::connect(d->inputEditRulerNodeComboBox, SIGNAL(nodeAdded(vtkMRMLNode*)), this, SLOT(onInputRulerAdded(vtkMRMLNode*)));
-
-
+  QObject::connect(&d->InputNodeUpdateTimer, SIGNAL(timeout()), this, SLOT(onInputNodeChanged()));
+  QObject::connect(d->inputEditVolumeNodeComboBox, SIGNAL(currentNodeChanged(vtkMRMLNode*)), &d->EnhancementUpdateTimer, SLOT(start()));
+  QObject::connect(&d->EnhancementUpdateTimer, SIGNAL(timeout()), this, SLOT(updateEnhancementPreview()));
+  QObject::connect(d->densityComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(onDensityChanged()));
+
+  // the scene was set before the comboboxes were connected
+  d->inputPatientNodeComboBox->setMRMLScene(this->mrmlScene());
+  d->inputStudyNodeComboBox->setMRMLScene(this->mrmlScene());
+  d->inputImageNodeComboBox->setMRMLScene(this->mrmlScene());
+  d->inputEditVolumeNodeComboBox->setMRMLScene(this->mrmlScene());
+  d->inputEditROINodeComboBox->setMRMLScene(this->mrmlScene());
+  d->inputEditRulerNodeComboBox->setMRMLScene(this->mrmlScene());
   this->init();
+
+  QString inferenceSocket = QString::fromLocal8Bit(qgetenv("BREASTIMAGE_INFERENCE_SOCKET"));
+  if (!inferenceSocket.isEmpty())
+    {
+    d->InferenceServer = new qSlicerbreastImageInferenceServer(this);
+    d->InferenceServer->setLogic(d->logic());
+    if (!d->InferenceServer->listen(inferenceSocket))
+      {
+      qWarning() << "Cannot listen on the inference socket" << inferenceSocket;
+      }
+    }
 }
 
 //-----------------------------------------------------------------------------
 void qSlicerbreastImageModuleWidget::enter()
 {
+	Q_D(qSlicerbreastImageModuleWidget);
+	if (!d->Initialized)
+	{
+		this->lazySetup();
+	}
+	// another module may have changed the active volume
+	d->ShownVolume = NULL;
 	this->onInputNodeChanged();
 	this->onInputROIChanged();
 	this->onInputRulerChanged();
@@ -166,7 +270,10 @@ void qSlicerbreastImageModuleWidget::initializeNode(vtkMRMLNode *n)
 //-----------------------------------------------------------------------------
 void qSlicerbreastImageModuleWidget::onInputNodeChanged()
 {
-	Q_D(const qSlicerbreastImageModuleWidget);
+	BREASTIMAGE_TRACE_SCOPE("onInputNodeChanged");
+	Q_D(qSlicerbreastImageModuleWidget);
+	// a pending update would see the same selection
+	d->InputNodeUpdateTimer.stop();
 	vtkSlicerbreastImageLogic *logic = d->logic();
 	vtkSmartPointer<vtkMRMLNode> inputPatientNode = vtkMRMLNode::SafeDownCast(d->inputPatientNodeComboBox->currentNode());
 	vtkSmartPointer<vtkMRMLNode> inputStudyNode = vtkMRMLNode::SafeDownCast(d->inputStudyNodeComboBox->currentNode());
@@ -174,87 +281,81 @@ void qSlicerbreastImageModuleWidget::onInputNodeChanged()
 	vtkSmartPointer<vtkMRMLVolumeNode> inputVolumeNode = vtkMRMLVolumeNode::SafeDownCast(d->inputEditVolumeNodeComboBox->currentNode());
 	if (inputPatientNode)//Dicom patient information
 	{
-		QMap< QString, QString> m_map;
 		QString attributeValue;
-		m_map = logic->GetNodeAttribute(inputPatientNode);
-		attributeValue = m_map.value("DICOM.PatientID");
+		attributeValue = logic->GetNodeAttributeValue(inputPatientNode, "DICOM.PatientID");
 		m_dicomInf["PatientID"]= attributeValue;
 		d->patientInfTableWidget->setItem(0, 0, new QTableWidgetItem(attributeValue));
-		attributeValue = m_map.value("DICOM.PatientBirthDate");
+		attributeValue = logic->GetNodeAttributeValue(inputPatientNode, "DICOM.PatientBirthDate");
 		m_dicomInf["PatientBirthDate"] = attributeValue;
 		d->patientInfTableWidget->setItem(1, 0, new QTableWidgetItem(attributeValue));
 	}
 	if (inputStudyNode)//Dicom study information
 	{
-		QMap< QString, QString> m_map;
 		QString attributeValue;
-		m_map = logic->GetNodeAttribute(inputStudyNode);
-		attributeValue = m_map.value("StudyID");
+		attributeValue = logic->GetNodeAttributeValue(inputStudyNode, "StudyID");
 		m_dicomInf["StudyID"] = attributeValue;
 		d->patientInfTableWidget->setItem(2, 0, new QTableWidgetItem(attributeValue));
-		attributeValue = m_map.value("DICOM.StudyDate");
+		attributeValue = logic->GetNodeAttributeValue(inputStudyNode, "DICOM.StudyDate");
 		m_dicomInf["StudyDate"] = attributeValue;
 		d->patientInfTableWidget->setItem(3, 0, new QTableWidgetItem(attributeValue));
 	}
 	if (inputImageNode)//Dicom series information
 	{
-		QMap< QString, QString> m_map;
 		QString attributeValue;
-		m_map = logic->GetNodeAttribute(inputImageNode);
-		attributeValue = m_map.value("DICOM.SeriesNumber");
+		attributeValue = logic->GetNodeAttributeValue(inputImageNode, "DICOM.SeriesNumber");
 		m_dicomInf["SeriesNumber"] = attributeValue;
 		d->patientInfTableWidget->setItem(4, 0, new QTableWidgetItem(attributeValue));
-		
-		if (inputVolumeNode)//image information
+
+		vtkMRMLSubjectHierarchyNode* seriesNode = vtkMRMLSubjectHierarchyNode::SafeDownCast(inputImageNode);
+		if (!inputVolumeNode && seriesNode && !seriesNode->GetAssociatedNode())
 		{
-			QString nodeName = inputVolumeNode->GetName();
-			if (nodeName == QString(attributeValue+": L MLO"))
-			{
-				m_view = "L_MLO";
-				//m_modality = "2D";
-			}
-			else if (nodeName == QString(attributeValue + ": L MLO Breast Tomosynthesis Image"))
-			{
-				m_view = "L_MLO";
-				//m_modality = "3D";
-			}
-			else if (nodeName == QString(attributeValue + ": L CC"))
-			{
-				m_view = "L_CC";
-				//m_modality = "2D";
-			}
-			else if (nodeName == QString(attributeValue + ": L CC Breast Tomosynthesis Image"))
-			{
-				m_view = "L_CC";
-				//m_modality = "3D";
-			}
-			else if (nodeName == QString(attributeValue + ": R CC"))
-			{
-				m_view = "R_CC";
-				//m_modality = "2D";
-			}
-			else if (nodeName == QString(attributeValue + ": R CC Breast Tomosynthesis Image"))
-			{
-				m_view = "R_CC";
-				//m_modality = "3D";
-			}
-			else if (nodeName == QString(attributeValue + ": R MLO"))
+			// series not loaded: show a preview of its cached volume at once,
+			// the full resolution replaces it when loaded. A series selected
+			// again gets the volume already opened for it.
+			QString cacheKey = logic->GetVolumeCacheKey(seriesNode);
+			vtkMRMLVolumeNode* previewNode = logic->GetCachedVolume(cacheKey);
+			if (!previewNode)
 			{
-				m_view = "R_MLO";
-				//m_modality = "2D";
+				QFuture<void> fullResolution;
+				previewNode = logic->OpenCachedVolume(cacheKey, seriesNode->GetName(), fullResolution);
+				if (previewNode)
+				{
+					// a watcher per volume, the loads of earlier series still
+					// replace their previews
+					QFutureWatcher<void>* watcher = new QFutureWatcher<void>(this);
+					watcher->setProperty("volumeID", QString(previewNode->GetID()));
+					QObject::connect(watcher, SIGNAL(finished()), this, SLOT(onFullResolutionLoaded()));
+					d->FullResolutionWatchers.insert(previewNode->GetID(), watcher);
+					watcher->setFuture(fullResolution);
+				}
 			}
-			else if (nodeName == QString(attributeValue + ": R CC Breast Tomosynthesis Image"))
+			if (previewNode)
 			{
-				m_view = "R_MLO";
-				//m_modality = "3D";
+				// selecting the preview updates the information
+				d->inputEditVolumeNodeComboBox->setCurrentNode(previewNode);
+				return;
 			}
-			else
+		}
+		
+		if (d->InferenceServer)
+		{
+			d->InferenceServer->setVolume(inputVolumeNode);
+		}
+		if (inputVolumeNode)//image information
+		{
+			// classified on the first selection, until the view is known
+			m_view = logic->GetNodeAttributeValue(inputVolumeNode, "breastImage.View");
+			if (m_view.isEmpty())
 			{
-				m_view = "R_MLO";
-				//m_modality = "2D";
+				m_view = logic->ClassifyVolumeView(inputVolumeNode);
 			}
+			// the orientation and origin changes modify the node once
+			int wasModifying = inputVolumeNode->StartModify();
+			// detects and flips once, does nothing once an orientation is recorded
+			logic->ApplyOrientation(inputVolumeNode);
 			m_dicomInf["View"] = m_view;
 			d->imageInfTableWidget->setItem(0, 0, new QTableWidgetItem(m_view));
+			m_dicomInf["ContentHash"] = logic->GetVolumeContentHash(inputVolumeNode);
 
 			vtkImageData* image = inputVolumeNode->GetImageData();
 			// get the dimensions of input volume
@@ -283,15 +384,18 @@ void qSlicerbreastImageModuleWidget::onInputNodeChanged()
 			attributeValue = QString::number(spaceing[0], 10, 4) + "-" + QString::number(spaceing[1], 10, 4) + "-" + QString::number(spaceing[2], 10, 4);
 			d->imageInfTableWidget->setItem(3, 0, new QTableWidgetItem(attributeValue));
 			// populate Scalar Types
-			QComboBox *scalarType = new QComboBox();
-			for (int i = VTK_VOID; i < VTK_OBJECT; ++i)
+			if (!d->ScalarTypeComboBox)
 			{
-				scalarType->addItem(vtkImageScalarTypeNameMacro(i), i);
+				d->ScalarTypeComboBox = new QComboBox();
+				for (int i = VTK_VOID; i < VTK_OBJECT; ++i)
+				{
+					d->ScalarTypeComboBox->addItem(vtkImageScalarTypeNameMacro(i), i);
+				}
+				d->imageInfTableWidget->setCellWidget(4, 0, d->ScalarTypeComboBox);
 			}
 			int type=image->GetScalarType();
-			scalarType->setCurrentIndex(type);
-			m_dicomInf["scalarType"] = scalarType->currentText();
-			d->imageInfTableWidget->setCellWidget(4, 0, scalarType);
+			d->ScalarTypeComboBox->setCurrentIndex(type);
+			m_dicomInf["scalarType"] = d->ScalarTypeComboBox->currentText();
 			double origin[3];
 			if (dimensions[2] > 1)
 			{
@@ -299,19 +403,187 @@ void qSlicerbreastImageModuleWidget::onInputNodeChanged()
 				origin[0] = origin[1] = 0;
 				origin[2] = int(dimensions[2] / 2);
 				origin[2] = -origin[2];
-				inputVolumeNode->SetOrigin(origin);
 			}
 			else
 			{
 				m_modality = "2D";
 				origin[0] = origin[1] = origin[2] = 0;
-				inputVolumeNode->SetOrigin(origin);
 			}
+			inputVolumeNode->SetOrigin(origin);
+			inputVolumeNode->EndModify(wasModifying);
 			m_dicomInf["Modality"] = m_modality;
 			d->imageInfTableWidget->setItem(1, 0, new QTableWidgetItem(m_modality));
-			this->updateVolume(inputVolumeNode);
+			// an unchanged selection is already shown
+			if (d->ShownVolume != inputVolumeNode.GetPointer())
+			{
+				this->updateVolume(inputVolumeNode);
+			}
+			if (d->JournalVolume != inputVolumeNode.GetPointer())
+			{
+				this->openAnnotationJournal(inputVolumeNode);
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageModuleWidget::onFullResolutionLoaded()
+{
+	Q_D(qSlicerbreastImageModuleWidget);
+	QString volumeID = this->sender() ? this->sender()->property("volumeID").toString() : QString();
+	QFutureWatcher<void>* watcher = d->FullResolutionWatchers.take(volumeID);
+	if (!watcher)
+	{
+		return;
+	}
+	watcher->deleteLater();
+	vtkMRMLVolumeNode* volumeNode = this->mrmlScene()
+		? vtkMRMLVolumeNode::SafeDownCast(this->mrmlScene()->GetNodeByID(volumeID.toLatin1().constData())) : NULL;
+	if (volumeNode && d->logic()->SwapInFullResolution(volumeNode)
+		&& d->inputEditVolumeNodeComboBox->currentNode() == volumeNode)
+	{
+		this->onInputNodeChanged();
+	}
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageModuleWidget::onReportWriteFinished()
+{
+	Q_D(qSlicerbreastImageModuleWidget);
+	QString fileName = this->sender() ? this->sender()->property("reportFile").toString() : QString();
+	QFutureWatcher<void>* watcher = d->ReportWriteWatchers.take(fileName);
+	if (!watcher)
+	{
+		return;
+	}
+	watcher->deleteLater();
+	int result = d->logic()->FinishAnnotationXMLWrite(fileName);
+	if (result == vtkSlicerbreastImageLogic::ReportWriteFailed)
+	{
+		QMessageBox::warning(this, "breastImage", QString("Could not write the report %1").arg(fileName));
+	}
+	// a dry run exports nothing, the journal keeps the annotations
+	bool written = result == vtkSlicerbreastImageLogic::ReportWritten
+		|| result == vtkSlicerbreastImageLogic::ReportUnchanged;
+	qSlicerbreastImageModuleWidgetPrivate::JournaledReport journaled = d->ReportWriteJournals.take(fileName);
+	if (written && journaled.Volume)
+	{
+		// the exported report holds the annotations journaled up to the save,
+		// in the journal of the volume saved even if another one is selected
+		vtkSlicerbreastImageAnnotationJournal volumeJournal;
+		bool selected = journaled.Volume == d->JournalVolume;
+		vtkSlicerbreastImageAnnotationJournal* journal = selected ? &d->Journal : &volumeJournal;
+		if (selected || d->logic()->OpenAnnotationJournal(journaled.Volume, journal))
+		{
+			d->logic()->ReleaseAnnotationJournal(journal, journaled.Position,
+				journaled.DicomInformation, journaled.PacasInformation, journaled.AnnotationInformation);
+		}
+		if (selected && !d->Journal.IsOpen())
+		{
+			d->logic()->OpenAnnotationJournal(d->JournalVolume, &d->Journal);
+		}
+	}
+	emit reportWritten(fileName, written);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageModuleWidget::openAnnotationJournal(vtkMRMLVolumeNode* volumeNode)
+{
+	Q_D(qSlicerbreastImageModuleWidget);
+	vtkSlicerbreastImageLogic *logic = d->logic();
+	d->JournalVolume = volumeNode;
+	if (!logic->OpenAnnotationJournal(volumeNode, &d->Journal)
+		|| d->Journal.GetAnnotationInformation().isEmpty())
+	{
+		return;
+	}
+	// annotations of an earlier session that were not exported
+	QMessageBox::StandardButton answer = QMessageBox::question(this, "breastImage",
+		"Restore the annotations of this image that were not exported?",
+		QMessageBox::Yes | QMessageBox::No, QMessageBox::Yes);
+	if (answer == QMessageBox::Yes)
+	{
+		this->restoreAnnotations(d->Journal.GetPacasInformation(), d->Journal.GetAnnotationInformation());
+	}
+	else
+	{
+		logic->RemoveAnnotationJournal(&d->Journal);
+		logic->OpenAnnotationJournal(volumeNode, &d->Journal);
+		// the positions of pending saves do not apply to the new journal
+		QMutableHashIterator<QString, qSlicerbreastImageModuleWidgetPrivate::JournaledReport> journaled(d->ReportWriteJournals);
+		while (journaled.hasNext())
+		{
+			if (journaled.next().value().Volume == volumeNode)
+			{
+				journaled.remove();
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageModuleWidget::journalAnnotations()
+{
+	Q_D(qSlicerbreastImageModuleWidget);
+	this->onPacasInfChanged();
+	this->onEditInfTableChanged();
+	if (d->InferenceServer)
+	{
+		d->InferenceServer->setAnnotations(m_AnnotationInf);
+	}
+	if (!d->Journal.IsOpen())
+	{
+		return;
+	}
+	d->Journal.Append(m_dicomInf, m_pacasInf, m_AnnotationInf);
+	// bound the replay time, the report of the compaction is written on the
+	// task pool and the records it holds are dropped by a later edit
+	if (d->Journal.GetNumberOfRecords() >= 512)
+	{
+		d->logic()->CompactAnnotationJournal(&d->Journal);
+	}
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageModuleWidget::restoreAnnotations(QMap<QString, QString> pacasInf, QMap<QString, QString> annotationInf)
+{
+	Q_D(qSlicerbreastImageModuleWidget);
+	QComboBox* pacasComboBoxes[4] = { d->subtleyComboBox, d->densityComboBox, d->biradsComboBox, d->resultComboBox };
+	const char* pacasKeys[4] = { "subtlety", "density", "assessment", "pathology" };
+	for (int i = 0; i < 4; i++)
+	{
+		int index = pacasComboBoxes[i]->findText(pacasInf.value(pacasKeys[i]));
+		if (index >= 0)
+		{
+			pacasComboBoxes[i]->setCurrentIndex(index);
+		}
+	}
+
+	d->editInfTableWidget->setRowCount(0);
+	m_number = 0;
+	int clusterNumber = qMax(1, annotationInf.value("clusterNumber").toInt());
+	for (int i = 1; i <= clusterNumber; i++)
+	{
+		this->addAnnotationRow();
+		qobject_cast<QSpinBox*>(d->editInfTableWidget->cellWidget(i - 1, 0))->setValue(annotationInf.value(QString("%1-number").arg(i)).toInt());
+		qobject_cast<QDoubleSpinBox*>(d->editInfTableWidget->cellWidget(i - 1, 1))->setValue(annotationInf.value(QString("%1-size").arg(i)).toDouble());
+		QComboBox* shape = qobject_cast<QComboBox*>(d->editInfTableWidget->cellWidget(i - 1, 2));
+		shape->setCurrentIndex(qMax(0, shape->findText(annotationInf.value(QString("%1-shape").arg(i)))));
+		QComboBox* distribution = qobject_cast<QComboBox*>(d->editInfTableWidget->cellWidget(i - 1, 3));
+		distribution->setCurrentIndex(qMax(0, distribution->findText(annotationInf.value(QString("%1-distribution").arg(i)))));
+		const char* rasKeys[6] = { "xCenterRas", "yCenterRas", "zCenterRas", "xRadiusRas", "yRadiusRas", "zRadiusRas" };
+		for (int j = 0; j < 6; j++)
+		{
+			QString value = annotationInf.value(QString("%1-%2").arg(i).arg(rasKeys[j]));
+			if (value != "NA")
+			{
+				d->editInfTableWidget->setItem(i - 1, 4 + j, new QTableWidgetItem(value));
+			}
 		}
 	}
+	m_AnnotationInf = annotationInf;
+	m_index = m_number;
+	m_readMode = false;
 }
 
 void qSlicerbreastImageModuleWidget::updateVolume(vtkMRMLVolumeNode* inputVolumeNode)
@@ -324,6 +596,9 @@ void qSlicerbreastImageModuleWidget::updateVolume(vtkMRMLVolumeNode* inputVolume
 		vtkMRMLSelectionNode *selectionNode = appLogic->GetSelectionNode();
 		selectionNode->SetReferenceActiveVolumeID(inputVolumeNode->GetID());
 		appLogic->PropagateVolumeSelection();
+		d->ShownVolume = inputVolumeNode;
+		// the histogram is computed on the first selection of the volume only
+		d->logic()->ApplyAutoWindowLevel(inputVolumeNode, d->windowLevelPreset());
 	}
 }
 
@@ -345,12 +620,17 @@ void qSlicerbreastImageModuleWidget::onInputVolumeAdded(vtkMRMLNode *mrmlNode)
 
 void qSlicerbreastImageModuleWidget::onInputROIChanged()
 {
-	Q_D(const qSlicerbreastImageModuleWidget);
+	Q_D(qSlicerbreastImageModuleWidget);
 	vtkSmartPointer<vtkMRMLAnnotationROINode> inputAnnotationRoiNode = vtkMRMLAnnotationROINode::SafeDownCast(d->inputEditROINodeComboBox->currentNode());
 	if (inputAnnotationRoiNode)
 	{
 		inputAnnotationRoiNode->SetDisplayVisibility(true);
 	}
+	// the enhancement preview follows the ROI
+	qvtkReconnect(d->EnhancedROI, inputAnnotationRoiNode, vtkCommand::ModifiedEvent,
+		&d->EnhancementUpdateTimer, SLOT(start()));
+	d->EnhancedROI = inputAnnotationRoiNode;
+	d->EnhancementUpdateTimer.start();
 }
 
 void qSlicerbreastImageModuleWidget::onInputRulerChanged()
@@ -395,38 +675,27 @@ void qSlicerbreastImageModuleWidget::onInputRulerAdded(vtkMRMLNode *mrmlNode)
 
 void qSlicerbreastImageModuleWidget::on_transformButton_clicked()
 {
+	BREASTIMAGE_TRACE_SCOPE("flip");
 	Q_D(const qSlicerbreastImageModuleWidget);
-	//vtkSlicerbreastImageLogic *logic = d->logic();
+	vtkSlicerbreastImageLogic *logic = d->logic();
 	vtkSmartPointer<vtkMRMLVolumeNode> inputVolumeNode = vtkMRMLVolumeNode::SafeDownCast(d->inputEditVolumeNodeComboBox->currentNode());
-	//logic->coordinatesTransform(inputVolumeNode);
 	if (!inputVolumeNode)
 	{
 		return;
 	}
 
-	vtkSmartPointer<vtkImageData> imageData = inputVolumeNode->GetImageData();
-	vtkNew<vtkImageData> imageDataWorkingCopy;
-	imageDataWorkingCopy->DeepCopy(imageData);
-	int* dims = imageData->GetDimensions();
-	for (int k = 0; k < dims[2]; k++)
+	// flip only when the detected orientation requires it, so pressing the
+	// button again does not undo the flip. Without a conclusive detection
+	// the flip is done on request and recorded as the standard orientation,
+	// so a second press does nothing either.
+	int wasModifying = inputVolumeNode->StartModify();
+	if (!logic->ApplyOrientation(inputVolumeNode)
+		&& QString(inputVolumeNode->GetAttribute("breastImage.Orientation")) != "Standard")
 	{
-		for (int j = 0; j < dims[1]; j++)
-		{
-			for (int i = 0; i < dims[0]; i++)
-			{
-				int a, b;
-				a = -i + dims[0] - 1;
-				b = -j + dims[1] - 1;
-				unsigned short* p = (unsigned short*)(imageDataWorkingCopy->GetScalarPointer(a, b, k));
-				unsigned short value = *p;
-				unsigned short* q = (unsigned short*)(imageData->GetScalarPointer(i, j, k));
-				*q = value;
-				d->transformProgressBar->setValue(k * 100 / (dims[2]-1));
-			}
-
-		}
-
+		logic->coordinatesTransform(inputVolumeNode);
+		inputVolumeNode->SetAttribute("breastImage.Orientation", "Standard");
 	}
+	d->transformProgressBar->setValue(100);
 	double spaceing[3];
 	spaceing[0] = 0.07 * 3328 / 1996;
 	spaceing[1] = 0.07 * 3328 / 1996;
@@ -440,8 +709,146 @@ void qSlicerbreastImageModuleWidget::on_transformButton_clicked()
 	m_dicomInf["imageSliceSpaceing"] = imageSpaceingSize;
 	inputVolumeNode->SetSpacing(spaceing);
 	inputVolumeNode->Modified();
+	inputVolumeNode->EndModify(wasModifying);
+	// the report names the flipped pixels
+	m_dicomInf["ContentHash"] = logic->GetVolumeContentHash(inputVolumeNode);
+	// processed volume, reopened from the cache without the DICOM loading
+	logic->CacheVolume(inputVolumeNode);
 	this->updateVolume(inputVolumeNode);
 }
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageModuleWidget::on_reorientButton_clicked()
+{
+	BREASTIMAGE_TRACE_SCOPE("reorient");
+	Q_D(qSlicerbreastImageModuleWidget);
+	vtkSlicerbreastImageLogic *logic = d->logic();
+	vtkMRMLVolumeNode* inputVolumeNode = vtkMRMLVolumeNode::SafeDownCast(d->inputEditVolumeNodeComboBox->currentNode());
+	// orientations of the entries of the combo box: rotations by 90 degrees
+	// clockwise and counterclockwise, by 180 degrees, horizontal, vertical
+	// and slice flips (see vtkSlicerbreastImageReorienter::GetOrientation)
+	static const int orientations[6] = { 9, 10, 3, 1, 2, 4 };
+	int entry = d->orientationComboBox->currentIndex();
+	if (!inputVolumeNode || entry < 0 || entry >= 6)
+	{
+		return;
+	}
+	int permutation[3];
+	bool flips[3];
+	vtkSlicerbreastImageReorienter::GetOrientation(orientations[entry], permutation, flips);
+	// the boxes of an imported report are left as read
+	vtkMRMLAnnotationROINode* roiNode = vtkMRMLAnnotationROINode::SafeDownCast(d->inputEditROINodeComboBox->currentNode());
+	if (!logic->ReorientVolume(inputVolumeNode, permutation, flips, m_readMode ? NULL : &m_AnnotationInf, roiNode))
+	{
+		return;
+	}
+	m_dicomInf["ContentHash"] = logic->GetVolumeContentHash(inputVolumeNode);
+	if (!m_readMode)
+	{
+		this->restoreAnnotations(m_pacasInf, m_AnnotationInf);
+		this->journalAnnotations();
+	}
+	logic->CacheVolume(inputVolumeNode);
+	this->updateVolume(inputVolumeNode);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageModuleWidget::on_asymmetryButton_clicked()
+{
+	Q_D(qSlicerbreastImageModuleWidget);
+	vtkSlicerbreastImageLogic *logic = d->logic();
+	vtkMRMLVolumeNode* inputVolumeNode = vtkMRMLVolumeNode::SafeDownCast(d->inputEditVolumeNodeComboBox->currentNode());
+	if (!inputVolumeNode)
+	{
+		return;
+	}
+	vtkMRMLVolumeNode* contralateralNode = logic->FindContralateralVolume(inputVolumeNode);
+	if (!contralateralNode)
+	{
+		QMessageBox::information(this, "breastImage", QString("No volume of the contralateral view of %1 is loaded").arg(inputVolumeNode->GetName()));
+		return;
+	}
+	vtkMRMLScalarVolumeNode* asymmetryNode = logic->ComputeAsymmetryMap(inputVolumeNode, contralateralNode);
+	if (!asymmetryNode)
+	{
+		QMessageBox::warning(this, "breastImage", QString("Could not compare %1 with %2").arg(inputVolumeNode->GetName()).arg(contralateralNode->GetName()));
+		return;
+	}
+
+	this->showOverlay(inputVolumeNode, asymmetryNode, 0.5);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageModuleWidget::onDensityChanged()
+{
+	Q_D(qSlicerbreastImageModuleWidget);
+	if (d->ShownVolume)
+	{
+		d->logic()->ApplyAutoWindowLevel(d->ShownVolume, d->windowLevelPreset());
+	}
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageModuleWidget::on_enhanceCheckBox_toggled(bool enhance)
+{
+	Q_D(qSlicerbreastImageModuleWidget);
+	if (enhance)
+	{
+		this->updateEnhancementPreview();
+		return;
+	}
+	d->EnhancementUpdateTimer.stop();
+	if (d->EnhancedVolume)
+	{
+		d->logic()->RemoveEnhancementPreview(d->EnhancedVolume);
+	}
+	d->EnhancedVolume = NULL;
+	d->EnhancementNode = NULL;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageModuleWidget::updateEnhancementPreview()
+{
+	BREASTIMAGE_TRACE_SCOPE("updateEnhancementPreview");
+	Q_D(qSlicerbreastImageModuleWidget);
+	d->EnhancementUpdateTimer.stop();
+	if (!d->enhanceCheckBox->isChecked())
+	{
+		return;
+	}
+	vtkSlicerbreastImageLogic *logic = d->logic();
+	vtkMRMLVolumeNode* inputVolumeNode = vtkMRMLVolumeNode::SafeDownCast(d->inputEditVolumeNodeComboBox->currentNode());
+	if (d->EnhancedVolume && d->EnhancedVolume != inputVolumeNode)
+	{
+		logic->RemoveEnhancementPreview(d->EnhancedVolume);
+	}
+	d->EnhancedVolume = inputVolumeNode;
+	vtkMRMLScalarVolumeNode* enhancementNode = logic->UpdateEnhancementPreview(inputVolumeNode, d->EnhancedROI);
+	// the slice views are set up once, later updates only move the preview
+	if (enhancementNode && enhancementNode != d->EnhancementNode)
+	{
+		this->showOverlay(inputVolumeNode, enhancementNode, 1.);
+	}
+	d->EnhancementNode = enhancementNode;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerbreastImageModuleWidget::showOverlay(vtkMRMLVolumeNode* volumeNode, vtkMRMLVolumeNode* overlayNode, double opacity)
+{
+	Q_D(qSlicerbreastImageModuleWidget);
+	vtkSlicerApplicationLogic *appLogic = this->module()->appLogic();
+	vtkMRMLSelectionNode *selectionNode = appLogic->GetSelectionNode();
+	selectionNode->SetReferenceActiveVolumeID(volumeNode->GetID());
+	selectionNode->SetReferenceSecondaryVolumeID(overlayNode->GetID());
+	appLogic->PropagateVolumeSelection(0);
+	std::vector<vtkMRMLNode*> compositeNodes;
+	this->mrmlScene()->GetNodesByClass("vtkMRMLSliceCompositeNode", compositeNodes);
+	for (size_t i = 0; i < compositeNodes.size(); i++)
+	{
+		vtkMRMLSliceCompositeNode::SafeDownCast(compositeNodes[i])->SetForegroundOpacity(opacity);
+	}
+	d->ShownVolume = volumeNode;
+}
 void qSlicerbreastImageModuleWidget::init()
 {
 	Q_D(const qSlicerbreastImageModuleWidget);
@@ -514,6 +921,12 @@ void qSlicerbreastImageModuleWidget::init()
 }
 
 void qSlicerbreastImageModuleWidget::on_addButton_clicked()
+{
+	this->addAnnotationRow();
+	this->journalAnnotations();
+}
+
+void qSlicerbreastImageModuleWidget::addAnnotationRow()
 {
 	Q_D(const qSlicerbreastImageModuleWidget);
 	int rowNumber = d->editInfTableWidget->rowCount();
@@ -610,6 +1023,7 @@ void qSlicerbreastImageModuleWidget::on_deleteButton_clicked()
 		m_AnnotationInf.remove(QString("%1-zRadiusIjk").arg(m_number));
 		m_number = m_number - 1;
 		m_index = m_number;
+		this->journalAnnotations();
 	}
 }
 
@@ -721,7 +1135,7 @@ void qSlicerbreastImageModuleWidget::on_importXMLButton_clicked()
 
 void qSlicerbreastImageModuleWidget::on_outputXMLButton_clicked()
 {
-	Q_D(const qSlicerbreastImageModuleWidget);
+	Q_D(qSlicerbreastImageModuleWidget);
 	vtkSmartPointer<vtkMRMLVolumeNode> inputVolumeNode = vtkMRMLVolumeNode::SafeDownCast(d->inputEditVolumeNodeComboBox->currentNode());
 	if (d->reportIdSpinBox->value() != 0)
 	{
@@ -753,7 +1167,32 @@ void qSlicerbreastImageModuleWidget::on_outputXMLButton_clicked()
 			inputVolumeNode->SetName(QString("B_%1_%2_%3_image").arg(str).arg(m_view).arg(m_modality).toStdString().c_str());
 			inputVolumeNode->Modified();
 		}
-		logic->writeAnnotationXML(dirPath, fileName, m_dicomInf, m_pacasInf, m_AnnotationInf);
+		// a save of the same report queued before is merged with this one,
+		// saves of other reports are written alongside
+		QFutureWatcher<void>* watcher = d->ReportWriteWatchers.value(dirPath);
+		if (!watcher)
+		{
+			watcher = new QFutureWatcher<void>(this);
+			watcher->setProperty("reportFile", dirPath);
+			QObject::connect(watcher, SIGNAL(finished()), this, SLOT(onReportWriteFinished()));
+			d->ReportWriteWatchers.insert(dirPath, watcher);
+		}
+		// hash of the pixels as they are saved, whatever changed them
+		m_dicomInf["ContentHash"] = logic->GetVolumeContentHash(inputVolumeNode);
+		watcher->setFuture(logic->writeAnnotationXMLAsync(dirPath, fileName, m_dicomInf, m_pacasInf, m_AnnotationInf));
+		// the journal is released up to this save once the report is written
+		d->ReportWriteJournals.remove(dirPath);
+		if (d->Journal.IsOpen() && d->JournalVolume == inputVolumeNode.GetPointer()
+			&& d->Journal.Append(m_dicomInf, m_pacasInf, m_AnnotationInf) >= 0)
+		{
+			qSlicerbreastImageModuleWidgetPrivate::JournaledReport journaled;
+			journaled.Volume = inputVolumeNode;
+			journaled.Position = d->Journal.GetPosition();
+			journaled.DicomInformation = m_dicomInf;
+			journaled.PacasInformation = m_pacasInf;
+			journaled.AnnotationInformation = m_AnnotationInf;
+			d->ReportWriteJournals.insert(dirPath, journaled);
+		}
 		vtkSlicerApplicationLogic *appLogic = this->module()->appLogic();
 		vtkMRMLSelectionNode *selectionNode = appLogic->GetSelectionNode();
 		selectionNode->SetReferenceActiveVolumeID(inputVolumeNode->GetID());
@@ -820,6 +1259,7 @@ void qSlicerbreastImageModuleWidget::on_refreshRoiButton_clicked()
 				m_AnnotationInf[QString("%1-yRadiusIjk").arg(rowIndex + 1)] = QString::number(logic->roiRadiusIJK[1], 10);
 				m_AnnotationInf[QString("%1-zRadiusIjk").arg(rowIndex + 1)] = QString::number(logic->roiRadiusIJK[2], 10);
 			}
+			this->journalAnnotations();
 		}
 		else
 		{
@@ -64,13 +64,30 @@ public slots:
   void on_refreshRoiButton_clicked();
   void on_refreshRulerButton_clicked();
   void on_transformButton_clicked();
+  void on_reorientButton_clicked();
+  void on_asymmetryButton_clicked();
+  void on_enhanceCheckBox_toggled(bool enhance);
+
+signals:
+  /// Emitted once a report saved with the output button is on disk, or
+  /// failed to be written.
+  void reportWritten(const QString& fileName, bool written);
 
 protected:
   QScopedPointer<qSlicerbreastImageModuleWidgetPrivate> d_ptr;
   virtual void setup();
   virtual void enter();
+  void lazySetup();
   virtual void setMRMLScene(vtkMRMLScene*);
   void updateVolume(vtkMRMLVolumeNode* inputVolumeNode);
+  void addAnnotationRow();
+  /// Append the annotation changes to the journal of the selected volume,
+  /// and pass them to the inference server.
+  void journalAnnotations();
+  void openAnnotationJournal(vtkMRMLVolumeNode* volumeNode);
+  void restoreAnnotations(QMap<QString, QString> pacasInf, QMap<QString, QString> annotationInf);
+  /// Show overlayNode over volumeNode in the slice views.
+  void showOverlay(vtkMRMLVolumeNode* volumeNode, vtkMRMLVolumeNode* overlayNode, double opacity);
 
 protected slots:
   void onInputNodeChanged();
@@ -82,6 +99,10 @@ protected slots:
   void onInputROIAdded(vtkMRMLNode*);
   void onInputRulerChanged();
   void onInputRulerAdded(vtkMRMLNode*);
+  void onFullResolutionLoaded();
+  void onReportWriteFinished();
+  void updateEnhancementPreview();
+  void onDensityChanged();
 
 private:
   Q_DECLARE_PRIVATE(qSlicerbreastImageModuleWidget);